@@ -0,0 +1,81 @@
+/* Common helpers for the benchmarks in this directory
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/* The benchmarks print a JSON array of results, in the same format as
+   rpcbench: each result is an object with at least the fields
+   "benchmark" and "seconds".  */
+
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include <stdio.h>
+#include <time.h>
+
+static int bench_nresults;
+
+static inline double
+bench_now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static inline void
+bench_begin (void)
+{
+  printf ("[");
+  fflush (stdout);
+}
+
+static inline void
+bench_end (void)
+{
+  printf ("\n]\n");
+}
+
+/* Start printing a result of BENCHMARK, with the string field KEY set to
+   VALUE to tell what was measured.  The caller prints the remaining
+   fields, each preceded by ", ", and then calls bench_result_end.  */
+static inline void
+bench_result_begin (const char *benchmark, const char *key,
+		    const char *value)
+{
+  printf ("%s\n  {\"benchmark\": \"%s\", \"%s\": \"%s\"",
+	  bench_nresults++ ? "," : "", benchmark, key, value);
+}
+
+static inline void
+bench_result_end (void)
+{
+  printf ("}");
+  fflush (stdout);
+}
+
+/* Print the fields of a result of NWORKERS processes doing OPS
+   operations in SECONDS; UNIT names the operations.  */
+static inline void
+bench_rate (int nworkers, double seconds, const char *unit, long long ops)
+{
+  printf (", \"jobs\": %d, \"seconds\": %.6f, \"%s\": %lld, "
+	  "\"ops_per_s\": %.1f",
+	  nworkers, seconds, unit, ops, ops / seconds);
+}
+
+#endif /* _BENCH_H */
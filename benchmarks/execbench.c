@@ -0,0 +1,161 @@
+/* Exec latency benchmark
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/* For every PROGRAM, fork a child that execs it and wait for it, one at
+   a time, and report the distribution of the time this takes.  Unlike
+   procbench, which measures throughput, this measures the latency of a
+   single exec, which is what the exec server's header cache improves;
+   run it against an exec server without the cache and against the
+   current one to compare.
+
+   The output is a JSON array like that of rpcbench.  */
+
+#include <argp.h>
+#include <error.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <version.h>
+#include <sys/wait.h>
+
+#include "bench.h"
+
+const char *argp_program_version = STANDARD_HURD_VERSION (execbench);
+
+static const struct argp_option options[] =
+{
+  {"iterations", 'n', "N", 0, "Execs per program (default 1000)."},
+  {"warmup", 'w', "N", 0,
+   "Execs per program before measuring (default 10)."},
+  {0}
+};
+
+static const char args_doc[] = "[PROGRAM...]";
+static const char doc[] =
+  "Measure the latency of fork, exec and wait."
+  "\vEach PROGRAM is run without arguments and must exit with status 0;"
+  " the default is /bin/true.";
+
+static int iterations = 1000;
+static int warmup = 10;
+
+static int
+compare_doubles (const void *a, const void *b)
+{
+  double x = *(const double *) a, y = *(const double *) b;
+  return x < y ? -1 : x > y;
+}
+
+/* Run PROGRAM once and return how long it took.  */
+static double
+run (const char *program)
+{
+  double start = bench_now ();
+  pid_t child;
+  int status;
+
+  child = fork ();
+  if (child == -1)
+    error (1, errno, "fork");
+  if (child == 0)
+    {
+      execl (program, program, (char *) 0);
+      _exit (127);
+    }
+  if (waitpid (child, &status, 0) != child)
+    error (1, errno, "waitpid");
+  if (! WIFEXITED (status) || WEXITSTATUS (status) != 0)
+    error (1, 0, "%s: child failed (status %#x)", program, status);
+
+  return bench_now () - start;
+}
+
+static void
+measure (const char *program)
+{
+  double *times, total = 0;
+  int i;
+
+  times = calloc (iterations, sizeof *times);
+  if (times == NULL)
+    error (1, errno, "calloc");
+
+  for (i = 0; i < warmup; i++)
+    run (program);
+  for (i = 0; i < iterations; i++)
+    total += times[i] = run (program);
+  qsort (times, iterations, sizeof *times, compare_doubles);
+
+  bench_result_begin ("exec", "target", program);
+  printf (", \"iterations\": %d, \"seconds\": %.6f, \"ns_per_op\": %.1f, "
+	  "\"min_ns\": %.1f, \"median_ns\": %.1f, \"p99_ns\": %.1f",
+	  iterations, total, total * 1e9 / iterations, times[0] * 1e9,
+	  times[iterations / 2] * 1e9,
+	  times[(iterations - 1) * 99 / 100] * 1e9);
+  bench_result_end ();
+  free (times);
+}
+
+int
+main (int argc, char **argv)
+{
+  char **programs = 0;
+  int nprograms = 0, i;
+
+  error_t parse_opt (int key, char *arg, struct argp_state *state)
+    {
+      switch (key)
+	{
+	case 'n':
+	  iterations = atoi (arg);
+	  if (iterations <= 0)
+	    argp_error (state, "invalid iteration count: %s", arg);
+	  break;
+
+	case 'w':
+	  warmup = atoi (arg);
+	  if (warmup < 0)
+	    argp_error (state, "invalid warmup count: %s", arg);
+	  break;
+
+	case ARGP_KEY_ARGS:
+	  programs = state->argv + state->next;
+	  nprograms = state->argc - state->next;
+	  break;
+
+	default:
+	  return ARGP_ERR_UNKNOWN;
+	}
+      return 0;
+    }
+  const struct argp argp = { options, parse_opt, args_doc, doc };
+
+  argp_parse (&argp, argc, argv, 0, 0, 0);
+
+  bench_begin ();
+  if (nprograms == 0)
+    measure ("/bin/true");
+  for (i = 0; i < nprograms; i++)
+    measure (programs[i]);
+  bench_end ();
+
+  return 0;
+}
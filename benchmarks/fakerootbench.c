@@ -0,0 +1,305 @@
+/* Tree walking benchmark, for fakeroot
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/* Walk the tree below DIR the way package builds do, which is meant to
+   be run both under fakeroot and without it:
+
+     fakeroot-hurd fakerootbench DIR
+
+   For 1, 2, 4, ... up to --jobs worker processes, every worker walks
+   the whole tree at the same time, and we measure the aggregate rate
+   of files visited.  This is done in several passes:
+
+   find    stat every file, like `find DIR -ls';
+   tar     also open and read every regular file, like `tar c DIR';
+   chown   give every file its own owner, like `chown -R', so that
+	   fakeroot has faked attributes for all of them;
+   find2   find again, now that fakeroot keeps a node for every file;
+   tar2    tar again.
+
+   With --files, a tree of that many files is made in DIR first and
+   removed afterwards.
+
+   The output is a JSON array like that of rpcbench.  */
+
+#include <argp.h>
+#include <error.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <version.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "bench.h"
+
+const char *argp_program_version = STANDARD_HURD_VERSION (fakerootbench);
+
+static const struct argp_option options[] =
+{
+  {"jobs", 'j', "N", 0, "Maximum number of concurrent workers (default 4)."},
+  {"files", 'n', "N", 0,
+   "Make a tree of N files in DIR to walk (default: walk DIR as it is)."},
+  {"size", 's', "BYTES", 0,
+   "Size of the files made by --files (default 4096)."},
+  {0}
+};
+
+static const char args_doc[] = "DIR";
+static const char doc[] =
+  "Measure walking a file tree, as find and tar do, under fakeroot.";
+
+enum pass { FIND, TAR, CHOWN, FIND2, TAR2 };
+static const char *const pass_names[] =
+  { "find", "tar", "chown", "find2", "tar2" };
+
+/* Files per directory in the tree made by --files.  */
+#define PER_DIR 64
+
+static int jobs = 4;
+static long nfiles;
+static long file_size = 4096;
+static const char *top;
+static char *tree;
+
+static enum pass current_pass;
+static long long visited;
+static char buf[65536];
+
+static int
+visit (const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+  int fd;
+
+  switch (current_pass)
+    {
+    case TAR:
+    case TAR2:
+      if (flag != FTW_F || ! S_ISREG (st->st_mode))
+	break;
+      fd = open (path, O_RDONLY);
+      if (fd < 0)
+	error (2, errno, "%s", path);
+      while (read (fd, buf, sizeof buf) > 0)
+	;
+      close (fd);
+      break;
+
+    case CHOWN:
+      if (lchown (path, st->st_uid, st->st_gid) < 0)
+	error (2, errno, "chown %s", path);
+      break;
+
+    default:
+      break;
+    }
+
+  visited++;
+  return 0;
+}
+
+/* Walk the tree for PASS, then write the number of files visited to
+   FD.  */
+static void
+worker (enum pass pass, int fd)
+{
+  current_pass = pass;
+  visited = 0;
+  if (nftw (tree, visit, 64, FTW_PHYS) < 0)
+    error (2, errno, "%s", tree);
+  if (write (fd, &visited, sizeof visited) != sizeof visited)
+    error (2, errno, "write");
+}
+
+/* Run one measurement of PASS with NWORKERS workers.  */
+static void
+measure (enum pass pass, int nworkers)
+{
+  int go[2], result[2];
+  long long files = 0;
+  double start, end;
+  int i, status;
+
+  if (pipe (go) < 0 || pipe (result) < 0)
+    error (1, errno, "pipe");
+
+  /* Every worker blocks reading GO until we close it, so they all
+     start at the same time.  */
+  for (i = 0; i < nworkers; i++)
+    {
+      pid_t pid = fork ();
+      if (pid == -1)
+	error (1, errno, "fork");
+      if (pid == 0)
+	{
+	  char c;
+	  close (go[1]);
+	  close (result[0]);
+	  if (read (go[0], &c, 1) < 0)
+	    _exit (2);
+	  worker (pass, result[1]);
+	  _exit (0);
+	}
+    }
+
+  close (go[0]);
+  close (result[1]);
+  start = bench_now ();
+  close (go[1]);
+
+  for (i = 0; i < nworkers; i++)
+    {
+      long long n;
+      if (read (result[0], &n, sizeof n) != sizeof n)
+	error (1, errno, "worker did not report");
+      files += n;
+    }
+  end = bench_now ();
+  while (wait (&status) > 0)
+    if (! WIFEXITED (status) || WEXITSTATUS (status) != 0)
+      error (1, 0, "worker failed");
+  close (result[0]);
+
+  bench_result_begin ("fakeroot", "pass", pass_names[pass]);
+  bench_rate (nworkers, end - start, "files", files);
+  bench_result_end ();
+}
+
+/* Make the tree for --files below TREE.  */
+static void
+make_tree (void)
+{
+  char path[strlen (tree) + 64];
+  long i;
+  int fd;
+
+  memset (buf, 'x', sizeof buf);
+  if (mkdir (tree, 0755) < 0)
+    error (1, errno, "%s", tree);
+  for (i = 0; i < nfiles; i++)
+    {
+      long left;
+
+      if (i % PER_DIR == 0)
+	{
+	  sprintf (path, "%s/d%ld", tree, i / PER_DIR);
+	  if (mkdir (path, 0755) < 0)
+	    error (1, errno, "%s", path);
+	}
+      sprintf (path, "%s/d%ld/f%ld", tree, i / PER_DIR, i);
+      fd = open (path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+      if (fd < 0)
+	error (1, errno, "%s", path);
+      for (left = file_size; left > 0; left -= sizeof buf)
+	if (write (fd, buf, left < sizeof buf ? left : sizeof buf) < 0)
+	  error (1, errno, "%s", path);
+      close (fd);
+    }
+}
+
+static int
+remove_one (const char *path, const struct stat *st, int flag,
+	    struct FTW *ftw)
+{
+  if (remove (path) < 0)
+    error (1, errno, "%s", path);
+  return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  enum pass pass;
+  int n;
+
+  error_t parse_opt (int key, char *arg, struct argp_state *state)
+    {
+      switch (key)
+	{
+	case 'j':
+	  jobs = atoi (arg);
+	  if (jobs <= 0)
+	    argp_error (state, "invalid number of jobs: %s", arg);
+	  break;
+
+	case 'n':
+	  nfiles = atol (arg);
+	  if (nfiles <= 0)
+	    argp_error (state, "invalid number of files: %s", arg);
+	  break;
+
+	case 's':
+	  file_size = atol (arg);
+	  if (file_size < 0)
+	    argp_error (state, "invalid size: %s", arg);
+	  break;
+
+	case ARGP_KEY_ARG:
+	  if (state->arg_num > 0)
+	    argp_usage (state);
+	  top = arg;
+	  break;
+
+	case ARGP_KEY_END:
+	  if (! top)
+	    argp_usage (state);
+	  break;
+
+	default:
+	  return ARGP_ERR_UNKNOWN;
+	}
+      return 0;
+    }
+  const struct argp argp = { options, parse_opt, args_doc, doc };
+
+  argp_parse (&argp, argc, argv, 0, 0, 0);
+
+  if (nfiles)
+    {
+      if (asprintf (&tree, "%s/fakerootbench.%d", top, getpid ()) < 0)
+	error (1, errno, "asprintf");
+      make_tree ();
+    }
+  else
+    tree = (char *) top;
+
+  bench_begin ();
+  for (pass = FIND; pass <= TAR2; pass++)
+    {
+      if (pass == CHOWN)
+	{
+	  /* Once is enough.  */
+	  measure (pass, 1);
+	  continue;
+	}
+      for (n = 1; n < jobs; n *= 2)
+	measure (pass, n);
+      measure (pass, jobs);
+    }
+  bench_end ();
+
+  if (nfiles && nftw (tree, remove_one, 64, FTW_PHYS | FTW_DEPTH) < 0)
+    error (1, errno, "%s", tree);
+
+  return 0;
+}
@@ -0,0 +1,182 @@
+/* Common helpers for the hosted data structure benchmarks
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/* The programs in this directory compile libihash, the libports
+   reference counting and deferred dereferencing code, libpipe's packet
+   queues, libhurd-slab, tmpfs's directory code and libftpconn's
+   transfer code against the thin Mach and libdiskfs shim in shim/, so
+   that they can be measured and stress tested on any POSIX host.  They
+   print JSON in the same format as ../rpcbench.  */
+
+#ifndef _HOSTED_BENCH_H
+#define _HOSTED_BENCH_H
+
+#include <errno.h>
+#include <error.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Thread counts used for contention curves.  */
+static const int bench_threads[] = { 1, 2, 4, 8, 16 };
+#define BENCH_NTHREADS (sizeof bench_threads / sizeof bench_threads[0])
+
+static int bench_nresults;
+
+static inline double
+bench_now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Return the resident set size of this process in bytes.  */
+static inline long
+bench_rss (void)
+{
+  long pages = 0, resident = 0;
+  FILE *f = fopen ("/proc/self/statm", "r");
+
+  if (f == NULL)
+    return 0;
+  if (fscanf (f, "%ld %ld", &pages, &resident) != 2)
+    resident = 0;
+  fclose (f);
+  return resident * sysconf (_SC_PAGESIZE);
+}
+
+static inline void
+bench_begin (void)
+{
+  printf ("[");
+}
+
+static inline void
+bench_end (void)
+{
+  printf ("\n]\n");
+}
+
+/* Print one measurement of OPS operations done by NTHREADS threads in
+   SECONDS.  BYTES, if nonzero, is a memory footprint to report.  */
+static inline void
+bench_report (const char *benchmark, const char *variant, int nthreads,
+	      long ops, double seconds, long bytes)
+{
+  printf ("%s\n  {\"benchmark\": \"%s\", \"target\": \"%s\", "
+	  "\"threads\": %d, \"iterations\": %ld, \"seconds\": %.6f, "
+	  "\"ns_per_op\": %.1f, \"mops_per_s\": %.3f",
+	  bench_nresults++ ? "," : "", benchmark, variant, nthreads, ops,
+	  seconds, ops ? seconds * 1e9 / ops : 0.0,
+	  seconds > 0 ? ops / seconds / 1e6 : 0.0);
+  if (bytes)
+    printf (", \"bytes\": %ld", bytes);
+  printf ("}");
+  fflush (stdout);
+}
+
+struct bench_thread
+{
+  pthread_t thread;
+  int index;
+  int nthreads;
+  long ops;			/* Set by the worker.  */
+  void *arg;
+  double start;			/* Set by bench_thread_ready.  */
+};
+
+static pthread_barrier_t bench_barrier;
+
+/* Run FN in NTHREADS threads, starting them at the same time.  Return
+   the time from the first worker starting to the last one finishing,
+   and the sum of the workers' OPS in *OPS.  */
+static inline double
+bench_run_threads (int nthreads, void *(*fn) (struct bench_thread *),
+		   void *arg, long *ops)
+{
+  struct bench_thread t[nthreads];
+  double start;
+  int i, err;
+
+  pthread_barrier_init (&bench_barrier, NULL, nthreads + 1);
+  for (i = 0; i < nthreads; i++)
+    {
+      t[i].index = i;
+      t[i].nthreads = nthreads;
+      t[i].ops = 0;
+      t[i].arg = arg;
+      err = pthread_create (&t[i].thread, NULL,
+			    (void *(*) (void *)) fn, &t[i]);
+      if (err)
+	error (1, err, "pthread_create");
+    }
+
+  pthread_barrier_wait (&bench_barrier);
+  *ops = 0;
+  for (i = 0; i < nthreads; i++)
+    {
+      pthread_join (t[i].thread, NULL);
+      *ops += t[i].ops;
+    }
+  start = t[0].start;
+  for (i = 1; i < nthreads; i++)
+    if (t[i].start < start)
+      start = t[i].start;
+  start = bench_now () - start;
+  pthread_barrier_destroy (&bench_barrier);
+  return start;
+}
+
+/* Workers call this once they are set up.  */
+static inline void
+bench_thread_ready (struct bench_thread *t)
+{
+  pthread_barrier_wait (&bench_barrier);
+  t->start = bench_now ();
+}
+
+/* A cheap per-thread pseudo random number generator.  */
+static inline unsigned long
+bench_random (unsigned long *state)
+{
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+/* Parse the common command line: an optional iteration count.  */
+static inline long
+bench_iterations (int argc, char **argv, long dflt)
+{
+  long n = dflt;
+  if (argc > 1)
+    {
+      n = atol (argv[1]);
+      if (n <= 0)
+	error (1, 0, "usage: %s [ITERATIONS]", argv[0]);
+    }
+  return n;
+}
+
+#endif /* _HOSTED_BENCH_H */
@@ -0,0 +1,367 @@
+/* Benchmark and test for restarted retrieves in libftpconn
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/* Fetch the second half of an ITERATIONS bytes long file from a
+   stand-in FTP server on the loopback interface, the way ftpfs's
+   content cache does: ftp_conn_start_retrieve_at, and if the server
+   rejects REST with 500 or 502, a plain retrieve with the prefix
+   skipped.  The stand-in answers REST with 350, 500 or 502 in turn.
+   The fetched data must be right in each case, and the control
+   connection must stay usable after REST is rejected.  */
+
+#include <ftpconn.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <stdarg.h>
+#include "bench.h"
+
+/* The file the stand-in serves, under any name.  */
+static char *file;
+static size_t file_size;
+
+/* The port the stand-in listens on, and how it answers REST.  */
+static int server_port;
+static int rest_reply;
+
+/* The number of RETR commands the stand-in has served from an offset
+   other than 0.  */
+static int restarted_retrs;
+
+/* Send the reply FMT to the client on CTL.  */
+static void
+reply (int ctl, const char *fmt, ...)
+{
+  char buf[256];
+  va_list ap;
+  int len;
+
+  va_start (ap, fmt);
+  len = vsnprintf (buf, sizeof buf - 2, fmt, ap);
+  va_end (ap);
+  strcpy (buf + len, "\r\n");
+  if (write (ctl, buf, len + 2) != len + 2)
+    error (1, errno, "stand-in: write");
+}
+
+/* Open a passive data listener, returning its socket and announcing it
+   on CTL.  */
+static int
+passive (int ctl)
+{
+  struct sockaddr_in addr = { .sin_family = AF_INET };
+  socklen_t len = sizeof addr;
+  unsigned char *a, *p;
+  int s;
+
+  addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  s = socket (AF_INET, SOCK_STREAM, 0);
+  if (s < 0 || bind (s, (struct sockaddr *) &addr, sizeof addr) < 0
+      || getsockname (s, (struct sockaddr *) &addr, &len) < 0
+      || listen (s, 1) < 0)
+    error (1, errno, "stand-in: data socket");
+
+  a = (unsigned char *) &addr.sin_addr.s_addr;
+  p = (unsigned char *) &addr.sin_port;
+  reply (ctl, "227 Entering Passive Mode (%d,%d,%d,%d,%d,%d)",
+	 a[0], a[1], a[2], a[3], p[0], p[1]);
+  return s;
+}
+
+/* Serve the control connection CTL.  */
+static void
+serve (int ctl)
+{
+  FILE *in = fdopen (ctl, "r");
+  char line[256];
+  int pasv = -1;
+  long rest = 0;
+  int one = 1;
+
+  /* Replies are written in pieces; don't let them wait for the
+     client's delayed acknowledgements.  */
+  setsockopt (ctl, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+
+  reply (ctl, "220 Stand-in ready");
+  while (fgets (line, sizeof line, in))
+    {
+      line[strcspn (line, "\r\n")] = '\0';
+
+      if (! strcasecmp (line, "pasv"))
+	{
+	  if (pasv >= 0)
+	    close (pasv);
+	  pasv = passive (ctl);
+	}
+      else if (! strncasecmp (line, "rest ", 5))
+	{
+	  if (rest_reply == 350)
+	    {
+	      rest = atol (line + 5);
+	      reply (ctl, "350 Restarting at %ld", rest);
+	    }
+	  else
+	    reply (ctl, "%d REST not understood", rest_reply);
+	}
+      else if (! strncasecmp (line, "retr ", 5))
+	{
+	  int data;
+
+	  if (pasv < 0)
+	    {
+	      reply (ctl, "425 Use PASV first");
+	      continue;
+	    }
+	  reply (ctl, "150 Opening data connection");
+	  data = accept (pasv, NULL, NULL);
+	  if (data < 0)
+	    error (1, errno, "stand-in: accept");
+	  if (rest > (long) file_size)
+	    rest = file_size;
+	  if (write (data, file + rest, file_size - rest)
+	      != (ssize_t) (file_size - rest))
+	    error (1, errno, "stand-in: data write");
+	  close (data);
+	  close (pasv);
+	  pasv = -1;
+	  if (rest)
+	    restarted_retrs++;
+	  rest = 0;
+	  reply (ctl, "226 Transfer complete");
+	}
+      else if (! strcasecmp (line, "quit"))
+	{
+	  reply (ctl, "221 Bye");
+	  break;
+	}
+      else
+	reply (ctl, "500 Unknown command");
+    }
+
+  if (pasv >= 0)
+    close (pasv);
+  fclose (in);
+}
+
+static void *
+server (void *arg)
+{
+  int listener = (intptr_t) arg;
+
+  for (;;)
+    {
+      int ctl = accept (listener, NULL, NULL);
+      if (ctl < 0)
+	error (1, errno, "stand-in: accept");
+      serve (ctl);
+    }
+  return NULL;
+}
+
+static void
+start_server (void)
+{
+  struct sockaddr_in addr = { .sin_family = AF_INET };
+  socklen_t len = sizeof addr;
+  pthread_t thread;
+  int s, err;
+
+  addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  s = socket (AF_INET, SOCK_STREAM, 0);
+  if (s < 0 || bind (s, (struct sockaddr *) &addr, sizeof addr) < 0
+      || getsockname (s, (struct sockaddr *) &addr, &len) < 0
+      || listen (s, 4) < 0)
+    error (1, errno, "stand-in: control socket");
+  server_port = ntohs (addr.sin_port);
+
+  err = pthread_create (&thread, NULL, server, (void *) (intptr_t) s);
+  if (err)
+    error (1, err, "pthread_create");
+  pthread_detach (thread);
+}
+
+/* libftpconn's ftp_conn_open connects to the ftp port of the remote
+   host; connect to the stand-in instead.  */
+error_t
+ftp_conn_open (struct ftp_conn *conn)
+{
+  struct sockaddr_in addr = { .sin_family = AF_INET };
+  int reply;
+  error_t err;
+
+  if (conn->control >= 0)
+    close (conn->control);
+  conn->control = socket (AF_INET, SOCK_STREAM, 0);
+  if (conn->control < 0)
+    return errno;
+  addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  addr.sin_port = htons (server_port);
+  if (connect (conn->control, (struct sockaddr *) &addr, sizeof addr) < 0)
+    return errno;
+
+  err = ftp_conn_get_reply (conn, &reply, 0);
+  if (!err && reply != 220)
+    err = EPROTO;
+  return err;
+}
+
+void
+ftp_conn_close (struct ftp_conn *conn)
+{
+  if (conn->control >= 0)
+    close (conn->control);
+  conn->control = -1;
+  if (conn->hooks && conn->hooks->closed)
+    (* conn->hooks->closed) (conn);
+}
+
+/* The stand-in's PASV reply always has the same format.  */
+error_t
+ftp_conn_unix_pasv_addr (struct ftp_conn *conn, const char *txt,
+			 struct sockaddr **addr)
+{
+  struct sockaddr_in *sin;
+  unsigned char *a, *p;
+  unsigned v[6];
+  int i;
+
+  txt = strchr (txt, '(');
+  if (! txt || sscanf (txt, "(%u,%u,%u,%u,%u,%u)",
+		       &v[0], &v[1], &v[2], &v[3], &v[4], &v[5]) != 6)
+    return EPROTO;
+
+  sin = calloc (1, sizeof *sin);
+  if (! sin)
+    return ENOMEM;
+  sin->sin_family = AF_INET;
+  a = (unsigned char *) &sin->sin_addr.s_addr;
+  p = (unsigned char *) &sin->sin_port;
+  for (i = 0; i < 4; i++)
+    a[i] = v[i];
+  p[0] = v[4];
+  p[1] = v[5];
+  *addr = (struct sockaddr *) sin;
+  return 0;
+}
+
+/* Read everything from DATA, skipping the first SKIP bytes, and check
+   that it is the file from OFFSET on.  */
+static void
+check_data (int data, size_t skip, size_t offset)
+{
+  char buf[8192];
+  size_t pos = offset - skip;
+  ssize_t n;
+
+  while ((n = read (data, buf, sizeof buf)) > 0)
+    {
+      char *p = buf;
+
+      if (skip > 0)
+	{
+	  size_t k = (size_t) n < skip ? (size_t) n : skip;
+	  p += k;
+	  n -= k;
+	  skip -= k;
+	  pos += k;
+	}
+      if (pos + n > file_size || memcmp (p, file + pos, n))
+	error (1, 0, "wrong data at offset %zu", pos);
+      pos += n;
+    }
+  if (n < 0)
+    error (1, errno, "read");
+  if (pos != file_size)
+    error (1, 0, "got %zu bytes of %zu", pos, file_size);
+}
+
+/* Fetch the file from OFFSET on over CONN, as ftpfs does.  */
+static void
+fetch (struct ftp_conn *conn, size_t offset)
+{
+  size_t skip = 0;
+  error_t err;
+  int data;
+
+  err = ftp_conn_start_retrieve_at (conn, "file", offset, &data);
+  if (err == EOPNOTSUPP && rest_reply != 350)
+    {
+      skip = offset;
+      err = ftp_conn_start_retrieve (conn, "file", &data);
+    }
+  else if (rest_reply != 350)
+    error (1, 0, "REST rejected with %d, but got %s", rest_reply,
+	   err ? strerror (err) : "no error");
+  if (err)
+    error (1, err, "retrieve from %zu", offset);
+
+  check_data (data, skip, offset);
+  close (data);
+  err = ftp_conn_finish_transfer (conn);
+  if (err)
+    error (1, err, "finishing the transfer");
+}
+
+int
+main (int argc, char **argv)
+{
+  static const struct ftp_conn_params params = { .addr_type = AF_INET };
+  static const struct ftp_conn_hooks hooks;
+  static const int replies[] = { 350, 500, 502 };
+  struct ftp_conn *conn;
+  unsigned long rnd = 0x2545F4914F6CDD1DUL;
+  size_t i;
+  error_t err;
+
+  file_size = bench_iterations (argc, argv, 1 << 20);
+  file = malloc (file_size);
+  if (file == NULL)
+    error (1, errno, "malloc");
+  for (i = 0; i < file_size; i++)
+    file[i] = bench_random (&rnd);
+
+  start_server ();
+  err = ftp_conn_create (&params, &hooks, &conn);
+  if (err)
+    error (1, err, "ftp_conn_create");
+
+  bench_begin ();
+  for (i = 0; i < sizeof replies / sizeof replies[0]; i++)
+    {
+      char variant[16];
+      double start;
+      int k, before = restarted_retrs;
+
+      rest_reply = replies[i];
+      start = bench_now ();
+      for (k = 0; k < 4; k++)
+	fetch (conn, file_size / 2 + k);
+      snprintf (variant, sizeof variant, "rest %d", rest_reply);
+      bench_report ("ftp_retrieve_at", variant, 1,
+		    4 * (file_size - file_size / 2), bench_now () - start, 0);
+
+      if ((restarted_retrs - before != 0) != (rest_reply == 350))
+	error (1, 0, "REST %d: %d restarted transfers", rest_reply,
+	       restarted_retrs - before);
+    }
+  bench_end ();
+
+  ftp_conn_free (conn);
+  free (file);
+  return 0;
+}
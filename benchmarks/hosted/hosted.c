@@ -0,0 +1,46 @@
+/* Support routines for the hosted Mach shim
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <mach.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert-backtrace.h>
+
+unsigned long hosted_port_deallocs;
+
+/* libshouldbeinlibc's versions print a Hurd backtrace; a plain message
+   is enough here, the host debugger can do the rest.  */
+void
+__assert_fail_backtrace (const char *assertion, const char *file,
+			 unsigned int line, const char *function)
+{
+  fprintf (stderr, "%s:%u: %s: Assertion `%s' failed.\n",
+	   file, line, function, assertion);
+  abort ();
+}
+
+void
+__assert_perror_fail_backtrace (int errnum, const char *file,
+				unsigned int line, const char *function)
+{
+  fprintf (stderr, "%s:%u: %s: Unexpected error: %s.\n",
+	   file, line, function, strerror (errnum));
+  abort ();
+}
@@ -0,0 +1,241 @@
+/* Benchmark and stress test for libihash
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <hurd/ihash.h>
+#include "bench.h"
+
+/* Values stored in the table; KEY is checked on lookup.  */
+struct item
+{
+  hurd_ihash_key_t key;
+  char name[32];
+};
+
+static struct item *items;
+static long nitems;
+
+static long
+footprint (struct hurd_ihash *ht)
+{
+  return ht->size * sizeof (struct _hurd_ihash_item);
+}
+
+static void
+check (struct hurd_ihash *ht, hurd_ihash_key_t key, struct item *expect)
+{
+  struct item *found = hurd_ihash_find (ht, key);
+  if (found != expect)
+    error (1, 0, "lookup of %lu returned %p, expected %p",
+	   (unsigned long) key, found, expect);
+}
+
+/* Insert, look up and remove NITEMS keys produced by KEYOF.  */
+static void
+bench_single (const char *variant, hurd_ihash_key_t (*keyof) (long))
+{
+  struct hurd_ihash ht;
+  double start;
+  long i;
+
+  hurd_ihash_init (&ht, HURD_IHASH_NO_LOCP);
+  for (i = 0; i < nitems; i++)
+    items[i].key = keyof (i);
+
+  start = bench_now ();
+  for (i = 0; i < nitems; i++)
+    if (hurd_ihash_add (&ht, items[i].key, &items[i]))
+      error (1, errno, "hurd_ihash_add");
+  bench_report ("ihash_insert", variant, 1, nitems, bench_now () - start,
+		footprint (&ht));
+
+  start = bench_now ();
+  for (i = 0; i < nitems; i++)
+    check (&ht, items[i].key, &items[i]);
+  bench_report ("ihash_lookup_hit", variant, 1, nitems,
+		bench_now () - start, 0);
+
+  start = bench_now ();
+  for (i = 0; i < nitems; i++)
+    check (&ht, keyof (i + nitems), NULL);
+  bench_report ("ihash_lookup_miss", variant, 1, nitems,
+		bench_now () - start, 0);
+
+  start = bench_now ();
+  for (i = 0; i < nitems; i++)
+    if (! hurd_ihash_remove (&ht, items[i].key))
+      error (1, 0, "hurd_ihash_remove: key %lu missing",
+	     (unsigned long) items[i].key);
+  bench_report ("ihash_remove", variant, 1, nitems, bench_now () - start, 0);
+
+  if (ht.nr_items != 0)
+    error (1, 0, "%zu items left after removing all", ht.nr_items);
+  hurd_ihash_destroy (&ht);
+}
+
+static hurd_ihash_key_t
+sequential_key (long i)
+{
+  return i + 1;
+}
+
+/* Port names and pointers as used by libports are sparse.  */
+static hurd_ihash_key_t
+sparse_key (long i)
+{
+  unsigned long x = i + 1;
+  return x * 0x9E3779B97F4A7C15UL;
+}
+
+/* String keys through the generalized key interface.  */
+static hurd_ihash_key_t
+string_hash (const void *key)
+{
+  return hurd_ihash_hash32 (key, strlen (key), 0);
+}
+
+static int
+string_compare (const void *a, const void *b)
+{
+  return strcmp (a, b) == 0;
+}
+
+static void
+bench_strings (void)
+{
+  struct hurd_ihash ht;
+  double start;
+  long i;
+
+  hurd_ihash_init (&ht, HURD_IHASH_NO_LOCP);
+  hurd_ihash_set_gki (&ht, string_hash, string_compare);
+  for (i = 0; i < nitems; i++)
+    snprintf (items[i].name, sizeof items[i].name, "file-%ld.o", i);
+
+  start = bench_now ();
+  for (i = 0; i < nitems; i++)
+    if (hurd_ihash_add (&ht, (hurd_ihash_key_t) items[i].name, &items[i]))
+      error (1, errno, "hurd_ihash_add");
+  bench_report ("ihash_insert", "string", 1, nitems, bench_now () - start,
+		footprint (&ht));
+
+  start = bench_now ();
+  for (i = 0; i < nitems; i++)
+    {
+      char name[32];
+      snprintf (name, sizeof name, "file-%ld.o", i);
+      check (&ht, (hurd_ihash_key_t) name, &items[i]);
+    }
+  bench_report ("ihash_lookup_hit", "string", 1, nitems,
+		bench_now () - start, 0);
+
+  hurd_ihash_destroy (&ht);
+}
+
+/* Shared table for the contention test, protected the way Hurd servers
+   protect theirs: by a single lock around every operation.  */
+static struct hurd_ihash shared;
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+static long keyspace;
+
+static void *
+contention_worker (struct bench_thread *t)
+{
+  unsigned long rnd = 0x2545F4914F6CDD1DUL + t->index;
+  long per_thread = nitems / t->nthreads, i;
+
+  bench_thread_ready (t);
+  for (i = 0; i < per_thread; i++)
+    {
+      unsigned long r = bench_random (&rnd);
+      long k = r % keyspace;
+      hurd_ihash_key_t key = sparse_key (k);
+
+      pthread_mutex_lock (&shared_lock);
+      switch ((r >> 32) % 20)
+	{
+	case 0:
+	  hurd_ihash_add (&shared, key, &items[k]);
+	  break;
+	case 1:
+	  hurd_ihash_remove (&shared, key);
+	  break;
+	default:
+	  {
+	    struct item *found = hurd_ihash_find (&shared, key);
+	    if (found && found != &items[k])
+	      error (1, 0, "key %lu maps to the wrong item", (unsigned long) key);
+	  }
+	}
+      pthread_mutex_unlock (&shared_lock);
+    }
+  t->ops = per_thread;
+  return NULL;
+}
+
+static void
+bench_contention (void)
+{
+  size_t n;
+
+  keyspace = nitems < 65536 ? nitems : 65536;
+  for (n = 0; n < BENCH_NTHREADS; n++)
+    {
+      long i, ops, valid = 0;
+      double secs;
+
+      hurd_ihash_init (&shared, HURD_IHASH_NO_LOCP);
+      for (i = 0; i < keyspace; i += 2)
+	{
+	  items[i].key = sparse_key (i);
+	  hurd_ihash_add (&shared, sparse_key (i), &items[i]);
+	}
+
+      secs = bench_run_threads (bench_threads[n], contention_worker,
+				NULL, &ops);
+      bench_report ("ihash_mixed_locked", "sparse", bench_threads[n], ops,
+		    secs, footprint (&shared));
+
+      /* Stress check: the item count must match the table.  */
+      HURD_IHASH_ITERATE (&shared, value)
+	valid++;
+      if (valid != (long) shared.nr_items)
+	error (1, 0, "table holds %ld items but nr_items is %zu",
+	       valid, shared.nr_items);
+      hurd_ihash_destroy (&shared);
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  nitems = bench_iterations (argc, argv, 1000000);
+  items = calloc (2 * nitems, sizeof *items);
+  if (items == NULL)
+    error (1, errno, "calloc");
+
+  bench_begin ();
+  bench_single ("sequential", sequential_key);
+  bench_single ("sparse", sparse_key);
+  bench_strings ();
+  bench_contention ();
+  bench_end ();
+
+  free (items);
+  return 0;
+}
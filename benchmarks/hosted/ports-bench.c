@@ -0,0 +1,184 @@
+/* Benchmark and stress test for libports reference counting and
+   deferred dereferencing
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "ports.h"
+#include "bench.h"
+
+static long iterations;
+static struct port_class class;
+static struct port_bucket bucket;
+
+/* Objects handed to _ports_complete_deallocate.  */
+static long created, freed, max_pending;
+
+/* The real one removes the port from the hash tables and destroys the
+   receive right; here we only count and free.  */
+void
+_ports_complete_deallocate (struct port_info *pi)
+{
+  __atomic_add_fetch (&freed, 1, __ATOMIC_RELAXED);
+  free (pi);
+}
+
+static struct port_info *
+new_port (void)
+{
+  struct port_info *pi = calloc (1, sizeof *pi);
+  if (pi == NULL)
+    error (1, errno, "calloc");
+  pi->class = &class;
+  pi->bucket = &bucket;
+  pi->port_right = 1;
+  refcounts_init (&pi->refcounts, 1, 0);
+  __atomic_add_fetch (&created, 1, __ATOMIC_RELAXED);
+  return pi;
+}
+
+static struct port_info **objects;
+static long nobjects;
+
+/* Take and drop references on shared objects, as every RPC does for
+   the port it arrives on.  */
+static void *
+ref_worker (struct bench_thread *t)
+{
+  unsigned long rnd = 0x9E3779B97F4A7C15UL + t->index;
+  long n = iterations / t->nthreads, i;
+
+  bench_thread_ready (t);
+  for (i = 0; i < n; i++)
+    {
+      struct port_info *pi = objects[bench_random (&rnd) % nobjects];
+      ports_port_ref (pi);
+      ports_port_deref (pi);
+    }
+  t->ops = n;
+  return NULL;
+}
+
+/* Simulate a server thread: every iteration is one RPC followed by a
+   quiescent period; every eighth RPC destroys an object, which is then
+   released through the deferred dereferencing machinery.  */
+static void *
+deferred_worker (struct bench_thread *t)
+{
+  unsigned long rnd = 0xD1B54A32D192ED03UL + t->index;
+  long n = iterations / t->nthreads, i;
+  struct ports_thread thread;
+
+  _ports_thread_online (&bucket.threadpool, &thread);
+  bench_thread_ready (t);
+  for (i = 0; i < n; i++)
+    {
+      struct port_info *pi = objects[bench_random (&rnd) % nobjects];
+
+      ports_port_ref (pi);
+      if ((i & 7) == 0)
+	{
+	  long pending;
+	  _ports_port_deref_deferred (new_port ());
+	  pending = __atomic_load_n (&created, __ATOMIC_RELAXED)
+		    - __atomic_load_n (&freed, __ATOMIC_RELAXED) - nobjects;
+	  if (pending > __atomic_load_n (&max_pending, __ATOMIC_RELAXED))
+	    __atomic_store_n (&max_pending, pending, __ATOMIC_RELAXED);
+	}
+      ports_port_deref (pi);
+      _ports_thread_quiescent (&bucket.threadpool, &thread);
+    }
+  _ports_thread_offline (&bucket.threadpool, &thread);
+  t->ops = n;
+  return NULL;
+}
+
+static void
+make_objects (long n)
+{
+  long i;
+
+  nobjects = n;
+  objects = malloc (n * sizeof *objects);
+  if (objects == NULL)
+    error (1, errno, "malloc");
+  for (i = 0; i < n; i++)
+    objects[i] = new_port ();
+}
+
+static void
+free_objects (void)
+{
+  long i;
+  for (i = 0; i < nobjects; i++)
+    ports_port_deref (objects[i]);
+  free (objects);
+}
+
+int
+main (int argc, char **argv)
+{
+  static const long spreads[] = { 1, 1024 };
+  size_t s, n;
+
+  iterations = bench_iterations (argc, argv, 10000000);
+  _ports_threadpool_init (&bucket.threadpool);
+
+  bench_begin ();
+  for (s = 0; s < sizeof spreads / sizeof spreads[0]; s++)
+    {
+      char variant[32];
+
+      snprintf (variant, sizeof variant, "%ld-objects", spreads[s]);
+      make_objects (spreads[s]);
+
+      for (n = 0; n < BENCH_NTHREADS; n++)
+	{
+	  long ops;
+	  double secs = bench_run_threads (bench_threads[n], ref_worker,
+					   NULL, &ops);
+	  bench_report ("ports_ref_deref", variant, bench_threads[n],
+			ops, secs, 0);
+	}
+
+      for (n = 0; n < BENCH_NTHREADS; n++)
+	{
+	  long ops;
+	  double secs;
+
+	  max_pending = 0;
+	  secs = bench_run_threads (bench_threads[n], deferred_worker,
+				    NULL, &ops);
+	  bench_report ("ports_deref_deferred", variant, bench_threads[n],
+			ops, secs, max_pending * sizeof (struct port_info));
+
+	  /* Stress check: with every thread offline, nothing may hold a
+	     stale reference, so objects destroyed now must be released
+	     at once, and so must everything deferred during the run.  */
+	  _ports_port_deref_deferred (new_port ());
+	  _ports_port_deref_deferred (new_port ());
+	  if (created - freed != nobjects)
+	    error (1, 0, "%ld deferred objects were never released",
+		   created - freed - nobjects);
+	}
+
+      free_objects ();
+    }
+  bench_end ();
+
+  return 0;
+}
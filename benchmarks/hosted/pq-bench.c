@@ -0,0 +1,221 @@
+/* Benchmark for libpipe packet queues
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <sys/mman.h>
+#include "pq.h"
+#include "bench.h"
+
+static long iterations;
+
+/* Message sizes; the largest ones take the vm_allocate path in
+   packet_realloc and the zero-copy path in packet_read.  */
+static const size_t sizes[] = { 1, 64, 1024, 4096, 65536, 1048576 };
+
+static char *wbuf;
+static size_t wbuf_len;
+
+/* pq_dequeue releases the packet's source address through this.  */
+void
+pipe_dealloc_addr (void *addr)
+{
+}
+
+static const char *
+size_name (size_t size, const char *suffix)
+{
+  static char name[32];
+  snprintf (name, sizeof name, "%zu%s", size, suffix);
+  return name;
+}
+
+/* Read AMOUNT bytes from PACKET into BUF, checking the contents.  */
+static void
+read_packet (struct packet *packet, char *buf, size_t amount)
+{
+  char *data = buf;
+  size_t len = amount;
+  error_t err;
+
+  err = packet_read (packet, &data, &len, amount);
+  if (err)
+    error (1, err, "packet_read");
+  if (len != amount)
+    error (1, 0, "packet_read returned %zu bytes, expected %zu", len, amount);
+  if (data[0] != wbuf[0] || data[len - 1] != wbuf[len - 1])
+    error (1, 0, "packet_read returned corrupted data");
+  if (data != buf)
+    munmap (data, len);
+}
+
+/* Write and read back one SIZE byte packet at a time, as a datagram
+   pipe does.  */
+static void
+bench_dgram (size_t size, char *rbuf)
+{
+  struct pq *pq;
+  double start;
+  long n = iterations, i;
+  error_t err;
+
+  if (size >= 65536)
+    n = n / 1000 + 1;
+
+  err = pq_create (&pq);
+  if (err)
+    error (1, err, "pq_create");
+
+  start = bench_now ();
+  for (i = 0; i < n; i++)
+    {
+      struct packet *packet = pq_queue (pq, PACKET_TYPE_DATA, NULL);
+      if (packet == NULL)
+	error (1, ENOMEM, "pq_queue");
+      err = packet_write (packet, wbuf, size, NULL);
+      if (err)
+	error (1, err, "packet_write");
+      read_packet (pq_head (pq, PACKET_TYPE_DATA, NULL), rbuf, size);
+      pq_dequeue (pq);
+    }
+  bench_report ("pq_dgram", size_name (size, ""), 1, n,
+		bench_now () - start, 0);
+  pq_free (pq);
+}
+
+/* Append SIZE byte writes to a single data packet and drain it in
+   reads of the same size, keeping DEPTH writes queued, as a stream
+   pipe with a slow reader does.  */
+static void
+bench_stream (size_t size, int depth, char *rbuf)
+{
+  struct pq *pq;
+  struct packet *packet;
+  double start;
+  long n = iterations, i;
+  error_t err;
+
+  if (size >= 65536)
+    n = n / 1000 + 1;
+
+  err = pq_create (&pq);
+  if (err)
+    error (1, err, "pq_create");
+  packet = pq_queue (pq, PACKET_TYPE_DATA, NULL);
+  if (packet == NULL)
+    error (1, ENOMEM, "pq_queue");
+
+  start = bench_now ();
+  for (i = 0; i < n + depth; i++)
+    {
+      if (i < n)
+	{
+	  err = packet_write (packet, wbuf, size, NULL);
+	  if (err)
+	    error (1, err, "packet_write");
+	}
+      if (i >= depth)
+	read_packet (packet, rbuf, size);
+    }
+  if (packet_readable (packet) != 0)
+    error (1, 0, "%zu bytes left in the stream", packet_readable (packet));
+  bench_report ("pq_stream", size_name (size, depth > 1 ? "-queued" : ""),
+		1, n, bench_now () - start, 0);
+  pq_free (pq);
+}
+
+/* Many writers and readers sharing one queue, as on a pipe with
+   several clients; the queue is protected by a mutex like the pipe's
+   own lock.  */
+static struct pq *shared;
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *
+shared_worker (struct bench_thread *t)
+{
+  long n = iterations / t->nthreads, i;
+  char rbuf[64];
+
+  bench_thread_ready (t);
+  for (i = 0; i < n; i++)
+    {
+      struct packet *packet;
+      error_t err;
+
+      pthread_mutex_lock (&shared_lock);
+      packet = pq_queue (shared, PACKET_TYPE_DATA, NULL);
+      if (packet == NULL)
+	error (1, ENOMEM, "pq_queue");
+      err = packet_write (packet, wbuf, sizeof rbuf, NULL);
+      if (err)
+	error (1, err, "packet_write");
+      pthread_mutex_unlock (&shared_lock);
+
+      pthread_mutex_lock (&shared_lock);
+      read_packet (pq_head (shared, PACKET_TYPE_DATA, NULL), rbuf,
+		   sizeof rbuf);
+      pq_dequeue (shared);
+      pthread_mutex_unlock (&shared_lock);
+    }
+  t->ops = n;
+  return NULL;
+}
+
+int
+main (int argc, char **argv)
+{
+  char *rbuf;
+  size_t s, n;
+  error_t err;
+
+  iterations = bench_iterations (argc, argv, 1000000);
+
+  wbuf_len = sizes[sizeof sizes / sizeof sizes[0] - 1];
+  wbuf = malloc (wbuf_len);
+  rbuf = malloc (wbuf_len);
+  if (wbuf == NULL || rbuf == NULL)
+    error (1, errno, "malloc");
+  for (s = 0; s < wbuf_len; s++)
+    wbuf[s] = s * 7 + 1;
+
+  bench_begin ();
+  for (s = 0; s < sizeof sizes / sizeof sizes[0]; s++)
+    {
+      bench_dgram (sizes[s], rbuf);
+      bench_stream (sizes[s], 1, rbuf);
+      bench_stream (sizes[s], 16, rbuf);
+    }
+
+  err = pq_create (&shared);
+  if (err)
+    error (1, err, "pq_create");
+  for (n = 0; n < BENCH_NTHREADS; n++)
+    {
+      long ops;
+      double secs = bench_run_threads (bench_threads[n], shared_worker,
+				       NULL, &ops);
+      bench_report ("pq_shared", "64", bench_threads[n], ops, secs, 0);
+    }
+  if (pq_head (shared, PACKET_TYPE_ANY, NULL) != NULL)
+    error (1, 0, "packets left in the shared queue");
+  pq_free (shared);
+  bench_end ();
+
+  free (rbuf);
+  free (wbuf);
+  return 0;
+}
@@ -0,0 +1 @@
+/* No configure results are needed by the hosted benchmarks.  */
@@ -0,0 +1,31 @@
+/* The Hurd's struct dirent, which has a d_namlen field, for compiling
+   Hurd file system code on a POSIX host.  */
+#ifndef _HOSTED_DIRENT_H
+#define _HOSTED_DIRENT_H
+
+#include <sys/types.h>
+
+struct dirent
+{
+  ino_t d_ino;
+  unsigned short int d_reclen;
+  unsigned char d_type;
+  unsigned char d_namlen;
+  char d_name[1];
+};
+#define d_fileno d_ino
+
+enum
+{
+  DT_UNKNOWN = 0,
+  DT_FIFO = 1,
+  DT_CHR = 2,
+  DT_DIR = 4,
+  DT_BLK = 6,
+  DT_REG = 8,
+  DT_LNK = 10,
+  DT_SOCK = 12,
+  DT_WHT = 14
+};
+
+#endif /* _HOSTED_DIRENT_H */
@@ -0,0 +1,14 @@
+/* Minimal Hurd definitions for running Hurd libraries on a POSIX host.  */
+#ifndef _HOSTED_HURD_H
+#define _HOSTED_HURD_H
+
+#include <mach.h>
+#include <pthread.h>
+
+static inline thread_t
+hurd_thread_self (void)
+{
+  return (thread_t) (uintptr_t) pthread_self ();
+}
+
+#endif /* _HOSTED_HURD_H */
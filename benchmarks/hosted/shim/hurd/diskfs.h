@@ -0,0 +1,87 @@
+/* Minimal libdiskfs definitions for compiling the directory code of
+   Hurd file systems on a POSIX host
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/* Only the fields of struct node and the calls the directory code
+   uses are here; the test program provides the calls.  */
+
+#ifndef _HOSTED_HURD_DISKFS_H
+#define _HOSTED_HURD_DISKFS_H
+
+#include <mach.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include <assert-backtrace.h>
+
+typedef struct stat io_statbuf_t;
+
+struct node
+{
+  struct disknode *dn;
+  io_statbuf_t dn_stat;
+  pthread_mutex_t lock;
+  struct modreq *dirmod_reqs;
+};
+
+struct protid;
+struct dirstat;
+
+enum lookup_type
+{
+  LOOKUP,
+  CREATE,
+  REMOVE,
+  RENAME,
+};
+#define SPEC_DOTDOT 0x10000000
+
+enum dir_changed_type
+{
+  DIR_CHANGED_NULL,
+  DIR_CHANGED_NEW,
+  DIR_CHANGED_UNLINK,
+  DIR_CHANGED_RENUMBER,
+};
+
+extern struct node *diskfs_root_node;
+extern const size_t diskfs_dirstat_size;
+
+error_t diskfs_cached_lookup (ino_t inum, struct node **np);
+void diskfs_nref (struct node *np);
+void diskfs_nrele (struct node *np);
+void diskfs_notice_dirchange (struct node *dp, enum dir_changed_type type,
+			      const char *name);
+
+/* Implemented by the file system.  */
+int diskfs_dirempty (struct node *dp, struct protid *cred);
+error_t diskfs_get_directs (struct node *dp, int entry, int n,
+			    char **data, size_t *datacnt,
+			    vm_size_t bufsiz, int *amt);
+void diskfs_null_dirstat (struct dirstat *ds);
+error_t diskfs_lookup_hard (struct node *dp, const char *name,
+			    enum lookup_type type, struct node **np,
+			    struct dirstat *ds, struct protid *cred);
+error_t diskfs_direnter_hard (struct node *dp, const char *name,
+			      struct node *np, struct dirstat *ds,
+			      struct protid *cred);
+error_t diskfs_dirremove_hard (struct node *dp, struct dirstat *ds);
+
+#endif /* _HOSTED_HURD_DISKFS_H */
@@ -0,0 +1,2 @@
+/* Use the libihash under test.  */
+#include "../../../../libihash/ihash.h"
@@ -0,0 +1,16 @@
+/* Included before the libftpconn sources built here.  libftpconn uses
+   the Hurd's EGRATUITOUS error code, and the sa_len field of BSD style
+   socket addresses, which other systems lack.  Only xfer.c reads
+   sa_len, as the length argument of connect; the socket code that sets
+   it, in open.c and unix.c, is replaced by the test program.  */
+
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#ifndef EGRATUITOUS
+#define EGRATUITOUS EPROTO
+#endif
+
+#define sa_len sa_family == AF_INET ? sizeof (struct sockaddr_in) \
+			   : sizeof (struct sockaddr)
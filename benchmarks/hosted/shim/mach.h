@@ -0,0 +1,2 @@
+/* Minimal Mach definitions for running Hurd libraries on a POSIX host.  */
+#include <mach/mach.h>
@@ -0,0 +1,139 @@
+/* Minimal Mach definitions for running Hurd libraries on a POSIX host
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/* This is not an emulation of Mach.  It only provides the types and the
+   handful of calls the data structures under test use, mapping memory
+   calls onto mmap and making port calls no-ops that are counted.  */
+
+#ifndef _HOSTED_MACH_MACH_H
+#define _HOSTED_MACH_MACH_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+typedef unsigned int natural_t;
+typedef int integer_t;
+typedef int boolean_t;
+typedef int kern_return_t;
+typedef uintptr_t vm_offset_t;
+typedef uintptr_t vm_address_t;
+typedef uintptr_t vm_size_t;
+typedef natural_t mach_port_t;
+typedef mach_port_t task_t;
+typedef mach_port_t thread_t;
+typedef natural_t mach_port_seqno_t;
+typedef natural_t mach_msg_seqno_t;
+typedef natural_t mach_port_mscount_t;
+typedef natural_t mach_msg_type_number_t;
+typedef natural_t mach_msg_type_name_t;
+typedef natural_t mach_msg_bits_t;
+typedef natural_t mach_msg_size_t;
+typedef integer_t mach_msg_id_t;
+
+typedef struct
+{
+  mach_msg_bits_t msgh_bits;
+  mach_msg_size_t msgh_size;
+  mach_port_t msgh_remote_port;
+  mach_port_t msgh_local_port;
+  mach_port_seqno_t msgh_seqno;
+  mach_msg_id_t msgh_id;
+} mach_msg_header_t;
+
+#define TRUE	1
+#define FALSE	0
+
+#define KERN_SUCCESS		0
+#define KERN_NO_SPACE		3
+#define MACH_PORT_NULL		((mach_port_t) 0)
+#define MACH_PORT_DEAD		((mach_port_t) ~0)
+#define MACH_PORT_VALID(name) \
+  ((name) != MACH_PORT_NULL && (name) != MACH_PORT_DEAD)
+
+#define MACH_NOTIFY_FIRST		0100
+#define MACH_NOTIFY_PORT_DELETED	(MACH_NOTIFY_FIRST + 001)
+#define MACH_NOTIFY_MSG_ACCEPTED	(MACH_NOTIFY_FIRST + 002)
+#define MACH_NOTIFY_PORT_DESTROYED	(MACH_NOTIFY_FIRST + 005)
+#define MACH_NOTIFY_NO_SENDERS		(MACH_NOTIFY_FIRST + 006)
+#define MACH_NOTIFY_SEND_ONCE		(MACH_NOTIFY_FIRST + 007)
+#define MACH_NOTIFY_DEAD_NAME		(MACH_NOTIFY_FIRST + 010)
+
+#define vm_page_size	((vm_size_t) sysconf (_SC_PAGESIZE))
+#define trunc_page(x)	((vm_address_t) (x) & ~(vm_page_size - 1))
+#define round_page(x)	trunc_page ((vm_address_t) (x) + vm_page_size - 1)
+
+/* Number of mach_port_deallocate calls made; benchmarks report it so
+   that leaked or doubled port references show up.  */
+extern unsigned long hosted_port_deallocs;
+
+static inline mach_port_t
+mach_task_self (void)
+{
+  return 1;
+}
+
+static inline kern_return_t
+vm_allocate (task_t task, vm_address_t *addr, vm_size_t size, boolean_t anywhere)
+{
+  void *p = mmap (anywhere ? 0 : (void *) *addr, size, PROT_READ | PROT_WRITE,
+		  MAP_PRIVATE | MAP_ANONYMOUS
+		  | (anywhere ? 0 : MAP_FIXED_NOREPLACE), -1, 0);
+  if (p == MAP_FAILED)
+    return KERN_NO_SPACE;
+  if (! anywhere && p != (void *) *addr)
+    {
+      /* Kernels without MAP_FIXED_NOREPLACE treat it as a hint.  */
+      munmap (p, size);
+      return KERN_NO_SPACE;
+    }
+  *addr = (vm_address_t) p;
+  return 0;
+}
+
+static inline kern_return_t
+vm_deallocate (task_t task, vm_address_t addr, vm_size_t size)
+{
+  return munmap ((void *) addr, size) ? errno : 0;
+}
+
+static inline kern_return_t
+mach_port_deallocate (task_t task, mach_port_t name)
+{
+  __atomic_add_fetch (&hosted_port_deallocs, 1, __ATOMIC_RELAXED);
+  return 0;
+}
+
+/* On the Hurd, mmap with neither MAP_PRIVATE nor MAP_SHARED is
+   accepted, and libpipe relies on that for anonymous memory.  */
+static inline void *
+hosted_mmap (void *addr, size_t len, int prot, int flags, int fd, off_t off)
+{
+  if (flags & MAP_ANONYMOUS)
+    {
+      if (! (flags & (MAP_PRIVATE | MAP_SHARED)))
+	flags |= MAP_PRIVATE;
+      fd = -1;
+    }
+  return mmap (addr, len, prot, flags, fd, off);
+}
+#define mmap hosted_mmap
+
+#endif /* _HOSTED_MACH_MACH_H */
@@ -0,0 +1,2 @@
+/* Notification ids are defined in <mach/mach.h> in the hosted shim.  */
+#include <mach/mach.h>
@@ -0,0 +1,182 @@
+/* Benchmark for libhurd-slab
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "slab.h"
+#include "bench.h"
+
+/* Objects live at most this many at a time per thread.  */
+#define WORKING_SET 4096
+
+static long iterations;
+static size_t object_size;
+static hurd_slab_space_t space;
+
+static void *
+slab_get (void)
+{
+  void *p;
+  error_t err = hurd_slab_alloc (space, &p);
+  if (err)
+    error (1, err, "hurd_slab_alloc");
+  return p;
+}
+
+static void
+slab_put (void *p)
+{
+  hurd_slab_dealloc (space, p);
+}
+
+static void *
+malloc_get (void)
+{
+  void *p = malloc (object_size);
+  if (p == NULL)
+    error (1, errno, "malloc");
+  return p;
+}
+
+static void
+malloc_put (void *p)
+{
+  free (p);
+}
+
+struct allocator
+{
+  const char *name;
+  void *(*get) (void);
+  void (*put) (void *);
+};
+
+static const struct allocator allocators[] =
+  {
+    { "slab", slab_get, slab_put },
+    { "malloc", malloc_get, malloc_put },
+  };
+
+/* Keep a working set of WORKING_SET objects, replacing a random one
+   each iteration, so that allocation and deallocation interleave the
+   way they do for port and node structures.  Every object is written
+   to; a corrupted object is reported.  */
+static void *
+worker (struct bench_thread *t)
+{
+  const struct allocator *a = t->arg;
+  unsigned long rnd = 0x9E3779B97F4A7C15UL * (t->index + 1);
+  long n = iterations / t->nthreads, i;
+  void **set = calloc (WORKING_SET, sizeof *set);
+
+  if (set == NULL)
+    error (1, errno, "calloc");
+
+  bench_thread_ready (t);
+  for (i = 0; i < n; i++)
+    {
+      unsigned long slot = bench_random (&rnd) % WORKING_SET;
+      unsigned long *obj = set[slot];
+
+      if (obj)
+	{
+	  if (*obj != (unsigned long) obj)
+	    error (1, 0, "%s object %p was overwritten", a->name, obj);
+	  a->put (obj);
+	}
+      obj = a->get ();
+      *obj = (unsigned long) obj;
+      set[slot] = obj;
+    }
+  for (i = 0; i < WORKING_SET; i++)
+    if (set[i])
+      a->put (set[i]);
+  free (set);
+  t->ops = n;
+  return NULL;
+}
+
+/* Allocate COUNT objects with A and report the resident memory they
+   take.  */
+static void
+footprint (const struct allocator *a, long count)
+{
+  void **objs = malloc (count * sizeof *objs);
+  long before, i;
+  double start;
+  char variant[32];
+
+  if (objs == NULL)
+    error (1, errno, "malloc");
+  before = bench_rss ();
+  start = bench_now ();
+  for (i = 0; i < count; i++)
+    {
+      objs[i] = a->get ();
+      memset (objs[i], 0, object_size);
+    }
+  snprintf (variant, sizeof variant, "%s-%zu", a->name, object_size);
+  bench_report ("slab_footprint", variant, 1, count, bench_now () - start,
+		bench_rss () - before);
+  for (i = 0; i < count; i++)
+    a->put (objs[i]);
+  free (objs);
+}
+
+int
+main (int argc, char **argv)
+{
+  static const size_t sizes[] = { 32, 128, 512 };
+  size_t s, a, n;
+  error_t err;
+
+  iterations = bench_iterations (argc, argv, 4000000);
+
+  bench_begin ();
+  for (s = 0; s < sizeof sizes / sizeof sizes[0]; s++)
+    {
+      object_size = sizes[s];
+      err = hurd_slab_create (object_size, 0, NULL, NULL, NULL, NULL, NULL,
+			      &space);
+      if (err)
+	error (1, err, "hurd_slab_create");
+
+      for (a = 0; a < sizeof allocators / sizeof allocators[0]; a++)
+	{
+	  char variant[32];
+
+	  snprintf (variant, sizeof variant, "%s-%zu", allocators[a].name,
+		    object_size);
+	  for (n = 0; n < BENCH_NTHREADS; n++)
+	    {
+	      long ops;
+	      double secs = bench_run_threads (bench_threads[n], worker,
+					       (void *) &allocators[a], &ops);
+	      bench_report ("slab_alloc", variant, bench_threads[n], ops,
+			    secs, 0);
+	    }
+	  footprint (&allocators[a], 100000);
+	}
+
+      err = hurd_slab_free (space);
+      if (err)
+	error (1, err, "hurd_slab_free (objects leaked)");
+    }
+  bench_end ();
+
+  return 0;
+}
@@ -0,0 +1,233 @@
+/* Benchmark and test for the tmpfs directory index
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/* Fill one directory with ITERATIONS entries, unlink some from the
+   middle and read it back in chunks, the way glibc's readdir and nfsd
+   do: each call continues at the entry number the previous one ended
+   at.  Every entry must be returned exactly once.  */
+
+#include "tmpfs.h"
+#include "bench.h"
+
+off_t tmpfs_page_limit = (off_t) 1 << 40, tmpfs_space_used;
+unsigned int num_files;
+struct node *diskfs_root_node;
+
+static struct node dir, child;
+static struct disknode dir_dn, child_dn, parent_dn;
+static long nentries;
+static char *removed;
+static struct dirstat *ds;
+
+error_t
+diskfs_cached_lookup (ino_t inum, struct node **np)
+{
+  *np = &child;
+  return 0;
+}
+
+void
+diskfs_nref (struct node *np)
+{
+}
+
+void
+diskfs_nrele (struct node *np)
+{
+}
+
+void
+diskfs_notice_dirchange (struct node *dp, enum dir_changed_type type,
+			 const char *name)
+{
+}
+
+static void
+name_of (long i, char *name, size_t len)
+{
+  snprintf (name, len, "file-%ld.o", i);
+}
+
+static void
+add (long i)
+{
+  char name[32];
+  error_t err;
+
+  name_of (i, name, sizeof name);
+  err = diskfs_direnter_hard (&dir, name, &child, NULL, NULL);
+  if (err)
+    error (1, err, "adding %s", name);
+}
+
+static void
+remove_entry (long i)
+{
+  char name[32];
+  error_t err;
+
+  name_of (i, name, sizeof name);
+  diskfs_null_dirstat (ds);
+  err = diskfs_lookup_hard (&dir, name, LOOKUP, NULL, ds, NULL);
+  if (err)
+    error (1, err, "looking up %s", name);
+  err = diskfs_dirremove_hard (&dir, ds);
+  if (err)
+    error (1, err, "removing %s", name);
+  removed[i] = 1;
+}
+
+/* Read the whole directory, at most N entries or BUFSIZ bytes per
+   call, and check that every entry is returned exactly once.  Return
+   the number of calls made.  */
+static long
+read_dir (int n, vm_size_t bufsiz)
+{
+  /* What diskfs_get_directs maps when BUFSIZ is zero.  */
+  const size_t dots_size = 2 * ((offsetof (struct dirent, d_name[3]) + 7)
+				& ~7);
+  char *seen = calloc (nentries, 1);
+  int entry = 0, dots = 0, amt;
+  long calls = 0, found = 0, expect = 0, i;
+
+  if (seen == NULL)
+    error (1, errno, "calloc");
+
+  do
+    {
+      char buf[4096], *data = buf, *p;
+      size_t datacnt = sizeof buf;
+      vm_size_t mapped = bufsiz ?: dir.dn_stat.st_size + dots_size;
+      error_t err;
+      int k;
+
+      err = diskfs_get_directs (&dir, entry, n, &data, &datacnt, bufsiz,
+				&amt);
+      if (err)
+	error (1, err, "diskfs_get_directs");
+      calls++;
+      if (n >= 0 && amt > n)
+	error (1, 0, "asked for %d entries, got %d", n, amt);
+
+      for (p = data, k = 0; p < data + datacnt; k++)
+	{
+	  struct dirent *d = (struct dirent *) p;
+
+	  if (! strcmp (d->d_name, ".") || ! strcmp (d->d_name, ".."))
+	    dots++;
+	  else
+	    {
+	      i = strtol (d->d_name + strlen ("file-"), NULL, 10);
+	      if (i < 0 || i >= nentries || removed[i])
+		error (1, 0, "entry %d: unexpected name %s",
+		       entry + k, d->d_name);
+	      if (seen[i]++)
+		error (1, 0, "entry %d: %s returned twice",
+		       entry + k, d->d_name);
+	      found++;
+	    }
+	  p += d->d_reclen;
+	}
+      if (k != amt)
+	error (1, 0, "%d dirents returned but *amt is %d", k, amt);
+      if (data != buf)
+	munmap (data, mapped);
+      entry += amt;
+    }
+  while (amt > 0);
+
+  for (i = 0; i < nentries; i++)
+    expect += ! removed[i];
+  if (dots != 2)
+    error (1, 0, ". and .. returned %d times", dots);
+  if (found != expect)
+    error (1, 0, "%ld of %ld entries returned", found, expect);
+  free (seen);
+  return calls;
+}
+
+int
+main (int argc, char **argv)
+{
+  double start;
+  long i, calls, n;
+
+  nentries = bench_iterations (argc, argv, 100000);
+  removed = calloc (nentries, 1);
+  ds = malloc (diskfs_dirstat_size);
+  if (removed == NULL || ds == NULL)
+    error (1, errno, "malloc");
+
+  dir.dn = &dir_dn;
+  dir.dn_stat.st_ino = 3;
+  dir_dn.type = DT_DIR;
+  dir_dn.u.dir.dotdot = &parent_dn;
+  child.dn = &child_dn;
+  child_dn.type = DT_REG;
+
+  bench_begin ();
+
+  start = bench_now ();
+  for (i = 0; i < nentries; i++)
+    add (i);
+  bench_report ("tmpfs_dir_enter", "sequential", 1, nentries,
+		bench_now () - start, 0);
+
+  start = bench_now ();
+  calls = read_dir (-1, 4096);
+  bench_report ("tmpfs_dir_readdir", "4k", 1, calls, bench_now () - start,
+		0);
+
+  /* Unlink every other entry of the middle third, then read the
+     directory in small chunks.  */
+  start = bench_now ();
+  for (n = 0, i = nentries / 3; i < 2 * nentries / 3; n++, i += 2)
+    remove_entry (i);
+  bench_report ("tmpfs_dir_remove", "middle", 1, n, bench_now () - start, 0);
+
+  start = bench_now ();
+  calls = read_dir (7, 0);
+  bench_report ("tmpfs_dir_readdir", "7 entries", 1, calls,
+		bench_now () - start, 0);
+  start = bench_now ();
+  calls = read_dir (-1, 1000);
+  bench_report ("tmpfs_dir_readdir", "1000 bytes", 1, calls,
+		bench_now () - start, 0);
+
+  /* New entries fill the holes and must show up too.  */
+  for (i = nentries / 3; i < 2 * nentries / 3; i += 4)
+    {
+      add (i);
+      removed[i] = 0;
+    }
+  read_dir (13, 0);
+
+  for (i = 0; i < nentries; i++)
+    if (! removed[i])
+      remove_entry (i);
+  if (dir_dn.u.dir.index != NULL)
+    error (1, 0, "index of the empty directory not freed");
+  read_dir (-1, 0);
+
+  bench_end ();
+
+  free (removed);
+  free (ds);
+  return 0;
+}
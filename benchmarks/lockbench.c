@@ -0,0 +1,278 @@
+/* Record lock benchmark
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/* For 1, 2, 4, ... up to --jobs worker processes, every worker locks
+   and unlocks byte ranges of FILE with fcntl as fast as it can for a
+   while, and we measure the aggregate rate.  This is done in three
+   ways:
+
+   disjoint  every worker write-locks a record of its own, the way a
+	     database updates different rows;
+   shared    every worker read-locks the same record;
+   mixed     every worker locks one of --records records at random,
+	     for writing one time in four and for reading otherwise.
+
+   Before measuring, every worker also takes --held read locks on
+   records past those used above and keeps them, so that the file has
+   many locks to look through.
+
+   The output is a JSON array like that of rpcbench.  */
+
+#include <argp.h>
+#include <error.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <version.h>
+#include <sys/wait.h>
+
+#include "bench.h"
+
+const char *argp_program_version = STANDARD_HURD_VERSION (lockbench);
+
+static const struct argp_option options[] =
+{
+  {"jobs", 'j', "N", 0, "Maximum number of concurrent workers (default 8)."},
+  {"seconds", 't', "SECS", 0,
+   "Duration of each measurement (default 2)."},
+  {"records", 'r', "N", 0,
+   "Number of records locked by mixed (default 64)."},
+  {"held", 'H', "N", 0,
+   "Number of locks every worker holds throughout (default 0)."},
+  {0}
+};
+
+static const char args_doc[] = "FILE";
+static const char doc[] =
+  "Measure byte range locking by concurrent processes."
+  "\vFILE is created if need be.  It is not written to.";
+
+enum mode { DISJOINT, SHARED, MIXED };
+static const char *const mode_names[] = { "disjoint", "shared", "mixed" };
+
+/* The size of a record.  */
+#define RECORD 128
+
+static int jobs = 8;
+static double seconds = 2;
+static int nrecords = 64;
+static int held = 0;
+static const char *file;
+
+static void
+stalled (int sig)
+{
+  error (1, 0, "%s: locks did not finish, deadlock?", file);
+}
+
+/* Set a lock of TYPE on record REC of FD, waiting for it.  */
+static void
+lock_record (int fd, short type, long rec)
+{
+  struct flock lock;
+
+  lock.l_type = type;
+  lock.l_whence = SEEK_SET;
+  lock.l_start = rec * RECORD;
+  lock.l_len = RECORD;
+  while (fcntl (fd, F_SETLKW, &lock) < 0)
+    if (errno != EINTR)
+      error (2, errno, "%s: lock record %ld", file, rec);
+}
+
+/* Lock and unlock for MODE until END as worker ID, then write the
+   number of locks taken to FD.  */
+static void
+worker (enum mode mode, int id, double end, int fd)
+{
+  long long total = 0;
+  unsigned seed = id;
+  int file_fd, i;
+
+  file_fd = open (file, O_RDWR);
+  if (file_fd < 0)
+    error (2, errno, "%s", file);
+
+  /* Records past those used below, and past each other's.  */
+  for (i = 0; i < held; i++)
+    lock_record (file_fd, F_RDLCK,
+		 jobs + nrecords + 2 * ((long) i * jobs + id));
+
+  while (bench_now () < end)
+    {
+      long rec;
+      short type;
+
+      switch (mode)
+	{
+	case DISJOINT:
+	  rec = id;
+	  type = F_WRLCK;
+	  break;
+	case SHARED:
+	  rec = 0;
+	  type = F_RDLCK;
+	  break;
+	default:
+	  rec = rand_r (&seed) % nrecords;
+	  type = rand_r (&seed) % 4 ? F_RDLCK : F_WRLCK;
+	  break;
+	}
+
+      lock_record (file_fd, type, rec);
+      lock_record (file_fd, F_UNLCK, rec);
+      total++;
+    }
+
+  close (file_fd);
+  if (write (fd, &total, sizeof total) != sizeof total)
+    error (2, errno, "write");
+}
+
+/* Run one measurement of MODE with NWORKERS workers.  */
+static void
+measure (enum mode mode, int nworkers)
+{
+  int go[2], result[2];
+  long long locks = 0;
+  double start, end;
+  int i, status;
+
+  if (pipe (go) < 0 || pipe (result) < 0)
+    error (1, errno, "pipe");
+
+  /* Every worker blocks reading GO until we close it, so they all
+     start at the same time.  */
+  for (i = 0; i < nworkers; i++)
+    {
+      pid_t pid = fork ();
+      if (pid == -1)
+	error (1, errno, "fork");
+      if (pid == 0)
+	{
+	  char c;
+	  close (go[1]);
+	  close (result[0]);
+	  if (read (go[0], &c, 1) < 0)
+	    _exit (2);
+	  worker (mode, i, bench_now () + seconds, result[1]);
+	  _exit (0);
+	}
+    }
+
+  close (go[0]);
+  close (result[1]);
+  start = bench_now ();
+  alarm (seconds + 60);
+  close (go[1]);
+
+  for (i = 0; i < nworkers; i++)
+    {
+      long long n;
+      if (read (result[0], &n, sizeof n) != sizeof n)
+	error (1, errno, "worker did not report");
+      locks += n;
+    }
+  end = bench_now ();
+  while (wait (&status) > 0)
+    if (! WIFEXITED (status) || WEXITSTATUS (status) != 0)
+      error (1, 0, "worker failed");
+  alarm (0);
+  close (result[0]);
+
+  bench_result_begin ("lock", "mode", mode_names[mode]);
+  printf (", \"held\": %d", held);
+  bench_rate (nworkers, end - start, "locks", locks);
+  bench_result_end ();
+}
+
+int
+main (int argc, char **argv)
+{
+  enum mode mode;
+  int fd, n;
+
+  error_t parse_opt (int key, char *arg, struct argp_state *state)
+    {
+      switch (key)
+	{
+	case 'j':
+	  jobs = atoi (arg);
+	  if (jobs <= 0)
+	    argp_error (state, "invalid number of jobs: %s", arg);
+	  break;
+
+	case 't':
+	  seconds = atof (arg);
+	  if (seconds <= 0)
+	    argp_error (state, "invalid duration: %s", arg);
+	  break;
+
+	case 'r':
+	  nrecords = atoi (arg);
+	  if (nrecords <= 0)
+	    argp_error (state, "invalid number of records: %s", arg);
+	  break;
+
+	case 'H':
+	  held = atoi (arg);
+	  if (held < 0)
+	    argp_error (state, "invalid number of locks: %s", arg);
+	  break;
+
+	case ARGP_KEY_ARG:
+	  if (state->arg_num > 0)
+	    argp_usage (state);
+	  file = arg;
+	  break;
+
+	case ARGP_KEY_END:
+	  if (! file)
+	    argp_usage (state);
+	  break;
+
+	default:
+	  return ARGP_ERR_UNKNOWN;
+	}
+      return 0;
+    }
+  const struct argp argp = { options, parse_opt, args_doc, doc };
+
+  argp_parse (&argp, argc, argv, 0, 0, 0);
+
+  fd = open (file, O_RDWR | O_CREAT, 0644);
+  if (fd < 0)
+    error (1, errno, "%s", file);
+  close (fd);
+  signal (SIGALRM, stalled);
+
+  bench_begin ();
+  for (mode = DISJOINT; mode <= MIXED; mode++)
+    {
+      for (n = 1; n < jobs; n *= 2)
+	measure (mode, n);
+      measure (mode, jobs);
+    }
+  bench_end ();
+
+  return 0;
+}
@@ -0,0 +1,308 @@
+/* Parallel fork/exec/wait throughput benchmark for the proc server
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/* For 1, 2, 4, ... up to --jobs worker processes, every worker creates
+   and reaps children as fast as it can, and we measure the aggregate
+   rate.  Creating, exec'ing and reaping a child takes a handful of proc
+   RPCs from the parent, the child and the exec server, so this mostly
+   measures how well proc serves them concurrently.  With --scan, another process scans the process table
+   like ps does at the same time, and its rate is reported too.
+
+   The output is a JSON array like that of rpcbench.  */
+
+#include <hurd.h>
+#include <hurd/process.h>
+#include <argp.h>
+#include <error.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <version.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "bench.h"
+
+const char *argp_program_version = STANDARD_HURD_VERSION (procbench);
+
+static const struct argp_option options[] =
+{
+  {"jobs", 'j', "N", 0, "Maximum number of concurrent workers (default 8)."},
+  {"iterations", 'n', "N", 0,
+   "Children created per measurement, over all workers (default 2000)."},
+  {"program", 'p', "FILE", 0,
+   "Program run by the exec benchmark (default /bin/true)."},
+  {"scan", 's', 0, 0,
+   "Scan the process table concurrently and report its rate."},
+  {0}
+};
+
+static const char args_doc[] = "[BENCHMARK...]";
+static const char doc[] =
+  "Measure parallel process creation throughput."
+  "\vBENCHMARK is fork (fork, exit and wait) or exec (fork, exec and wait);"
+  " by default both are run.";
+
+static int jobs = 8;
+static int iterations = 2000;
+static const char *program = "/bin/true";
+static int scan;
+
+static volatile sig_atomic_t stop_scanning;
+
+/* Create and reap N children.  If EXEC, they run PROGRAM.  */
+static void
+worker (long n, int exec)
+{
+  long i;
+
+  for (i = 0; i < n; i++)
+    {
+      pid_t child = fork ();
+      int status;
+
+      if (child == -1)
+	error (2, errno, "fork");
+      if (child == 0)
+	{
+	  if (exec)
+	    {
+	      execl (program, program, (char *) 0);
+	      _exit (127);
+	    }
+	  _exit (0);
+	}
+      if (waitpid (child, &status, 0) != child)
+	error (2, errno, "waitpid");
+      if (! WIFEXITED (status) || WEXITSTATUS (status) != 0)
+	error (2, 0, "%s: child failed (status %#x)",
+	       exec ? program : "fork", status);
+    }
+}
+
+static void
+stop_scan (int sig)
+{
+  stop_scanning = 1;
+}
+
+/* Call proc_getprocinfo on every process until told to stop, then
+   write the number of calls to FD.  */
+static void
+scanner (int fd)
+{
+  process_t proc = getproc ();
+  long calls = 0;
+  error_t err;
+
+  signal (SIGTERM, stop_scan);
+  while (! stop_scanning)
+    {
+      pid_t *pids = 0;
+      mach_msg_type_number_t npids = 0, i;
+
+      err = proc_getallpids (proc, &pids, &npids);
+      if (err == EINTR)
+	continue;
+      if (err)
+	error (2, err, "proc_getallpids");
+      for (i = 0; i < npids && ! stop_scanning; i++)
+	{
+	  int flags = PI_FETCH_TASKINFO;
+	  int info[256];
+	  procinfo_t pi = info;
+	  mach_msg_type_number_t pi_len = 256;
+	  char waits_buf[128], *waits = waits_buf;
+	  mach_msg_type_number_t waits_len = sizeof waits_buf;
+
+	  err = proc_getprocinfo (proc, pids[i], &flags, &pi, &pi_len,
+				  &waits, &waits_len);
+	  calls++;
+	  if (err)
+	    continue;
+	  if (pi != info)
+	    munmap (pi, pi_len * sizeof (int));
+	  if (waits != waits_buf)
+	    munmap (waits, waits_len);
+	}
+      munmap (pids, npids * sizeof *pids);
+    }
+
+  if (write (fd, &calls, sizeof calls) != sizeof calls)
+    error (2, errno, "write");
+}
+
+/* Run one measurement with NWORKERS workers.  */
+static void
+measure (const char *benchmark, int exec, int nworkers)
+{
+  int go[2], result[2];
+  pid_t *workers, scan_pid = 0;
+  long per_worker = (iterations + nworkers - 1) / nworkers;
+  long calls = 0;
+  double start, elapsed;
+  int i, status;
+
+  if (pipe (go) < 0 || pipe (result) < 0)
+    error (1, errno, "pipe");
+
+  workers = calloc (nworkers, sizeof *workers);
+  if (workers == NULL)
+    error (1, errno, "calloc");
+
+  /* Every worker blocks reading GO until we close it, so they all
+     start at the same time.  */
+  for (i = 0; i < nworkers; i++)
+    {
+      workers[i] = fork ();
+      if (workers[i] == -1)
+	error (1, errno, "fork");
+      if (workers[i] == 0)
+	{
+	  char c;
+	  close (go[1]);
+	  if (read (go[0], &c, 1) < 0)
+	    _exit (2);
+	  worker (per_worker, exec);
+	  _exit (0);
+	}
+    }
+
+  if (scan)
+    {
+      scan_pid = fork ();
+      if (scan_pid == -1)
+	error (1, errno, "fork");
+      if (scan_pid == 0)
+	{
+	  char c;
+	  close (go[1]);
+	  close (result[0]);
+	  if (read (go[0], &c, 1) < 0)
+	    _exit (2);
+	  scanner (result[1]);
+	  _exit (0);
+	}
+    }
+
+  close (go[0]);
+  close (result[1]);
+  start = bench_now ();
+  close (go[1]);
+
+  for (i = 0; i < nworkers; i++)
+    {
+      if (waitpid (workers[i], &status, 0) != workers[i])
+	error (1, errno, "waitpid");
+      if (! WIFEXITED (status) || WEXITSTATUS (status) != 0)
+	error (1, 0, "worker %d failed", i);
+    }
+  elapsed = bench_now () - start;
+
+  if (scan_pid)
+    {
+      kill (scan_pid, SIGTERM);
+      if (read (result[0], &calls, sizeof calls) != sizeof calls)
+	error (1, errno, "scanner did not report");
+      waitpid (scan_pid, &status, 0);
+    }
+  close (result[0]);
+  free (workers);
+
+  bench_result_begin (benchmark, "target", exec ? program : "proc");
+  printf (", \"jobs\": %d, \"iterations\": %ld, \"seconds\": %.6f, "
+	  "\"ns_per_op\": %.1f, \"ops_per_s\": %.1f",
+	  nworkers, per_worker * nworkers, elapsed,
+	  elapsed * 1e9 / (per_worker * nworkers),
+	  per_worker * nworkers / elapsed);
+  if (scan)
+    printf (", \"scan_calls\": %ld, \"scan_calls_per_s\": %.1f",
+	    calls, calls / elapsed);
+  bench_result_end ();
+}
+
+int
+main (int argc, char **argv)
+{
+  char **benchmarks = 0;
+  int nbenchmarks = 0, i, n;
+
+  error_t parse_opt (int key, char *arg, struct argp_state *state)
+    {
+      switch (key)
+	{
+	case 'j':
+	  jobs = atoi (arg);
+	  if (jobs <= 0)
+	    argp_error (state, "invalid number of jobs: %s", arg);
+	  break;
+
+	case 'n':
+	  iterations = atoi (arg);
+	  if (iterations <= 0)
+	    argp_error (state, "invalid iteration count: %s", arg);
+	  break;
+
+	case 'p':
+	  program = arg;
+	  break;
+
+	case 's':
+	  scan = 1;
+	  break;
+
+	case ARGP_KEY_ARGS:
+	  benchmarks = state->argv + state->next;
+	  nbenchmarks = state->argc - state->next;
+	  break;
+
+	default:
+	  return ARGP_ERR_UNKNOWN;
+	}
+      return 0;
+    }
+  const struct argp argp = { options, parse_opt, args_doc, doc };
+
+  argp_parse (&argp, argc, argv, 0, 0, 0);
+
+  bench_begin ();
+  for (i = 0; i < (nbenchmarks ?: 2); i++)
+    {
+      static const char *all[] = { "fork", "exec" };
+      const char *b = nbenchmarks ? benchmarks[i] : all[i];
+      int exec;
+
+      if (! strcmp (b, "fork"))
+	exec = 0;
+      else if (! strcmp (b, "exec"))
+	exec = 1;
+      else
+	error (1, 0, "%s: unknown benchmark", b);
+
+      for (n = 1; n < jobs; n *= 2)
+	measure (b, exec, n);
+      measure (b, exec, jobs);
+    }
+  bench_end ();
+
+  return 0;
+}
@@ -0,0 +1,205 @@
+/* Read throughput benchmark for the random translator
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/* For every read size, and for 1, 2, 4, ... up to --jobs reader
+   processes, every reader reads FILE as fast as it can for a while, and
+   we measure the aggregate rate.  Small reads mostly measure the RPC
+   path and contention in the translator, large ones the generator.
+
+   The output is a JSON array like that of rpcbench.  */
+
+#include <argp.h>
+#include <error.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <version.h>
+#include <sys/wait.h>
+
+#include "bench.h"
+
+const char *argp_program_version = STANDARD_HURD_VERSION (randbench);
+
+static const struct argp_option options[] =
+{
+  {"jobs", 'j', "N", 0, "Maximum number of concurrent readers (default 8)."},
+  {"seconds", 't', "SECS", 0,
+   "Duration of each measurement (default 2)."},
+  {"file", 'f', "FILE", 0, "File to read (default /dev/urandom)."},
+  {0}
+};
+
+static const char args_doc[] = "[SIZE...]";
+static const char doc[] =
+  "Measure parallel read throughput of a random number source."
+  "\vSIZE is the number of bytes read at a time; by default 16, 4096"
+  " and 1048576 are measured.";
+
+static int jobs = 8;
+static double seconds = 2;
+static const char *file = "/dev/urandom";
+
+/* Read FILE SIZE bytes at a time until END, then write the number of
+   bytes read to FD.  */
+static void
+reader (size_t size, double end, int fd)
+{
+  char *buf = malloc (size);
+  long long total = 0;
+  int in;
+
+  if (buf == NULL)
+    error (2, errno, "malloc");
+  in = open (file, O_RDONLY);
+  if (in < 0)
+    error (2, errno, "%s", file);
+
+  while (bench_now () < end)
+    {
+      ssize_t cc = read (in, buf, size);
+      if (cc <= 0)
+	error (2, cc ? errno : 0, "%s: read failed", file);
+      total += cc;
+    }
+
+  if (write (fd, &total, sizeof total) != sizeof total)
+    error (2, errno, "write");
+  close (in);
+  free (buf);
+}
+
+/* Run one measurement with NREADERS readers reading SIZE bytes at a
+   time.  */
+static void
+measure (size_t size, int nreaders)
+{
+  int go[2], result[2];
+  long long bytes = 0;
+  double start, end;
+  int i, status;
+
+  if (pipe (go) < 0 || pipe (result) < 0)
+    error (1, errno, "pipe");
+
+  /* Every reader blocks reading GO until we close it, so they all
+     start at the same time.  */
+  for (i = 0; i < nreaders; i++)
+    {
+      pid_t pid = fork ();
+      if (pid == -1)
+	error (1, errno, "fork");
+      if (pid == 0)
+	{
+	  char c;
+	  close (go[1]);
+	  close (result[0]);
+	  if (read (go[0], &c, 1) < 0)
+	    _exit (2);
+	  reader (size, bench_now () + seconds, result[1]);
+	  _exit (0);
+	}
+    }
+
+  close (go[0]);
+  close (result[1]);
+  start = bench_now ();
+  close (go[1]);
+
+  for (i = 0; i < nreaders; i++)
+    {
+      long long n;
+      if (read (result[0], &n, sizeof n) != sizeof n)
+	error (1, errno, "reader did not report");
+      bytes += n;
+    }
+  end = bench_now ();
+  while (wait (&status) > 0)
+    if (! WIFEXITED (status) || WEXITSTATUS (status) != 0)
+      error (1, 0, "reader failed");
+  close (result[0]);
+
+  bench_result_begin ("read", "target", file);
+  printf (", \"size\": %zu, \"jobs\": %d, \"seconds\": %.6f, "
+	  "\"bytes\": %lld, \"ops_per_s\": %.1f, \"mb_per_s\": %.2f",
+	  size, nreaders, end - start, bytes,
+	  bytes / (double) size / (end - start),
+	  bytes / 1e6 / (end - start));
+  bench_result_end ();
+}
+
+int
+main (int argc, char **argv)
+{
+  char **sizes = 0;
+  int nsizes = 0, i, n;
+
+  error_t parse_opt (int key, char *arg, struct argp_state *state)
+    {
+      switch (key)
+	{
+	case 'j':
+	  jobs = atoi (arg);
+	  if (jobs <= 0)
+	    argp_error (state, "invalid number of jobs: %s", arg);
+	  break;
+
+	case 't':
+	  seconds = atof (arg);
+	  if (seconds <= 0)
+	    argp_error (state, "invalid duration: %s", arg);
+	  break;
+
+	case 'f':
+	  file = arg;
+	  break;
+
+	case ARGP_KEY_ARGS:
+	  sizes = state->argv + state->next;
+	  nsizes = state->argc - state->next;
+	  break;
+
+	default:
+	  return ARGP_ERR_UNKNOWN;
+	}
+      return 0;
+    }
+  const struct argp argp = { options, parse_opt, args_doc, doc };
+
+  argp_parse (&argp, argc, argv, 0, 0, 0);
+
+  bench_begin ();
+  for (i = 0; i < (nsizes ?: 3); i++)
+    {
+      static const size_t all[] = { 16, 4096, 1048576 };
+      size_t size = nsizes ? strtoul (sizes[i], 0, 0) : all[i];
+
+      if (size == 0)
+	error (1, 0, "%s: invalid size", sizes[i]);
+
+      for (n = 1; n < jobs; n *= 2)
+	measure (size, n);
+      measure (size, jobs);
+    }
+  bench_end ();
+
+  return 0;
+}
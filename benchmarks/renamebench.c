@@ -0,0 +1,426 @@
+/* Directory rename benchmark and stress test
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/* For 1, 2, 4, ... up to --jobs worker processes, every worker renames
+   directories below DIR as fast as it can for a while, and we measure
+   the aggregate rate.  This is done in three ways:
+
+   same    every worker renames a directory back and forth within a
+	   directory of its own, the way directories are published;
+   cross   every worker moves a directory back and forth between two
+	   directories of its own;
+   tangle  all workers move --dirs shared directories into each other
+	   at random, most of these renames failing because the
+	   directory is not where they guess or would end up inside
+	   itself.
+
+   After every measurement, the tree is checked: every directory must
+   be found exactly once, and its `..' must be the directory it is in.
+   A measurement that does not finish within a minute of its end is
+   taken for a deadlock.
+
+   The output is a JSON array like that of rpcbench.  */
+
+#include <argp.h>
+#include <error.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <version.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "bench.h"
+
+const char *argp_program_version = STANDARD_HURD_VERSION (renamebench);
+
+static const struct argp_option options[] =
+{
+  {"jobs", 'j', "N", 0, "Maximum number of concurrent workers (default 8)."},
+  {"seconds", 't', "SECS", 0,
+   "Duration of each measurement (default 2)."},
+  {"dirs", 'd', "N", 0,
+   "Number of directories moved around by tangle (default 16)."},
+  {0}
+};
+
+static const char args_doc[] = "DIR";
+static const char doc[] =
+  "Measure parallel directory renames and check the tree they leave."
+  "\vDIR must be an empty directory on the file system to test.";
+
+enum mode { SAME, CROSS, TANGLE };
+static const char *const mode_names[] = { "same", "cross", "tangle" };
+
+static int jobs = 8;
+static double seconds = 2;
+static int ndirs = 16;
+static const char *top;
+static int topfd;
+static int *tangle_fds;		/* TOP, then d0 to d(NDIRS-1).  */
+
+static void
+stalled (int sig)
+{
+  error (1, 0, "%s: renames did not finish, deadlock?", top);
+}
+
+static int
+open_dir (int at, const char *name)
+{
+  int fd = openat (at, name, O_RDONLY | O_DIRECTORY);
+  if (fd < 0)
+    error (1, errno, "%s/%s", top, name);
+  return fd;
+}
+
+static void
+make_dir (int at, const char *name)
+{
+  if (mkdirat (at, name, 0755) < 0)
+    error (1, errno, "%s: mkdir %s", top, name);
+}
+
+/* Remove everything below the directory FD.  */
+static void
+remove_tree (int fd)
+{
+  char name[32];
+  int i;
+
+  for (i = 0; i < ndirs; i++)
+    {
+      int sub;
+
+      sprintf (name, "d%d", i);
+      sub = openat (fd, name, O_RDONLY | O_DIRECTORY);
+      if (sub < 0)
+	continue;
+      remove_tree (sub);
+      close (sub);
+      if (unlinkat (fd, name, AT_REMOVEDIR) < 0)
+	error (1, errno, "%s: rmdir %s", top, name);
+    }
+}
+
+/* Count the directories d0 to d(NDIRS-1) below the directory FD, which
+   is DEPTH levels below TOP, in SEEN, and check their `..'.  */
+static void
+check_tree (int fd, int depth, int *seen)
+{
+  struct stat self, up;
+  char name[32];
+  int i;
+
+  if (depth > ndirs)
+    error (1, 0, "%s: the tree has a loop", top);
+  if (fstat (fd, &self) < 0)
+    error (1, errno, "%s: stat", top);
+
+  for (i = 0; i < ndirs; i++)
+    {
+      int sub;
+
+      sprintf (name, "d%d", i);
+      sub = openat (fd, name, O_RDONLY | O_DIRECTORY);
+      if (sub < 0)
+	{
+	  if (errno != ENOENT)
+	    error (1, errno, "%s: %s", top, name);
+	  continue;
+	}
+      if (fstatat (sub, "..", &up, 0) < 0)
+	error (1, errno, "%s: stat %s/..", top, name);
+      if (up.st_ino != self.st_ino || up.st_dev != self.st_dev)
+	error (1, 0, "%s: the `..' of %s is not its parent", top, name);
+      seen[i]++;
+      check_tree (sub, depth + 1, seen);
+      close (sub);
+    }
+}
+
+/* Rename for MODE until END as worker ID, then write the number of
+   renames done to FD.  */
+static void
+worker (enum mode mode, int id, double end, int fd)
+{
+  long long total = 0;
+  char name[2][32];
+  int dirs[2], i;
+  unsigned seed = id;
+
+  if (mode == TANGLE)
+    while (bench_now () < end)
+      {
+	int d = rand_r (&seed) % ndirs;
+	int from = rand_r (&seed) % (ndirs + 1);
+	int to = rand_r (&seed) % (ndirs + 1);
+
+	sprintf (name[0], "d%d", d);
+	if (renameat (tangle_fds[from], name[0], tangle_fds[to], name[0]) == 0)
+	  total++;
+	else if (errno != ENOENT && errno != EINVAL)
+	  error (2, errno, "%s: rename %s", top, name[0]);
+      }
+  else
+    {
+      sprintf (name[0], "w%d", id);
+      dirs[0] = open_dir (topfd, name[0]);
+      if (mode == CROSS)
+	{
+	  sprintf (name[0], "x%d", id);
+	  dirs[1] = open_dir (topfd, name[0]);
+	}
+      else
+	dirs[1] = dirs[0];
+      strcpy (name[0], "a");
+      strcpy (name[1], mode == CROSS ? "a" : "b");
+
+      for (i = 0; bench_now () < end; i ^= 1)
+	{
+	  if (renameat (dirs[i], name[i], dirs[i ^ 1], name[i ^ 1]) < 0)
+	    error (2, errno, "%s: rename %s", top, name[i]);
+	  total++;
+	}
+    }
+
+  if (write (fd, &total, sizeof total) != sizeof total)
+    error (2, errno, "write");
+}
+
+/* Set up the tree for MODE with NWORKERS workers.  */
+static void
+setup (enum mode mode, int nworkers)
+{
+  char name[32];
+  int i;
+
+  if (mode == TANGLE)
+    {
+      /* Start with a chain, so that there is something to untangle.
+	 The workers inherit the descriptors, which follow the
+	 directories wherever they are moved.  */
+      tangle_fds = malloc ((ndirs + 1) * sizeof *tangle_fds);
+      if (! tangle_fds)
+	error (1, errno, "malloc");
+      tangle_fds[0] = topfd;
+      for (i = 0; i < ndirs; i++)
+	{
+	  sprintf (name, "d%d", i);
+	  make_dir (tangle_fds[i], name);
+	  tangle_fds[i + 1] = open_dir (tangle_fds[i], name);
+	}
+    }
+  else
+    for (i = 0; i < nworkers; i++)
+      {
+	int fd;
+	sprintf (name, "w%d", i);
+	make_dir (topfd, name);
+	fd = open_dir (topfd, name);
+	make_dir (fd, "a");
+	close (fd);
+	if (mode == CROSS)
+	  {
+	    sprintf (name, "x%d", i);
+	    make_dir (topfd, name);
+	  }
+      }
+}
+
+/* Check and remove the tree left by MODE with NWORKERS workers.  */
+static void
+teardown (enum mode mode, int nworkers)
+{
+  char name[32];
+  int i;
+
+  if (mode == TANGLE)
+    {
+      int *seen = calloc (ndirs, sizeof *seen);
+      if (! seen)
+	error (1, errno, "calloc");
+      check_tree (topfd, 0, seen);
+      for (i = 0; i < ndirs; i++)
+	if (seen[i] != 1)
+	  error (1, 0, "%s: d%d found %d times", top, i, seen[i]);
+      free (seen);
+      for (i = 1; i <= ndirs; i++)
+	close (tangle_fds[i]);
+      free (tangle_fds);
+      remove_tree (topfd);
+      return;
+    }
+
+  for (i = 0; i < nworkers; i++)
+    {
+      int fd, n = 0;
+      struct stat st;
+
+      sprintf (name, "w%d", i);
+      fd = open_dir (topfd, name);
+      n += fstatat (fd, "a", &st, 0) == 0;
+      n += fstatat (fd, "b", &st, 0) == 0;
+      unlinkat (fd, "a", AT_REMOVEDIR);
+      unlinkat (fd, "b", AT_REMOVEDIR);
+      close (fd);
+      if (mode == CROSS)
+	{
+	  sprintf (name, "x%d", i);
+	  fd = open_dir (topfd, name);
+	  n += fstatat (fd, "a", &st, 0) == 0;
+	  unlinkat (fd, "a", AT_REMOVEDIR);
+	  close (fd);
+	  unlinkat (topfd, name, AT_REMOVEDIR);
+	}
+      if (n != 1)
+	error (1, 0, "%s: worker %d left %d directories", top, i, n);
+      sprintf (name, "w%d", i);
+      if (unlinkat (topfd, name, AT_REMOVEDIR) < 0)
+	error (1, errno, "%s: rmdir %s", top, name);
+    }
+}
+
+/* Run one measurement of MODE with NWORKERS workers.  */
+static void
+measure (enum mode mode, int nworkers)
+{
+  int go[2], result[2];
+  long long renames = 0;
+  double start, end;
+  int i, status;
+
+  setup (mode, nworkers);
+  if (pipe (go) < 0 || pipe (result) < 0)
+    error (1, errno, "pipe");
+
+  /* Every worker blocks reading GO until we close it, so they all
+     start at the same time.  */
+  for (i = 0; i < nworkers; i++)
+    {
+      pid_t pid = fork ();
+      if (pid == -1)
+	error (1, errno, "fork");
+      if (pid == 0)
+	{
+	  char c;
+	  close (go[1]);
+	  close (result[0]);
+	  if (read (go[0], &c, 1) < 0)
+	    _exit (2);
+	  worker (mode, i, bench_now () + seconds, result[1]);
+	  _exit (0);
+	}
+    }
+
+  close (go[0]);
+  close (result[1]);
+  start = bench_now ();
+  alarm (seconds + 60);
+  close (go[1]);
+
+  for (i = 0; i < nworkers; i++)
+    {
+      long long n;
+      if (read (result[0], &n, sizeof n) != sizeof n)
+	error (1, errno, "worker did not report");
+      renames += n;
+    }
+  end = bench_now ();
+  while (wait (&status) > 0)
+    if (! WIFEXITED (status) || WEXITSTATUS (status) != 0)
+      error (1, 0, "worker failed");
+  alarm (0);
+  close (result[0]);
+
+  teardown (mode, nworkers);
+
+  bench_result_begin ("rename", "mode", mode_names[mode]);
+  bench_rate (nworkers, end - start, "renames", renames);
+  bench_result_end ();
+}
+
+int
+main (int argc, char **argv)
+{
+  enum mode mode;
+  int n;
+
+  error_t parse_opt (int key, char *arg, struct argp_state *state)
+    {
+      switch (key)
+	{
+	case 'j':
+	  jobs = atoi (arg);
+	  if (jobs <= 0)
+	    argp_error (state, "invalid number of jobs: %s", arg);
+	  break;
+
+	case 't':
+	  seconds = atof (arg);
+	  if (seconds <= 0)
+	    argp_error (state, "invalid duration: %s", arg);
+	  break;
+
+	case 'd':
+	  ndirs = atoi (arg);
+	  if (ndirs <= 0)
+	    argp_error (state, "invalid number of directories: %s", arg);
+	  break;
+
+	case ARGP_KEY_ARG:
+	  if (state->arg_num > 0)
+	    argp_usage (state);
+	  top = arg;
+	  break;
+
+	case ARGP_KEY_END:
+	  if (! top)
+	    argp_usage (state);
+	  break;
+
+	default:
+	  return ARGP_ERR_UNKNOWN;
+	}
+      return 0;
+    }
+  const struct argp argp = { options, parse_opt, args_doc, doc };
+
+  argp_parse (&argp, argc, argv, 0, 0, 0);
+
+  topfd = open (top, O_RDONLY | O_DIRECTORY);
+  if (topfd < 0)
+    error (1, errno, "%s", top);
+  signal (SIGALRM, stalled);
+
+  bench_begin ();
+  for (mode = SAME; mode <= TANGLE; mode++)
+    {
+      for (n = 1; n < jobs; n *= 2)
+	measure (mode, n);
+      measure (mode, jobs);
+    }
+  bench_end ();
+
+  return 0;
+}
@@ -0,0 +1,580 @@
+/* Microbenchmarks for the hot RPC paths of the core Hurd servers
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/* Every benchmark prints one JSON object per measurement; the whole
+   output is a JSON array, so runs can be stored and compared by
+   scripts.  Each object has at least the fields "benchmark", "target",
+   "iterations", "seconds" and "ns_per_op".  */
+
+#include <hurd.h>
+#include <hurd/fsys.h>
+#include <hurd/process.h>
+#include <argp.h>
+#include <error.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <version.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+const char *argp_program_version = STANDARD_HURD_VERSION (rpcbench);
+
+static const struct argp_option options[] =
+{
+  {"dir", 'd', "DIR", 0,
+   "Run the filesystem benchmarks in DIR (may be repeated, e.g. once for"
+   " an ext2fs and once for a tmpfs directory; default /tmp)."},
+  {"iterations", 'n', "N", 0, "Number of iterations per measurement"
+   " (default 10000)."},
+  {"translator", 'T', "PATH", 0,
+   "Translator used for the startup benchmark (default /hurd/null)."},
+  {0}
+};
+
+static const char args_doc[] = "[BENCHMARK...]";
+static const char doc[] =
+  "Measure latency and throughput of core Hurd RPCs."
+  "\vBENCHMARK is one of io, lookup, pflocal, pipe, proc and translator;"
+  " by default all of them are run.";
+
+static int iterations = 10000;
+static const char *translator = "/hurd/null";
+static char **dirs;
+static int ndirs;
+static int nresults;
+
+static const size_t io_sizes[] = { 1, 512, 4096, 65536, 1024 * 1024 };
+#define N_IO_SIZES (sizeof io_sizes / sizeof io_sizes[0])
+
+static double
+now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Print one result.  BYTES is the amount of data moved per operation,
+   or zero if throughput is meaningless.  */
+static void
+report (const char *benchmark, const char *target, size_t bytes,
+	long ops, double seconds)
+{
+  printf ("%s\n  {\"benchmark\": \"%s\", \"target\": \"%s\", ",
+	  nresults++ ? "," : "", benchmark, target);
+  if (bytes)
+    printf ("\"size\": %zu, ", bytes);
+  printf ("\"iterations\": %ld, \"seconds\": %.6f, \"ns_per_op\": %.1f",
+	  ops, seconds, ops ? seconds * 1e9 / ops : 0.0);
+  if (bytes && seconds > 0)
+    printf (", \"mb_per_s\": %.2f", (double) bytes * ops / seconds / 1e6);
+  printf ("}");
+  fflush (stdout);
+}
+
+/* Scale the iteration count down for large transfers so every
+   measurement moves a bounded amount of data.  */
+static long
+scaled_iterations (size_t size)
+{
+  long n = iterations;
+  if (size > 4096 && n > (long) (256 * 1024 * 1024 / size))
+    n = 256 * 1024 * 1024 / size;
+  return n > 0 ? n : 1;
+}
+
+/* io_read/io_write on a file in DIR, bypassing the C library's
+   buffering.  */
+static void
+bench_io (const char *dir)
+{
+  char *name;
+  file_t file;
+  char *buf;
+  size_t i;
+  error_t err;
+
+  if (asprintf (&name, "%s/rpcbench-io.%d", dir, getpid ()) < 0)
+    error (1, errno, "asprintf");
+  file = file_name_lookup (name, O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (file == MACH_PORT_NULL)
+    error (1, errno, "%s", name);
+
+  buf = mmap (0, io_sizes[N_IO_SIZES - 1], PROT_READ|PROT_WRITE,
+	      MAP_ANON, 0, 0);
+  if (buf == MAP_FAILED)
+    error (1, errno, "mmap");
+  memset (buf, 'x', io_sizes[N_IO_SIZES - 1]);
+
+  for (i = 0; i < N_IO_SIZES; i++)
+    {
+      size_t size = io_sizes[i];
+      long n = scaled_iterations (size), j;
+      double start;
+
+      start = now ();
+      for (j = 0; j < n; j++)
+	{
+	  vm_size_t amount;
+	  err = io_write (file, buf, size, 0, &amount);
+	  if (err)
+	    error (1, err, "io_write");
+	}
+      report ("io_write", dir, size, n, now () - start);
+
+      start = now ();
+      for (j = 0; j < n; j++)
+	{
+	  char *data = buf;
+	  mach_msg_type_number_t len = size;
+	  err = io_read (file, &data, &len, 0, size);
+	  if (err)
+	    error (1, err, "io_read");
+	  if (data != buf)
+	    munmap (data, len);
+	}
+      report ("io_read", dir, size, n, now () - start);
+    }
+
+  munmap (buf, io_sizes[N_IO_SIZES - 1]);
+  mach_port_deallocate (mach_task_self (), file);
+  unlink (name);
+  free (name);
+}
+
+/* dir_lookup rate in a directory holding WIDTH entries, and of a path
+   DEPTH components deep.  */
+static void
+bench_lookup (const char *dir)
+{
+  const int width = 1000, depth = 32;
+  char *base, *path, *p;
+  file_t dirport;
+  double start;
+  long j;
+  int i;
+
+  if (asprintf (&base, "%s/rpcbench-lookup.%d", dir, getpid ()) < 0)
+    error (1, errno, "asprintf");
+  if (mkdir (base, 0700))
+    error (1, errno, "%s", base);
+
+  /* Wide: many entries in one directory.  */
+  for (i = 0; i < width; i++)
+    {
+      char name[PATH_MAX];
+      int fd;
+      snprintf (name, sizeof name, "%s/f%d", base, i);
+      fd = open (name, O_CREAT | O_WRONLY, 0600);
+      if (fd < 0)
+	error (1, errno, "%s", name);
+      close (fd);
+    }
+
+  dirport = file_name_lookup (base, O_READ, 0);
+  if (dirport == MACH_PORT_NULL)
+    error (1, errno, "%s", base);
+
+  start = now ();
+  for (j = 0; j < iterations; j++)
+    {
+      char name[32];
+      retry_type retry;
+      string_t retry_name;
+      mach_port_t result;
+      error_t err;
+
+      snprintf (name, sizeof name, "f%ld", j % width);
+      err = dir_lookup (dirport, name, O_READ, 0, &retry, retry_name,
+			&result);
+      if (err)
+	error (1, err, "dir_lookup %s", name);
+      mach_port_deallocate (mach_task_self (), result);
+    }
+  report ("dir_lookup_wide", dir, 0, iterations, now () - start);
+
+  /* Deep: a long path resolved in one file_name_lookup.  */
+  path = malloc (strlen (base) + depth * 3 + 1);
+  if (path == NULL)
+    error (1, errno, "malloc");
+  p = stpcpy (path, base);
+  for (i = 0; i < depth; i++)
+    {
+      p = stpcpy (p, "/d");
+      if (mkdir (path, 0700))
+	error (1, errno, "%s", path);
+    }
+
+  start = now ();
+  for (j = 0; j < iterations; j++)
+    {
+      file_t f = file_name_lookup (path, O_READ, 0);
+      if (f == MACH_PORT_NULL)
+	error (1, errno, "%s", path);
+      mach_port_deallocate (mach_task_self (), f);
+    }
+  report ("dir_lookup_deep", dir, 0, iterations, now () - start);
+
+  /* Clean up.  */
+  for (i = depth; i > 0; i--)
+    {
+      rmdir (path);
+      path[strlen (path) - 2] = '\0';
+    }
+  for (i = 0; i < width; i++)
+    {
+      char name[PATH_MAX];
+      snprintf (name, sizeof name, "%s/f%d", base, i);
+      unlink (name);
+    }
+  rmdir (base);
+  mach_port_deallocate (mach_task_self (), dirport);
+  free (path);
+  free (base);
+}
+
+/* Ping-pong and bulk transfer from FDS[0] to FDS[1], with a child
+   process echoing back through BACK or draining on the other side.
+   If BACK is null the channel is one-way (a pipe) and only the bulk
+   test is run.  */
+static void
+bench_channel (const char *benchmark, int fds[2], int back[2])
+{
+  const size_t bulk = 64 * 1024;
+  char *buf = malloc (bulk);
+  long n, j;
+  double start;
+  pid_t child;
+  int status;
+
+  if (buf == NULL)
+    error (1, errno, "malloc");
+  memset (buf, 'x', bulk);
+
+  child = fork ();
+  if (child < 0)
+    error (1, errno, "fork");
+  if (child == 0)
+    {
+      ssize_t r;
+
+      close (fds[0]);
+      /* Echo single bytes while BACK is usable, then drain.  */
+      if (back)
+	for (j = 0; j < iterations; j++)
+	  {
+	    if (read (fds[1], buf, 1) != 1
+		|| write (back[1], buf, 1) != 1)
+	      _exit (1);
+	  }
+      while ((r = read (fds[1], buf, bulk)) > 0)
+	;
+      _exit (r < 0);
+    }
+
+  close (fds[1]);
+  if (back)
+    {
+      char name[64];
+
+      start = now ();
+      for (j = 0; j < iterations; j++)
+	if (write (fds[0], buf, 1) != 1 || read (back[0], buf, 1) != 1)
+	  error (1, errno, "%s ping-pong", benchmark);
+      snprintf (name, sizeof name, "%s_pingpong", benchmark);
+      report (name, "localhost", 1, iterations, now () - start);
+    }
+
+  n = scaled_iterations (bulk);
+  start = now ();
+  for (j = 0; j < n; j++)
+    {
+      size_t done = 0;
+      while (done < bulk)
+	{
+	  ssize_t w = write (fds[0], buf + done, bulk - done);
+	  if (w < 0)
+	    error (1, errno, "%s write", benchmark);
+	  done += w;
+	}
+    }
+  close (fds[0]);
+  if (waitpid (child, &status, 0) != child || status != 0)
+    error (1, 0, "%s: child failed", benchmark);
+  {
+    char name[64];
+    snprintf (name, sizeof name, "%s_bulk", benchmark);
+    report (name, "localhost", bulk, n, now () - start);
+  }
+
+  free (buf);
+}
+
+static void
+bench_pflocal (void)
+{
+  int fds[2], back[2];
+
+  if (socketpair (AF_LOCAL, SOCK_STREAM, 0, fds)
+      || socketpair (AF_LOCAL, SOCK_STREAM, 0, back))
+    error (1, errno, "socketpair");
+  bench_channel ("pflocal", fds, back);
+  close (back[0]);
+  close (back[1]);
+}
+
+static void
+bench_pipe (void)
+{
+  int fds[2];
+  int swapped[2];
+
+  if (pipe (fds))
+    error (1, errno, "pipe");
+  /* bench_channel writes to FDS[0] and the child reads FDS[1].  */
+  swapped[0] = fds[1];
+  swapped[1] = fds[0];
+  bench_channel ("pipe", swapped, NULL);
+}
+
+/* Scan the process table the way ps does.  */
+static void
+bench_proc (void)
+{
+  process_t proc = getproc ();
+  pid_t *pids = 0;
+  mach_msg_type_number_t npids = 0, i;
+  long scans, j, calls = 0;
+  double start;
+  error_t err;
+
+  err = proc_getallpids (proc, &pids, &npids);
+  if (err)
+    error (1, err, "proc_getallpids");
+  munmap (pids, npids * sizeof *pids);
+
+  scans = iterations / (npids ? npids : 1);
+  if (scans < 1)
+    scans = 1;
+
+  start = now ();
+  for (j = 0; j < scans; j++)
+    {
+      pids = 0;
+      npids = 0;
+      err = proc_getallpids (proc, &pids, &npids);
+      if (err)
+	error (1, err, "proc_getallpids");
+      for (i = 0; i < npids; i++)
+	{
+	  int flags = PI_FETCH_TASKINFO | PI_FETCH_THREADS;
+	  int info[256];
+	  procinfo_t pi = info;
+	  mach_msg_type_number_t pi_len = 256;
+	  char waits_buf[128], *waits = waits_buf;
+	  mach_msg_type_number_t waits_len = sizeof waits_buf;
+
+	  err = proc_getprocinfo (proc, pids[i], &flags, &pi, &pi_len,
+				  &waits, &waits_len);
+	  calls++;
+	  if (err)
+	    continue;
+	  if (pi != info)
+	    munmap (pi, pi_len * sizeof (int));
+	  if (waits != waits_buf)
+	    munmap (waits, waits_len);
+	}
+      munmap (pids, npids * sizeof *pids);
+    }
+  report ("proc_getprocinfo", "proc", 0, calls, now () - start);
+}
+
+/* Translator startup latency: set a passive translator on a node and
+   time the first lookup, which starts it; then time fsys_getroot on
+   the running translator.  */
+static void
+bench_translator (const char *dir)
+{
+  char *name;
+  long n = iterations / 100, j;
+  double total = 0, start;
+  file_t node;
+  fsys_t control;
+  error_t err;
+  int fd;
+
+  if (n < 10)
+    n = 10;
+  if (asprintf (&name, "%s/rpcbench-trans.%d", dir, getpid ()) < 0)
+    error (1, errno, "asprintf");
+  fd = open (name, O_CREAT | O_WRONLY, 0600);
+  if (fd < 0)
+    error (1, errno, "%s", name);
+  close (fd);
+
+  node = file_name_lookup (name, O_NOTRANS, 0);
+  if (node == MACH_PORT_NULL)
+    error (1, errno, "%s", name);
+  err = file_set_translator (node, FS_TRANS_SET, 0, 0,
+			     (char *) translator, strlen (translator) + 1,
+			     MACH_PORT_NULL, MACH_MSG_TYPE_COPY_SEND);
+  if (err)
+    error (1, err, "file_set_translator");
+
+  for (j = 0; j < n; j++)
+    {
+      file_t f;
+
+      start = now ();
+      f = file_name_lookup (name, 0, 0);
+      total += now () - start;
+      if (f == MACH_PORT_NULL)
+	error (1, errno, "%s", name);
+      mach_port_deallocate (mach_task_self (), f);
+
+      err = file_get_translator_cntl (node, &control);
+      if (err)
+	error (1, err, "file_get_translator_cntl");
+      err = fsys_goaway (control, 0);
+      if (err && err != MACH_SEND_INVALID_DEST && err != MIG_SERVER_DIED)
+	error (1, err, "fsys_goaway");
+      mach_port_deallocate (mach_task_self (), control);
+    }
+  report ("translator_startup", dir, 0, n, total);
+
+  /* Leave one instance running for fsys_getroot.  */
+  {
+    file_t f = file_name_lookup (name, 0, 0);
+    if (f == MACH_PORT_NULL)
+      error (1, errno, "%s", name);
+    mach_port_deallocate (mach_task_self (), f);
+  }
+  err = file_get_translator_cntl (node, &control);
+  if (err)
+    error (1, err, "file_get_translator_cntl");
+
+  start = now ();
+  for (j = 0; j < iterations; j++)
+    {
+      retry_type retry;
+      string_t retry_name;
+      mach_port_t root;
+
+      err = fsys_getroot (control, MACH_PORT_NULL, MACH_MSG_TYPE_COPY_SEND,
+			  0, 0, 0, 0, O_READ, &retry, retry_name, &root);
+      if (err)
+	error (1, err, "fsys_getroot");
+      mach_port_deallocate (mach_task_self (), root);
+    }
+  report ("fsys_getroot", dir, 0, iterations, now () - start);
+
+  fsys_goaway (control, 0);
+  mach_port_deallocate (mach_task_self (), control);
+  file_set_translator (node, FS_TRANS_SET, 0, 0, 0, 0,
+		       MACH_PORT_NULL, MACH_MSG_TYPE_COPY_SEND);
+  mach_port_deallocate (mach_task_self (), node);
+  unlink (name);
+  free (name);
+}
+
+int
+main (int argc, char **argv)
+{
+  char **benchmarks = 0;
+  int nbenchmarks = 0, i, k;
+
+  error_t parse_opt (int key, char *arg, struct argp_state *state)
+    {
+      switch (key)
+	{
+	case 'd':
+	  dirs = realloc (dirs, (ndirs + 1) * sizeof *dirs);
+	  if (dirs == NULL)
+	    error (1, errno, "realloc");
+	  dirs[ndirs++] = arg;
+	  break;
+
+	case 'n':
+	  iterations = atoi (arg);
+	  if (iterations <= 0)
+	    argp_error (state, "invalid iteration count: %s", arg);
+	  break;
+
+	case 'T':
+	  translator = arg;
+	  break;
+
+	case ARGP_KEY_ARGS:
+	  benchmarks = state->argv + state->next;
+	  nbenchmarks = state->argc - state->next;
+	  break;
+
+	default:
+	  return ARGP_ERR_UNKNOWN;
+	}
+      return 0;
+    }
+  const struct argp argp = { options, parse_opt, args_doc, doc };
+
+  argp_parse (&argp, argc, argv, 0, 0, 0);
+
+  if (ndirs == 0)
+    {
+      static char *default_dirs[] = { "/tmp" };
+      dirs = default_dirs;
+      ndirs = 1;
+    }
+
+  printf ("[");
+  for (i = 0; i < (nbenchmarks ?: 6); i++)
+    {
+      static const char *all[] =
+	{ "io", "lookup", "pflocal", "pipe", "proc", "translator" };
+      const char *b = nbenchmarks ? benchmarks[i] : all[i];
+
+      if (! strcmp (b, "io"))
+	for (k = 0; k < ndirs; k++)
+	  bench_io (dirs[k]);
+      else if (! strcmp (b, "lookup"))
+	for (k = 0; k < ndirs; k++)
+	  bench_lookup (dirs[k]);
+      else if (! strcmp (b, "pflocal"))
+	bench_pflocal ();
+      else if (! strcmp (b, "pipe"))
+	bench_pipe ();
+      else if (! strcmp (b, "proc"))
+	bench_proc ();
+      else if (! strcmp (b, "translator"))
+	for (k = 0; k < ndirs; k++)
+	  bench_translator (dirs[k]);
+      else
+	error (1, 0, "%s: unknown benchmark", b);
+    }
+  printf ("\n]\n");
+
+  return 0;
+}
@@ -70,6 +70,7 @@ volatile struct mapped_time_value *console_maptime;
 #define DEFAULT_WIDTH 80
 #define DEFAULT_HEIGHT 25
 #define DEFAULT_LINES 50
+#define DEFAULT_FRAME_INTERVAL 10
 /* Stringification of a macro.  */
 #define STRX(s) #s
 #define STR(s)	STRX(s)
@@ -146,6 +147,10 @@ struct cons
   unsigned int lines;
   unsigned int width;
   unsigned int height;
+
+  /* The minimum time between screen change notifications, in
+     milliseconds.  */
+  unsigned int frame_interval;
 };
 
 
@@ -1362,6 +1367,9 @@ static const struct argp_option options[] =
     STR(DEFAULT_HEIGHT) "')" },
   { "lines", 'l', "LINES", 0, "Set amount of scrollback lines to LINES "
     "(default `" STR(DEFAULT_LINES) "')" },
+  { "frame-interval", 'i', "MSECS", 0, "Notify clients of screen changes "
+    "at most every MSECS milliseconds (default `"
+    STR(DEFAULT_FRAME_INTERVAL) "')" },
   {0}
 };
 
@@ -1535,6 +1543,16 @@ parse_opt (int opt, char *arg, struct argp_state *state)
 	argp_error (state, "Overflow in argument HEIGHT %s", arg);
       break;
 
+    case 'i':
+      errno = 0;
+      cons->frame_interval = strtoul (arg, &tail, 0);
+      if (tail == NULL || tail == arg || *tail != '\0')
+	argp_error (state, "MSECS is not a number: %s", arg);
+      if (errno)
+	argp_error (state, "Overflow in argument MSECS %s", arg);
+      display_set_frame_interval (cons->frame_interval);
+      break;
+
     case 'e':
       /* XXX Check validity of encoding.  Can we perform all necessary
 	 conversions?  */
@@ -1617,6 +1635,14 @@ netfs_append_args (char **argz, size_t *argz_len)
       else
 	err = argz_add (argz, argz_len, buf);
     }
+  if (!err && cons->frame_interval != DEFAULT_FRAME_INTERVAL)
+    {
+      char *buf;
+      if (asprintf (&buf, "--frame-interval=%u", cons->frame_interval) < 0)
+	err = ENOMEM;
+      else
+	err = argz_add (argz, argz_len, buf);
+    }
   if (!err && cons->attribute.intensity != DEFAULT_INTENSITY)
     {
       if (attrp != attr)
@@ -2017,6 +2043,8 @@ main (int argc, char **argv)
   cons->width = DEFAULT_WIDTH;
   cons->height = DEFAULT_HEIGHT;
   cons->lines = DEFAULT_LINES;
+  cons->frame_interval = DEFAULT_FRAME_INTERVAL;
+  display_set_frame_interval (cons->frame_interval);
   cons->attribute.intensity = DEFAULT_INTENSITY;
   cons->attribute.underlined = DEFAULT_UNDERLINED;
   cons->attribute.blinking = DEFAULT_BLINKING;
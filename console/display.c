@@ -28,6 +28,7 @@
 #include <string.h>
 #include <assert-backtrace.h>
 #include <error.h>
+#include <time.h>
 
 #include <pthread.h>
 
@@ -62,8 +63,16 @@ struct changes
   uint32_t bell_audible;
   uint32_t bell_visible;
 
-  off_t start;
-  off_t end;
+  /* The changed parts of the matrix, as disjoint ranges of offsets
+     sorted by START, none of which wraps around the end of the matrix.
+     One more than DISPLAY_DAMAGE_MAX is used while adding a range.  */
+#define DISPLAY_DAMAGE_MAX 8
+  struct
+  {
+    off_t start;
+    off_t end;
+  } damage[DISPLAY_DAMAGE_MAX + 1];
+  int ndamage;
 
 #define DISPLAY_CHANGE_CURSOR_POS	0x0001
 #define DISPLAY_CHANGE_CURSOR_STATUS	0x0002
@@ -125,6 +134,10 @@ struct output
   size_t allocated;
   size_t size;
 
+  /* Nonzero if the encoding maps the printable ASCII characters to
+     themselves in any state, see display_output_ascii.  */
+  int ascii;
+
   /* The parsing state of output characters.  */
   struct parse parse;
 };
@@ -170,6 +183,13 @@ struct display
 
   /* The pending changes.  */
   struct changes changes;
+  /* Nonzero while CHANGES holds changes that have not been flushed.  */
+  int frame_open;
+  /* Changes are not flushed before this time, see display_end_frame.  */
+  struct timespec next_flush;
+  /* Nonzero while DISPLAY is on the frame queue.  */
+  int frame_queued;
+  struct display *next_queued;
 
   /* The state of the virtual console.  */
   /* The saved cursor position.  */
@@ -201,6 +221,19 @@ struct display
 static struct port_bucket *notify_bucket;
 static struct port_class *notify_class;
 
+/* Scrolling output changes the screen many times a second, and
+   reporting every change costs a change record and a notification
+   message per write, most of which the clients can't keep up with
+   anyway.  So the changes are collected in frames: the first changes
+   after a quiet period are reported at once, and the following ones at
+   most every FRAME_INTERVAL, by the frame thread.  The displays it has
+   to flush are on the frame queue, holding a reference to their notify
+   port.  */
+static struct timespec frame_interval;
+static pthread_mutex_t frame_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t frame_wakeup = PTHREAD_COND_INITIALIZER;
+static struct display *frame_queue, **frame_queue_tail = &frame_queue;
+
 #define msgh_request_port	msgh_remote_port
 #define msgh_reply_port		msgh_local_port
 
@@ -599,13 +632,34 @@ display_flush_filechange (display_t display, unsigned int type)
   if (type & DISPLAY_CHANGE_MATRIX
       && display->changes.which & DISPLAY_CHANGE_MATRIX)
     {
+      struct changes *changes = &display->changes;
+      off_t size = user->screen.width * user->screen.lines;
+      int first = 0, last = changes->ndamage - 1;
+      int i;
+
+      void record (off_t start, off_t end)
+	{
+	  next->matrix.start = start;
+	  next->matrix.end = end;
+	  user->changes.written++;
+	  next = &user->changes._buffer[user->changes.written
+					% _CONS_CHANGES_LENGTH];
+	}
+
       notify = 1;
-      next->matrix.start = display->changes.start;
-      next->matrix.end = display->changes.end;
-      user->changes.written++;
-      next = &user->changes._buffer[user->changes.written
-				    % _CONS_CHANGES_LENGTH];
-      display->changes.which &= ~DISPLAY_CHANGE_MATRIX;
+      if (last > first && changes->damage[first].start == 0
+	  && changes->damage[last].end == size - 1)
+	{
+	  /* Report the ranges at both ends as one that wraps around.  */
+	  record (changes->damage[last].start, changes->damage[first].end);
+	  first++;
+	  last--;
+	}
+      for (i = first; i <= last; i++)
+	record (changes->damage[i].start, changes->damage[i].end);
+
+      changes->ndamage = 0;
+      changes->which &= ~DISPLAY_CHANGE_MATRIX;
     }
 
   memset (next, 0, sizeof (cons_change_t));
@@ -688,87 +742,183 @@ display_flush_filechange (display_t display, unsigned int type)
     display_notice_filechange (display);
 }
 
-/* Record a change in the matrix ringbuffer.  */
+/* Add the range of offsets from START to END, which must not be
+   smaller than START, to the changed parts of the matrix of DISPLAY,
+   merging it with the ranges it overlaps or touches.  If that makes
+   too many ranges, the two closest ones are merged.  */
 static void
-display_record_filechange (display_t display, off_t start, off_t end)
+display_add_damage (display_t display, off_t start, off_t end)
 {
-  if (!(display->changes.which & DISPLAY_CHANGE_MATRIX))
+  struct changes *changes = &display->changes;
+  int i, j, n = changes->ndamage;
+
+  for (i = 0; i < n && changes->damage[i].end + 1 < start; i++)
+    ;
+  /* Merge with ranges I to J - 1.  */
+  for (j = i; j < n && changes->damage[j].start <= end + 1; j++)
+    {
+      if (changes->damage[j].start < start)
+	start = changes->damage[j].start;
+      if (changes->damage[j].end > end)
+	end = changes->damage[j].end;
+    }
+  memmove (&changes->damage[i + 1], &changes->damage[j],
+	   (n - j) * sizeof changes->damage[0]);
+  n += 1 - (j - i);
+  changes->damage[i].start = start;
+  changes->damage[i].end = end;
+
+  if (n > DISPLAY_DAMAGE_MAX)
     {
-      display->changes.start = start;
-      display->changes.end = end;
-      display->changes.which |= DISPLAY_CHANGE_MATRIX;
+      int k = 0;
+
+      for (i = 1; i < n - 1; i++)
+	if (changes->damage[i + 1].start - changes->damage[i].end
+	    < changes->damage[k + 1].start - changes->damage[k].end)
+	  k = i;
+      changes->damage[k].end = changes->damage[k + 1].end;
+      memmove (&changes->damage[k + 1], &changes->damage[k + 2],
+	       (n - k - 2) * sizeof changes->damage[0]);
+      n--;
     }
+  changes->ndamage = n;
+}
+
+/* Record a change in the matrix ringbuffer.  END is smaller than START
+   if the change wraps around the end of the matrix.  */
+static void
+display_record_filechange (display_t display, off_t start, off_t end)
+{
+  if (start <= end)
+    display_add_damage (display, start, end);
   else
     {
       off_t size = display->user->screen.width * display->user->screen.lines;
-      off_t rotate = display->changes.start;
-      off_t old_end = display->changes.end;
-      int disjunct = 0;
-
-      /* First rotate the buffer to reduce the number of cases.  */
-      old_end -= rotate;
-      if (old_end < 0)
-	old_end += size;
-      start -= rotate;
-      if (start < 0)
-	start += size;
-      end -= rotate;
-      if (end < 0)
-	end += size;
-
-      /* Now the old region starts at 0 and ends at OLD_END.  Try to
-	 merge in the new region if it overlaps or touches the old
-	 one.  */
-      if (start <= end)
-	{
-	  if (start <= old_end + 1)
-	    {
-	      start = 0;
-	      if (old_end > end)
-		end = old_end;
-	    }
-	  else
-	    {
-	      if (end == size - 1)
-		end = old_end;
-	      else
-		disjunct = 1;
-	    }
-	}
-      else
-	{
-	  if (start <= old_end + 1)
-	    {
-	      start = 0;
-	      end = size - 1;
-	    }
-	  else
-	    {
-	      if (old_end > end)
-		end = old_end;
-	    }
-	}
-      /* Now reverse the rotation.  */
-      start += rotate;
-      if (start >= size)
-	start -= size;
-      end += rotate;
-      if (end >= size)
-	end -= size;
-
-      if (disjunct)
-	{
-	  /* The regions are disjunct, so we have to flush the old
-	     changes.  */
-	  display_flush_filechange (display, DISPLAY_CHANGE_MATRIX);
-	  display->changes.which |= DISPLAY_CHANGE_MATRIX;
-	}
-      display->changes.start = start;
-      display->changes.end = end;
+
+      display_add_damage (display, start, size - 1);
+      display_add_damage (display, 0, end);
     }
+  display->changes.which |= DISPLAY_CHANGE_MATRIX;
 }
-	    
-
+
+/* Start collecting the changes DISPLAY is about to undergo, unless the
+   changes since the last flush are still being collected.  */
+static void
+display_begin_frame (display_t display)
+{
+  if (display->frame_open)
+    return;
+
+  display->changes.cursor.col = display->user->cursor.col;
+  display->changes.cursor.row = display->user->cursor.row;
+  display->changes.cursor.status = display->user->cursor.status;
+  display->changes.screen.cur_line = display->user->screen.cur_line;
+  display->changes.screen.scr_lines = display->user->screen.scr_lines;
+  display->changes.bell_audible = display->user->bell.audible;
+  display->changes.bell_visible = display->user->bell.visible;
+  display->changes.flags = display->user->flags;
+  display->changes.which = ~DISPLAY_CHANGE_MATRIX;
+  display->changes.ndamage = 0;
+  display->frame_open = 1;
+}
+
+/* Flush the changes collected for DISPLAY.  */
+static void
+display_flush_frame (display_t display)
+{
+  struct timespec now;
+
+  display_flush_filechange (display, ~0);
+  display->frame_open = 0;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  display->next_flush.tv_sec = now.tv_sec + frame_interval.tv_sec;
+  display->next_flush.tv_nsec = now.tv_nsec + frame_interval.tv_nsec;
+  if (display->next_flush.tv_nsec >= 1000000000)
+    {
+      display->next_flush.tv_sec++;
+      display->next_flush.tv_nsec -= 1000000000;
+    }
+}
+
+/* Flush the changes collected for DISPLAY if the last flush was at
+   least FRAME_INTERVAL ago, and else have the frame thread flush them
+   when it is.  */
+static void
+display_end_frame (display_t display)
+{
+  struct timespec now;
+
+  if (display->frame_queued)
+    return;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  if (now.tv_sec > display->next_flush.tv_sec
+      || (now.tv_sec == display->next_flush.tv_sec
+	  && now.tv_nsec >= display->next_flush.tv_nsec))
+    {
+      display_flush_frame (display);
+      return;
+    }
+
+  ports_port_ref (display->notify_port);
+  display->frame_queued = 1;
+  display->next_queued = NULL;
+  pthread_mutex_lock (&frame_lock);
+  *frame_queue_tail = display;
+  frame_queue_tail = &display->next_queued;
+  pthread_cond_signal (&frame_wakeup);
+  pthread_mutex_unlock (&frame_lock);
+}
+
+/* A top-level function for the frame thread, which flushes the
+   displays on the frame queue when their frame interval is over.  */
+static void *
+service_frames (void *arg)
+{
+  pthread_mutex_lock (&frame_lock);
+  for (;;)
+    {
+      display_t display;
+      struct timespec deadline;
+
+      while (! frame_queue)
+	pthread_cond_wait (&frame_wakeup, &frame_lock);
+      display = frame_queue;
+      frame_queue = display->next_queued;
+      if (! frame_queue)
+	frame_queue_tail = &frame_queue;
+      pthread_mutex_unlock (&frame_lock);
+
+      pthread_mutex_lock (&display->lock);
+      deadline = display->next_flush;
+      pthread_mutex_unlock (&display->lock);
+      while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline,
+			      NULL) == EINTR)
+	;
+
+      pthread_mutex_lock (&display->lock);
+      display->frame_queued = 0;
+      /* The display may have been destroyed meanwhile.  */
+      if (display->user && display->frame_open)
+	display_flush_frame (display);
+      pthread_mutex_unlock (&display->lock);
+      ports_port_deref (display->notify_port);
+
+      pthread_mutex_lock (&frame_lock);
+    }
+  return NULL;
+}
+
+/* Report the changes to the screen at most every MSECS milliseconds.  */
+void
+display_set_frame_interval (unsigned int msecs)
+{
+  frame_interval.tv_sec = msecs / 1000;
+  frame_interval.tv_nsec = (msecs % 1000) * 1000000;
+}
+
+
 static void
 conchar_memset (conchar_t *conchar, wchar_t chr, conchar_attr_t attr,
 		size_t size)
@@ -960,6 +1110,16 @@ output_init (output_t output, const char *encoding)
   output->cd = iconv_open ("WCHAR_T", encoding);
   if (output->cd == (iconv_t) -1)
     return errno;
+
+  /* Stateful encodings may shift the ASCII bytes to other characters,
+     so only trust the encodings known to be ASCII supersets.  */
+  output->ascii = (! strcasecmp (encoding, "UTF-8")
+		   || ! strcasecmp (encoding, "UTF8")
+		   || ! strcasecmp (encoding, "ASCII")
+		   || ! strcasecmp (encoding, "US-ASCII")
+		   || ! strcasecmp (encoding, "ANSI_X3.4-1968")
+		   || ! strncasecmp (encoding, "ISO-8859-", 9)
+		   || ! strncasecmp (encoding, "ISO8859-", 8));
   return 0;
 }
 
@@ -1778,6 +1938,67 @@ display_output_one (display_t display, wchar_t chr)
     }
 }
 
+/* Output the plain text at the start of the LENGTH bytes at BUFFER, as
+   display_output_one would, and return the number of bytes output.
+   Plain text is printable ASCII characters, carriage returns and line
+   feeds, and is only handled here in the normal parsing state and
+   outside of insert and alternate character set mode.  Characters are
+   stored a line at a time, with one change recorded for each line.  */
+static size_t
+display_output_ascii (display_t display, const char *buffer, size_t length)
+{
+  struct cons_display *user = display->user;
+  size_t i = 0;
+
+  if (!display->output.ascii || display->output.parse.state != STATE_NORMAL
+      || display->insert_mode || display->attr.altchar)
+    return 0;
+
+  while (i < length)
+    {
+      conchar_t *conchar;
+      int line, idx, n;
+
+      if (buffer[i] == '\n')
+	{
+	  linefeed (display);
+	  i++;
+	  continue;
+	}
+      if (buffer[i] == '\r')
+	{
+	  user->cursor.col = 0;
+	  i++;
+	  continue;
+	}
+      if (buffer[i] < ' ' || buffer[i] > '~')
+	break;
+
+      if (user->cursor.col >= user->screen.width)
+	{
+	  user->cursor.col = 0;
+	  linefeed (display);
+	}
+
+      line = (user->screen.cur_line + user->cursor.row) % user->screen.lines;
+      idx = line * user->screen.width + user->cursor.col;
+      conchar = &user->_matrix[idx];
+      for (n = 0; i + n < length
+	     && user->cursor.col + n < user->screen.width
+	     && buffer[i + n] >= ' ' && buffer[i + n] <= '~'; n++)
+	{
+	  conchar[n].chr = buffer[i + n];
+	  conchar[n].attr = display->attr.current;
+	}
+
+      user->cursor.col += n;
+      display_record_filechange (display, idx, idx + n - 1);
+      i += n;
+    }
+
+  return i;
+}
+
 /* Output LENGTH bytes starting from BUFFER in the system encoding.
    Set BUFFER and LENGTH to the new values.  The exact semantics are
    just as in the iconv interface.  */
@@ -1787,15 +2008,7 @@ display_output_some (display_t display, char **buffer, size_t *length)
 #define CONV_OUTBUF_SIZE 256
   error_t err = 0;
 
-  display->changes.cursor.col = display->user->cursor.col;
-  display->changes.cursor.row = display->user->cursor.row;
-  display->changes.cursor.status = display->user->cursor.status;
-  display->changes.screen.cur_line = display->user->screen.cur_line;
-  display->changes.screen.scr_lines = display->user->screen.scr_lines;
-  display->changes.bell_audible = display->user->bell.audible;
-  display->changes.bell_visible = display->user->bell.visible;
-  display->changes.flags = display->user->flags;
-  display->changes.which = ~DISPLAY_CHANGE_MATRIX;
+  display_begin_frame (display);
 
   while (!err && *length > 0)
     {
@@ -1806,6 +2019,12 @@ display_output_some (display_t display, char **buffer, size_t *length)
       error_t saved_err;
       int i;
 
+      nconv = display_output_ascii (display, *buffer, *length);
+      *buffer += nconv;
+      *length -= nconv;
+      if (*length == 0)
+	break;
+
       nconv = iconv (display->output.cd, buffer, length, &outptr, &outsize);
       saved_err = errno;
 
@@ -1834,7 +2053,7 @@ display_output_some (display_t display, char **buffer, size_t *length)
 	}
     }
 
-  display_flush_filechange (display, ~0);
+  display_end_frame (display);
   return err;
 }
 
@@ -1866,6 +2085,15 @@ display_init (void)
       errno = err;
       perror ("pthread_create");
     }
+
+  err = pthread_create (&thread, NULL, service_frames, NULL);
+  if (!err)
+    pthread_detach (thread);
+  else
+    {
+      errno = err;
+      perror ("pthread_create");
+    }
 }
 
 
@@ -1937,6 +2165,7 @@ display_destroy (display_t display)
   ports_destroy_right (display->notify_port);
   output_deinit (&display->output);
   user_destroy (display);
+  display->user = NULL;
   pthread_mutex_unlock (&display->lock);
 
   /* We can not free the display structure here, because it might
@@ -2131,6 +2360,8 @@ display_start_output (display_t display)
       display->output.stopped = 0;
       pthread_cond_broadcast (&display->output.resumed);
     }
+  if (display->frame_open)
+    display_flush_frame (display);
   display->changes.flags = display->user->flags;
   display->changes.which = DISPLAY_CHANGE_FLAGS;
   display->user->flags &= ~CONS_FLAGS_SCROLL_LOCK;
@@ -2145,6 +2376,8 @@ display_stop_output (display_t display)
 {
   pthread_mutex_lock (&display->lock);
   display->output.stopped = 1;
+  if (display->frame_open)
+    display_flush_frame (display);
   display->changes.flags = display->user->flags;
   display->changes.which = DISPLAY_CHANGE_FLAGS;
   display->user->flags |= CONS_FLAGS_SCROLL_LOCK;
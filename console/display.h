@@ -28,6 +28,9 @@ typedef struct display *display_t;
 
 void display_init (void);
 
+/* Report the changes to the screen at most every MSECS milliseconds.  */
+void display_set_frame_interval (unsigned int msecs);
+
 /* Create a new virtual console display, with the system encoding
    being ENCODING and the default colors being FOREGROUND and BACKGROUND.  */
 error_t
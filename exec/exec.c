@@ -450,6 +450,7 @@ prepare (file_t file, struct execdata *e)
   e->cntlmap = MACH_PORT_NULL;
 
   e->interp.section = NULL;
+  e->have_mtime = 0;
 
   e->start_code = 0;
   e->end_code = 0;
@@ -519,6 +520,10 @@ prepare (file_t file, struct execdata *e)
       if (e->error)
 	return;
       e->file_size = st.st_size;
+      e->file_mtime = st.st_mtim;
+      e->file_dev = st.st_dev;
+      e->file_ino = st.st_ino;
+      e->have_mtime = 1;
       e->optimal_block = st.st_blksize;
     }
 }
@@ -582,7 +587,7 @@ check_elf (struct execdata *e)
       return;
     }
   e->info.elf.phdr = phdr;
-  e->info.elf.phdr_addr = ehdr->e_phoff;
+  e->info.elf.phoff = e->info.elf.phdr_addr = ehdr->e_phoff;
 }
 
 /* Copy MAPPED_PHDR into E->info.elf.phdr, filling in E->interp.phdr
@@ -762,6 +767,8 @@ load (task_t usertask, struct execdata *e, vm_offset_t anywhere_start)
 	      anywhere_start = end;
 	  }
 
+      prefault (e);
+
       /* The entry point address is relative to wherever we loaded the
 	 program text.  */
       e->entry += e->info.elf.loadbase;
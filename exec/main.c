@@ -106,12 +106,16 @@ deadboot (void *p)
 }
 
 #define OPT_DEVICE_MASTER_PORT	(-1)
+#define OPT_PREFAULT		(-2)
 
 static const struct argp_option options[] =
 {
   {"device-master-port", OPT_DEVICE_MASTER_PORT, "PORT", 0,
    "If specified, a boot-time exec server can print "
    "diagnostic messages earlier.", 0},
+  {"prefault", OPT_PREFAULT, "BYTES", 0,
+   "Fault in up to BYTES of the pages each program needs at startup "
+   "before running it (default 0, don't).", 0},
   {0}
 };
 
@@ -130,6 +134,10 @@ parse_opt (int opt, char *arg, struct argp_state *state)
     case OPT_DEVICE_MASTER_PORT:
       opt_device_master = atoi (arg);
       break;
+
+    case OPT_PREFAULT:
+      prefault_limit = strtoul (arg, 0, 0);
+      break;
     }
   return 0;
 }
@@ -154,6 +162,17 @@ trivfs_append_args (struct trivfs_control *fsys,
 	}
     }
 
+  if (! err && prefault_limit > 0)
+    {
+      asprintf (&opt, "--prefault=%zu", prefault_limit);
+
+      if (opt)
+	{
+	  err = argz_add (argz, argz_len, opt);
+	  free (opt);
+	}
+    }
+
   return err;
 }
 
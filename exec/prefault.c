@@ -0,0 +1,331 @@
+/* GNU Hurd standard exec server, prefaulting of program startup pages.
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd; see the file COPYING.  If not, write to
+   the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* load_section maps the segments of a program into the new task, which
+   then faults in every page it touches, each fault being a round trip
+   to the file's pager.  Before the program runs, the dynamic linker
+   reads its program headers, symbol, string, hash, version and
+   relocation tables, and then it jumps to the entry point.  All of
+   those are in read-only segments, so with --prefault we fault them in
+   from here: they end up in the memory object, where the new task's
+   faults find them without asking the pager.  We map each of these
+   ranges at once, so the kernel may ask the pager for several pages in
+   a single request.
+
+   The ranges are found from the headers and the dynamic section, which
+   needs reading the file, so they are remembered for the files executed
+   recently and reused on the next exec of the same file.  At most
+   PREFAULT_LIMIT bytes are faulted in per file.  */
+
+#include "priv.h"
+#include <hurd/sigpreempt.h>
+
+size_t prefault_limit;
+
+/* The working sets of recently executed files, keyed by the fsid and
+   inode number, size and modification time that io_stat returned for
+   them.  Any translator can claim any key, but all a wrong working set
+   makes us do is fault in other pages of the file at hand, so the key
+   is trusted.  */
+#define WORKING_SET_CACHE_SIZE	32
+
+struct working_set
+  {
+    dev_t file_dev;
+    ino_t file_ino;
+    off_t file_size;
+    struct timespec file_mtime;
+    unsigned long last_use;	/* Zero if the slot is empty.  */
+    int n;
+    struct exec_range ranges[EXEC_WORKING_SET_MAX];
+  };
+
+static struct working_set cache[WORKING_SET_CACHE_SIZE];
+static unsigned long use_clock;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Copy the working set remembered for the file in E, if any, to WS and
+   return its number of ranges; return -1 if there is none.  */
+static int
+lookup_working_set (const struct execdata *e, struct exec_range *ws)
+{
+  int i, n = -1;
+
+  if (! e->have_mtime)
+    return -1;
+
+  pthread_mutex_lock (&cache_lock);
+  for (i = 0; i < WORKING_SET_CACHE_SIZE; i++)
+    if (cache[i].last_use
+	&& cache[i].file_dev == e->file_dev
+	&& cache[i].file_ino == e->file_ino
+	&& cache[i].file_size == e->file_size
+	&& cache[i].file_mtime.tv_sec == e->file_mtime.tv_sec
+	&& cache[i].file_mtime.tv_nsec == e->file_mtime.tv_nsec)
+      {
+	cache[i].last_use = ++use_clock;
+	n = cache[i].n;
+	memcpy (ws, cache[i].ranges, n * sizeof *ws);
+	break;
+      }
+  pthread_mutex_unlock (&cache_lock);
+  return n;
+}
+
+/* Remember WS, N ranges long, as the working set of the file in E.  */
+static void
+remember_working_set (const struct execdata *e,
+		      const struct exec_range *ws, int n)
+{
+  int i, victim;
+
+  if (! e->have_mtime)
+    return;
+
+  pthread_mutex_lock (&cache_lock);
+
+  /* Replace an older version of the same file if there is one, else
+     the least recently used entry, which may be an empty one.  */
+  for (victim = i = 0; i < WORKING_SET_CACHE_SIZE; i++)
+    {
+      if (cache[i].last_use
+	  && cache[i].file_dev == e->file_dev
+	  && cache[i].file_ino == e->file_ino)
+	{
+	  victim = i;
+	  break;
+	}
+      if (cache[i].last_use < cache[victim].last_use)
+	victim = i;
+    }
+
+  cache[victim].file_dev = e->file_dev;
+  cache[victim].file_ino = e->file_ino;
+  cache[victim].file_size = e->file_size;
+  cache[victim].file_mtime = e->file_mtime;
+  cache[victim].last_use = ++use_clock;
+  cache[victim].n = n;
+  memcpy (cache[victim].ranges, ws, n * sizeof *ws);
+
+  pthread_mutex_unlock (&cache_lock);
+}
+
+/* Add the part of the LEN bytes at file offset OFFSET of E that is in a
+   read-only loaded segment to WS, which has *N ranges sorted by offset,
+   merging it with those it overlaps or touches.  */
+static void
+add_range (const struct execdata *e, struct exec_range *ws, int *n,
+	   off_t offset, size_t len)
+{
+  const ElfW(Phdr) *ph;
+  off_t start, end;
+  int i, j;
+
+  for (ph = e->info.elf.phdr; ph < &e->info.elf.phdr[e->info.elf.phnum]; ph++)
+    if (ph->p_type == PT_LOAD && ! (ph->p_flags & PF_W)
+	&& offset >= ph->p_offset && offset < ph->p_offset + ph->p_filesz)
+      break;
+  if (ph == &e->info.elf.phdr[e->info.elf.phnum] || len == 0)
+    return;
+
+  start = trunc_page (offset);
+  end = round_page (MIN (offset + len, ph->p_offset + ph->p_filesz));
+
+  for (i = 0; i < *n && ws[i].offset + (off_t) ws[i].size < start; i++)
+    ;
+  /* Merge with ranges I to J - 1.  */
+  for (j = i; j < *n && ws[j].offset <= end; j++)
+    {
+      start = MIN (start, ws[j].offset);
+      end = MAX (end, ws[j].offset + (off_t) ws[j].size);
+    }
+  if (i == j)
+    {
+      if (*n == EXEC_WORKING_SET_MAX)
+	return;
+      memmove (&ws[i + 1], &ws[i], (*n - i) * sizeof *ws);
+      ++*n;
+    }
+  else
+    {
+      memmove (&ws[i + 1], &ws[j], (*n - j) * sizeof *ws);
+      *n -= j - i - 1;
+    }
+  ws[i].offset = start;
+  ws[i].size = end - start;
+}
+
+/* Add the LEN bytes at virtual address VADDR of E to WS.  */
+static void
+add_vaddr (const struct execdata *e, struct exec_range *ws, int *n,
+	   ElfW(Addr) vaddr, size_t len)
+{
+  const ElfW(Phdr) *ph;
+
+  for (ph = e->info.elf.phdr; ph < &e->info.elf.phdr[e->info.elf.phnum]; ph++)
+    if (ph->p_type == PT_LOAD
+	&& vaddr >= ph->p_vaddr && vaddr < ph->p_vaddr + ph->p_filesz)
+      {
+	add_range (e, ws, n, ph->p_offset + (vaddr - ph->p_vaddr), len);
+	return;
+      }
+}
+
+/* Find the working set of E from its headers and dynamic section.
+   Return the number of ranges stored in WS.  */
+static int
+find_working_set (struct execdata *e, struct exec_range *ws)
+{
+  const ElfW(Phdr) *ph;
+  int n = 0;
+
+  add_range (e, ws, &n, e->info.elf.phoff,
+	     e->info.elf.phnum * sizeof (ElfW(Phdr)));
+  add_vaddr (e, ws, &n, e->entry, vm_page_size);
+
+  for (ph = e->info.elf.phdr; ph < &e->info.elf.phdr[e->info.elf.phnum]; ph++)
+    if (ph->p_type == PT_DYNAMIC)
+      {
+	const ElfW(Dyn) *first, *dyn, *end;
+	ElfW(Addr) lo = -1, hi = 0, strtab = 0, rel = 0, rela = 0, jmprel = 0;
+
+	first = map (e, ph->p_offset, ph->p_filesz);
+	if (! first)
+	  break;
+	end = first + ph->p_filesz / sizeof *first;
+
+	/* The tables the dynamic linker reads are usually laid out
+	   together, in the order of the cases below; take the extent of
+	   them all, as far as their sizes are known.  XXX/fault  */
+	for (dyn = first; dyn < end && dyn->d_tag != DT_NULL; dyn++)
+	  switch (dyn->d_tag)
+	    {
+	    case DT_HASH:
+	    case DT_GNU_HASH:
+	    case DT_SYMTAB:
+	    case DT_VERSYM:
+	    case DT_VERNEED:
+	    case DT_VERDEF:
+	      lo = MIN (lo, dyn->d_un.d_ptr);
+	      break;
+	    case DT_STRTAB:
+	      strtab = dyn->d_un.d_ptr;
+	      break;
+	    case DT_REL:
+	      rel = dyn->d_un.d_ptr;
+	      break;
+	    case DT_RELA:
+	      rela = dyn->d_un.d_ptr;
+	      break;
+	    case DT_JMPREL:
+	      jmprel = dyn->d_un.d_ptr;
+	      break;
+	    }
+
+	for (dyn = first; dyn < end && dyn->d_tag != DT_NULL; dyn++)
+	  {
+	    ElfW(Addr) start;
+
+	    switch (dyn->d_tag)
+	      {
+	      case DT_STRSZ:
+		start = strtab;
+		break;
+	      case DT_RELSZ:
+		start = rel;
+		break;
+	      case DT_RELASZ:
+		start = rela;
+		break;
+	      case DT_PLTRELSZ:
+		start = jmprel;
+		break;
+	      default:
+		continue;
+	      }
+	    if (start == 0)
+	      continue;
+	    lo = MIN (lo, start);
+	    hi = MAX (hi, start + dyn->d_un.d_val);
+	  }
+
+	if (lo < hi)
+	  add_vaddr (e, ws, &n, lo, hi - lo);
+	break;
+      }
+
+  return n;
+}
+
+/* Fault in the pages of E that the program will need at startup.  Call
+   this after loading E, before releasing its file.  */
+void
+prefault (struct execdata *e)
+{
+  struct exec_range ws[EXEC_WORKING_SET_MAX];
+  size_t budget = prefault_limit;
+  int i, n;
+
+  if (prefault_limit == 0 || e->error
+      || e->filemap == MACH_PORT_NULL || e->file_data != NULL)
+    return;
+
+  n = lookup_working_set (e, ws);
+  if (n < 0)
+    {
+      n = find_working_set (e, ws);
+      if (e->error)
+	{
+	  /* Not being able to read the dynamic section is no reason to
+	     fail the exec; the program will find out if it is bad.  */
+	  e->error = 0;
+	  return;
+	}
+      remember_working_set (e, ws, n);
+    }
+
+  for (i = 0; i < n && budget > 0; i++)
+    {
+      vm_address_t addr = 0;
+      vm_size_t size = MIN (ws[i].size, trunc_page (budget));
+
+      error_t touch (struct hurd_signal_preemptor *preemptor)
+	{
+	  volatile const char *p;
+
+	  for (p = (const char *) addr; p < (const char *) addr + size;
+	       p += vm_page_size)
+	    (void) *p;
+	  return 0;
+	}
+
+      if (size == 0)
+	break;
+      budget -= size;
+
+      if (vm_map (mach_task_self (), &addr, size, 0, 1,
+		  e->filemap, ws[i].offset, 0, VM_PROT_READ, VM_PROT_READ,
+		  VM_INHERIT_NONE))
+	break;
+      /* A page we can't read is the program's problem, not ours.  */
+      hurd_catch_signal (sigmask (SIGSEGV) | sigmask (SIGBUS),
+			 addr, addr + size, &touch, SIG_ERR);
+      munmap ((caddr_t) addr, size);
+    }
+}
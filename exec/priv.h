@@ -64,6 +64,16 @@ extern mach_port_t procserver;	/* Our proc port.  */
 
 typedef void asection;
 
+/* A page-aligned range of a file.  */
+struct exec_range
+  {
+    off_t offset;
+    size_t size;
+  };
+
+/* Maximum number of ranges in the working set of a program.  */
+#define EXEC_WORKING_SET_MAX	8
+
 /* Data shared between check, check_section,
    load, load_section, and finish.  */
 struct execdata
@@ -100,6 +110,10 @@ struct execdata
     struct shared_io *cntl;
     char *file_data;		/* File data if already copied in core.  */
     off_t file_size;
+    struct timespec file_mtime;	/* Valid if HAVE_MTIME.  */
+    dev_t file_dev;		/* Likewise.  */
+    ino_t file_ino;		/* Likewise.  */
+    int have_mtime;
     size_t optimal_block;	/* Optimal size for io_read from file.  */
 
     /* Set by caller of load.  */
@@ -113,6 +127,7 @@ struct execdata
 	       After `check' this is a pointer into the mapping window.
 	       By `load' it is local alloca'd storage.  */
 	    ElfW(Phdr) *phdr;
+	    ElfW(Off) phoff;	/* File offset of the program header table.  */
 	    ElfW(Addr) phdr_addr;
 	    ElfW(Word) phnum;	/* Number of program header table elements.  */
 	    int anywhere;	/* Nonzero if image can go anywhere.  */
@@ -131,6 +146,10 @@ void finish (struct execdata *, int dealloc_file_port);
    a pointer into the window corresponding to POSN.  */
 void *map (struct execdata *e, off_t posn, size_t len);
 
+/* Prefaulting of the pages programs need at startup, in prefault.c.  */
+extern size_t prefault_limit;
+void prefault (struct execdata *e);
+
 
 void check_hashbang (struct execdata *e,
 		     file_t file,
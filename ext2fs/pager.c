@@ -162,6 +162,52 @@ find_block (struct node *node, vm_offset_t offset,
   return err;
 }
 
+/* Implement the diskfs_map_block_hook callback from the diskfs library;
+   see <hurd/diskfs.h> for the interface description.  */
+static error_t
+ext2_map_block (struct node *node, off_t offset, struct store **st,
+		off_t *addr, size_t *len)
+{
+  block_t block = offset >> log2_block_size;
+  size_t in_block = offset & (block_size - 1);
+  size_t wanted = *len;
+  block_t disk_block, next;
+  error_t err;
+
+  *st = store;
+  pthread_rwlock_rdlock (&diskfs_node_disknode (node)->alloc_lock);
+
+  err = ext2_getblk (node, block, 0, &disk_block);
+  if (err == EINVAL)
+    {
+      *addr = -1;
+      *len = block_size - in_block;
+      err = 0;
+    }
+  else if (! err)
+    {
+      *addr = ((off_t) disk_block << log2_block_size) + in_block;
+      *len = block_size - in_block;
+      /* Take in the following blocks as long as they follow on disk.  */
+      while (*len < wanted
+	     && ((off_t) (block + 1) << log2_block_size) < node->allocsize
+	     && ext2_getblk (node, block + 1, 0, &next) == 0
+	     && next == disk_block + 1)
+	{
+	  block++;
+	  disk_block++;
+	  *len += block_size;
+	}
+    }
+
+  pthread_rwlock_unlock (&diskfs_node_disknode (node)->alloc_lock);
+  return err;
+}
+
+error_t (*diskfs_map_block_hook) (struct node *np, off_t offset,
+				  struct store **store, off_t *addr,
+				  size_t *len) = ext2_map_block;
+
 /* Read one page for the pager backing NODE at offset PAGE, into BUF.  This
    may need to read several filesystem blocks to satisfy one page, and tries
    to consolidate the i/o if possible.  */
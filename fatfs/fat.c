@@ -53,8 +53,9 @@ cluster_t nr_of_clusters;
 /* Hold this lock while converting times using gmtime.  */
 pthread_spinlock_t epoch_to_time_lock = PTHREAD_SPINLOCK_INITIALIZER;
 
-/* Hold this lock while allocating a new cluster in the FAT.  */
-pthread_spinlock_t allocate_free_cluster_lock = PTHREAD_SPINLOCK_INITIALIZER;
+/* Hold this lock while allocating a new cluster in the FAT, or using
+   the free cluster bitmap.  */
+pthread_mutex_t allocate_free_cluster_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /* Where to look for the next free cluster. This is meant to avoid
    searching through a nearly full file system from the beginning at
@@ -63,6 +64,14 @@ pthread_spinlock_t allocate_free_cluster_lock = PTHREAD_SPINLOCK_INITIALIZER;
    FAT.  */
 cluster_t next_free_cluster = 2;
 
+/* One bit per cluster, set if the cluster is free, so that allocating
+   a cluster and counting the free ones don't have to read the whole
+   FAT.  It is built from the FAT the first time it is needed, and
+   fat_write_next_cluster keeps it up to date.  */
+#define BITS_PER_WORD (CHAR_BIT * sizeof (unsigned long))
+static unsigned long *free_bitmap;
+static cluster_t nr_free_clusters;
+
 
 /* Read the superblock.  */
 void
@@ -204,11 +213,10 @@ fat_read_sblock (void)
 }
 
 
-/* Write NEXT_CLUSTER in the FAT at position CLUSTER.
-   You must call this from inside diskfs_catch_exception.
-   Returns 0 (always succeeds).  */
-error_t
-fat_write_next_cluster(cluster_t cluster, cluster_t next_cluster)
+/* Write NEXT_CLUSTER in the FAT at position CLUSTER, without updating
+   the free cluster bitmap.  */
+static void
+write_fat_entry (cluster_t cluster, cluster_t next_cluster)
 {
   loff_t fat_entry_offset;
   cluster_t data;
@@ -254,8 +262,51 @@ fat_write_next_cluster(cluster_t cluster, cluster_t next_cluster)
       fat_entry_offset = cluster * 4;
       write_dword (fat_image + fat_entry_offset, next_cluster & 0x0fffffff);
     }
+}
 
-  return 0;
+/* Write NEXT_CLUSTER in the FAT at position CLUSTER, with
+   ALLOCATE_FREE_CLUSTER_LOCK held.  Writing the FAT can fault, so catch
+   that here rather than leave the lock held; return the error.  */
+static error_t
+write_fat_entry_locked (cluster_t cluster, cluster_t next_cluster)
+{
+  error_t err;
+
+  err = diskfs_catch_exception ();
+  if (!err)
+    write_fat_entry (cluster, next_cluster);
+  diskfs_end_catch_exception ();
+  return err;
+}
+
+/* Write NEXT_CLUSTER in the FAT at position CLUSTER.
+   Returns 0 on success, or the error from writing the FAT.  */
+error_t
+fat_write_next_cluster(cluster_t cluster, cluster_t next_cluster)
+{
+  error_t err;
+
+  pthread_mutex_lock (&allocate_free_cluster_lock);
+  err = write_fat_entry_locked (cluster, next_cluster);
+  if (!err && free_bitmap)
+    {
+      unsigned long *word = &free_bitmap[cluster / BITS_PER_WORD];
+      unsigned long bit = 1UL << (cluster % BITS_PER_WORD);
+
+      if (next_cluster == FAT_FREE_CLUSTER && !(*word & bit))
+	{
+	  *word |= bit;
+	  nr_free_clusters++;
+	}
+      else if (next_cluster != FAT_FREE_CLUSTER && (*word & bit))
+	{
+	  *word &= ~bit;
+	  nr_free_clusters--;
+	}
+    }
+  pthread_mutex_unlock (&allocate_free_cluster_lock);
+
+  return err;
 }
 
 /* Read the FAT entry at position CLUSTER into NEXT_CLUSTER.
@@ -308,58 +359,177 @@ fat_get_next_cluster(cluster_t cluster, cluster_t *next_cluster)
   return 0;
 }
 
+/* Build the free cluster bitmap from the FAT if that wasn't done yet.
+   ALLOCATE_FREE_CLUSTER_LOCK must be held.  Faults while reading the
+   FAT are caught here, so that the lock is not left held and no
+   partial bitmap is kept; they are returned as errors.  */
+static error_t
+build_free_bitmap (void)
+{
+  cluster_t cluster, next_cluster;
+  error_t err;
+
+  if (free_bitmap)
+    return 0;
+
+  free_bitmap = calloc ((nr_of_clusters + 2 + BITS_PER_WORD - 1)
+			/ BITS_PER_WORD, sizeof *free_bitmap);
+  if (!free_bitmap)
+    return ENOMEM;
+
+  err = diskfs_catch_exception ();
+  if (!err)
+    /* First cluster is the 3rd entry in the FAT table.  */
+    for (cluster = 2; cluster < nr_of_clusters + 2; cluster++)
+      {
+	fat_get_next_cluster (cluster, &next_cluster);
+	if (next_cluster == FAT_FREE_CLUSTER)
+	  {
+	    free_bitmap[cluster / BITS_PER_WORD]
+	      |= 1UL << (cluster % BITS_PER_WORD);
+	    nr_free_clusters++;
+	  }
+      }
+  diskfs_end_catch_exception ();
+
+  if (err)
+    {
+      free (free_bitmap);
+      free_bitmap = 0;
+      nr_free_clusters = 0;
+    }
+  return err;
+}
+
+/* Return the first free cluster from FROM up to but not including TO,
+   or FAT_FREE_CLUSTER if there is none.  */
+static cluster_t
+find_free_cluster (cluster_t from, cluster_t to)
+{
+  cluster_t i = from / BITS_PER_WORD;
+  unsigned long word;
+
+  if (from >= to)
+    return FAT_FREE_CLUSTER;
+
+  word = free_bitmap[i] & (~0UL << (from % BITS_PER_WORD));
+  while (!word)
+    {
+      if (++i * BITS_PER_WORD >= to)
+	return FAT_FREE_CLUSTER;
+      word = free_bitmap[i];
+    }
+
+  from = i * BITS_PER_WORD + __builtin_ctzl (word);
+  return from < to ? from : FAT_FREE_CLUSTER;
+}
+
 /* Allocate a new cluster, write CONTENT into the FAT at this new
-   clusters position.  At success, 0 is returned and CLUSTER contains
-   the cluster number allocated.  Otherwise, ENOSPC is returned if the
-   filesystem is full.
-   You must call this from inside diskfs_catch_exception.  */
+   clusters position.  Prefer the cluster GOAL, or else the first free
+   cluster after it, if GOAL is a valid cluster number, so that a file
+   that grows stays contiguous.  At success, 0 is returned and CLUSTER
+   contains the cluster number allocated.  Otherwise, ENOSPC is
+   returned if the filesystem is full, or the error from reading or
+   writing the FAT.  */
 error_t
-fat_allocate_cluster (cluster_t content, cluster_t *cluster)
+fat_allocate_cluster (cluster_t content, cluster_t goal, cluster_t *cluster)
 {
-  error_t err = 0;
-  cluster_t old_next_free_cluster;
-  int wrapped = 0;
-  cluster_t found_cluster = FAT_FREE_CLUSTER;
+  error_t err;
+  cluster_t found_cluster;
 
   assert_backtrace (content != FAT_FREE_CLUSTER);
 
-  pthread_spin_lock (&allocate_free_cluster_lock);
-  old_next_free_cluster = next_free_cluster;
+  pthread_mutex_lock (&allocate_free_cluster_lock);
 
-  /* Loop over all clusters, starting from next_free_cluster and
-     wrapping if reaching the end of the FAT, until we either find an
-     unallocated cluster, or we have to give up because all clusters
-     are allocated.  */
-  do
+  err = build_free_bitmap ();
+  if (err)
     {
-      cluster_t next_free_content;
-
-      fat_get_next_cluster (next_free_cluster, &next_free_content);
+      pthread_mutex_unlock (&allocate_free_cluster_lock);
+      return err;
+    }
 
-      if (next_free_content == FAT_FREE_CLUSTER)
-	found_cluster = next_free_cluster;
+  if (goal < 2 || goal >= nr_of_clusters + 2)
+    goal = next_free_cluster;
 
-      if (++next_free_cluster == nr_of_clusters + 2)
-	{
-	  next_free_cluster = 2;
-	  wrapped = 1;
-	}
-    }
-  while (found_cluster == FAT_FREE_CLUSTER
-	 && !(wrapped && next_free_cluster == old_next_free_cluster));
+  /* Search from GOAL to the end of the FAT, and then wrap.  */
+  found_cluster = find_free_cluster (goal, nr_of_clusters + 2);
+  if (found_cluster == FAT_FREE_CLUSTER)
+    found_cluster = find_free_cluster (2, goal);
 
   if (found_cluster != FAT_FREE_CLUSTER)
     {
-      *cluster = found_cluster;
-      fat_write_next_cluster(found_cluster, content);
+      err = write_fat_entry_locked (found_cluster, content);
+      if (!err)
+	{
+	  free_bitmap[found_cluster / BITS_PER_WORD]
+	    &= ~(1UL << (found_cluster % BITS_PER_WORD));
+	  nr_free_clusters--;
+	  next_free_cluster = found_cluster + 1;
+	  if (next_free_cluster == nr_of_clusters + 2)
+	    next_free_cluster = 2;
+
+	  *cluster = found_cluster;
+	}
     }
   else 
     err = ENOSPC;
 
-  pthread_spin_unlock (&allocate_free_cluster_lock);
+  pthread_mutex_unlock (&allocate_free_cluster_lock);
   return err;
 }
 
+/* Append the disk cluster CLUSTER to the chain of DN.
+   DN->chain_extension_lock must be held.  */
+static error_t
+append_to_chain (struct disknode *dn, cluster_t cluster)
+{
+  struct cluster_run *run = dn->nr_runs ? &dn->runs[dn->nr_runs - 1] : 0;
+
+  if (run && run->disk_cluster + run->length == cluster)
+    run->length++;
+  else
+    {
+      if (dn->nr_runs == dn->alloc_runs)
+	{
+	  size_t n = dn->alloc_runs ? 2 * dn->alloc_runs : 4;
+	  struct cluster_run *new = realloc (dn->runs, n * sizeof *new);
+	  if (!new)
+	    return ENOMEM;
+	  dn->runs = new;
+	  dn->alloc_runs = n;
+	}
+      run = &dn->runs[dn->nr_runs++];
+      run->file_cluster = dn->length_of_chain;
+      run->disk_cluster = cluster;
+      run->length = 1;
+    }
+
+  dn->length_of_chain++;
+  return 0;
+}
+
+/* Return the index in DN->runs of the run holding cluster CLUSTER of
+   the file, which must be less than DN->length_of_chain.  */
+static size_t
+find_run (struct disknode *dn, cluster_t cluster)
+{
+  size_t lo = 0, hi = dn->nr_runs;
+
+  assert_backtrace (cluster < dn->length_of_chain);
+
+  /* The run we look for is the last one starting at or before
+     CLUSTER; it is in [LO, HI).  */
+  while (hi - lo > 1)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+      if (dn->runs[mid].file_cluster <= cluster)
+	lo = mid;
+      else
+	hi = mid;
+    }
+  return lo;
+}
+
 /* Extend the cluster chain to maximum size or new_last_cluster,
    whatever is less. If we reach the end of the file, and CREATE is
    true, allocate new blocks until there is either no space on the
@@ -370,60 +540,43 @@ fat_extend_chain (struct node *node, cluster_t new_last_cluster, int create)
 {
   error_t err = 0;
   struct disknode *dn = node->dn;
-  struct cluster_chain *table;
-  int offs;
   cluster_t left, prev_cluster, cluster;
 
-  error_t allocate_new_table(struct cluster_chain **table)
-    {
-      struct cluster_chain *t;
-
-      t = *table;
-      *table = malloc (sizeof (struct cluster_chain));
-      if (!*table)
-	return ENOMEM;
-      (*table)->next = 0;
-      if (t)
-	dn->last = t->next = *table;
-      else
-	dn->last = dn->first = *table;
-      return 0;
-    }
-  
-  pthread_spin_lock (&dn->chain_extension_lock);
+  pthread_mutex_lock (&dn->chain_extension_lock);
 
   /* If we already have what we need, or we have all clusters that are
      available without allocating new ones, go out.  */
   if (new_last_cluster < dn->length_of_chain
       || (!create && dn->chain_complete))
     {
-      pthread_spin_unlock (&dn->chain_extension_lock);
+      pthread_mutex_unlock (&dn->chain_extension_lock);
       return 0;
     }
 
   left = new_last_cluster + 1 - dn->length_of_chain;
 
-  table = dn->last;
-  if (table)
+  if (dn->nr_runs)
     {
-      offs = (dn->length_of_chain - 1) & (CLUSTERS_PER_TABLE - 1);
-      prev_cluster = table->cluster[offs];
+      struct cluster_run *run = &dn->runs[dn->nr_runs - 1];
+      prev_cluster = run->disk_cluster + run->length - 1;
     }
   else
-    {
-      offs = CLUSTERS_PER_TABLE - 1;
-      prev_cluster = FAT_FREE_CLUSTER;
-    }
+    prev_cluster = FAT_FREE_CLUSTER;
 
    while (left)
      {
        if (dn->chain_complete)
 	 {
-	   err = fat_allocate_cluster(FAT_EOC, &cluster);
+	   err = fat_allocate_cluster(FAT_EOC, prev_cluster + 1, &cluster);
 	   if (err)
 	     break;
 	   if (prev_cluster)
-	     fat_write_next_cluster(prev_cluster, cluster);
+	     {
+	       err = fat_write_next_cluster (prev_cluster, cluster);
+	       if (err)
+		 /* CLUSTER is lost until the next fsck.  */
+		 break;
+	     }
 	   else
 	     /* XXX: Also write this to dirent structure!  */
 	     dn->start_cluster = cluster;
@@ -444,23 +597,16 @@ fat_extend_chain (struct node *node, cluster_t new_last_cluster, int create)
 	     }
 	 }
        prev_cluster = cluster;
-       offs++;
-       if (offs == CLUSTERS_PER_TABLE)
-	 {
-	   offs = 0;
-	   err = allocate_new_table(&table);
-	   if (err)
-	     break;
-	 }
-       table->cluster[offs] = cluster;
-       dn->length_of_chain++;
+       err = append_to_chain (dn, cluster);
+       if (err)
+	 break;
        left--;
      }
 
    if (dn->length_of_chain << log2_bytes_per_cluster > node->allocsize)
      node->allocsize = dn->length_of_chain << log2_bytes_per_cluster;
 
-   pthread_spin_unlock (&dn->chain_extension_lock);
+   pthread_mutex_unlock (&dn->chain_extension_lock);
    return err;
 }
    
@@ -472,39 +618,35 @@ fat_getcluster (struct node *node, cluster_t cluster, int create,
 		cluster_t *disk_cluster)
 {
   error_t err = 0;
-  cluster_t chains_to_go = cluster >> LOG2_CLUSTERS_PER_TABLE;
-  cluster_t offs = cluster & (CLUSTERS_PER_TABLE - 1);
-  struct cluster_chain *chain;
+  struct disknode *dn = node->dn;
+  struct cluster_run *run;
 
-  if (cluster >= node->dn->length_of_chain)
+  if (cluster >= dn->length_of_chain)
     {
       err = fat_extend_chain (node, cluster, create);
       if (err)
 	return err;
-      if (cluster >= node->dn->length_of_chain)
+      if (cluster >= dn->length_of_chain)
 	{
 	  assert_backtrace (!create);
 	  return EINVAL;
 	}
     }
-  chain = node->dn->first;
-  while (chains_to_go--)
-    {
-      assert_backtrace (chain);
-      chain = chain->next;
-    }
-  assert_backtrace (chain);
-  *disk_cluster = chain->cluster[offs];
+
+  pthread_mutex_lock (&dn->chain_extension_lock);
+  run = &dn->runs[find_run (dn, cluster)];
+  *disk_cluster = run->disk_cluster + (cluster - run->file_cluster);
+  pthread_mutex_unlock (&dn->chain_extension_lock);
   return 0;
 }
 
-void
+error_t
 fat_truncate_node (struct node *node, cluster_t clusters_to_keep)
 {
-  struct cluster_chain *next;
-  cluster_t count;
+  struct disknode *dn = node->dn;
+  size_t first_run, i;
   cluster_t offs;
-  cluster_t pos;
+  error_t err;
 
   /* The root dir of a FAT12/16 fs is of fixed size, while the root
      dir of a FAT32 fs must never decease to exist.  */
@@ -512,78 +654,58 @@ fat_truncate_node (struct node *node, cluster_t clusters_to_keep)
 	     || (fat_type == FAT32 && node == diskfs_root_node && clusters_to_keep == 0)));
 
   /* Expand the cluster chain, because we have to know the complete tail.  */
-  fat_extend_chain (node, FAT_EOC, 0);
-  if (clusters_to_keep == node->dn->length_of_chain)
-    return;
-  assert_backtrace (clusters_to_keep < node->dn->length_of_chain);
+  err = fat_extend_chain (node, FAT_EOC, 0);
+  if (err)
+    return err;
+  if (clusters_to_keep == dn->length_of_chain)
+    return 0;
+  assert_backtrace (clusters_to_keep < dn->length_of_chain);
 
   /* Truncation happens here.  */
-  next = node->dn->first;
   if (clusters_to_keep == 0)
     {
       /* Deallocate the complete file.  */
-      node->dn->start_cluster = 0;
-      pos = count = offs = 0;
-      node->dn->last = 0;
+      dn->start_cluster = 0;
+      first_run = 0;
     }
   else
     {
-      count = (clusters_to_keep - 1) >> LOG2_CLUSTERS_PER_TABLE;
-      offs = (clusters_to_keep - 1) & (CLUSTERS_PER_TABLE - 1);
-      while (count-- > 0)
-	{
-	  assert_backtrace (next);
-
-	  /* This cluster is now the last cluster in the chain.  */
-	  if (count == 0)
-	    node->dn->last = next;
-
-	  next = next->next;
-	}
-      assert_backtrace (next);
-      fat_write_next_cluster (next->cluster[offs++], FAT_EOC);
-      pos = clusters_to_keep;
+      struct cluster_run *run;
+
+      i = find_run (dn, clusters_to_keep - 1);
+      run = &dn->runs[i];
+      err = fat_write_next_cluster (run->disk_cluster
+				    + (clusters_to_keep - 1
+				       - run->file_cluster),
+				    FAT_EOC);
+      if (err)
+	return err;
+      first_run = i + 1;
     }
 
   /* Purge dangling clusters. If we die here, scandisk will have to
      clean up the remains.  */
-  while (pos < node->dn->length_of_chain)
+  for (i = first_run ? first_run - 1 : 0; i < dn->nr_runs; i++)
     {
-      if (offs == CLUSTERS_PER_TABLE)
+      struct cluster_run *run = &dn->runs[i];
+      offs = run->file_cluster > clusters_to_keep
+	     ? 0 : clusters_to_keep - run->file_cluster;
+      for (; offs < run->length; offs++)
 	{
-	  offs = 0;
-	  next = next->next;
-	  assert_backtrace (next);
+	  err = fat_write_next_cluster (run->disk_cluster + offs, 0);
+	  if (err)
+	    return err;
 	}
-      fat_write_next_cluster(next->cluster[offs++], 0);
-      pos++;
-    }
- 
-  /* Free now unused tables.  (Could be done in one run with the above.)  */
-  next = node->dn->first;
-  if (clusters_to_keep != 0)
-    {
-      count = (clusters_to_keep - 1) >> LOG2_CLUSTERS_PER_TABLE;
-      offs = (clusters_to_keep - 1) & (CLUSTERS_PER_TABLE - 1);
-      while (count-- > 0)
-	{
-	  assert_backtrace (next);
-	  next = next->next;
-	}
-      assert_backtrace (next);
-      next = next->next;
-    }
-  while (next)
-    {
-      struct cluster_chain *next_next = next->next;
-      free (next);
-      next = next_next;
     }
 
-  if (clusters_to_keep == 0)
-    node->dn->first = 0;
-  
-  node->dn->length_of_chain = clusters_to_keep; 
+  /* Drop the runs past the new end.  */
+  dn->nr_runs = first_run;
+  if (first_run)
+    dn->runs[first_run - 1].length
+      = clusters_to_keep - dn->runs[first_run - 1].file_cluster;
+
+  dn->length_of_chain = clusters_to_keep; 
+  return 0;
 }
 
 
@@ -592,23 +714,13 @@ int
 fat_get_freespace (void)
 {
   int free_clusters = 0;
-  cluster_t curr_cluster;
-  cluster_t next_cluster;
   error_t err;
 
-  err = diskfs_catch_exception ();
+  pthread_mutex_lock (&allocate_free_cluster_lock);
+  err = build_free_bitmap ();
   if (!err)
-    {
-      /* First cluster is the 3rd entry in the FAT table.  */
-      for (curr_cluster = 2; curr_cluster < nr_of_clusters + 2;
-	   curr_cluster++)
-	{
-	  fat_get_next_cluster (curr_cluster, &next_cluster);
-	  if (next_cluster == FAT_FREE_CLUSTER)
-	    free_clusters++;
-	}
-    }
-  diskfs_end_catch_exception ();
+    free_clusters = nr_free_clusters;
+  pthread_mutex_unlock (&allocate_free_cluster_lock);
 
   return free_clusters;
 }
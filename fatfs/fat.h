@@ -307,13 +307,14 @@ extern size_t bytes_per_cluster;
 /* A cluster number.  */
 typedef unsigned long cluster_t;
 
-#define LOG2_CLUSTERS_PER_TABLE 10
-#define CLUSTERS_PER_TABLE (1 << LOG2_CLUSTERS_PER_TABLE)
-
-struct cluster_chain
+/* A run of clusters of a file that are consecutive on disk: clusters
+   FILE_CLUSTER to FILE_CLUSTER + LENGTH - 1 of the file are the disk
+   clusters starting at DISK_CLUSTER.  */
+struct cluster_run
 {
-  struct cluster_chain *next;
-  cluster_t cluster[CLUSTERS_PER_TABLE];
+  cluster_t file_cluster;
+  cluster_t disk_cluster;
+  cluster_t length;
 };
 
 /* Prototyping.  */
@@ -321,7 +322,7 @@ void fat_read_sblock (void);
 void fat_to_epoch (unsigned char *, unsigned char *, struct timespec *);
 void fat_from_epoch (unsigned char *, unsigned char *, time_t *);
 error_t fat_getcluster (struct node *, cluster_t, int, cluster_t *);
-void fat_truncate_node (struct node *, cluster_t);
+error_t fat_truncate_node (struct node *, cluster_t);
 error_t fat_extend_chain (struct node *, cluster_t, int);
 int fat_get_freespace (void);
 
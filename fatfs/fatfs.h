@@ -52,12 +52,15 @@ struct disknode
   /* Lock to hold while fiddling with this inode's block allocation
      info.  */
   pthread_rwlock_t alloc_lock;
-  /* Lock to hold while extending this inode's block allocation info.
-     Hold only if you hold readers alloc_lock, then you don't need to
-     hold it if you hold writers alloc_lock already.  */
-  pthread_spinlock_t chain_extension_lock;
-  struct cluster_chain *first;
-  struct cluster_chain *last;
+  /* Lock to hold while extending or looking up this inode's block
+     allocation info.  Hold only if you hold readers alloc_lock, then
+     you don't need to hold it if you hold writers alloc_lock
+     already.  */
+  pthread_mutex_t chain_extension_lock;
+  /* The first LENGTH_OF_CHAIN clusters of the file, as NR_RUNS runs
+     sorted by file cluster, read from the FAT as they are needed.  */
+  struct cluster_run *runs;
+  size_t nr_runs, alloc_runs;
   cluster_t length_of_chain;
   int chain_complete;
 
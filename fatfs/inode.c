@@ -54,11 +54,12 @@ diskfs_user_make_node (struct node **npp, struct lookup_context *ctx)
   /* Format specific data for the new node.  */
   dn = np->dn;
   dn->pager = 0;
-  dn->first = 0;
-  dn->last = 0;
+  dn->runs = 0;
+  dn->nr_runs = 0;
+  dn->alloc_runs = 0;
   dn->length_of_chain = 0;
   dn->chain_complete = 0;
-  dn->chain_extension_lock = PTHREAD_SPINLOCK_INITIALIZER;
+  pthread_mutex_init (&dn->chain_extension_lock, NULL);
   pthread_rwlock_init (&dn->alloc_lock, NULL);
   pthread_rwlock_init (&dn->dirent_lock, NULL);
 
@@ -83,14 +84,7 @@ diskfs_cached_lookup_in_dirbuf (int inum, struct node **npp, vm_address_t buf)
 void
 diskfs_node_norefs (struct node *np)
 {
-  struct cluster_chain *last = np->dn->first;
-
-  while (last)
-    {
-      struct cluster_chain *next = last->next;
-      free(last);
-      last = next;
-    }
+  free (np->dn->runs);
 
   if (np->dn->translator)
     free (np->dn->translator);
@@ -394,14 +388,14 @@ write_node (struct node *np)
 error_t
 diskfs_node_reload (struct node *node)
 {
-  struct cluster_chain *last = node->dn->first;
   static struct lookup_context ctx = { buf: 0 };
-  while (last)
-    {
-      struct cluster_chain *next = last->next;
-      free(last);
-      last = next;
-    }
+
+  free (node->dn->runs);
+  node->dn->runs = 0;
+  node->dn->nr_runs = 0;
+  node->dn->alloc_runs = 0;
+  node->dn->length_of_chain = 0;
+  node->dn->chain_complete = 0;
   flush_node_pager (node);
 
   return diskfs_user_read_node (node, &ctx);
@@ -530,10 +524,10 @@ diskfs_truncate (struct node *node, loff_t length)
 
   err = diskfs_catch_exception ();
   if (!err)
-    {
-      fat_truncate_node(node, round_cluster(length) >> log2_bytes_per_cluster);
-      node->allocsize = round_cluster(length);
-    }
+    err = fat_truncate_node (node,
+			     round_cluster (length) >> log2_bytes_per_cluster);
+  if (!err)
+    node->allocsize = round_cluster(length);
   diskfs_end_catch_exception ();
 
   node->dn_set_mtime = 1;
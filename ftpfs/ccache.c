@@ -20,198 +20,509 @@
 
 #include <unistd.h>
 #include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <hurd/netfs.h>
 
 #include "ccache.h"
 
+/* The contents of a file are cached in blocks of CCACHE_BLOCK_SIZE
+   bytes, each of which is fetched when it is first read, using REST to
+   start the transfer where it is needed.  A read that needs many
+   missing blocks splits them among up to PARALLEL_FETCHES connections
+   from the pool, each fetching at least PARALLEL_MIN_BLOCKS blocks.  A
+   data connection is kept open after a fetch, so that a following
+   sequential read continues on it.  */
+
+#define PARALLEL_MIN_BLOCKS	4
+
+/* The state of a block.  */
+#define BLOCK_EMPTY	0
+#define BLOCK_FETCHING	1	/* Some thread is fetching it.  */
+#define BLOCK_VALID	2
+
 #define READ_CHUNK_SIZE   (8*1024)
-#define ALLOC_CHUNK_SIZE  (64*1024)
-
+
+/* With --cache-dir, the cache of a file is kept in a file there, so
+   that it survives us.  The file starts with this header, followed by
+   the remote path of the file; the block states and the file image
+   follow, each at a page boundary.  The cache file is only trusted if
+   it was closed properly, and if the size and modification time of the
+   remote file haven't changed.  */
+#define CCACHE_MAGIC "ftpfsC1"
+
+struct ccache_file_header
+{
+  char magic[8];
+  uint32_t block_size;
+  uint32_t clean;
+  int64_t size;
+  int64_t mtime_sec, mtime_nsec;
+  uint32_t path_len;
+  char path[0];
+};
+
+/* Open the cache file for CC, which has just been given a size, and
+   map IMAGE and BLOCKS from it.  */
+static error_t
+open_cache_file (struct ccache *cc, const char *dir)
+{
+  struct netnode *nn = cc->node->nn;
+  const struct ftp_conn_params *params = nn->fs->ftp_params;
+  size_t path_len = strlen (nn->rmt_path);
+  size_t blocks_offs = round_page (sizeof (struct ccache_file_header)
+				   + path_len);
+  size_t image_offs = blocks_offs + round_page (cc->num_blocks);
+  struct ccache_file_header *hdr;
+  struct stat st;
+  char *name;
+  uint32_t host;
+  error_t err = 0;
+  int fd;
+
+  host = hurd_ihash_hash32 (params->addr, params->addr_len, 0);
+  if (params->user)
+    host = hurd_ihash_hash32 (params->user, strlen (params->user), host);
+  if (asprintf (&name, "%s/%08x%08x", dir, host,
+		hurd_ihash_hash32 (nn->rmt_path, path_len, 0)) < 0)
+    return ENOMEM;
+  fd = open (name, O_RDWR | O_CREAT, 0600);
+  free (name);
+  if (fd < 0)
+    return errno;
+
+  if (fstat (fd, &st) < 0)
+    err = errno;
+  else if (st.st_size != image_offs + cc->size
+	   && (ftruncate (fd, 0) < 0
+	       || ftruncate (fd, image_offs + cc->size) < 0))
+    err = errno;
+
+  if (! err)
+    {
+      hdr = mmap (0, image_offs + cc->size, PROT_READ | PROT_WRITE,
+		  MAP_SHARED, fd, 0);
+      if (hdr == MAP_FAILED)
+	err = errno;
+    }
+  if (err)
+    {
+      close (fd);
+      return err;
+    }
+
+  cc->file = fd;
+  cc->file_map = hdr;
+  cc->file_map_size = image_offs + cc->size;
+  cc->blocks = (unsigned char *) hdr + blocks_offs;
+  cc->image = (char *) hdr + image_offs;
+
+  if (memcmp (hdr->magic, CCACHE_MAGIC, sizeof hdr->magic) == 0
+      && hdr->block_size == CCACHE_BLOCK_SIZE
+      && hdr->clean
+      && hdr->size == cc->size
+      && hdr->mtime_sec == cc->node->nn_stat.st_mtim.tv_sec
+      && hdr->mtime_nsec == cc->node->nn_stat.st_mtim.tv_nsec
+      && hdr->path_len == path_len
+      && memcmp (hdr->path, nn->rmt_path, path_len) == 0)
+    /* Reuse what an earlier cache left; blocks that were being fetched
+       then are empty now.  */
+    {
+      size_t i;
+      for (i = 0; i < cc->num_blocks; i++)
+	if (cc->blocks[i] != BLOCK_VALID)
+	  cc->blocks[i] = BLOCK_EMPTY;
+    }
+  else
+    {
+      memset (cc->blocks, BLOCK_EMPTY, cc->num_blocks);
+      memcpy (hdr->magic, CCACHE_MAGIC, sizeof hdr->magic);
+      hdr->block_size = CCACHE_BLOCK_SIZE;
+      hdr->size = cc->size;
+      hdr->mtime_sec = cc->node->nn_stat.st_mtim.tv_sec;
+      hdr->mtime_nsec = cc->node->nn_stat.st_mtim.tv_nsec;
+      hdr->path_len = path_len;
+      memcpy (hdr->path, nn->rmt_path, path_len);
+    }
+
+  /* If we die with the cache file open, its blocks may be marked valid
+     before their contents made it to disk.  */
+  hdr->clean = 0;
+  msync (hdr, vm_page_size, MS_SYNC);
+
+  return 0;
+}
+
+/* Set up CC for the current size of its node.  CC must be locked.  */
+static error_t
+setup (struct ccache *cc)
+{
+  const char *dir = cc->node->nn->fs->params.cache_dir;
+
+  cc->size = cc->node->nn_stat.st_size;
+  cc->num_blocks = (cc->size + CCACHE_BLOCK_SIZE - 1) / CCACHE_BLOCK_SIZE;
+  if (cc->size == 0)
+    return 0;
+
+  if (dir && open_cache_file (cc, dir) == 0)
+    return 0;
+
+  /* No cache file; keep the cache in memory.  */
+  cc->blocks = calloc (cc->num_blocks, 1);
+  if (cc->blocks)
+    {
+      cc->image = mmap (0, cc->size, PROT_READ|PROT_WRITE, MAP_ANON, 0, 0);
+      if (cc->image != MAP_FAILED)
+	return 0;
+      free (cc->blocks);
+    }
+
+  cc->image = 0;
+  cc->blocks = 0;
+  cc->size = -1;
+  return ENOMEM;
+}
+
+/* Close the data connection of S.  */
+static void
+close_stream (struct ccache *cc, struct ccache_stream *s)
+{
+  close (s->data_conn);
+  s->data_conn = -1;
+  ftp_conn_finish_transfer (s->conn);
+  ftpfs_release_ftp_conn (cc->node->nn->fs, s->conn);
+  s->conn = 0;
+}
+
+/* Open a data connection in S on the file of CC, starting at POS.  */
+static error_t
+open_stream (struct ccache *cc, struct ccache_stream *s, off_t pos)
+{
+  struct netnode *nn = cc->node->nn;
+  error_t err;
+
+  err = ftpfs_get_ftp_conn (nn->fs, &s->conn);
+  if (err)
+    {
+      s->conn = 0;
+      return err;
+    }
+
+  err = ftp_conn_start_retrieve_at (s->conn, nn->rmt_path, pos,
+				    &s->data_conn);
+  if (err == EOPNOTSUPP && pos > 0)
+    /* The server can't start in the middle; skip what we don't need.  */
+    {
+      err = ftp_conn_start_retrieve (s->conn, nn->rmt_path, &s->data_conn);
+      s->pos = 0;
+      while (! err && s->pos < pos)
+	{
+	  char buf[READ_CHUNK_SIZE];
+	  size_t amount = pos - s->pos < sizeof buf ? pos - s->pos : sizeof buf;
+	  ssize_t rd = read (s->data_conn, buf, amount);
+	  if (rd <= 0)
+	    {
+	      err = rd < 0 ? errno : EIO;
+	      close (s->data_conn);
+	      ftp_conn_finish_transfer (s->conn);
+	    }
+	  else
+	    s->pos += rd;
+	}
+    }
+  if (err == ENOENT)
+    err = ESTALE;
+  if (err)
+    {
+      ftpfs_release_ftp_conn (nn->fs, s->conn);
+      s->conn = 0;
+    }
+  else
+    s->pos = pos;
+
+  return err;
+}
+
+/* Fetch blocks FIRST up to END of CC, which the caller has marked
+   BLOCK_FETCHING, marking each valid as soon as it is.  Blocks that
+   couldn't be fetched are marked empty again.  */
+static error_t
+fetch_blocks (struct ccache *cc, size_t first, size_t end)
+{
+  off_t start = (off_t) first * CCACHE_BLOCK_SIZE;
+  off_t stop = (off_t) end * CCACHE_BLOCK_SIZE;
+  struct ccache_stream *s;
+  int re_connected = 0;
+  size_t done = first;
+  off_t pos = start;
+  error_t err = 0;
+  int i;
+
+  if (stop > cc->size)
+    stop = cc->size;
+
+  /* Find a stream to fetch over: one that is already where we start if
+     there is one, else an unused or idle one.  The caller doesn't run
+     more fetches than there are streams, but other readers might.  */
+  pthread_mutex_lock (&cc->lock);
+  for (;;)
+    {
+      s = 0;
+      for (i = 0; i < CCACHE_MAX_STREAMS; i++)
+	if (! cc->streams[i].busy)
+	  {
+	    if (cc->streams[i].conn && cc->streams[i].pos == start)
+	      {
+		s = &cc->streams[i];
+		break;
+	      }
+	    if (! s || (s->conn && ! cc->streams[i].conn))
+	      s = &cc->streams[i];
+	  }
+      if (s)
+	break;
+      pthread_cond_wait (&cc->wakeup, &cc->lock);
+    }
+  s->busy = 1;
+  pthread_mutex_unlock (&cc->lock);
+
+  if (s->conn && s->pos != start)
+    close_stream (cc, s);
+
+  while (pos < stop && !err)
+    {
+      ssize_t rd;
+
+      if (! s->conn)
+	{
+	  err = open_stream (cc, s, pos);
+	  re_connected = 1;
+	  if (err)
+	    break;
+	}
+
+      rd = read (s->data_conn, cc->image + pos, stop - pos);
+      if (rd < 0)
+	err = errno;
+      else if (rd == 0)
+	/* EOF.  This either means the file changed size, or our
+	   data-connection got closed; we just try to open the connection
+	   a second time, and then if that fails, assume the size
+	   changed.  */
+	{
+	  if (re_connected)
+	    err = EIO;
+	  else
+	    close_stream (cc, s);
+	}
+      else
+	{
+	  size_t now_done;
+
+	  pos += rd;
+	  s->pos = pos;
+
+	  now_done = pos == stop ? end : pos / CCACHE_BLOCK_SIZE;
+	  if (now_done > done)
+	    /* Let readers waiting for these blocks look.  */
+	    {
+	      pthread_mutex_lock (&cc->lock);
+	      memset (cc->blocks + done, BLOCK_VALID, now_done - done);
+	      done = now_done;
+	      pthread_cond_broadcast (&cc->wakeup);
+	      pthread_mutex_unlock (&cc->lock);
+	    }
+
+	  if (ports_self_interrupted ())
+	    err = EINTR;
+	}
+    }
+
+  if (s->conn && (err || s->pos == cc->size))
+    /* Either we don't know where the connection is, or there's nothing
+       left to read over it.  */
+    close_stream (cc, s);
+
+  pthread_mutex_lock (&cc->lock);
+  s->busy = 0;
+  if (done < end)
+    memset (cc->blocks + done, BLOCK_EMPTY, end - done);
+  pthread_cond_broadcast (&cc->wakeup);
+  pthread_mutex_unlock (&cc->lock);
+
+  return err;
+}
+
+/* A range of blocks to fetch, possibly in a thread of its own.  */
+struct fetch
+{
+  struct ccache *cc;
+  size_t first, end;
+  error_t err;
+  pthread_t thread;
+  int threaded;
+};
+
+static void *
+fetch_thread (void *arg)
+{
+  struct fetch *f = arg;
+  f->err = fetch_blocks (f->cc, f->first, f->end);
+  return 0;
+}
+
 /* Read LEN bytes at OFFS in the file referred to by CC into DATA, or return
    an error.  */
 error_t
 ccache_read (struct ccache *cc, off_t offs, size_t len, void *data)
 {
   error_t err = 0;
-  size_t max = offs + len;
+  off_t max = offs + len;
+  size_t first, end, b;
+  unsigned parallel = cc->node->nn->fs->params.parallel_fetches;
+
+  if (parallel < 1)
+    parallel = 1;
+  else if (parallel > CCACHE_MAX_STREAMS)
+    parallel = CCACHE_MAX_STREAMS;
 
   pthread_mutex_lock (&cc->lock);
 
+  if (cc->size < 0)
+    err = setup (cc);
+
   if (max > cc->size)
     max = cc->size;
+  if (err || offs >= max)
+    {
+      pthread_mutex_unlock (&cc->lock);
+      return err;
+    }
+
+  first = offs / CCACHE_BLOCK_SIZE;
+  end = (max + CCACHE_BLOCK_SIZE - 1) / CCACHE_BLOCK_SIZE;
 
-  while (cc->max < max && !err)
+  for (b = first; b < end && !err; )
     {
-      if (cc->fetching_active)
-	/* Some thread is fetching data, so just let it do its thing, but get
-	   a wakeup call when it's done.  */
+      struct fetch fetches[CCACHE_MAX_STREAMS];
+      unsigned nfetches = 0, i;
+      size_t run;
+
+      if (cc->blocks[b] == BLOCK_VALID)
+	{
+	  b++;
+	  continue;
+	}
+
+      if (cc->blocks[b] == BLOCK_FETCHING)
+	/* Some thread is fetching this block, so just let it do its thing,
+	   but get a wakeup call when it's done.  */
 	{
 	  if (pthread_hurd_cond_wait_np (&cc->wakeup, &cc->lock))
 	    err = EINTR;
+	  continue;
 	}
-      else
-	{
-	  int re_connected = 0;
-	  struct netnode *nn = cc->node->nn;
 
-	  cc->fetching_active = 1;
+      /* Claim the run of empty blocks starting at B, and split it among
+	 as many connections as it is worth.  */
+      for (run = b; run < end && cc->blocks[run] == BLOCK_EMPTY; run++)
+	cc->blocks[run] = BLOCK_FETCHING;
+      run -= b;
 
-	  while (cc->max < max && !err)
-	    {
-	      pthread_mutex_unlock (&cc->lock);
-
-	      if (! cc->conn)
-		/* We need to setup a connection to fetch data over.  */
-		{
-		  err = ftpfs_get_ftp_conn (nn->fs, &cc->conn);
-		  if (! err)
-		    {
-		      err = ftp_conn_start_retrieve (cc->conn, nn->rmt_path,
-						     &cc->data_conn);
-		      if (err == ENOENT)
-			err = ESTALE;
-		      if (err)
-			{
-			  ftpfs_release_ftp_conn (nn->fs, cc->conn);
-			  cc->conn = 0;
-			}
-		      else
-			cc->data_conn_pos = 0;
-		    }
-		  re_connected = 1;
-		}
-
-	      if (! err)
-		/* Try and read some data over the connection.  */
-		{
-		  size_t new_end = cc->max + READ_CHUNK_SIZE;
-
-		  if (new_end > cc->size)
-		    new_end = cc->size;
-
-		  if (new_end > cc->alloced)
-		    /* Make some room in memory for the new part of the
-		       image.  */
-		    {
-		      size_t alloc_end = cc->alloced + ALLOC_CHUNK_SIZE;
-
-		      if (alloc_end < new_end)
-			alloc_end = new_end;
-		      else if (alloc_end > cc->size)
-			alloc_end = cc->size;
-
-		      if (cc->alloced == 0)
-			{
-			  vm_address_t addr = 0;
-			  addr = (vm_address_t) mmap (0, alloc_end, 
-						      PROT_READ|PROT_WRITE,
-						      MAP_ANON, 0, 0);
-			  err = (addr == -1) ? errno : 0;
-			  if (! err)
-			    cc->image = (char *)addr;
-			}
-		      else
-			{
-			  vm_address_t addr =
-			    (vm_address_t)cc->image + cc->alloced;
-			  /* XXX.  This can't be replaced with mmap until we
-			     have MAP_EXCL.  -tb  */
-			  err = vm_allocate (mach_task_self (),
-					     &addr, alloc_end - cc->alloced,
-					     0);
-			  if (err == EKERN_NO_SPACE)
-			    /* Gack.  We've goota move the whole splooge.  */
-			    {
-			      addr = 0;
-			      addr = (vm_address_t) mmap (0, alloc_end, 
-							  PROT_READ|PROT_WRITE,
-							  MAP_ANON, 0, 0);
-			      err = (addr == -1) ? errno : 0;
-			      if (! err)
-				/* That worked; copy what's already-fetched. */
-				{
-				  bcopy (cc->image, (void *)addr, cc->max);
-				  munmap (cc->image, cc->alloced);
-				  cc->image = (char *)addr;
-				}
-			    }
-			}
-		      if (! err)
-			cc->alloced = alloc_end;
-		    }
-
-		  if (! err)
-		    {
-		      ssize_t rd =
-			read (cc->data_conn,
-			      cc->image + cc->data_conn_pos,
-			      new_end - cc->data_conn_pos);
-		      if (rd < 0)
-			err = errno;
-		      else if (rd == 0)
-			/* EOF.  This either means the file changed size, or
-			   our data-connection got closed; we just try to
-			   open the connection a second time, and then if
-			   that fails, assume the size changed.  */
-			{
-			  if (re_connected)
-			    err = EIO; /* Something's fucked */
-			  else
-			    /* Try opening the connection again.  */
-			    {
-			      close (cc->data_conn);
-			      ftp_conn_finish_transfer (cc->conn);
-			      ftpfs_release_ftp_conn (nn->fs, cc->conn);
-			      cc->conn = 0;
-			    }
-			}
-		      else
-			{
-			  cc->data_conn_pos += rd;
-			  if (cc->data_conn_pos > cc->max)
-			    cc->max = cc->data_conn_pos;
-			}
-		    }
-
-		  if (!err && ports_self_interrupted ())
-		    err = EINTR;
-		}
+      nfetches = run / PARALLEL_MIN_BLOCKS;
+      if (nfetches < 1)
+	nfetches = 1;
+      else if (nfetches > parallel)
+	nfetches = parallel;
 
-	      pthread_mutex_lock (&cc->lock);
+      for (i = 0; i < nfetches; i++)
+	{
+	  fetches[i].cc = cc;
+	  fetches[i].first = b + run * i / nfetches;
+	  fetches[i].end = b + run * (i + 1) / nfetches;
+	  fetches[i].err = 0;
+	  fetches[i].threaded = 0;
+	}
+      b += run;
 
-	      if (cc->max < max && !err)
-		/* If anyone's waiting for data, let them look (if we're done
-		   fetching, this gets delayed until below).  */
-		pthread_cond_broadcast (&cc->wakeup);
-	    }
+      cc->fetchers++;
+      pthread_mutex_unlock (&cc->lock);
 
-	  if (!err && cc->conn && cc->max == cc->size)
-	    /* We're finished reading all data, close the data connection.  */
-	    {
-	      close (cc->data_conn);
-	      ftp_conn_finish_transfer (cc->conn);
-	      ftpfs_release_ftp_conn (nn->fs, cc->conn);
-	      cc->conn = 0;
-	    }
+      for (i = 1; i < nfetches; i++)
+	fetches[i].threaded =
+	  pthread_create (&fetches[i].thread, 0, fetch_thread,
+			  &fetches[i]) == 0;
+      for (i = 0; i < nfetches; i++)
+	{
+	  if (fetches[i].threaded)
+	    continue;
+	  fetch_thread (&fetches[i]);
+	}
+      for (i = 0; i < nfetches; i++)
+	{
+	  if (fetches[i].threaded)
+	    pthread_join (fetches[i].thread, 0);
+	  if (! err)
+	    err = fetches[i].err;
+	}
 
-	  /* We're done, error or no.  */
-	  cc->fetching_active = 0;
+      pthread_mutex_lock (&cc->lock);
+      cc->fetchers--;
+      pthread_cond_broadcast (&cc->wakeup);
 
-	  /* Let others know something's going on.  */
-	  pthread_cond_broadcast (&cc->wakeup);
-	}
+      if (! err)
+	/* Look at the blocks we fetched again, in case a thread fetching
+	   some that we waited for failed.  */
+	b = first;
     }
 
   if (! err)
-    bcopy (cc->image + offs, data, max - offs);
+    memcpy (data, cc->image + offs, max - offs);
 
   pthread_mutex_unlock (&cc->lock);
 
   return err;
 }
-
+
+/* Release the contents of CC, which must be locked, and have no thread
+   fetching data.  */
+static void
+teardown (struct ccache *cc)
+{
+  int i;
+
+  for (i = 0; i < CCACHE_MAX_STREAMS; i++)
+    if (cc->streams[i].conn)
+      close_stream (cc, &cc->streams[i]);
+
+  if (cc->file >= 0)
+    {
+      struct ccache_file_header *hdr = cc->file_map;
+
+      /* Mark the cache file clean only once everything else in it is
+	 on disk.  */
+      msync (cc->file_map, cc->file_map_size, MS_SYNC);
+      hdr->clean = 1;
+      msync (hdr, vm_page_size, MS_SYNC);
+      munmap (cc->file_map, cc->file_map_size);
+      close (cc->file);
+      cc->file = -1;
+    }
+  else if (cc->size > 0)
+    {
+      munmap (cc->image, cc->size);
+      free (cc->blocks);
+    }
+
+  cc->image = 0;
+  cc->blocks = 0;
+  cc->size = -1;
+}
+
 /* Discard any cached contents in CC.  */
 error_t
 ccache_invalidate (struct ccache *cc)
@@ -220,7 +531,7 @@ ccache_invalidate (struct ccache *cc)
 
   pthread_mutex_lock (&cc->lock);
 
-  while  (cc->fetching_active && !err)
+  while  (cc->fetchers > 0 && !err)
     /* Some thread is fetching data, so just let it do its thing, but get
        a wakeup call when it's done.  */
     {
@@ -229,47 +540,42 @@ ccache_invalidate (struct ccache *cc)
     }
 
   if (! err)
-    {
-      if (cc->alloced > 0)
-	{
-	  munmap (cc->image, cc->alloced);
-	  cc->image = 0;
-	  cc->alloced = 0;
-	  cc->max = 0;
-	}
-      if (cc->conn)
-	{
-	  close (cc->data_conn);
-	  ftp_conn_finish_transfer (cc->conn);
-	  ftpfs_release_ftp_conn (cc->node->nn->fs, cc->conn);
-	  cc->conn = 0;
-	}
-    }
+    /* The next read sets the cache up again, for the new size.  */
+    teardown (cc);
 
   pthread_mutex_unlock (&cc->lock);
 
   return err;
 }
-
+
 /* Return a ccache object for NODE in CC.  */
 error_t
 ccache_create (struct node *node, struct ccache **cc)
 {
   struct ccache *new = malloc (sizeof (struct ccache));
+  int i;
 
   if (! new)
     return ENOMEM;
 
   new->node = node;
   new->image = 0;
-  new->size = node->nn_stat.st_size;
-  new->max = 0;
-  new->alloced = 0;
+  new->size = -1;
+  new->blocks = 0;
+  new->num_blocks = 0;
+  new->file = -1;
+  new->file_map = 0;
+  new->file_map_size = 0;
   pthread_mutex_init (&new->lock, NULL);
   pthread_cond_init (&new->wakeup, NULL);
-  new->fetching_active = 0;
-  new->conn = 0;
-  new->data_conn = -1;
+  new->fetchers = 0;
+  for (i = 0; i < CCACHE_MAX_STREAMS; i++)
+    {
+      new->streams[i].conn = 0;
+      new->streams[i].data_conn = -1;
+      new->streams[i].pos = 0;
+      new->streams[i].busy = 0;
+    }
 
   *cc = new;
 
@@ -280,14 +586,6 @@ ccache_create (struct node *node, struct ccache **cc)
 void
 ccache_free (struct ccache *cc)
 {
-  if (cc->alloced > 0)
-    munmap (cc->image, cc->alloced);
-  if (cc->data_conn >= 0)
-    close (cc->data_conn);
-  if (cc->conn)
-    {
-      ftp_conn_finish_transfer (cc->conn);
-      ftpfs_release_ftp_conn (cc->node->nn->fs, cc->conn);
-    }
+  teardown (cc);
   free (cc);
 }
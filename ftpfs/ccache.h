@@ -23,38 +23,60 @@
 
 #include "ftpfs.h"
 
+/* The cache is kept in blocks of this many bytes.  */
+#define CCACHE_BLOCK_SIZE	(64*1024)
+
+/* The maximum number of data connections per file.  */
+#define CCACHE_MAX_STREAMS	8
+
+/* A data connection over which a file is being retrieved.  */
+struct ccache_stream
+{
+  /* Ftp connection over which data is being fetched, or 0 if this stream
+     isn't open.  */
+  struct ftp_conn *conn;
+  /* File descriptor over which data is being fetched.  */
+  int data_conn;
+  /* Where DATA_CONN points in the file.  */
+  off_t pos;
+  /* True if some thread is reading from this stream; only that thread
+     should touch the fields above.  */
+  int busy;
+};
+
 struct ccache
 {
   /* The filesystem node this is a cache of.  */
   struct node *node;
 
-  /* In memory file image, alloced using vm_allocate.  */
+  /* In memory file image of SIZE bytes, or 0 if SIZE is 0.  */
   char *image;
 
-  /* Size of data.  */
+  /* Size of data, or -1 if the cache isn't set up (see ccache_read).  */
   off_t size;
 
-  /* Upper bounds of fetched image.  */
-  off_t max;
+  /* The state of each CCACHE_BLOCK_SIZE block of IMAGE, NUM_BLOCKS of
+     them.  */
+  unsigned char *blocks;
+  size_t num_blocks;
 
-  /* Amount of IMAGE that has been allocated.  */
-  size_t alloced;
+  /* If the cache is saved in a file, its descriptor and our mapping of
+     it, which holds IMAGE and BLOCKS; else FILE is -1.  */
+  int file;
+  void *file_map;
+  size_t file_map_size;
 
   pthread_mutex_t lock;
 
   /* People can wait for a reading thread on this condition.  */
   pthread_cond_t wakeup;
 
-  /* True if some thread is now fetching data.  Only that thread should
-     modify the DATA_CONN, DATA_CONN_POS, and MAX fields.  */
-  int fetching_active;
+  /* The number of threads fetching data.  */
+  int fetchers;
 
-  /* Ftp connection over which data is being fetched, or 0.  */
-  struct ftp_conn *conn;
-  /* File descriptor over which data is being fetched.  */
-  int data_conn;
-  /* Where DATA_CONN points in the file.  */
-  off_t data_conn_pos;
+  /* Data connections left open by earlier fetches, so that reading on
+     sequentially doesn't need a new one.  */
+  struct ccache_stream streams[CCACHE_MAX_STREAMS];
 };
 
 /* Read LEN bytes at OFFS in the file referred to by CC into DATA, or return
@@ -106,6 +106,8 @@ cntl_debug (struct ftp_conn *conn, int type, const char *txt)
 
 #define DEFAULT_NODE_CACHE_MAX	50
 
+#define DEFAULT_PARALLEL_FETCHES 4
+
 /* Return a string corresponding to the printed rep of DEFAULT_what */
 #define ___D(what) #what
 #define __D(what) ___D(what)
@@ -120,6 +122,8 @@ cntl_debug (struct ftp_conn *conn, int type, const char *txt)
 #define OPT_NODE_CACHE_MAX      8
 #define OPT_BULK_STAT_PERIOD    9
 #define OPT_BULK_STAT_THRESHOLD 10
+#define OPT_PARALLEL_FETCHES    11
+#define OPT_CACHE_DIR           12
 
 /* Options usable both at startup and at runtime.  */
 static const struct argp_option common_options[] =
@@ -142,6 +146,13 @@ static const struct argp_option common_options[] =
    "Number of stats within the bulk-stat-period that trigger a bulk stat"
    " (default " _D(BULK_STAT_THRESHOLD) ")"},
 
+  {"parallel-fetches", OPT_PARALLEL_FETCHES, "CONNS", 0,
+   "Number of connections a large read may fetch file contents over"
+   " (default " _D(PARALLEL_FETCHES) ")"},
+  {"cache-dir",        OPT_CACHE_DIR,        "DIR", 0,
+   "Keep the contents of files read in DIR, to be reused by later ftpfs"
+   " translators"},
+
   {0, 0}
 };
 
@@ -207,6 +218,19 @@ parse_common_opt (int key, char *arg, struct argp_state *state)
       params->name_timeout = atoi (arg); break;
     case OPT_STAT_TIMEOUT:
       params->stat_timeout = atoi (arg); break;
+    case OPT_PARALLEL_FETCHES:
+      if (atoi (arg) < 1)
+	{
+	  argp_error (state, "%s: Invalid number of connections", arg);
+	  return EINVAL;
+	}
+      params->parallel_fetches = atoi (arg);
+      break;
+    case OPT_CACHE_DIR:
+      params->cache_dir = strdup (arg);
+      if (! params->cache_dir)
+	return ENOMEM;
+      break;
     default:
       return ARGP_ERR_UNKNOWN;
     }
@@ -363,6 +387,19 @@ netfs_append_args (char **argz, size_t *argz_len)
     FOPT ("--bulk-stat-period=%ld", ftpfs->params.bulk_stat_period);
   if (ftpfs->params.bulk_stat_threshold != DEFAULT_BULK_STAT_THRESHOLD)
     FOPT ("--bulk-stat-threshold=%d", ftpfs->params.bulk_stat_threshold);
+  if (ftpfs->params.parallel_fetches != DEFAULT_PARALLEL_FETCHES)
+    FOPT ("--parallel-fetches=%u", ftpfs->params.parallel_fetches);
+  if (ftpfs->params.cache_dir && ! err)
+    {
+      char *rep;
+      if (asprintf (&rep, "--cache-dir=%s", ftpfs->params.cache_dir) < 0)
+	err = ENOMEM;
+      else
+	{
+	  err = argz_add (argz, argz_len, rep);
+	  free (rep);
+	}
+    }
 
   return argz_add (argz, argz_len, ftpfs_remote_fs);
 }
@@ -384,6 +421,8 @@ main (int argc, char **argv)
   ftpfs_params.node_cache_max = DEFAULT_NODE_CACHE_MAX;
   ftpfs_params.bulk_stat_period = DEFAULT_BULK_STAT_PERIOD;
   ftpfs_params.bulk_stat_threshold = DEFAULT_BULK_STAT_THRESHOLD;
+  ftpfs_params.parallel_fetches = DEFAULT_PARALLEL_FETCHES;
+  ftpfs_params.cache_dir = 0;
 
   argp_parse (&argp, argc, argv, 0, 0, 0);
 
@@ -145,6 +145,14 @@ struct ftpfs_params
 
   /* The size of the node cache.  */
   size_t node_cache_max;
+
+  /* The number of connections a single read of a file may fetch its
+     contents over in parallel.  */
+  unsigned parallel_fetches;
+
+  /* If non-zero, a directory in which the contents of files are cached
+     across runs.  */
+  const char *cache_dir;
 };
 
 /* A particular filesystem.  */
@@ -72,7 +72,7 @@ typedef const uid_t *const_idarray_t;
 typedef __loff_t *off_array_t;
 typedef const __loff_t *const_off_array_t;
 typedef struct rusage rusage_t;
-typedef struct flock flock_t;
+typedef struct flock64 flock_t;
 typedef struct utsname utsname_t;
 #if _FILE_OFFSET_BITS == 64
 typedef struct stat io_statbuf_t;
@@ -166,6 +166,11 @@ typedef enum file_changed_type file_changed_type_t;
 #define FSYS_GOAWAY_UNLINK    0x00000008 /* Go away only if non-directory.  */
 #define FSYS_GOAWAY_RECURSE   0x00000010 /* Shutdown children too.  */
 
+/* Flags for rpcstats.defs:rpcstats_get.  */
+#define RPCSTATS_ENABLE       0x00000001 /* Start collecting statistics.  */
+#define RPCSTATS_DISABLE      0x00000002 /* Stop collecting statistics.  */
+#define RPCSTATS_RESET        0x00000004 /* Discard collected statistics.  */
+
 /* Types of ports the terminal driver can run on top of;
    used in term.defs:term_get_bottom_type.  */
 enum term_bottom_type
@@ -326,6 +331,21 @@ typedef const int *const_procinfo_t;
 #define PI_GETMSG  0x00000400	/* Process is blocked in proc_getmsgport. */
 #define PI_LOGINLD 0x00000800	/* Process is leader of login collection */
 
+/* Header of each record returned by proc_getprocinfo_bulk.  It is
+   followed by LEN ints holding the struct procinfo of process PID,
+   and the next record starts right after those.  LEN is always even,
+   so records stay 8-byte aligned.  If ERROR is nonzero, LEN is zero;
+   EREMOTE means the process lives in a sub-Hurd's task namespace and
+   must be asked about with proc_getprocinfo.  FLAGS is the subset of
+   the requested PI_FETCH_ flags actually fetched for this process.  */
+struct procinfo_bulk
+{
+  pid_t pid;
+  int error;
+  int flags;
+  int len;
+};
+
 
 /*   Conventions   */
 
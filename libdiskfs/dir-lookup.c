@@ -57,11 +57,16 @@ diskfs_S_dir_lookup (struct protid *dircred,
   int type;
   struct protid *newpi = 0;
   struct peropen *newpo = 0;
+  char *lastslash;
+  ino64_t chain[PREFIX_MAX_DEPTH + 1];
+  int depth = -1;
+  unsigned long generation = 0;
 
   if (!dircred)
     return EOPNOTSUPP;
 
-  flags &= O_HURD;
+  /* O_DIRECT is not part of O_HURD, but we honor it; see diskfs.h.  */
+  flags &= O_HURD | O_DIRECT;
 
   create = (flags & O_CREAT);
   excl = (flags & O_EXCL);
@@ -93,10 +98,37 @@ diskfs_S_dir_lookup (struct protid *dircred,
       goto gotit;
     }
 
-  dnp = dircred->po->np;
-  pthread_mutex_lock (&dnp->lock);
+  /* If the directory of the last component is in the path prefix
+     cache, start from there; the ones in between are neither locked
+     nor searched.  Otherwise, record the directories we go through
+     (in CHAIN, with DEPTH the index of the last one) for entering the
+     path into the cache.  DEPTH is -1 when that is out of question.  */
+  dnp = 0;
+  lastslash = strrchr (filename, '/');
+  if (lastslash && lastslash[1] != '\0')
+    {
+      size_t len = lastslash - filename;
+      while (filename[len - 1] == '/')
+	len--;
 
-  diskfs_nref (dnp);		/* acquire a reference for later diskfs_nput */
+      dnp = _diskfs_check_prefix_cache (dircred->po->np, filename, len);
+      if (dnp)
+	filename = lastslash + 1;
+      else
+	{
+	  generation = _diskfs_prefix_cache_generation ();
+	  chain[0] = dircred->po->np->cache_id;
+	  depth = 0;
+	}
+    }
+
+  if (! dnp)
+    {
+      dnp = dircred->po->np;
+      pthread_mutex_lock (&dnp->lock);
+
+      diskfs_nref (dnp);	/* acquire a reference for later diskfs_nput */
+    }
 
   do
     {
@@ -332,6 +364,7 @@ diskfs_S_dir_lookup (struct protid *dircred,
 	     vanished while NP was unlocked inside fshelp_fetch_root.
 	     Reacquire the locks, and continue as normal. */
 	  err = 0;
+	  depth = -1;
 	  if (np != dnp)
 	    {
 	      if (!strcmp (filename, ".."))
@@ -355,6 +388,8 @@ diskfs_S_dir_lookup (struct protid *dircred,
 	{
 	  /* Handle symlink interpretation */
 
+	  depth = -1;
+
 	  if (nsymlinks++ > diskfs_maxsymlinks)
 	    {
 	      err = ELOOP;
@@ -429,6 +464,23 @@ diskfs_S_dir_lookup (struct protid *dircred,
       else
 	{
 	  /* Handle normal nodes */
+	  if (depth >= 0)
+	    {
+	      /* A path only goes into the prefix cache if anybody,
+		 including users without ids, may search the directories
+		 it skips.  */
+	      if (!lastcomp && depth < PREFIX_MAX_DEPTH
+		  && np != dnp && S_ISDIR (np->dn_stat.st_mode)
+		  && strcmp (filename, "..")
+		  && ((dnp->dn_stat.st_mode & (S_IXUSR|S_IXGRP|S_IXOTH))
+		      == (S_IXUSR|S_IXGRP|S_IXOTH))
+		  && (!(dnp->dn_stat.st_mode & S_IUSEUNK)
+		      || (dnp->dn_stat.st_mode & (S_IEXEC << S_IUNKSHIFT))))
+		chain[++depth] = np->cache_id;
+	      else
+		depth = -1;
+	    }
+
 	  filename = nextname;
 	  if (np == dnp)
 	    diskfs_nrele (dnp);
@@ -438,6 +490,17 @@ diskfs_S_dir_lookup (struct protid *dircred,
 	    {
 	      dnp = np;
 	      np = 0;
+
+	      if (depth > 0 && ! index (filename, '/'))
+		{
+		  /* DNP is the directory of the last component.  */
+		  size_t len = filename - filename_start;
+		  while (relpath[len - 1] == '/')
+		    len--;
+		  _diskfs_enter_prefix_cache (relpath, len, chain, depth,
+					      generation);
+		  depth = -1;
+		}
 	    }
 	  else
 	    dnp = 0;
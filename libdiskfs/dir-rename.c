@@ -21,11 +21,6 @@
 #include "fs_S.h"
 #include <string.h>
 
-/* To avoid races in checkpath, and to prevent a directory from being
-   simultaneously renamed by two processes, we serialize all renames of
-   directores with this lock */
-static pthread_mutex_t renamedirlock = PTHREAD_MUTEX_INITIALIZER;
-
 /* Implement dir_rename as described in <hurd/fs.defs>. */
 kern_return_t
 diskfs_S_dir_rename (struct protid *fromcred,
@@ -74,13 +69,14 @@ diskfs_S_dir_rename (struct protid *fromcred,
   if (S_ISDIR (fnp->dn_stat.st_mode))
     {
       pthread_mutex_unlock (&fnp->lock);
-      if (pthread_mutex_trylock (&renamedirlock))
+      err = diskfs_rename_dir (fdp, fnp, fromname, tdp, toname, fromcred,
+			       tocred);
+      if (err == EAGAIN)
 	{
+	  /* Someone else renamed FROMNAME in the meantime.  */
 	  diskfs_nrele (fnp);
 	  goto try_again;
 	}
-      err = diskfs_rename_dir (fdp, fnp, fromname, tdp, toname, fromcred,
-			       tocred);
       if (diskfs_synchronous)
 	{
 	  pthread_mutex_lock (&fdp->lock);
@@ -97,7 +93,6 @@ diskfs_S_dir_rename (struct protid *fromcred,
 	}
       
       diskfs_nrele (fnp);
-      pthread_mutex_unlock (&renamedirlock);
       if (!err)
 	/* MiG won't do this for us, which it ought to. */
 	mach_port_deallocate (mach_task_self (), tocred->pi.port_right);
@@ -16,59 +16,192 @@
    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
 
 #include "priv.h"
+#include <stdlib.h>
 
+/* Moving a directory to another directory makes a loop if it is an
+   ancestor of the new parent, which we check by walking up the `..'
+   entries from the new parent.  No directory on that path may be moved
+   to another directory until the rename is done.  So a rename that
+   moves a directory to another directory holds the rename locks of the
+   directory and of its old and new parent exclusively, and those of the
+   ancestors of both parents shared.  Two such renames that run at the
+   same time thus change directories none of which is an ancestor of
+   another, and cannot wait for each other's node locks.  Renames in
+   unrelated parts of the tree run in parallel.
 
-/* Check if source directory is in the path of the target directory.
-   We get target locked, source unlocked but with a reference.  When
-   we return, nothing is locked, and target has lost its reference.
-   This routine assumes that no renames of directories will happen
-   while it is running; as a result, ufs_rename serializes all renames
-   of directories.  */
+   The rename locks are taken in the order of the node addresses, and
+   with no node locks held, so they cannot deadlock.  The paths are
+   found by walks without them; once they are held, a second walk checks
+   that they are still the paths, as none of their directories can be
+   moved then.  */
+
+/* The directories whose rename locks a rename holds.  */
+struct ancestors
+{
+  struct node **nodes;
+  size_t n, alloc;
+  int locked;
+};
+
+static int
+node_order (const void *a, const void *b)
+{
+  const struct node *x = *(struct node *const *) a;
+  const struct node *y = *(struct node *const *) b;
+
+  return x < y ? -1 : x > y;
+}
+
+/* Add NP to A, with a reference of its own.  Return EEXIST if it is
+   there already.  */
+static error_t
+add_ancestor (struct ancestors *a, struct node *np)
+{
+  size_t i;
+
+  for (i = 0; i < a->n; i++)
+    if (a->nodes[i] == np)
+      return EEXIST;
+
+  if (a->n == a->alloc)
+    {
+      size_t alloc = a->alloc ? 2 * a->alloc : 16;
+      struct node **nodes = realloc (a->nodes, alloc * sizeof *nodes);
+      if (! nodes)
+	return ENOMEM;
+      a->nodes = nodes;
+      a->alloc = alloc;
+    }
+
+  diskfs_nref (np);
+  a->nodes[a->n++] = np;
+  return 0;
+}
+
+/* Drop the rename locks and references of A.  */
+static void
+unlock_ancestors (struct ancestors *a)
+{
+  size_t i;
+
+  for (i = 0; i < a->n; i++)
+    {
+      if (a->locked)
+	pthread_rwlock_unlock (&a->nodes[i]->rename_lock);
+      diskfs_nrele (a->nodes[i]);
+    }
+  a->n = 0;
+  a->locked = 0;
+}
+
+/* Walk up the `..' entries from DP to the root of CRED's tree.  Unless
+   A is locked, add the directories on the way to A; directories may be
+   moved while we walk, so this is only a guess, and we stop at one that
+   is in A already.  If A is locked, return EAGAIN if the path leaves A,
+   and set *FOUND if FIND is on the way.  */
 static error_t
-checkpath(struct node *source,
-	  struct node *target,
-	  struct protid *cred)
+walk_path (struct node *dp, struct protid *cred, struct ancestors *a,
+	   struct node *find, int *found)
 {
   error_t err;
   struct node *np;
 
-  for (np = target, err = 0;
+  pthread_mutex_lock (&dp->lock);
+  diskfs_nref (dp);
+
+  for (np = dp, err = 0;
        /* nothing */;
        /* This special lookup does a diskfs_nput on its first argument
 	  when it succeeds. */
        err = diskfs_lookup (np, "..", LOOKUP | SPEC_DOTDOT, &np, 0, cred))
     {
       if (err)
-	{
-	  diskfs_nput (np);
-	  return err;
-	}
+	break;
 
-      if (np == source)
+      if (! a->locked)
 	{
-	  diskfs_nput (np);
-	  return EINVAL;
+	  err = add_ancestor (a, np);
+	  if (err == EEXIST)
+	    {
+	      err = 0;
+	      break;
+	    }
 	}
+      else if (! bsearch (&np, a->nodes, a->n, sizeof *a->nodes, node_order))
+	err = EAGAIN;
+      else if (np == find)
+	*found = 1;
+
+      if (err || np == diskfs_root_node || np == cred->po->shadow_root)
+	break;
+    }
 
-      if (np == diskfs_root_node || np == cred->po->shadow_root)
+  diskfs_nput (np);
+  return err;
+}
+
+/* Take the rename locks for moving SOURCE from FROM into TARGET, as
+   described above, and record them in A.  FROMCRED and TOCRED are the
+   users responsible for FROM and TARGET.  Return EINVAL if SOURCE is
+   TARGET or one of its ancestors.  Set *TARGET_ABOVE if TARGET is an
+   ancestor of FROM.  */
+static error_t
+lock_ancestors (struct node *source, struct node *from, struct node *target,
+		struct protid *fromcred, struct protid *tocred,
+		struct ancestors *a, int *target_above)
+{
+  error_t err;
+  size_t i;
+  int loop;
+
+  do
+    {
+      err = walk_path (target, tocred, a, 0, 0);
+      if (! err)
+	err = walk_path (from, fromcred, a, 0, 0);
+      if (! err)
+	err = add_ancestor (a, source);
+      if (err == EEXIST)
+	err = 0;
+      if (err)
+	break;
+
+      qsort (a->nodes, a->n, sizeof *a->nodes, node_order);
+      for (i = 0; i < a->n; i++)
 	{
-	  diskfs_nput (np);
-	  return 0;
+	  struct node *np = a->nodes[i];
+
+	  if (np == source || np == from || np == target)
+	    pthread_rwlock_wrlock (&np->rename_lock);
+	  else
+	    pthread_rwlock_rdlock (&np->rename_lock);
 	}
+      a->locked = 1;
+
+      loop = *target_above = 0;
+      err = walk_path (target, tocred, a, source, &loop);
+      if (! err)
+	err = walk_path (from, fromcred, a, target, target_above);
+      if (! err && loop)
+	err = EINVAL;
+      if (err == EAGAIN)
+	/* A directory on a path was moved before we locked it.  */
+	unlock_ancestors (a);
     }
+  while (err == EAGAIN);
+
+  if (err)
+    unlock_ancestors (a);
+  return err;
 }
 
-/* Rename directory node FNP (whose parent is FDP, and which has name
-   FROMNAME in that directory) to have name TONAME inside directory
-   TDP.  None of these nodes are locked, and none should be locked
-   upon return.  This routine is serialized, so it doesn't have to be
-   reentrant.  Directories will never be renamed except by this
-   routine.  FROMCRED and TOCRED are the users responsible for
-   FDP/FNP and TDP respectively.  */
-error_t
-diskfs_rename_dir (struct node *fdp, struct node *fnp, const char *fromname,
-		   struct node *tdp, const char *toname,
-		   struct protid *fromcred, struct protid *tocred)
+/* Move FNP as diskfs_rename_dir does, with the rename locks held if
+   FDP and TDP differ.  TDP_ABOVE says whether TDP is an ancestor of
+   FDP.  */
+static error_t
+rename_dir (struct node *fdp, struct node *fnp, const char *fromname,
+	    struct node *tdp, const char *toname,
+	    struct protid *fromcred, struct protid *tocred, int tdp_above)
 {
   error_t err;
   struct node *tnp, *tmpnp;
@@ -76,18 +209,13 @@ diskfs_rename_dir (struct node *fdp, struct node *fnp, const char *fromname,
   struct dirstat *ds;
   struct dirstat *tmpds;
 
-  pthread_mutex_lock (&tdp->lock);
-  diskfs_nref (tdp);		/* reference and lock will get consumed by
-				   checkpath */
-  err = checkpath (fnp, tdp, tocred);
-
-  if (err)
-    return err;
-
-  /* Now, lock the parent directories.  This is legal because tdp is not
-     a child of fnp (guaranteed by checkpath above). */
+  /* Now, lock the parent directories, the upper one first.  This is
+     legal because tdp is not a child of fnp (guaranteed by
+     lock_ancestors). */
+  if (tdp_above)
+    pthread_mutex_lock (&tdp->lock);
   pthread_mutex_lock (&fdp->lock);
-  if (fdp != tdp)
+  if (fdp != tdp && ! tdp_above)
     pthread_mutex_lock (&tdp->lock);
 
   /* 1: Lookup target; if it exists, make sure it's an empty directory. */
@@ -110,12 +238,22 @@ diskfs_rename_dir (struct node *fdp, struct node *fnp, const char *fromname,
   /* Check permissions to remove FROMNAME and lock FNP.  */
   tmpds = alloca (diskfs_dirstat_size);
   err = diskfs_lookup (fdp, fromname, REMOVE, &tmpnp, tmpds, fromcred);
-  assert_backtrace (!tmpnp || tmpnp == fnp);
-  if (tmpnp)
-    diskfs_nrele (tmpnp);
   diskfs_drop_dirstat (fdp, tmpds);
+  if (tmpnp && tmpnp != fnp)
+    {
+      /* FNP was renamed while FDP was unlocked, before we held its
+	 rename lock or by a rename within FDP.  */
+      diskfs_nput (tmpnp);
+      err = EAGAIN;
+    }
+  else if (tmpnp)
+    diskfs_nrele (tmpnp);
   if (err)
-    goto out;
+    {
+      /* diskfs_lookup has not locked fnp then, do not unlock it. */
+      fnp = NULL;
+      goto out;
+    }
 
   if (tnp)
     {
@@ -241,3 +379,33 @@ diskfs_rename_dir (struct node *fdp, struct node *fnp, const char *fromname,
     diskfs_drop_dirstat (tdp, ds);
   return err;
 }
+
+/* Rename directory node FNP (whose parent is FDP, and which has name
+   FROMNAME in that directory) to have name TONAME inside directory
+   TDP.  None of these nodes are locked, and none should be locked
+   upon return.  Calls may run concurrently with each other; those
+   that move FNP to another directory hold the rename locks of FNP,
+   FDP, TDP and their ancestors.  Directories will never be renamed
+   except by this routine.  Return EAGAIN if FROMNAME no longer
+   refers to FNP.  FROMCRED and TOCRED are the users responsible for
+   FDP/FNP and TDP respectively.  */
+error_t
+diskfs_rename_dir (struct node *fdp, struct node *fnp, const char *fromname,
+		   struct node *tdp, const char *toname,
+		   struct protid *fromcred, struct protid *tocred)
+{
+  struct ancestors a = { 0 };
+  error_t err = 0;
+  int tdp_above = 0;
+
+  /* Within one directory, FNP can't end up inside itself.  */
+  if (fdp != tdp)
+    err = lock_ancestors (fnp, fdp, tdp, fromcred, tocred, &a, &tdp_above);
+  if (! err)
+    err = rename_dir (fdp, fnp, fromname, tdp, toname, fromcred, tocred,
+		      tdp_above);
+
+  unlock_ancestors (&a);
+  free (a.nodes);
+  return err;
+}
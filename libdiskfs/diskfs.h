@@ -30,6 +30,13 @@
 #include <idvec.h>
 #include <features.h>
 #include <refcount.h>
+#include <fcntl.h>
+
+/* The C library doesn't define O_DIRECT on the Hurd.  This bit is not
+   used by any other open mode.  */
+#ifndef O_DIRECT
+#define O_DIRECT	0x01000000
+#endif
 
 #ifdef DISKFS_DEFINE_EXTERN_INLINE
 #define DISKFS_EXTERN_INLINE
@@ -59,6 +66,7 @@ struct peropen
 {
   off_t filepointer;
   int lock_status;
+  struct rlock_peropen rlock_status;
   refcount_t refcnt;
   int openstat;
 
@@ -105,6 +113,10 @@ struct node
 
   pthread_mutex_t lock;
 
+  /* Held by renames that move directories to other directories, see
+     dir-renamed.c.  It is taken before any node lock.  */
+  pthread_rwlock_t rename_lock;
+
   refcounts_t refcounts;
 
   mach_port_t sockaddr;		/* address for S_IFSOCK shortcut */
@@ -114,6 +126,7 @@ struct node
   struct transbox transbox;
 
   struct lock_box userlock;
+  struct rlock_box userbox;
 
   struct conch conch;
 
@@ -585,6 +598,29 @@ error_t (*diskfs_create_symlink_hook)(struct node *np, const char *target);
    used.  If it returns any other error, it is returned to the user. */
 error_t (*diskfs_read_symlink_hook)(struct node *np, char *target);
 
+/* If this function is nonzero it is called to read (if DIR is zero) or
+   write *AMT bytes of the contents of locked node NP at OFFSET from or
+   to DATA, instead of copying them through the memory object returned
+   by diskfs_get_filemap; the file size already permits the access.  If
+   it returns EINVAL or isn't set, the memory object is used.  If it
+   returns any other error, it is returned to the user.  */
+error_t (*diskfs_rdwr_hook)(struct node *np, char *data, off_t offset,
+			    size_t *amt, int dir);
+
+/* If this function is nonzero, files opened with O_DIRECT are read and
+   written straight from and to the disk instead of through the memory
+   object returned by diskfs_get_filemap.  It must return in *STORE the
+   store holding the contents of locked node NP at OFFSET, in *ADDR
+   their byte address in that store, and in *LEN, which is the number
+   of bytes wanted on entry, the number of bytes from OFFSET on that
+   are contiguous both in the file and in the store; at least until the
+   end of the block containing OFFSET.  If there is no block allocated
+   at OFFSET, it must set *ADDR to -1 and *LEN to the size of the hole.
+   It must not allocate blocks.  */
+error_t (*diskfs_map_block_hook)(struct node *np, off_t offset,
+				 struct store **store, off_t *addr,
+				 size_t *len);
+
 /* The user may define this function.  The function must set source to
    the source of the translator. The function may return an EOPNOTSUPP
    to indicate that the concept of a source device is not
@@ -1014,12 +1050,14 @@ struct node *diskfs_check_lookup_cache (struct node *dir, const char *name);
 /* Rename directory node FNP (whose parent is FDP, and which has name
    FROMNAME in that directory) to have name TONAME inside directory
    TDP.  None of these nodes are locked, and none should be locked
-   upon return.  This routine is serialized, so it doesn't have to be
-   reentrant.  Directories will never be renamed except by this
-   routine.  FROMCRED and TOCRED are the users responsible for
+   upon return.  Calls may run concurrently with each other; those
+   that move FNP to another directory hold the rename locks of FNP,
+   FDP, TDP and their ancestors.  Directories will never be renamed
+   except by this routine.  Return EAGAIN if FROMNAME no longer
+   refers to FNP.  FROMCRED and TOCRED are the users responsible for
    FDP/FNP and TDP respectively.  This routine assumes the usual
-   convention where `.' and `..' are represented by ordinary links;
-   if that is not true for your format, you have to redefine this
+   convention where `.' and `..' are represented by ordinary links; if
+   that is not true for your format, you have to redefine this
    function.*/
 error_t
 diskfs_rename_dir (struct node *fdp, struct node *fnp, const char *fromname,
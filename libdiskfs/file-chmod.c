@@ -47,6 +47,8 @@ diskfs_S_file_chmod (struct protid *cred,
 			     {
 			       np->dn_stat.st_mode = mode;
 			       np->dn_set_ctime = 1;
+			       if (S_ISDIR (mode))
+				 _diskfs_purge_prefix_cache (np);
 			       if (np->filemod_reqs)
 				 diskfs_notice_filechange (np,
 							   FILE_CHANGED_META,
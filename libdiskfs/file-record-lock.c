@@ -0,0 +1,41 @@
+/*
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd; see the file COPYING.  If not, write to
+   the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+#include "priv.h"
+#include "fs_S.h"
+
+/* Implement file_record_lock as described in <hurd/fs.defs>. */
+kern_return_t
+diskfs_S_file_record_lock (struct protid *cred, int cmd, flock_t *lock,
+			   mach_port_t rendezvous)
+{
+  struct node *np;
+  error_t err;
+
+  if (!cred)
+    return EOPNOTSUPP;
+
+  np = cred->po->np;
+  pthread_mutex_lock (&np->lock);
+  err = fshelp_rlock_tweak (&np->userbox, &np->lock, &cred->po->rlock_status,
+			    cred->po->openstat, np->dn_stat.st_size,
+			    cred->po->filepointer, cmd, lock, rendezvous);
+  pthread_mutex_unlock (&np->lock);
+  return err;
+}
@@ -101,6 +101,8 @@ diskfs_S_file_set_translator (struct protid *cred,
 	  pthread_mutex_unlock (&np->lock);
 	  return err;
 	}
+      if (S_ISDIR (np->dn_stat.st_mode))
+	_diskfs_purge_prefix_cache (np);
     }
 
   /* Set passive translator */
@@ -217,6 +219,8 @@ diskfs_S_file_set_translator (struct protid *cred,
 	    }
 	}
       err = diskfs_set_translator (np, passive, passivelen, cred);
+      if (S_ISDIR (np->dn_stat.st_mode))
+	_diskfs_purge_prefix_cache (np);
     }
 
   pthread_mutex_unlock (&np->lock);
@@ -72,3 +72,20 @@ diskfs_S_fsys_get_children (struct diskfs_control *fsys,
   free (c);
   return err;
 }
+
+/* Implement fsys_get_generation as described in <hurd/fsys.defs>.  */
+error_t
+diskfs_S_fsys_get_generation (struct diskfs_control *fsys,
+			      mach_port_t reply,
+			      mach_msg_type_name_t replytype,
+			      natural_t *generation)
+{
+  if (! fsys)
+    return EOPNOTSUPP;
+
+  /* Both only ever grow.  */
+  *generation = (fshelp_get_active_translators_generation ()
+		 + __atomic_load_n (&_diskfs_options_generation,
+				    __ATOMIC_RELAXED));
+  return 0;
+}
@@ -57,7 +57,8 @@ diskfs_S_fsys_getroot (struct diskfs_control *pt,
   if (!pt)
     return EOPNOTSUPP;
 
-  flags &= O_HURD;
+  /* O_DIRECT is not part of O_HURD, but we honor it; see diskfs.h.  */
+  flags &= O_HURD | O_DIRECT;
 
   user.uids = make_idvec ();
   user.gids = make_idvec ();
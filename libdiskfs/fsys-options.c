@@ -26,6 +26,8 @@
 #include "priv.h"
 #include "fsys_S.h"
 
+unsigned int _diskfs_options_generation;
+
 struct args
 {
   char *data;
@@ -70,6 +72,8 @@ diskfs_S_fsys_set_options (struct diskfs_control *pt,
     {
       pthread_rwlock_wrlock (&diskfs_fsys_lock);
       err = diskfs_set_options (data, len);
+      if (!err)
+	__atomic_add_fetch (&_diskfs_options_generation, 1, __ATOMIC_RELAXED);
       pthread_rwlock_unlock (&diskfs_fsys_lock);
     }
 
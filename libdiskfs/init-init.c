@@ -90,6 +90,7 @@ diskfs_init_diskfs (void)
 
   diskfs_protid_class = ports_create_class (diskfs_protid_rele, 0);
   diskfs_control_class = ports_create_class (_diskfs_control_clean, 0);
+  ports_serve_rpc_stats (diskfs_control_class);
   diskfs_execboot_class = ports_create_class (0, 0);
   diskfs_shutdown_notification_class = ports_create_class (0, 0);
 
@@ -93,7 +93,8 @@ diskfs_S_io_read (struct protid *cred,
 
   if (err == EINVAL)
     err = _diskfs_rdwr_internal (np, buf, off, datalen, 0,
-				 cred->po->openstat & O_NOATIME);
+				 cred->po->openstat & O_NOATIME,
+				 cred->po->openstat & O_DIRECT);
 
   if (diskfs_synchronous)
     diskfs_node_update (np, 1);	/* atime! */
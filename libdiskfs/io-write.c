@@ -76,7 +76,8 @@ diskfs_S_io_write (struct protid *cred,
     }
 
   *amt = datalen;
-  err = _diskfs_rdwr_internal (np, data, off, amt, 1, 0);
+  err = _diskfs_rdwr_internal (np, data, off, amt, 1, 0,
+			       cred->po->openstat & O_DIRECT);
 
   if (!err && offset == -1)
     cred->po->filepointer += *amt;
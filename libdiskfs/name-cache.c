@@ -220,6 +220,10 @@ diskfs_purge_lookup_cache (struct node *dp, struct node *np)
 	remove_entry (b, i);
 
   pthread_mutex_unlock (&cache_lock);
+
+  /* Only directories are on the paths in the prefix cache.  */
+  if (S_ISDIR (np->dn_stat.st_mode))
+    _diskfs_purge_prefix_cache (np);
 }
 
 /* Scan the cache looking for NAME inside DIR.  If we don't know
@@ -291,3 +295,166 @@ diskfs_check_lookup_cache (struct node *dir, const char *name)
   pthread_mutex_unlock (&cache_lock);
   return 0;
 }
+
+/* The path prefix cache maps a directory and a path of several
+   components relative to it to the directory the path leads to.
+   dir_lookup uses it to jump straight to the directory of the last
+   component, without locking or searching the ones in between; deep
+   trees like node_modules make for long paths that are looked up over
+   and over.
+
+   Skipping a directory skips checking that the user may search it, so
+   only paths through directories anybody may search are entered, and
+   only those without symlinks, translators, `.' or `..' on the way.
+   An entry records every directory on its path, and is purged when one
+   of them is unlinked (which is how rename and rmdir get rid of it) or
+   has its mode or translator changed.  The purge bumps the generation
+   of the cache, so that a path resolved before then is not entered.
+
+   Lookups only take PREFIX_LOCK for reading.  The table is direct
+   mapped; a new entry replaces whatever is in its slot.  */
+
+/* Number of entries.  Must be a power of two.  */
+#define PREFIX_CACHE_SIZE	128
+
+struct prefix_entry
+{
+  /* The path, not NUL-terminated, or NULL if the entry is unused.  */
+  char *path;
+  size_t len;
+
+  /* The key.  */
+  unsigned long key;
+
+  /* CHAIN[0] is the directory PATH is relative to, CHAIN[DEPTH] the
+     one it leads to, and the others those in between.  */
+  int depth;
+  ino64_t chain[PREFIX_MAX_DEPTH + 1];
+};
+
+static struct prefix_entry prefix_cache[PREFIX_CACHE_SIZE];
+static unsigned long prefix_generation;
+static pthread_rwlock_t prefix_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/* Hash the directory cache_id and the LEN bytes of PATH.  */
+static inline unsigned long
+prefix_hash (ino64_t dir_cache_id, const char *path, size_t len)
+{
+  unsigned long h;
+  h = hurd_ihash_hash32 (&dir_cache_id, sizeof dir_cache_id, 0);
+  h = hurd_ihash_hash32 (path, len, h);
+  return h;
+}
+
+/* Return the cache_id of the directory PATH, LEN bytes long, leads to
+   from DIR_CACHE_ID, or 0 if it is not cached.  */
+static ino64_t
+find_prefix (ino64_t dir_cache_id, const char *path, size_t len,
+	     unsigned long key)
+{
+  struct prefix_entry *e = &prefix_cache[key & (PREFIX_CACHE_SIZE - 1)];
+  ino64_t id = 0;
+
+  pthread_rwlock_rdlock (&prefix_lock);
+  if (e->path
+      && e->key == key
+      && e->chain[0] == dir_cache_id
+      && e->len == len
+      && memcmp (e->path, path, len) == 0)
+    id = e->chain[e->depth];
+  pthread_rwlock_unlock (&prefix_lock);
+
+  return id;
+}
+
+unsigned long
+_diskfs_prefix_cache_generation (void)
+{
+  unsigned long generation;
+
+  pthread_rwlock_rdlock (&prefix_lock);
+  generation = prefix_generation;
+  pthread_rwlock_unlock (&prefix_lock);
+
+  return generation;
+}
+
+struct node *
+_diskfs_check_prefix_cache (struct node *dir, const char *path, size_t len)
+{
+  unsigned long key = prefix_hash (dir->cache_id, path, len);
+  struct node *np;
+  ino64_t id;
+
+  id = find_prefix (dir->cache_id, path, len, key);
+  if (id == 0 || diskfs_cached_lookup (id, &np))
+    return NULL;
+
+  /* We can't hold PREFIX_LOCK while locking a node, so the directory
+     may have been removed in the meantime; if so, its entry is gone.  */
+  if (find_prefix (dir->cache_id, path, len, key) != id
+      || !S_ISDIR (np->dn_stat.st_mode)
+      || np->dn_stat.st_nlink == 0)
+    {
+      diskfs_nput (np);
+      return NULL;
+    }
+
+  return np;
+}
+
+void
+_diskfs_enter_prefix_cache (const char *path, size_t len,
+			    const ino64_t *chain, int depth,
+			    unsigned long generation)
+{
+  unsigned long key = prefix_hash (chain[0], path, len);
+  struct prefix_entry *e = &prefix_cache[key & (PREFIX_CACHE_SIZE - 1)];
+  char *copy;
+
+  assert_backtrace (depth > 0 && depth <= PREFIX_MAX_DEPTH);
+
+  copy = malloc (len);
+  if (! copy)
+    return;
+  memcpy (copy, path, len);
+
+  pthread_rwlock_wrlock (&prefix_lock);
+  if (generation != prefix_generation)
+    /* Something on the path may have changed while it was resolved.  */
+    {
+      pthread_rwlock_unlock (&prefix_lock);
+      free (copy);
+      return;
+    }
+
+  free (e->path);
+  e->path = copy;
+  e->len = len;
+  e->key = key;
+  e->depth = depth;
+  memcpy (e->chain, chain, (depth + 1) * sizeof *chain);
+  pthread_rwlock_unlock (&prefix_lock);
+}
+
+void
+_diskfs_purge_prefix_cache (struct node *np)
+{
+  struct prefix_entry *e;
+  int i;
+
+  pthread_rwlock_wrlock (&prefix_lock);
+  prefix_generation++;
+
+  for (e = &prefix_cache[0]; e < &prefix_cache[PREFIX_CACHE_SIZE]; e++)
+    if (e->path)
+      for (i = 0; i <= e->depth; i++)
+	if (e->chain[i] == np->cache_id)
+	  {
+	    free (e->path);
+	    e->path = NULL;
+	    break;
+	  }
+
+  pthread_rwlock_unlock (&prefix_lock);
+}
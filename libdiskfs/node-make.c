@@ -30,6 +30,7 @@ init_node (struct node *np, struct disknode *dn)
   np->author_tracks_uid = 0;
 
   pthread_mutex_init (&np->lock, NULL);
+  pthread_rwlock_init (&np->rename_lock, NULL);
   refcounts_init (&np->refcounts, 1, 0);
   np->owner = 0;
   np->sockaddr = MACH_PORT_NULL;
@@ -42,6 +43,7 @@ init_node (struct node *np, struct disknode *dn)
   fshelp_transbox_init (&np->transbox, &np->lock, np);
   iohelp_initialize_conch (&np->conch, &np->lock);
   fshelp_lock_init (&np->userlock);
+  fshelp_rlock_init (&np->userbox);
 
   return np;
 }
@@ -64,7 +64,7 @@ diskfs_node_rdwr (struct node *np,
     *amtread = amt;
   else
     amtread = &amt;
-  err = _diskfs_rdwr_internal (np, data, off, amtread, dir, 0);
+  err = _diskfs_rdwr_internal (np, data, off, amtread, dir, 0, 0);
   if (*amtread && diskfs_synchronous)
     {
       if (dir)
@@ -34,11 +34,14 @@ diskfs_release_peropen (struct peropen *po)
   if (po->shadow_root_parent)
     mach_port_deallocate (mach_task_self (), po->shadow_root_parent);
 
-  if (po->lock_status != LOCK_UN)
+  if (po->lock_status != LOCK_UN
+      || po->rlock_status.owner || po->rlock_status.nowners)
     {
       pthread_mutex_lock (&po->np->lock);
-      fshelp_acquire_lock (&po->np->userlock, &po->lock_status,
-                           &po->np->lock, LOCK_UN);
+      if (po->lock_status != LOCK_UN)
+	fshelp_acquire_lock (&po->np->userlock, &po->lock_status,
+			     &po->np->lock, LOCK_UN);
+      fshelp_rlock_drop_peropen (&po->np->userbox, &po->rlock_status);
       diskfs_nput (po->np);
     }
   else
@@ -84,7 +84,7 @@ typedef struct bootinfo *bootinfo_t;
    be locked.   If NOTIME is set, then don't update the access or
    modify times on the file.  */
 error_t _diskfs_rdwr_internal (struct node *np, char *data, off_t offset,
-			       size_t *amt, int dir, int notime);
+			       size_t *amt, int dir, int notime, int direct);
 
 /* Called when we have a real user environment (complete with proc
    and auth ports). */
@@ -106,10 +106,39 @@ extern int _diskfs_ncontrol_ports;
 /* Lock for _diskfs_ncontrol_ports. */
 extern pthread_spinlock_t _diskfs_control_lock;
 
+/* Incremented whenever fsys_set_options changes our options.  */
+extern unsigned int _diskfs_options_generation;
+
 /* Callback routines for active translator startup */
 extern fshelp_fetch_root_callback1_t _diskfs_translator_callback1;
 extern fshelp_fetch_root_callback2_t _diskfs_translator_callback2;
 
+/* The path prefix cache, see name-cache.c.  At most PREFIX_MAX_DEPTH
+   components of a path are cached.  */
+#define PREFIX_MAX_DEPTH 32
+
+/* Return the current generation of the path prefix cache.  */
+unsigned long _diskfs_prefix_cache_generation (void);
+
+/* If the directory that PATH, LEN bytes long, leads to from DIR is in
+   the path prefix cache, return it locked and with a new reference;
+   otherwise return NULL.  DIR need not be locked.  */
+struct node *_diskfs_check_prefix_cache (struct node *dir, const char *path,
+					 size_t len);
+
+/* PATH, LEN bytes long, has just been resolved through the DEPTH + 1
+   directories in CHAIN, starting with the one it is relative to.
+   GENERATION is that of the cache from before the first of them was
+   looked at.  */
+void _diskfs_enter_prefix_cache (const char *path, size_t len,
+				 const ino64_t *chain, int depth,
+				 unsigned long generation);
+
+/* Purge the paths through the directory NP from the path prefix
+   cache.  Call this after NP is unlinked or its mode or translator
+   changes.  */
+void _diskfs_purge_prefix_cache (struct node *np);
+
 /* This macro locks the node associated with PROTID, and then
    evaluates the expression OPERATION; then it syncs the inode
    (without waiting) and unlocks everything, and then returns
@@ -136,7 +165,8 @@ extern fshelp_fetch_root_callback2_t _diskfs_translator_callback2;
 })
 
 /* Bits the user is permitted to set with io_*_openmodes */
-#define HONORED_STATE_MODES (O_APPEND|O_ASYNC|O_FSYNC|O_NONBLOCK|O_NOATIME)
+#define HONORED_STATE_MODES \
+  (O_APPEND|O_ASYNC|O_FSYNC|O_NONBLOCK|O_NOATIME|O_DIRECT)
 
 /* Bits that are turned off after open */
 #define OPENONLY_STATE_MODES \
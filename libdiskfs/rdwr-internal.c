@@ -18,21 +18,125 @@
 #include "priv.h"
 #include <string.h>
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <hurd/pager.h>
+#include <hurd/store.h>
+
+/* Read (if DIR is zero) or write *AMT bytes of NP at OFFSET straight
+   from or to the disk, using diskfs_map_block_hook, and set *AMT to the
+   amount transferred.  Return EINVAL if the request can't be done this
+   way, because it is not aligned to the blocks of the store or because
+   it would write to a hole; nothing has been transferred then.
+
+   Dirty pages of the file's memory object in the range are written to
+   the disk first, and for writes, the pages are dropped from memory,
+   so that the file's mappings see the new contents.  */
+static error_t
+rdwr_direct (struct node *np, char *data, off_t offset, size_t *amt, int dir)
+{
+  memory_object_t memobj;
+  struct pager *pager;
+  struct store *store;
+  off_t end = offset + *amt, pos, addr;
+  vm_offset_t start_page;
+  size_t len;
+  error_t err = 0;
+
+  /* Check that every part of the request is aligned to the blocks of
+     its store, and that writes only go to allocated blocks.  */
+  for (pos = offset; pos < end && !err; pos += len)
+    {
+      len = end - pos;
+      err = (*diskfs_map_block_hook) (np, pos, &store, &addr, &len);
+      if (err)
+	return err;
+      if (len > end - pos)
+	len = end - pos;
+      if (addr < 0 ? dir : (pos % store->block_size
+			    || addr % store->block_size
+			    || len % store->block_size))
+	return EINVAL;
+    }
+
+  memobj = diskfs_get_filemap (np, (dir ? VM_PROT_READ | VM_PROT_WRITE
+				    : VM_PROT_READ));
+  if (memobj == MACH_PORT_NULL)
+    return errno;
+  pager = diskfs_get_filemap_pager_struct (np);
+  start_page = trunc_page (offset);
+  if (dir)
+    pager_return_some (pager, start_page, round_page (end) - start_page, 1);
+  else
+    pager_sync_some (pager, start_page, round_page (end) - start_page, 1);
+
+  pos = offset;
+  while (pos < end && !err)
+    {
+      char *buf = data + (pos - offset);
+
+      len = end - pos;
+      err = (*diskfs_map_block_hook) (np, pos, &store, &addr, &len);
+      if (err)
+	break;
+      if (len > end - pos)
+	len = end - pos;
+
+      if (addr < 0)
+	/* A hole; only reads get here.  */
+	memset (buf, 0, len);
+      else if (dir)
+	{
+	  size_t written;
+	  err = store_write (store, addr / store->block_size, buf, len,
+			     &written);
+	  if (!err && written != len)
+	    err = EIO;
+	}
+      else
+	{
+	  void *read_buf = buf;
+	  size_t read_len = len;
+	  err = store_read (store, addr / store->block_size, len,
+			    &read_buf, &read_len);
+	  if (!err)
+	    {
+	      if (read_buf != buf)
+		{
+		  memcpy (buf, read_buf, read_len < len ? read_len : len);
+		  munmap (read_buf, read_len);
+		}
+	      if (read_len != len)
+		err = EIO;
+	    }
+	}
+
+      if (!err)
+	pos += len;
+    }
+
+  mach_port_deallocate (mach_task_self (), memobj);
+
+  *amt = pos - offset;
+  /* Report what has been transferred, if anything.  */
+  return pos > offset ? 0 : err;
+}
 
 /* Actually read or write a file.  The file size must already permit
    the requested access.  NP is the file to read/write.  DATA is a buffer
    to write from or fill on read.  OFFSET is the absolute address (-1
    not permitted here); AMT is the size of the read/write to perform;
    DIR is set for writing and clear for reading.  The inode must
-   be locked.  If NOTIME is set, then don't update the mtime or atime. */
+   be locked.  If NOTIME is set, then don't update the mtime or atime.
+   If DIRECT is set, bypass the memory object if the filesystem
+   supports it (see diskfs_map_block_hook).  */
 error_t
 _diskfs_rdwr_internal (struct node *np,
 		       char *data,
 		       off_t offset,
 		       size_t *amt,
 		       int dir,
-		       int notime)
+		       int notime,
+		       int direct)
 {
   memory_object_t memobj;
   vm_prot_t prot = dir ? (VM_PROT_READ | VM_PROT_WRITE) : VM_PROT_READ;
@@ -53,18 +157,29 @@ _diskfs_rdwr_internal (struct node *np,
 	np->dn_set_atime = 1;
     }
 
-  memobj = diskfs_get_filemap (np, prot);
+  err = EINVAL;
+  if (direct && diskfs_map_block_hook)
+    err = rdwr_direct (np, data, offset, amt, dir);
+  if (err == EINVAL && diskfs_rdwr_hook)
+    err = (*diskfs_rdwr_hook) (np, data, offset, amt, dir);
+  if (err == EINVAL)
+    {
+      memobj = diskfs_get_filemap (np, prot);
 
-  if (memobj == MACH_PORT_NULL)
-    return errno;
+      if (memobj == MACH_PORT_NULL)
+	return errno;
 
-  /* pager_memcpy inherently uses vm_offset_t, which may be smaller than off_t.  */
-  if (sizeof(off_t) > sizeof(vm_offset_t) &&
-      offset + *amt > ((off_t) 1) << (sizeof(vm_offset_t) * 8))
-    err = EFBIG;
-  else
-    err = pager_memcpy (diskfs_get_filemap_pager_struct (np), memobj,
-		      offset, data, amt, prot);
+      /* pager_memcpy inherently uses vm_offset_t, which may be smaller
+	 than off_t.  */
+      if (sizeof(off_t) > sizeof(vm_offset_t) &&
+	  offset + *amt > ((off_t) 1) << (sizeof(vm_offset_t) * 8))
+	err = EFBIG;
+      else
+	err = pager_memcpy (diskfs_get_filemap_pager_struct (np), memobj,
+			    offset, data, amt, prot);
+
+      mach_port_deallocate (mach_task_self (), memobj);
+    }
 
   if (!diskfs_check_readonly () && !notime)
     {
@@ -74,6 +189,5 @@ _diskfs_rdwr_internal (struct node *np,
 	np->dn_set_atime = 1;
     }
 
-  mach_port_deallocate (mach_task_self (), memobj);
   return err;
 }
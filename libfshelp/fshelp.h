@@ -30,6 +30,7 @@
 #include <pthread.h>
 #include <hurd/iohelp.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #include <maptime.h>
 
 
@@ -65,6 +66,11 @@ fshelp_get_active_translators (char **translators,
 			       mach_port_t **controls,
                                size_t *controls_count);
 
+/* Return a number that changes whenever the list of active
+   translators does.  */
+unsigned int
+fshelp_get_active_translators_generation (void);
+
 /* Call FUN for each active translator.  If FUN returns non-zero, the
    iteration immediately stops, and returns that value.  FUN is called
    with COOKIE, the name of the translator, and the translators
@@ -241,6 +247,54 @@ error_t fshelp_acquire_lock (struct lock_box *box, int *user,
    should be initialized with LOCK_UN.).  */
 void fshelp_lock_init (struct lock_box *box);
 
+
+
+/* Record (byte-range) locks, as per file_record_lock.  */
+struct rlock;
+struct rlock_owner;
+
+/* One of these per object.  */
+struct rlock_box
+{
+  /* The locks, in an interval tree.  */
+  struct rlock *locks;
+  pthread_cond_t wait;
+  int waiting;
+};
+
+/* One of these per open.  */
+struct rlock_peropen
+{
+  /* The owner of the locks taken without a rendezvous port.  */
+  struct rlock_owner *owner;
+
+  /* The owners that have taken locks through this open.  */
+  struct rlock_owner **owners;
+  int nowners;
+};
+
+/* Initialize rlock_box BOX.  */
+void fshelp_rlock_init (struct rlock_box *box);
+
+/* Initialize rlock_peropen PO.  */
+void fshelp_rlock_po_init (struct rlock_peropen *po);
+
+/* Implement file_record_lock on the object of BOX, opened as PO with
+   OPEN_MODE.  FILE_SIZE and FILE_POINTER are the size of the object
+   and the file pointer of PO, for LOCK->l_whence.  CMD and LOCK are as
+   per fcntl; RENDEZVOUS is consumed on success.  MUT is a mutex which
+   will be held whenever this routine is called, to lock BOX and PO.  */
+error_t fshelp_rlock_tweak (struct rlock_box *box, pthread_mutex_t *mut,
+			    struct rlock_peropen *po, int open_mode,
+			    loff_t file_size, loff_t file_pointer, int cmd,
+			    struct flock64 *lock, mach_port_t rendezvous);
+
+/* The open PO of the object of BOX is going away; release the locks of
+   the owners that have used it and the resources of PO.  The mutex
+   passed to fshelp_rlock_tweak must be held.  */
+void fshelp_rlock_drop_peropen (struct rlock_box *box,
+				struct rlock_peropen *po);
+
 
 
 struct port_bucket;		/* shut up C compiler */
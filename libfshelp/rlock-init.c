@@ -0,0 +1,38 @@
+/* Initialization of record locks
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd; see the file COPYING.  If not, write to
+   the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+#include "fshelp.h"
+
+/* Initialize a record lock box.  */
+void
+fshelp_rlock_init (struct rlock_box *box)
+{
+  box->locks = NULL;
+  pthread_cond_init (&box->wait, NULL);
+  box->waiting = 0;
+}
+
+/* Initialize the record lock state of an open.  */
+void
+fshelp_rlock_po_init (struct rlock_peropen *po)
+{
+  po->owner = NULL;
+  po->owners = NULL;
+  po->nowners = 0;
+}
@@ -0,0 +1,639 @@
+/* Record (byte-range) locks
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd; see the file COPYING.  If not, write to
+   the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* The locks on an object are kept in an interval tree, so that finding
+   the ones that overlap a range takes time logarithmic in their number
+   rather than linear: databases may hold many locks on a file at once.
+   The tree is a treap ordered by the start of the locks and augmented
+   with the greatest end in every subtree.
+
+   As POSIX wants, the locks of one owner never overlap each other: a
+   new lock replaces the parts of the owner's locks it overlaps, and is
+   merged with those of the same type it overlaps or touches.  Owners
+   are identified by the rendezvous port passed to file_record_lock,
+   which is the same for all the descriptors of a process.
+
+   An owner that has to wait for the lock of another records that in
+   BLOCKED_ON; it gets EDEADLK instead if following BLOCKED_ON from the
+   holder leads back to itself.  That takes a lock common to all
+   objects, since the cycle may go through several of them.  An owner
+   has only one BLOCKED_ON, so a cycle may go unnoticed if several
+   threads of a process wait at the same time.  */
+
+#include <assert-backtrace.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <hurd/ihash.h>
+
+#include "fshelp.h"
+
+/* The end of locks that extend to the end of the file and beyond.  */
+#define RLOCK_MAX_END	INT64_MAX
+
+/* How far to follow BLOCKED_ON before calling it a deadlock anyway.  */
+#define RLOCK_MAX_CHAIN	64
+
+struct rlock
+{
+  /* The locked bytes, START to END inclusive.  */
+  loff_t start, end;
+  int type;			/* F_RDLCK or F_WRLCK.  */
+  struct rlock_owner *owner;
+
+  /* The tree.  MAX_END is the greatest END in this subtree.  */
+  struct rlock *left, *right;
+  unsigned priority;
+  loff_t max_end;
+
+  /* For making lists of the locks to change.  */
+  struct rlock *next;
+};
+
+struct rlock_owner
+{
+  /* The rendezvous port, of which we hold a send right, or
+     MACH_PORT_NULL for the owner of the locks of an open.  */
+  mach_port_t port;
+  pid_t pid;
+
+  /* One for every lock, every open listing the owner and every owner
+     blocked on it, and one for every call using it.  */
+  int refs;
+
+  /* The owner of the lock this one waits for, or NULL.  */
+  struct rlock_owner *blocked_on;
+};
+
+/* The owners with a rendezvous port, by port.  */
+static struct hurd_ihash owners = HURD_IHASH_INITIALIZER (HURD_IHASH_NO_LOCP);
+
+/* Protects OWNERS, and the REFS and BLOCKED_ON of every owner.  */
+static pthread_mutex_t owners_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Add DELTA to the references of OWNER, freeing it if none are left.
+   OWNERS_LOCK must be held.  */
+static void
+owner_refs_locked (struct rlock_owner *owner, int delta)
+{
+  owner->refs += delta;
+  assert_backtrace (owner->refs >= 0);
+  if (owner->refs > 0)
+    return;
+
+  assert_backtrace (! owner->blocked_on);
+  if (owner->port != MACH_PORT_NULL)
+    {
+      hurd_ihash_remove (&owners, (hurd_ihash_key_t) owner->port);
+      mach_port_deallocate (mach_task_self (), owner->port);
+    }
+  free (owner);
+}
+
+static void
+owner_refs (struct rlock_owner *owner, int delta)
+{
+  pthread_mutex_lock (&owners_lock);
+  owner_refs_locked (owner, delta);
+  pthread_mutex_unlock (&owners_lock);
+}
+
+/* Return the owner for RENDEZVOUS, which may be MACH_PORT_NULL, with a
+   new reference in *OWNER.  PID is that of the process.  */
+static error_t
+owner_get (mach_port_t rendezvous, pid_t pid, struct rlock_owner **owner)
+{
+  struct rlock_owner *o = NULL;
+  error_t err = 0;
+
+  pthread_mutex_lock (&owners_lock);
+  if (rendezvous != MACH_PORT_NULL)
+    o = hurd_ihash_find (&owners, (hurd_ihash_key_t) rendezvous);
+  if (o)
+    o->refs++;
+  else
+    {
+      o = malloc (sizeof *o);
+      if (! o)
+	err = ENOMEM;
+      else if (rendezvous != MACH_PORT_NULL)
+	{
+	  /* The owner keeps a user reference of its own.  */
+	  err = mach_port_mod_refs (mach_task_self (), rendezvous,
+				    MACH_PORT_RIGHT_SEND, 1);
+	  if (! err)
+	    {
+	      err = hurd_ihash_add (&owners, (hurd_ihash_key_t) rendezvous, o);
+	      if (err)
+		mach_port_deallocate (mach_task_self (), rendezvous);
+	    }
+	}
+
+      if (err)
+	{
+	  free (o);
+	  o = NULL;
+	}
+      else
+	{
+	  o->port = rendezvous;
+	  o->pid = pid;
+	  o->refs = 1;
+	  o->blocked_on = NULL;
+	}
+    }
+  pthread_mutex_unlock (&owners_lock);
+
+  *owner = o;
+  return err;
+}
+
+static inline loff_t
+max_end (const struct rlock *t)
+{
+  return t ? t->max_end : -1;
+}
+
+static inline void
+update (struct rlock *t)
+{
+  t->max_end = t->end;
+  if (max_end (t->left) > t->max_end)
+    t->max_end = t->left->max_end;
+  if (max_end (t->right) > t->max_end)
+    t->max_end = t->right->max_end;
+}
+
+/* Return nonzero if A comes before B in the tree.  Locks with the same
+   start are ordered by address.  */
+static inline int
+before (const struct rlock *a, const struct rlock *b)
+{
+  return (a->start < b->start
+	  || (a->start == b->start && (uintptr_t) a < (uintptr_t) b));
+}
+
+/* Split T into the locks before L, in *LEFT, and the others, in
+   *RIGHT.  */
+static void
+split (struct rlock *t, const struct rlock *l,
+       struct rlock **left, struct rlock **right)
+{
+  if (! t)
+    *left = *right = NULL;
+  else if (before (t, l))
+    {
+      split (t->right, l, &t->right, right);
+      update (t);
+      *left = t;
+    }
+  else
+    {
+      split (t->left, l, left, &t->left);
+      update (t);
+      *right = t;
+    }
+}
+
+/* Join A and B, all of whose locks come after those of A.  */
+static struct rlock *
+join (struct rlock *a, struct rlock *b)
+{
+  if (! a)
+    return b;
+  if (! b)
+    return a;
+  if (a->priority > b->priority)
+    {
+      a->right = join (a->right, b);
+      update (a);
+      return a;
+    }
+  b->left = join (a, b->left);
+  update (b);
+  return b;
+}
+
+/* Insert L in T and return the new tree.  */
+static struct rlock *
+tree_insert (struct rlock *t, struct rlock *l)
+{
+  struct rlock *left, *right;
+
+  /* Any hash of the address makes for a balanced tree on average.  */
+  l->priority = ((uintptr_t) l >> 4) * 2654435761U;
+  l->left = l->right = NULL;
+  update (l);
+
+  split (t, l, &left, &right);
+  return join (join (left, l), right);
+}
+
+/* Remove L from T and return the new tree.  */
+static struct rlock *
+tree_remove (struct rlock *t, struct rlock *l)
+{
+  assert_backtrace (t);
+
+  if (t == l)
+    return join (t->left, t->right);
+
+  if (before (l, t))
+    t->left = tree_remove (t->left, l);
+  else
+    t->right = tree_remove (t->right, l);
+  update (t);
+  return t;
+}
+
+/* Call FN on the locks of T that overlap START to END, in order, until
+   it returns nonzero, and return that.  FN must not change T.  */
+static int
+overlapping (struct rlock *t, loff_t start, loff_t end,
+	     int (*fn) (struct rlock *))
+{
+  int ret;
+
+  if (! t || t->max_end < start)
+    return 0;
+
+  ret = overlapping (t->left, start, end, fn);
+  if (ret || t->start > end)
+    return ret;
+  if (t->end >= start && (ret = (*fn) (t)))
+    return ret;
+  return overlapping (t->right, start, end, fn);
+}
+
+/* Return a lock in BOX that keeps OWNER from taking a TYPE lock on
+   START to END, or NULL if there is none.  */
+static struct rlock *
+find_conflict (struct rlock_box *box, struct rlock_owner *owner, int type,
+	       loff_t start, loff_t end)
+{
+  struct rlock *conflict = NULL;
+
+  int check (struct rlock *l)
+    {
+      if (l->owner != owner && (type == F_WRLCK || l->type == F_WRLCK))
+	{
+	  conflict = l;
+	  return 1;
+	}
+      return 0;
+    }
+
+  overlapping (box->locks, start, end, check);
+  return conflict;
+}
+
+static void
+wake_waiters (struct rlock_box *box)
+{
+  if (box->waiting)
+    {
+      box->waiting = 0;
+      pthread_cond_broadcast (&box->wait);
+    }
+}
+
+/* Wait, as OWNER, for a change to the locks of BOX, one of HOLDER's
+   being in the way.  Return EDEADLK if HOLDER waits for OWNER.  */
+static error_t
+wait_for (struct rlock_box *box, pthread_mutex_t *mut,
+	  struct rlock_owner *owner, struct rlock_owner *holder)
+{
+  struct rlock_owner *o;
+  int n = 0, cancel;
+
+  pthread_mutex_lock (&owners_lock);
+  for (o = holder; o; o = o->blocked_on)
+    if (o == owner || ++n > RLOCK_MAX_CHAIN)
+      {
+	pthread_mutex_unlock (&owners_lock);
+	return EDEADLK;
+      }
+  owner->blocked_on = holder;
+  holder->refs++;
+  pthread_mutex_unlock (&owners_lock);
+
+  box->waiting = 1;
+  cancel = pthread_hurd_cond_wait_np (&box->wait, mut);
+
+  pthread_mutex_lock (&owners_lock);
+  if (owner->blocked_on == holder)
+    owner->blocked_on = NULL;
+  owner_refs_locked (holder, -1);
+  pthread_mutex_unlock (&owners_lock);
+
+  return cancel ? EINTR : 0;
+}
+
+/* Make OWNER hold a TYPE lock on START to END of BOX, or none if TYPE
+   is F_UNLCK.  */
+static error_t
+apply (struct rlock_box *box, struct rlock_owner *owner, int type,
+       loff_t start, loff_t end)
+{
+  struct rlock *new, *spare, *changed = NULL, *l, *next;
+  loff_t new_start = start, new_end = end;
+  int delta = 0;
+
+  int collect (struct rlock *l)
+    {
+      if (l->owner == owner)
+	{
+	  l->next = changed;
+	  changed = l;
+	}
+      return 0;
+    }
+
+  /* Allocate what we may need first, so as not to fail halfway.  A new
+     lock splits at most one old one in two.  */
+  new = malloc (sizeof *new);
+  spare = malloc (sizeof *spare);
+  if (! new || ! spare)
+    {
+      free (new);
+      free (spare);
+      return ENOMEM;
+    }
+
+  /* Also find the locks that just touch the range, to merge them.  */
+  overlapping (box->locks, start > 0 ? start - 1 : start,
+	       end < RLOCK_MAX_END ? end + 1 : end, collect);
+
+  for (l = changed; l; l = next)
+    {
+      next = l->next;
+
+      if ((l->end < start || l->start > end) && l->type != type)
+	/* Touching but not of the same type, so it stays.  */
+	continue;
+
+      box->locks = tree_remove (box->locks, l);
+
+      if (l->type == type)
+	{
+	  if (l->start < new_start)
+	    new_start = l->start;
+	  if (l->end > new_end)
+	    new_end = l->end;
+	  free (l);
+	  delta--;
+	  continue;
+	}
+
+      /* Keep what is outside START to END.  */
+      if (l->start < start && l->end > end)
+	{
+	  *spare = *l;
+	  spare->start = end + 1;
+	  l->end = start - 1;
+	  box->locks = tree_insert (box->locks, l);
+	  box->locks = tree_insert (box->locks, spare);
+	  spare = NULL;
+	  delta++;
+	}
+      else if (l->start < start)
+	{
+	  l->end = start - 1;
+	  box->locks = tree_insert (box->locks, l);
+	}
+      else if (l->end > end)
+	{
+	  l->start = end + 1;
+	  box->locks = tree_insert (box->locks, l);
+	}
+      else
+	{
+	  free (l);
+	  delta--;
+	}
+
+      /* Part of a lock went away or was downgraded.  */
+      wake_waiters (box);
+    }
+
+  if (type != F_UNLCK)
+    {
+      new->start = new_start;
+      new->end = new_end;
+      new->type = type;
+      new->owner = owner;
+      box->locks = tree_insert (box->locks, new);
+      delta++;
+    }
+  else
+    free (new);
+  free (spare);
+
+  if (delta)
+    owner_refs (owner, delta);
+  return 0;
+}
+
+/* Remember in PO that OWNER takes locks through it.  */
+static error_t
+po_add_owner (struct rlock_peropen *po, struct rlock_owner *owner)
+{
+  struct rlock_owner **new;
+  int i;
+
+  if (owner == po->owner)
+    return 0;
+  for (i = 0; i < po->nowners; i++)
+    if (po->owners[i] == owner)
+      return 0;
+
+  new = realloc (po->owners, (po->nowners + 1) * sizeof *new);
+  if (! new)
+    return ENOMEM;
+  po->owners = new;
+  po->owners[po->nowners++] = owner;
+  owner_refs (owner, 1);
+  return 0;
+}
+
+/* Release all the locks of OWNER in BOX.  */
+static void
+drop_owner (struct rlock_box *box, struct rlock_owner *owner)
+{
+  struct rlock *changed = NULL, *l, *next;
+  int n = 0;
+
+  int collect (struct rlock *l)
+    {
+      if (l->owner == owner)
+	{
+	  l->next = changed;
+	  changed = l;
+	}
+      return 0;
+    }
+
+  overlapping (box->locks, 0, RLOCK_MAX_END, collect);
+  for (l = changed; l; l = next)
+    {
+      next = l->next;
+      box->locks = tree_remove (box->locks, l);
+      free (l);
+      n++;
+    }
+
+  if (n)
+    {
+      owner_refs (owner, -n);
+      wake_waiters (box);
+    }
+}
+
+error_t
+fshelp_rlock_tweak (struct rlock_box *box, pthread_mutex_t *mut,
+		    struct rlock_peropen *po, int open_mode,
+		    loff_t file_size, loff_t file_pointer, int cmd,
+		    struct flock64 *lock, mach_port_t rendezvous)
+{
+  struct rlock_owner *owner;
+  struct rlock *conflict;
+  loff_t base, start, end;
+  error_t err = 0;
+
+  switch (lock->l_whence)
+    {
+    case SEEK_SET:
+      base = 0;
+      break;
+    case SEEK_CUR:
+      base = file_pointer;
+      break;
+    case SEEK_END:
+      base = file_size;
+      break;
+    default:
+      err = EINVAL;
+    }
+
+  if (! err
+      && (cmd != F_GETLK64 && cmd != F_SETLK64 && cmd != F_SETLKW64))
+    err = EINVAL;
+  else if (! err
+	   && lock->l_type != F_RDLCK && lock->l_type != F_WRLCK
+	   && (lock->l_type != F_UNLCK || cmd == F_GETLK64))
+    err = EINVAL;
+  else if (! err && cmd != F_GETLK64
+	   && ((lock->l_type == F_RDLCK && ! (open_mode & O_READ))
+	       || (lock->l_type == F_WRLCK && ! (open_mode & O_WRITE))))
+    err = EBADF;
+
+  /* A negative length locks the bytes before the start.  */
+  if (! err && __builtin_add_overflow (base, lock->l_start, &start))
+    err = EOVERFLOW;
+  else if (! err && lock->l_len > 0)
+    {
+      if (__builtin_add_overflow (start, lock->l_len - 1, &end))
+	err = EOVERFLOW;
+    }
+  else if (! err && lock->l_len == 0)
+    end = RLOCK_MAX_END;
+  else if (! err)
+    {
+      end = start - 1;
+      start += lock->l_len;
+    }
+  if (! err && start < 0)
+    err = EINVAL;
+
+  if (err)
+    return err;
+
+  if (rendezvous != MACH_PORT_NULL)
+    err = owner_get (rendezvous, lock->l_pid, &owner);
+  else
+    {
+      /* The locks belong to the open.  */
+      if (! po->owner)
+	err = owner_get (MACH_PORT_NULL, -1, &po->owner);
+      owner = po->owner;
+      if (! err)
+	owner_refs (owner, 1);
+    }
+  if (err)
+    return err;
+
+  if (cmd == F_GETLK64)
+    {
+      conflict = find_conflict (box, owner, lock->l_type, start, end);
+      if (conflict)
+	{
+	  lock->l_type = conflict->type;
+	  lock->l_whence = SEEK_SET;
+	  lock->l_start = conflict->start;
+	  lock->l_len = (conflict->end == RLOCK_MAX_END
+			 ? 0 : conflict->end - conflict->start + 1);
+	  lock->l_pid = conflict->owner->pid;
+	}
+      else
+	lock->l_type = F_UNLCK;
+    }
+  else
+    {
+      if (lock->l_type != F_UNLCK)
+	while (! err
+	       && (conflict = find_conflict (box, owner, lock->l_type,
+					     start, end)))
+	  {
+	    if (cmd == F_SETLK64)
+	      err = EAGAIN;
+	    else
+	      err = wait_for (box, mut, owner, conflict->owner);
+	  }
+
+      if (! err && lock->l_type != F_UNLCK)
+	err = po_add_owner (po, owner);
+      if (! err)
+	err = apply (box, owner, lock->l_type, start, end);
+    }
+
+  owner_refs (owner, -1);
+  if (! err && rendezvous != MACH_PORT_NULL)
+    mach_port_deallocate (mach_task_self (), rendezvous);
+  return err;
+}
+
+void
+fshelp_rlock_drop_peropen (struct rlock_box *box, struct rlock_peropen *po)
+{
+  int i;
+
+  for (i = 0; i < po->nowners; i++)
+    {
+      drop_owner (box, po->owners[i]);
+      owner_refs (po->owners[i], -1);
+    }
+  free (po->owners);
+
+  if (po->owner)
+    {
+      drop_owner (box, po->owner);
+      owner_refs (po->owner, -1);
+    }
+
+  fshelp_rlock_po_init (po);
+}
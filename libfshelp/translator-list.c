@@ -77,6 +77,9 @@ static struct hurd_ihash translator_ihash
 /* The lock protecting the translator_ihash.  */
 static pthread_mutex_t translator_ihash_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/* Incremented whenever translator_ihash changes.  */
+static unsigned int translator_generation;
+
 /* Record an active translator being bound to the given file name
    NAME.  TRANSBOX is the nodes transbox.  PI references a receive
    port that is used to request dead name notifications, typically the
@@ -151,12 +154,14 @@ fshelp_set_active_translator (struct port_info *pi,
       mach_port_mod_refs (mach_task_self (), transbox->active,
 			  MACH_PORT_RIGHT_SEND, +1);
       t->active = transbox->active;
+      translator_generation++;
     }
   else if (! MACH_PORT_VALID (transbox->active))
     {
       int ok;
       ok = hurd_ihash_remove (&translator_ihash, (hurd_ihash_key_t) transbox);
       assert_backtrace (ok);
+      translator_generation++;
     }
 
  out:
@@ -185,12 +190,28 @@ fshelp_remove_active_translator (mach_port_t active)
     }
 
   if (t)
-    hurd_ihash_locp_remove (&translator_ihash, t->locp);
+    {
+      hurd_ihash_locp_remove (&translator_ihash, t->locp);
+      translator_generation++;
+    }
 
   pthread_mutex_unlock (&translator_ihash_lock);
   return err;
 }
 
+/* Return a number that changes whenever the list of active
+   translators does.  */
+unsigned int
+fshelp_get_active_translators_generation (void)
+{
+  unsigned int generation;
+
+  pthread_mutex_lock (&translator_ihash_lock);
+  generation = translator_generation;
+  pthread_mutex_unlock (&translator_ihash_lock);
+  return generation;
+}
+
 /* Records the list of active translators below PREFIX into the argz
    vector specified by TRANSLATORS filtered by FILTER.  If PREFIX is
    NULL, entries with any prefix are considered.  If FILTER is NULL,
@@ -72,3 +72,20 @@ netfs_S_fsys_get_children (struct netfs_control *fsys,
   free (c);
   return err;
 }
+
+/* Implement fsys_get_generation as described in <hurd/fsys.defs>.  */
+error_t
+netfs_S_fsys_get_generation (struct netfs_control *fsys,
+			     mach_port_t reply,
+			     mach_msg_type_name_t reply_type,
+			     natural_t *generation)
+{
+  if (! fsys)
+    return EOPNOTSUPP;
+
+  /* Both only ever grow.  */
+  *generation = (fshelp_get_active_translators_generation ()
+		 + __atomic_load_n (&_netfs_options_generation,
+				    __ATOMIC_RELAXED));
+  return 0;
+}
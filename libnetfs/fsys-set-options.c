@@ -26,6 +26,8 @@
 #include "netfs.h"
 #include "fsys_S.h"
 
+unsigned int _netfs_options_generation;
+
 struct args
 {
   char *data;
@@ -76,6 +78,8 @@ netfs_S_fsys_set_options (struct netfs_control *pt,
       pthread_rwlock_wrlock (&netfs_fsys_lock);
 #endif
       err = netfs_set_options (data, data_len);
+      if (!err)
+	__atomic_add_fetch (&_netfs_options_generation, 1, __ATOMIC_RELAXED);
 #if NOT_YET
       pthread_rwlock_unlock (&netfs_fsys_lock);
 #endif
@@ -44,6 +44,7 @@ netfs_init ()
 
   netfs_protid_class = ports_create_class (netfs_release_protid, 0);
   netfs_control_class = ports_create_class (0, 0);
+  ports_serve_rpc_stats (netfs_control_class);
   netfs_port_bucket = ports_create_bucket ();
   netfs_auth_server_port = getauth ();
   mach_port_allocate (mach_task_self (), MACH_PORT_RIGHT_RECEIVE, 
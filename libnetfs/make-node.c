@@ -33,6 +33,7 @@ init_node (struct node *np, struct netnode *nn)
 
   fshelp_transbox_init (&np->transbox, &np->lock, np);
   fshelp_lock_init (&np->userlock);
+  fshelp_rlock_init (&np->userbox);
   
   return np;
 }
@@ -31,6 +31,7 @@ netfs_make_peropen (struct node *np, int flags, struct peropen *context)
 
   po->filepointer = 0;
   po->lock_status = LOCK_UN;
+  fshelp_rlock_po_init (&po->rlock_status);
   refcount_init (&po->refcnt, 1);
   po->openstat = flags;
   po->np = np;
@@ -51,6 +51,7 @@ struct peropen
 {
   loff_t filepointer;
   int lock_status;
+  struct rlock_peropen rlock_status;
   refcount_t refcnt;
   int openstat;
 
@@ -94,6 +95,7 @@ struct node
   struct transbox transbox;
 
   struct lock_box userlock;
+  struct rlock_box userbox;
 
   struct conch conch;
 
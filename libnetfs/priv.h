@@ -27,6 +27,9 @@
 
 volatile struct mapped_time_value *netfs_mtime;
 
+/* Incremented whenever fsys_set_options changes our options.  */
+extern unsigned int _netfs_options_generation;
+
 static inline struct protid * __attribute__ ((unused))
 begin_using_protid_port (file_t port)
 {
@@ -42,6 +42,7 @@ netfs_release_peropen (struct peropen *po)
   if (po->lock_status != LOCK_UN)
     fshelp_acquire_lock (&po->np->userlock, &po->lock_status,
 			 &po->np->lock, LOCK_UN);
+  fshelp_rlock_drop_peropen (&po->np->userbox, &po->rlock_status);
 
   netfs_nput (po->np);
 
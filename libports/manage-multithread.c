@@ -145,6 +145,7 @@ ports_manage_port_operations_multithread (struct port_bucket *bucket,
 
 	  __atomic_add_fetch (&totalthreads, 1, __ATOMIC_RELAXED);
 	  __atomic_add_fetch (&nreqthreads, 1, __ATOMIC_RELAXED);
+	  _ports_rpc_stats_threads (1);
 
 	  err = pthread_create (&pthread_id, &attr, thread_function, NULL);
 	  if (!err)
@@ -153,6 +154,7 @@ ports_manage_port_operations_multithread (struct port_bucket *bucket,
 	    {
 	      __atomic_sub_fetch (&totalthreads, 1, __ATOMIC_RELAXED);
 	      __atomic_sub_fetch (&nreqthreads, 1, __ATOMIC_RELAXED);
+	      _ports_rpc_stats_threads (-1);
 	      /* There is not much we can do at this point.  The code
 		 and design of the Hurd servers just don't handle
 		 thread creation failure.  */
@@ -195,7 +197,14 @@ ports_manage_port_operations_multithread (struct port_bucket *bucket,
 
       if (pi)
 	{
-	  error_t err = ports_begin_rpc (pi, inp->msgh_id, &link);
+	  int stats = __atomic_load_n (&_ports_rpc_stats_enabled,
+				       __ATOMIC_RELAXED);
+	  uint64_t start = 0, begun = 0;
+	  error_t err;
+
+	  if (stats)
+	    start = _ports_rpc_stats_now ();
+	  err = ports_begin_rpc (pi, inp->msgh_id, &link);
 	  if (err)
 	    {
 	      outp->RetCode = err;
@@ -209,8 +218,14 @@ ports_manage_port_operations_multithread (struct port_bucket *bucket,
 	      if (inp->msgh_seqno < cancel_threshold)
 		hurd_thread_cancel (link.thread);
 
-	      status = demuxer (inp, outheadp);
+	      if (stats)
+		begun = _ports_rpc_stats_now ();
+	      status = ((pi->class->flags & PORT_CLASS_RPCSTATS)
+			&& ports_rpcstats_server (inp, outheadp))
+		       || demuxer (inp, outheadp);
 	      ports_end_rpc (pi, &link);
+	      if (stats)
+		_ports_rpc_stats_record (inp->msgh_id, start, begun);
 	    }
 	  ports_port_deref (pi);
 	}
@@ -276,6 +291,7 @@ ports_manage_port_operations_multithread (struct port_bucket *bucket,
 	      goto startover;
 	    }
 	  __atomic_sub_fetch (&totalthreads, 1, __ATOMIC_RELAXED);
+	  _ports_rpc_stats_threads (-1);
 	}
       _ports_thread_offline (&bucket->threadpool, &thread);
       return NULL;
@@ -287,5 +303,6 @@ ports_manage_port_operations_multithread (struct port_bucket *bucket,
      master thread from going away.  */
   global_timeout = 0;
 
+  _ports_rpc_stats_threads (1);
   thread_function ((void *) 1);
 }
@@ -81,6 +81,12 @@ ports_manage_port_operations_one_thread (struct port_bucket *bucket,
 
       if (pi)
 	{
+	  int stats = __atomic_load_n (&_ports_rpc_stats_enabled,
+				       __ATOMIC_RELAXED);
+	  uint64_t start = 0, begun = 0;
+
+	  if (stats)
+	    start = _ports_rpc_stats_now ();
 	  err = ports_begin_rpc (pi, inp->msgh_id, &link);
 	  if (err)
 	    {
@@ -93,8 +99,14 @@ ports_manage_port_operations_one_thread (struct port_bucket *bucket,
 	      /* No need to check cancel threshold here, because
 		 in a single threaded server the cancel is always
 		 handled in order. */
-	      status = demuxer (inp, outheadp);
+	      if (stats)
+		begun = _ports_rpc_stats_now ();
+	      status = ((pi->class->flags & PORT_CLASS_RPCSTATS)
+			&& ports_rpcstats_server (inp, outheadp))
+		       || demuxer (inp, outheadp);
 	      ports_end_rpc (pi, &link);
+	      if (stats)
+		_ports_rpc_stats_record (inp->msgh_id, start, begun);
 	    }
 	  ports_port_deref (pi);
 	}
@@ -116,9 +128,11 @@ ports_manage_port_operations_one_thread (struct port_bucket *bucket,
   timeout = 0;
 
   _ports_thread_online (&bucket->threadpool, &thread);
+  _ports_rpc_stats_threads (1);
   do
     err = mach_msg_server_timeout (internal_demuxer, 0, bucket->portset, 
 				   timeout ? MACH_RCV_TIMEOUT : 0, timeout);
   while (err != MACH_RCV_TIMED_OUT);
+  _ports_rpc_stats_threads (-1);
   _ports_thread_offline (&bucket->threadpool, &thread);
 }
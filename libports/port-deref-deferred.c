@@ -56,6 +56,12 @@ _ports_threadpool_init (struct ports_threadpool *pool)
   pool->young_objects = NULL;
 }
 
+struct pi_list
+{
+  struct pi_list *next;
+  struct port_info *pi;
+};
+
 /* Turn all young objects and threads into old ones.  */
 static inline void
 flip_generations (struct ports_threadpool *pool)
@@ -68,6 +74,26 @@ flip_generations (struct ports_threadpool *pool)
   pool->color = flip_color (pool->color);
 }
 
+/* Called when OLD_THREADS dropped to zero.  Turn all young objects
+   and threads into old ones and return the list of objects that can
+   be deallocated.  If there are no threads left at all, nobody can
+   be using the young objects either, so they are returned too.  */
+static inline struct pi_list *
+release_generation (struct ports_threadpool *pool)
+{
+  struct pi_list *free_list = pool->old_objects, **tail;
+
+  flip_generations (pool);
+  if (pool->old_threads == 0)
+    {
+      for (tail = &free_list; *tail; tail = &(*tail)->next)
+	;
+      *tail = pool->old_objects;
+      pool->old_objects = NULL;
+    }
+  return free_list;
+}
+
 /* Called by a thread to join a thread pool.  */
 void
 _ports_thread_online (struct ports_threadpool *pool,
@@ -79,18 +105,28 @@ _ports_thread_online (struct ports_threadpool *pool,
   pthread_spin_unlock (&pool->lock);
 }
 
-struct pi_list
+/* Release the references held by the objects on FREE_LIST.  */
+static void
+free_objects (struct pi_list *free_list)
 {
-  struct pi_list *next;
-  struct port_info *pi;
-};
+  struct pi_list *p;
+
+  for (p = free_list; p;)
+    {
+      struct pi_list *old = p;
+      p = p->next;
+
+      ports_port_deref (old->pi);
+      free (old);
+    }
+}
 
 /* Called by a thread that enters its quiescent period.  */
 void
 _ports_thread_quiescent (struct ports_threadpool *pool,
 			 struct ports_thread *thread)
 {
-  struct pi_list *free_list = NULL, *p;
+  struct pi_list *free_list = NULL;
   assert_backtrace (valid_color (thread->color));
 
   pthread_spin_lock (&pool->lock);
@@ -101,21 +137,11 @@ _ports_thread_quiescent (struct ports_threadpool *pool,
       thread->color = flip_color (thread->color);
 
       if (pool->old_threads == 0)
-	{
-	  free_list = pool->old_objects;
-	  flip_generations (pool);
-	}
+	free_list = release_generation (pool);
     }
   pthread_spin_unlock (&pool->lock);
 
-  for (p = free_list; p;)
-    {
-      struct pi_list *old = p;
-      p = p->next;
-
-      ports_port_deref (old->pi);
-      free (old);
-    }
+  free_objects (free_list);
 }
 
 /* Called by a thread to leave a thread pool.  */
@@ -123,19 +149,25 @@ void
 _ports_thread_offline (struct ports_threadpool *pool,
 		       struct ports_thread *thread)
 {
+  struct pi_list *free_list = NULL;
   assert_backtrace (valid_color (thread->color));
 
- retry:
   pthread_spin_lock (&pool->lock);
   if (thread->color == pool->color)
     {
-      pthread_spin_unlock (&pool->lock);
-      _ports_thread_quiescent (pool, thread);
-      goto retry;
+      /* Leaving counts as a quiescent period, but we must not rejoin
+	 the young generation: if we are the only thread, the flip
+	 would make us old again, forever.  */
+      pool->old_threads -= 1;
+      if (pool->old_threads == 0)
+	free_list = release_generation (pool);
     }
+  else
+    pool->young_threads -= 1;
   thread->color = COLOR_INVALID;
-  pool->young_threads -= 1;
   pthread_spin_unlock (&pool->lock);
+
+  free_objects (free_list);
 }
 
 /* Schedule an object for deallocation.  */
@@ -143,6 +175,7 @@ void
 _ports_port_deref_deferred (struct port_info *pi)
 {
   struct ports_threadpool *pool = &pi->bucket->threadpool;
+  struct pi_list *free_list = NULL;
 
   struct pi_list *pl = malloc (sizeof *pl);
   if (pl == NULL)
@@ -155,7 +188,9 @@ _ports_port_deref_deferred (struct port_info *pi)
   if (pool->old_threads == 0)
     {
       assert_backtrace (pool->old_objects == NULL);
-      flip_generations (pool);
+      free_list = release_generation (pool);
     }
   pthread_spin_unlock (&pool->lock);
+
+  free_objects (free_list);
 }
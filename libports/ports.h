@@ -103,6 +103,7 @@ struct port_class
 #define PORT_CLASS_INHIBIT_WAIT	PORTS_INHIBIT_WAIT
 #define PORT_CLASS_NO_ALLOC	PORTS_NO_ALLOC
 #define PORT_CLASS_ALLOC_WAIT	PORTS_ALLOC_WAIT
+#define PORT_CLASS_RPCSTATS	0x2000 /* serve rpcstats_get */
 
 struct rpc_info
 {
@@ -384,6 +385,33 @@ void ports_manage_port_operations_multithread (struct port_bucket *bucket,
 					       int global_timeout,
 					       void (*hook)(void));
 
+/* RPC statistics.  When enabled, the ports_manage_port_operations_*
+   functions record per message id call counts, latency histograms and
+   the time spent waiting in ports_begin_rpc, as well as the size of the
+   thread pool over time.  Statistics can also be enabled, reset and
+   read by clients with the rpcstats_get RPC (see <hurd/rpcstats.defs>),
+   which is only served on ports of classes passed to
+   ports_serve_rpc_stats.  */
+
+/* Answer rpcstats_get on ports of CLASS before the server's demuxer
+   sees the message.  As the RPC can change the server's state, CLASS
+   should be one whose ports are only handed to privileged users, such
+   as a control port class.  */
+void ports_serve_rpc_stats (struct port_class *class);
+
+/* Start collecting RPC statistics, discarding any old ones.  */
+void ports_enable_rpc_stats (void);
+
+/* Stop collecting RPC statistics.  Collected ones are kept.  */
+void ports_disable_rpc_stats (void);
+
+/* Discard collected RPC statistics.  */
+void ports_reset_rpc_stats (void);
+
+/* Return a textual report of the collected RPC statistics in *DATA
+   (allocated with malloc) and its length in *LEN.  */
+error_t ports_rpc_stats_report (char **data, size_t *len);
+
 /* Interrupt any pending RPC on PORT.  Wait for all pending RPC's to
    finish, and then block any new RPC's starting on that port. */
 error_t ports_inhibit_port_rpcs (void *port);
@@ -447,6 +475,12 @@ void ports_interrupt_notified_rpcs (void *object, mach_port_t port,
 /* A notification server that calls the ports_do_mach_notify_* routines.  */
 int ports_notify_server (mach_msg_header_t *, mach_msg_header_t *);
 
+/* The rpcstats server; ports_manage_port_operations_* call this before
+   the user's demuxer for ports of classes flagged PORT_CLASS_RPCSTATS.
+   Servers that need a finer check than the port class, like proc, can
+   call it from their own demuxer instead.  */
+int ports_rpcstats_server (mach_msg_header_t *, mach_msg_header_t *);
+
 /* Notification server routines called by ports_notify_server.  */
 extern kern_return_t
  ports_do_mach_notify_dead_name (struct port_info *pi, mach_port_t deadport);
@@ -480,6 +514,11 @@ extern pthread_rwlock_t _ports_htable_lock;
 
 extern int _ports_total_rpcs;
 extern int _ports_flags;
+extern int _ports_rpc_stats_enabled;
+uint64_t _ports_rpc_stats_now (void);
+void _ports_rpc_stats_record (mach_msg_id_t msgid, uint64_t start,
+			      uint64_t begun);
+void _ports_rpc_stats_threads (int delta);
 #define _PORTS_INHIBITED	PORTS_INHIBITED
 #define _PORTS_BLOCKED		PORTS_BLOCKED
 #define _PORTS_INHIBIT_WAIT	PORTS_INHIBIT_WAIT
@@ -0,0 +1,274 @@
+/* Per-RPC statistics
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "ports.h"
+#include "rpcstats_S.h"
+#include <hurd/hurd_types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+
+/* Statistics are kept in a fixed-size open addressed table indexed by
+   message id, so that recording an RPC never allocates or takes a
+   lock.  Slots are claimed with a compare-and-swap on KEY, which holds
+   the message id plus one so that zero marks an unused slot.  If the
+   table fills up, RPCs with new ids are counted in OVERFLOW only.  */
+#define STATS_SLOTS	1024
+#define STATS_PROBES	16
+
+/* Latency histogram bucket N counts RPCs that took less than 2^N
+   microseconds; the last bucket counts everything slower.  */
+#define STATS_BUCKETS	24
+
+/* Number of thread pool size changes remembered.  */
+#define STATS_SAMPLES	128
+
+struct rpc_stat
+{
+  unsigned int key;
+  uint64_t count;
+  uint64_t total_ns;		/* Time spent in the demuxer.  */
+  uint64_t max_ns;
+  uint64_t wait_ns;		/* Time spent in ports_begin_rpc.  */
+  uint64_t buckets[STATS_BUCKETS];
+};
+
+static struct rpc_stat stats[STATS_SLOTS];
+static uint64_t overflow;
+
+int _ports_rpc_stats_enabled;
+static uint64_t stats_start;
+
+/* Threads currently running ports_manage_port_operations_*.  */
+static unsigned int nthreads;
+static unsigned int max_threads;
+
+static struct
+{
+  uint64_t time;
+  unsigned int threads;
+} samples[STATS_SAMPLES];
+static unsigned int nsamples;
+
+uint64_t
+_ports_rpc_stats_now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static struct rpc_stat *
+find_stat (mach_msg_id_t msgid)
+{
+  unsigned int key = (unsigned int) msgid + 1;
+  unsigned int i, slot;
+
+  for (i = 0; i < STATS_PROBES; i++)
+    {
+      unsigned int old;
+
+      slot = (key * 2654435761U + i) % STATS_SLOTS;
+      old = __atomic_load_n (&stats[slot].key, __ATOMIC_ACQUIRE);
+      if (old == key)
+	return &stats[slot];
+      if (old == 0
+	  && (__atomic_compare_exchange_n (&stats[slot].key, &old, key, 0,
+					   __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+	      || old == key))
+	return &stats[slot];
+    }
+  return NULL;
+}
+
+void
+_ports_rpc_stats_record (mach_msg_id_t msgid, uint64_t start, uint64_t begun)
+{
+  struct rpc_stat *s = find_stat (msgid);
+  uint64_t now = _ports_rpc_stats_now ();
+  uint64_t ns = now - begun;
+  uint64_t max, us;
+  int b;
+
+  if (s == NULL)
+    {
+      __atomic_add_fetch (&overflow, 1, __ATOMIC_RELAXED);
+      return;
+    }
+
+  __atomic_add_fetch (&s->count, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch (&s->total_ns, ns, __ATOMIC_RELAXED);
+  __atomic_add_fetch (&s->wait_ns, begun - start, __ATOMIC_RELAXED);
+
+  max = __atomic_load_n (&s->max_ns, __ATOMIC_RELAXED);
+  while (ns > max
+	 && ! __atomic_compare_exchange_n (&s->max_ns, &max, ns, 1,
+					   __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
+
+  us = ns / 1000;
+  for (b = 0; b < STATS_BUCKETS - 1 && us >= (1ULL << b); b++)
+    ;
+  __atomic_add_fetch (&s->buckets[b], 1, __ATOMIC_RELAXED);
+}
+
+void
+_ports_rpc_stats_threads (int delta)
+{
+  unsigned int n = __atomic_add_fetch (&nthreads, delta, __ATOMIC_RELAXED);
+  unsigned int max = __atomic_load_n (&max_threads, __ATOMIC_RELAXED);
+
+  while (n > max
+	 && ! __atomic_compare_exchange_n (&max_threads, &max, n, 1,
+					   __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
+
+  if (__atomic_load_n (&_ports_rpc_stats_enabled, __ATOMIC_RELAXED))
+    {
+      unsigned int i = __atomic_fetch_add (&nsamples, 1, __ATOMIC_RELAXED);
+      samples[i % STATS_SAMPLES].time = _ports_rpc_stats_now ();
+      samples[i % STATS_SAMPLES].threads = n;
+    }
+}
+
+void
+ports_serve_rpc_stats (struct port_class *class)
+{
+  pthread_mutex_lock (&_ports_lock);
+  class->flags |= PORT_CLASS_RPCSTATS;
+  pthread_mutex_unlock (&_ports_lock);
+}
+
+void
+ports_enable_rpc_stats (void)
+{
+  if (! __atomic_exchange_n (&_ports_rpc_stats_enabled, 1, __ATOMIC_RELAXED))
+    ports_reset_rpc_stats ();
+}
+
+void
+ports_disable_rpc_stats (void)
+{
+  __atomic_store_n (&_ports_rpc_stats_enabled, 0, __ATOMIC_RELAXED);
+}
+
+/* Concurrent RPCs may still add to the counters while they are being
+   cleared; that only makes the next report slightly inaccurate.  */
+void
+ports_reset_rpc_stats (void)
+{
+  int i;
+
+  for (i = 0; i < STATS_SLOTS; i++)
+    {
+      unsigned int key = stats[i].key;
+      memset (&stats[i], 0, sizeof stats[i]);
+      stats[i].key = key;
+    }
+  overflow = 0;
+  nsamples = 0;
+  max_threads = nthreads;
+  stats_start = _ports_rpc_stats_now ();
+}
+
+error_t
+ports_rpc_stats_report (char **data, size_t *len)
+{
+  FILE *f;
+  unsigned int i, n;
+  int b;
+
+  f = open_memstream (data, len);
+  if (f == NULL)
+    return errno;
+
+  fprintf (f, "rpcstats 1\n");
+  fprintf (f, "enabled %d\n",
+	   __atomic_load_n (&_ports_rpc_stats_enabled, __ATOMIC_RELAXED));
+  fprintf (f, "elapsed %llu\n",
+	   (unsigned long long) (_ports_rpc_stats_now () - stats_start));
+  fprintf (f, "threads %u %u\n", nthreads, max_threads);
+  fprintf (f, "overflow %llu\n", (unsigned long long) overflow);
+
+  n = __atomic_load_n (&nsamples, __ATOMIC_RELAXED);
+  for (i = n > STATS_SAMPLES ? n - STATS_SAMPLES : 0; i < n; i++)
+    fprintf (f, "sample %llu %u\n",
+	     (unsigned long long) (samples[i % STATS_SAMPLES].time
+				   - stats_start),
+	     samples[i % STATS_SAMPLES].threads);
+
+  for (i = 0; i < STATS_SLOTS; i++)
+    {
+      struct rpc_stat *s = &stats[i];
+      if (s->key == 0 || s->count == 0)
+	continue;
+      fprintf (f, "rpc %d %llu %llu %llu %llu",
+	       (mach_msg_id_t) (s->key - 1),
+	       (unsigned long long) s->count,
+	       (unsigned long long) s->total_ns,
+	       (unsigned long long) s->max_ns,
+	       (unsigned long long) s->wait_ns);
+      for (b = 0; b < STATS_BUCKETS; b++)
+	fprintf (f, " %llu", (unsigned long long) s->buckets[b]);
+      putc ('\n', f);
+    }
+
+  if (fclose (f))
+    {
+      free (*data);
+      return errno;
+    }
+  return 0;
+}
+
+kern_return_t
+ports_S_rpcstats_get (mach_port_t server, int flags,
+		      data_t *data, mach_msg_type_number_t *len)
+{
+  error_t err;
+  char *buf;
+  size_t buflen;
+
+  if (flags & RPCSTATS_DISABLE)
+    ports_disable_rpc_stats ();
+  if (flags & RPCSTATS_RESET)
+    ports_reset_rpc_stats ();
+  if (flags & RPCSTATS_ENABLE)
+    ports_enable_rpc_stats ();
+
+  err = ports_rpc_stats_report (&buf, &buflen);
+  if (err)
+    return err;
+
+  if (buflen > *len)
+    {
+      *data = mmap (0, buflen, PROT_READ|PROT_WRITE, MAP_ANON, 0, 0);
+      if (*data == MAP_FAILED)
+	{
+	  free (buf);
+	  return errno;
+	}
+    }
+  memcpy (*data, buf, buflen);
+  *len = buflen;
+  free (buf);
+
+  return 0;
+}
@@ -44,6 +44,12 @@ ps_context_create (process_t server, struct ps_context **pc)
   hurd_ihash_init (&(*pc)->ttys, HURD_IHASH_NO_LOCP);
   hurd_ihash_init (&(*pc)->ttys_by_cttyid, HURD_IHASH_NO_LOCP);
   hurd_ihash_init (&(*pc)->users, HURD_IHASH_NO_LOCP);
+  hurd_ihash_init (&(*pc)->prefetched, HURD_IHASH_NO_LOCP);
+  (*pc)->prefetch = 0;
+  (*pc)->prefetch_len = 0;
+  (*pc)->prefetch_time = 0;
+  pthread_mutex_init (&(*pc)->prefetch_lock, NULL);
+  (*pc)->no_bulk = 0;
 
   hurd_ihash_set_cleanup (&(*pc)->procs,
 			  (hurd_ihash_cleanup_t) _proc_stat_free, NULL);
@@ -63,6 +69,9 @@ ps_context_free (struct ps_context *pc)
   hurd_ihash_destroy (&pc->ttys);
   hurd_ihash_destroy (&pc->ttys_by_cttyid);
   hurd_ihash_destroy (&pc->users);
+  hurd_ihash_destroy (&pc->prefetched);
+  if (pc->prefetch)
+    munmap (pc->prefetch, pc->prefetch_len * sizeof (int));
   free (pc);
 }
 
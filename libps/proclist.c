@@ -372,6 +372,21 @@ proc_stat_list_set_flags (struct proc_stat_list *pp, ps_flags_t flags)
 {
   unsigned nprocs = pp->num_procs;
   struct proc_stat **procs = pp->proc_stats;
+  pid_t *pids = nprocs > 1 ? malloc (nprocs * sizeof (pid_t)) : 0;
+
+  if (pids)
+    /* Try to get the procinfo part of FLAGS for all of them at once.  */
+    {
+      size_t npids = 0;
+      unsigned i;
+
+      for (i = 0; i < nprocs; i++)
+	if (!proc_stat_is_thread (procs[i]) && !proc_stat_has (procs[i], flags))
+	  pids[npids++] = proc_stat_pid (procs[i]);
+      if (npids > 1)
+	ps_context_prefetch_procinfo (pp->context, pids, npids, flags);
+      free (pids);
+    }
 
   while (nprocs-- > 0)
     {
@@ -27,6 +27,7 @@
 #include "common.h"
 
 #include "ps_msg.h"
+#include "ps_process.h"
 
 /* ---------------------------------------------------------------- */
 
@@ -100,55 +101,118 @@ thread_state (thread_basic_info_t bi)
 #define PSTAT_PROCINFO_MERGE    (PSTAT_TASK_BASIC | PSTAT_TASK_EVENTS)
 #define PSTAT_PROCINFO_REFETCH  (PSTAT_PROCINFO - PSTAT_PROCINFO_MERGE)
 
+/* How PSTAT_ flags map to the PI_FETCH_ flags needed to get them.  */
+static const struct { ps_flags_t ps_flag; int pi_flags; } procinfo_map[] =
+{
+  { PSTAT_TASK_BASIC,     PI_FETCH_TASKINFO				},
+  { PSTAT_TASK_EVENTS,    PI_FETCH_TASKEVENTS				},
+  { PSTAT_NUM_THREADS,    PI_FETCH_THREADS				},
+  { PSTAT_THREAD_BASIC,   PI_FETCH_THREAD_BASIC | PI_FETCH_THREADS	},
+  { PSTAT_THREAD_SCHED,   PI_FETCH_THREAD_SCHED | PI_FETCH_THREADS	},
+  { PSTAT_THREAD_WAITS,   PI_FETCH_THREAD_WAITS | PI_FETCH_THREADS	},
+  { 0, }
+};
+
+/* Returns the PI_FETCH_ flags needed to get the things in NEED that aren't
+   in HAVE.  */
+static int
+procinfo_flags (ps_flags_t need, ps_flags_t have)
+{
+  int pi_flags = 0;
+  int i;
+
+  for (i = 0; procinfo_map[i].ps_flag; i++)
+    if ((need & procinfo_map[i].ps_flag) && !(have & procinfo_map[i].ps_flag))
+      pi_flags |= procinfo_map[i].pi_flags;
+
+  return pi_flags;
+}
+
+/* If PC has prefetched information about PID including everything in
+   *PI_FLAGS, returns it in PI & PI_SIZE the way proc_getprocinfo would, sets
+   *PI_FLAGS to what it includes, forgets it and returns true.  Otherwise
+   returns false.  */
+static int
+use_prefetched (struct ps_context *pc, pid_t pid, int *pi_flags,
+		struct procinfo **pi, size_t *pi_size)
+{
+  struct procinfo_bulk *rec;
+  int found = 0;
+
+  pthread_mutex_lock (&pc->prefetch_lock);
+  rec = hurd_ihash_find (&pc->prefetched, pid);
+  if (rec)
+    {
+      hurd_ihash_remove (&pc->prefetched, pid);
+      if (! rec->error && (rec->flags & *pi_flags) == *pi_flags
+	  && time (NULL) - pc->prefetch_time <= 1)
+	{
+	  size_t size = rec->len * sizeof (int);
+	  void *buf = *pi;
+
+	  if (size > *pi_size)
+	    buf = mmap (0, size, PROT_READ|PROT_WRITE, MAP_ANON, 0, 0);
+	  if (buf != MAP_FAILED)
+	    {
+	      memcpy (buf, rec + 1, size);
+	      *pi = buf;
+	      *pi_size = size;
+	      *pi_flags = rec->flags;
+	      found = 1;
+	    }
+	}
+      if (pc->prefetched.nr_items == 0)
+	/* That was the last one.  */
+	{
+	  munmap (pc->prefetch, pc->prefetch_len * sizeof (int));
+	  pc->prefetch = 0;
+	  pc->prefetch_len = 0;
+	}
+    }
+  pthread_mutex_unlock (&pc->prefetch_lock);
+
+  return found;
+}
+
 /* Fetches process information from the set in PSTAT_PROCINFO, returning it
    in PI & PI_SIZE.  NEED is the information, and HAVE is the what we already
    have.  */
 static error_t
-fetch_procinfo (process_t server, pid_t pid,
+fetch_procinfo (struct ps_context *pc, pid_t pid,
 		ps_flags_t need, ps_flags_t *have,
 		struct procinfo **pi, size_t *pi_size,
 		char **waits, size_t *waits_len)
 {
-  static const struct { ps_flags_t ps_flag; int pi_flags; } map[] =
-  {
-    { PSTAT_TASK_BASIC,     PI_FETCH_TASKINFO				},
-    { PSTAT_TASK_EVENTS,    PI_FETCH_TASKEVENTS				},
-    { PSTAT_NUM_THREADS,    PI_FETCH_THREADS				},
-    { PSTAT_THREAD_BASIC,   PI_FETCH_THREAD_BASIC | PI_FETCH_THREADS	},
-    { PSTAT_THREAD_SCHED,   PI_FETCH_THREAD_SCHED | PI_FETCH_THREADS	},
-    { PSTAT_THREAD_WAITS,   PI_FETCH_THREAD_WAITS | PI_FETCH_THREADS	},
-    { 0, }
-  };
-  int pi_flags = 0;
+  int pi_flags = procinfo_flags (need, *have);
   int i;
 
-  for (i = 0; map[i].ps_flag; i++)
-    if ((need & map[i].ps_flag) && !(*have & map[i].ps_flag))
-      pi_flags |= map[i].pi_flags;
-
   if (pi_flags || ((need & PSTAT_PROC_INFO) && !(*have & PSTAT_PROC_INFO)))
     {
-      error_t err;
+      error_t err = 0;
 
-      *pi_size /= sizeof (int);	/* getprocinfo takes an array of ints.  */
-      err = proc_getprocinfo (server, pid, &pi_flags,
-			      (procinfo_t *)pi, pi_size, waits, waits_len);
-      *pi_size *= sizeof (int);
+      if (! use_prefetched (pc, pid, &pi_flags, pi, pi_size))
+	{
+	  *pi_size /= sizeof (int);	/* getprocinfo takes an array of ints.  */
+	  err = proc_getprocinfo (pc->server, pid, &pi_flags,
+				  (procinfo_t *)pi, pi_size, waits, waits_len);
+	  *pi_size *= sizeof (int);
+	}
 
       if (! err)
 	/* Update *HAVE to reflect what we've successfully fetched.  */
 	{
 	  *have |= PSTAT_PROC_INFO;
-	  for (i = 0; map[i].ps_flag; i++)
-	    if ((pi_flags & map[i].pi_flags) == map[i].pi_flags)
-	      *have |= map[i].ps_flag;
+	  for (i = 0; procinfo_map[i].ps_flag; i++)
+	    if ((pi_flags & procinfo_map[i].pi_flags)
+		== procinfo_map[i].pi_flags)
+	      *have |= procinfo_map[i].ps_flag;
 	}
       return err;
     }
   else
     return 0;
 }
-
+
 /* The size of the initial buffer malloced to try and avoid getting
    vm_alloced memory for the procinfo structure returned by getprocinfo.
    Here we just give enough for four threads.  */
@@ -207,7 +271,7 @@ merge_procinfo (struct proc_stat *ps, ps_flags_t need, ps_flags_t have)
       new_waits_len = ps->thread_waits_len;
     }
 
-  err = fetch_procinfo (ps->context->server, ps->pid, really_need, &really_have,
+  err = fetch_procinfo (ps->context, ps->pid, really_need, &really_have,
 			&new_pi, &new_pi_size,
 			&new_waits, &new_waits_len);
   if (err)
@@ -597,6 +661,71 @@ get_thread_wait (char *waits, size_t waits_len, unsigned n)
   return wait;
 }
 
+/* Fetch with a single RPC the information in FLAGS that proc_stat_set_flags
+   would get from proc_getprocinfo for the NPIDS processes in PIDS, or for
+   every process if NPIDS is 0, and keep it in PC for a short while.  */
+error_t
+ps_context_prefetch_procinfo (struct ps_context *pc,
+			      const pid_t *pids, size_t npids,
+			      ps_flags_t flags)
+{
+  error_t err;
+  int pi_flags;
+  int *recs = 0;
+  mach_msg_type_number_t recs_len = 0;
+  size_t i;
+
+  flags = add_preconditions (flags, pc);
+  if (flags & PSTAT_USES_MSGPORT)
+    flags |= add_preconditions (PSTAT_TEST_MSGPORT, pc);
+  if (! (flags & PSTAT_PROCINFO) || pc->no_bulk)
+    return 0;
+
+  pi_flags = procinfo_flags (flags, 0);
+  if (pi_flags & PI_FETCH_THREAD_WAITS)
+    /* Not available in bulk, so each process will take an RPC anyway.  */
+    return 0;
+
+  err = ps_proc_getprocinfo_bulk (pc->server, (pid_t *) pids, npids,
+				  &pi_flags, &recs, &recs_len);
+  if (err == MIG_BAD_ID || err == EOPNOTSUPP)
+    /* An old proc server; don't bother again.  */
+    {
+      pc->no_bulk = 1;
+      return 0;
+    }
+  if (err)
+    return err;
+
+  pthread_mutex_lock (&pc->prefetch_lock);
+
+  /* Forget anything left over from last time.  */
+  hurd_ihash_destroy (&pc->prefetched);
+  hurd_ihash_init (&pc->prefetched, HURD_IHASH_NO_LOCP);
+  if (pc->prefetch)
+    munmap (pc->prefetch, pc->prefetch_len * sizeof (int));
+
+  pc->prefetch = recs;
+  pc->prefetch_len = recs_len;
+  pc->prefetch_time = time (NULL);
+
+  for (i = 0; i + sizeof (struct procinfo_bulk) / sizeof (int) <= recs_len; )
+    {
+      struct procinfo_bulk *rec = (struct procinfo_bulk *) &recs[i];
+
+      i += sizeof *rec / sizeof (int) + rec->len;
+      if (i > recs_len)
+	break;			/* Truncated; shouldn't happen.  */
+      err = hurd_ihash_add (&pc->prefetched, rec->pid, rec);
+      if (err)
+	break;
+    }
+
+  pthread_mutex_unlock (&pc->prefetch_lock);
+
+  return err;
+}
+
 /* Returns a malloced block of memory SIZE bytes long, containing a copy of
    SRC.  */
 static void *
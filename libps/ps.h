@@ -27,6 +27,8 @@
 
 #include <pwd.h>
 #include <errno.h>
+#include <pthread.h>
+#include <time.h>
 
 /* A PS_USER holds info about a particular user.  */
 
@@ -139,6 +141,21 @@ struct ps_context
 
   /* Functions that can be set to extend the behavior of proc_stats.  */
   struct ps_user_hooks *user_hooks;
+
+  /* Process information fetched for many processes at once by
+     ps_context_prefetch_procinfo, as returned by proc_getprocinfo_bulk.
+     PREFETCHED maps process ids to their struct procinfo_bulk records in
+     PREFETCH; each record is used at most once, and none after
+     PREFETCH_TIME + 1 second.  These are protected by PREFETCH_LOCK, so
+     that several threads may share the context.  */
+  struct hurd_ihash prefetched;
+  int *prefetch;
+  size_t prefetch_len;
+  time_t prefetch_time;
+  pthread_mutex_t prefetch_lock;
+
+  /* Nonzero if SERVER doesn't implement proc_getprocinfo_bulk.  */
+  int no_bulk;
 };
 
 #define ps_context_server(pc) ((pc)->server)
@@ -481,6 +498,18 @@ void _proc_stat_free (struct proc_stat *ps);
    a system error code if a fatal error occurred, and 0 otherwise.  */
 error_t proc_stat_set_flags (struct proc_stat *ps, ps_flags_t flags);
 
+/* Fetch with a single RPC the information in FLAGS that proc_stat_set_flags
+   would get from proc_getprocinfo for the NPIDS processes in PIDS, or for
+   every process if NPIDS is 0, and keep it in PC for a short while, so that
+   setting FLAGS in proc_stats for those processes doesn't each take an RPC.
+   This is only an optimization; if the proc server doesn't support it, or
+   some of FLAGS can't be fetched this way, proc_stat_set_flags just fetches
+   them itself.  Returns a system error code if an error occurred, and 0
+   otherwise.  */
+error_t ps_context_prefetch_procinfo (struct ps_context *pc,
+				      const pid_t *pids, size_t npids,
+				      ps_flags_t flags);
+
 /* Returns in THREAD_PS a proc_stat for the Nth thread in the proc_stat
    PS (N should be between 0 and the number of threads in the process).  The
    resulting proc_stat isn't fully functional -- most flags can't be set in
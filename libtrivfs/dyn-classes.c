@@ -177,6 +177,8 @@ trivfs_add_control_port_class (struct port_class **class)
 	return ENOMEM;
     }
 
+  ports_serve_rpc_stats (*class);
+
   return
     add_el (*class, 0,
 	    &trivfs_dynamic_control_port_classes, 
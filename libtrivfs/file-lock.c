@@ -26,6 +26,14 @@ trivfs_S_file_lock (struct trivfs_protid *cred,
   return EOPNOTSUPP;
 }
 
+kern_return_t
+trivfs_S_file_record_lock (struct trivfs_protid *cred,
+			   mach_port_t reply, mach_msg_type_name_t reply_type,
+			   int cmd, flock_t *lock, mach_port_t rendezvous)
+{
+  return EOPNOTSUPP;
+}
+
 kern_return_t
 trivfs_S_file_lock_stat (struct trivfs_protid *cred,
 			 mach_port_t reply, mach_msg_type_name_t reply_type,
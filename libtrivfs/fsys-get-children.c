@@ -39,3 +39,19 @@ trivfs_S_fsys_get_children (struct trivfs_control *fsys,
 {
   return EOPNOTSUPP;
 }
+
+/* Implement fsys_get_generation as described in <hurd/fsys.defs>.  We
+   have no children, so only our options can change.  */
+error_t
+trivfs_S_fsys_get_generation (struct trivfs_control *fsys,
+			      mach_port_t reply,
+			      mach_msg_type_name_t replyPoly,
+			      natural_t *generation)
+{
+  if (! fsys)
+    return EOPNOTSUPP;
+
+  *generation = __atomic_load_n (&_trivfs_options_generation,
+				 __ATOMIC_RELAXED);
+  return 0;
+}
@@ -23,14 +23,21 @@
 #include "priv.h"
 #include "trivfs_fsys_S.h"
 
+unsigned int _trivfs_options_generation;
+
 error_t
 trivfs_S_fsys_set_options (struct trivfs_control *cntl,
 			   mach_port_t reply, mach_msg_type_name_t reply_type,
 			   char *data, mach_msg_type_number_t len,
 			   int do_children)
 {
-  if (cntl)
-    return trivfs_set_options (cntl, data, len);
-  else
+  error_t err;
+
+  if (! cntl)
     return EOPNOTSUPP;
+
+  err = trivfs_set_options (cntl, data, len);
+  if (! err)
+    __atomic_add_fetch (&_trivfs_options_generation, 1, __ATOMIC_RELAXED);
+  return err;
 }
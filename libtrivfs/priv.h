@@ -25,6 +25,9 @@
 #include <unistd.h>
 #include "trivfs.h"
 
+/* Incremented whenever fsys_set_options changes our options.  */
+extern unsigned int _trivfs_options_generation;
+
 /* Returns true if UIDS contains either 0 or our user id.  */
 static inline int
 _is_privileged (struct idvec *uids)
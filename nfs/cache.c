@@ -22,6 +22,7 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <error.h>
 #include <netinet/in.h>
 
 /* Compute and return a hash key for NFS file handle.  */
@@ -84,6 +85,7 @@ lookup_fhandle (struct fhandle *handle, struct node **npp)
   nn->dtrans = NOT_POSSIBLE;
   nn->dead_dir = 0;
   nn->dead_name = 0;
+  nn->data = 0;
   
   hurd_ihash_add (&nodehash, (hurd_ihash_key_t) &nn->handle, np);
   netfs_nref_light (np);
@@ -150,15 +152,23 @@ netfs_node_norefs (struct node *np)
     {
       if (np->nn->dtrans == SYMLINK)
         free (np->nn->transarg.name);
+      data_cache_free (np);
       free (np);
     }
 }
 
-/* When dropping soft refs, we simply remove the node from the
-   node cache.  */
+/* When dropping soft refs, we commit any pending writes and remove
+   the node from the node cache.  */
 void
 netfs_try_dropping_softrefs (struct node *np)
 {
+  error_t err;
+
+  /* The last user is gone; make sure the server has its writes.  */
+  err = data_cache_commit ((struct iouser *) -1, np);
+  if (err)
+    error (0, err, "nfs commit");
+
   pthread_mutex_lock (&nodehash_ihash_lock);
   hurd_ihash_locp_remove (&nodehash, np->nn->slot);
   netfs_nrele_light (np);
@@ -195,3 +205,41 @@ recache_handle (int *p, struct node *np)
   pthread_mutex_unlock (&nodehash_ihash_lock);
   return p + len / sizeof (int);
 }
+
+/* Commit the pending writes of all nodes.  */
+error_t
+commit_all_nodes (void)
+{
+  struct node **nodes;
+  size_t n = 0, i;
+  error_t err = 0;
+
+  pthread_mutex_lock (&nodehash_ihash_lock);
+  nodes = malloc (nodehash.nr_items * sizeof *nodes);
+  if (! nodes)
+    {
+      pthread_mutex_unlock (&nodehash_ihash_lock);
+      return ENOMEM;
+    }
+  HURD_IHASH_ITERATE (&nodehash, value)
+    {
+      struct node *np = value;
+      netfs_nref (np);
+      nodes[n++] = np;
+    }
+  pthread_mutex_unlock (&nodehash_ihash_lock);
+
+  for (i = 0; i < n; i++)
+    {
+      error_t e;
+
+      pthread_mutex_lock (&nodes[i]->lock);
+      e = data_cache_commit ((struct iouser *) -1, nodes[i]);
+      if (e && ! err)
+	err = e;
+      netfs_nput (nodes[i]);
+    }
+
+  free (nodes);
+  return err;
+}
@@ -0,0 +1,776 @@
+/* data-cache.c - File contents cache, read-ahead and write-behind.
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* Reads and writes are split into RPCs of at most read_size and
+   write_size bytes.  Rather than waiting for each of them in turn, we
+   send up to MAX_INFLIGHT at once, so that a large transfer costs a
+   few round trips instead of one per chunk.
+
+   Each node caches the last DATA_CACHE_BLOCKS blocks of read_size
+   bytes read from it; if read_size is changed with fsysopts, the
+   blocks cached with the old size are dropped.  With NFSv3, a block
+   the server returned only part of without reaching the end of file
+   is completed with further reads.  A reader that continues where its
+   last read ended gets a read-ahead window that doubles with every
+   sequential read, up to READ_AHEAD blocks.  Cached blocks are dropped
+   when the attributes returned by the server show that someone else
+   changed the file, and after cache_timeout seconds.
+
+   With NFSv3, writes are sent UNSTABLE and kept until a COMMIT
+   confirms that the server has them on stable storage.  If the
+   server's write verifier changes in between, it rebooted and may
+   have lost them, so they are sent again.  At most WRITE_BEHIND bytes
+   per node are kept; beyond that, or on sync, or when the last user
+   closes the file, they are committed.  */
+
+#include "nfs.h"
+
+#include <netinet/in.h>
+#include <string.h>
+#include <error.h>
+
+#define DATA_CACHE_BLOCKS 32
+#define MAX_INFLIGHT DATA_CACHE_BLOCKS
+
+struct cached_block
+{
+  off_t offset;			/* Of the first byte; a multiple of BLOCK_SIZE.  */
+  size_t len;			/* Less than BLOCK_SIZE at end of file.  */
+  time_t fetched;		/* When it was read; 0 if invalid.  */
+  char *data;
+};
+
+/* A write the server has not yet committed to stable storage.  */
+struct unstable_write
+{
+  struct unstable_write *next;
+  off_t offset;
+  size_t len;
+  char data[];
+};
+
+struct data_cache
+{
+  /* Block N lives in BLOCKS[N % DATA_CACHE_BLOCKS].  Their data
+     buffers are BLOCK_SIZE bytes, the value of read_size when they
+     were allocated.  */
+  struct cached_block blocks[DATA_CACHE_BLOCKS];
+  int block_size;
+
+  /* The attributes the cached contents belong to.  */
+  struct timespec mtime;
+  off_t size;
+
+  /* Set while we expect the attributes to change because of our own
+     write; the new ones are then taken over without dropping the
+     cache.  */
+  int own_change;
+
+  /* Where the last read ended, and the current read-ahead window in
+     blocks.  */
+  off_t next_offset;
+  int window;
+
+  /* Unstable writes, newest first, and the write verifier the server
+     returned for them.  */
+  struct unstable_write *unstable;
+  size_t unstable_bytes;
+  char verf[NFS3_WRITEVERFSIZE];
+  int verf_changed;
+};
+
+/* Forget all cached blocks of DC.  */
+static void
+invalidate_blocks (struct data_cache *dc)
+{
+  int i;
+
+  for (i = 0; i < DATA_CACHE_BLOCKS; i++)
+    dc->blocks[i].fetched = 0;
+  dc->window = 0;
+}
+
+/* Return NP's data cache, creating it if necessary.  If read_size has
+   changed since the cached blocks were allocated, free them.  */
+static struct data_cache *
+get_data_cache (struct node *np)
+{
+  struct data_cache *dc = np->nn->data;
+  int size = read_size;
+  int i;
+
+  if (! dc)
+    {
+      dc = np->nn->data = calloc (1, sizeof (struct data_cache));
+      if (dc)
+	{
+	  dc->mtime = np->nn_stat.st_mtim;
+	  dc->size = np->nn_stat.st_size;
+	  dc->block_size = size;
+	}
+    }
+  else if (dc->block_size != size)
+    {
+      invalidate_blocks (dc);
+      for (i = 0; i < DATA_CACHE_BLOCKS; i++)
+	{
+	  free (dc->blocks[i].data);
+	  dc->blocks[i].data = NULL;
+	}
+      dc->block_size = size;
+    }
+  return dc;
+}
+
+/* Called by register_fresh_stat whenever new attributes for NP have
+   been stored in NP->nn_stat.  Drop the cache if they show that the
+   file was changed by someone else.  */
+void
+data_cache_check (struct node *np)
+{
+  struct data_cache *dc = np->nn->data;
+
+  if (! dc)
+    return;
+
+  if (dc->mtime.tv_sec != np->nn_stat.st_mtim.tv_sec
+      || dc->mtime.tv_nsec != np->nn_stat.st_mtim.tv_nsec
+      || dc->size != np->nn_stat.st_size)
+    {
+      if (! dc->own_change)
+	invalidate_blocks (dc);
+      dc->mtime = np->nn_stat.st_mtim;
+      dc->size = np->nn_stat.st_size;
+    }
+  dc->own_change = 0;
+}
+
+/* Called by process_wcc_stat with the modification time MTIME the
+   file had before an operation on NP.  If it does not match the
+   cached contents, the change is not just ours.  */
+void
+data_cache_check_wcc (struct node *np, struct timespec *mtime)
+{
+  struct data_cache *dc = np->nn->data;
+
+  if (dc && (dc->mtime.tv_sec != mtime->tv_sec
+	     || dc->mtime.tv_nsec != mtime->tv_nsec))
+    dc->own_change = 0;
+}
+
+/* Return the cached block number BLOCK of DC, or NULL if it is not
+   cached or too old.  */
+static struct cached_block *
+find_block (struct data_cache *dc, off_t block)
+{
+  struct cached_block *b = &dc->blocks[block % DATA_CACHE_BLOCKS];
+
+  if (b->fetched == 0 || b->offset != block * dc->block_size)
+    return NULL;
+  if (mapped_time->seconds - b->fetched >= cache_timeout)
+    {
+      b->fetched = 0;
+      return NULL;
+    }
+  return b;
+}
+
+/* Copy the part of B, a block of DC, that lies within
+   [OFFSET, OFFSET + LEN) to the corresponding place in DATA, and lower
+   *END to the end of file if B shows it.  */
+static void
+copy_block (struct data_cache *dc, struct cached_block *b, char *data,
+	    size_t len, off_t offset, off_t *end)
+{
+  off_t start = b->offset > offset ? b->offset : offset;
+  off_t stop = b->offset + b->len;
+
+  if (stop > offset + len)
+    stop = offset + len;
+  if (stop > start)
+    memcpy (data + (start - offset), b->data + (start - b->offset),
+	    stop - start);
+
+  if (b->len < dc->block_size && b->offset + b->len < *end)
+    *end = b->offset + b->len;
+}
+
+/* The server returned only the first *LEN bytes of the block of DC at
+   OFFSET of NP, in BUF, without reaching the end of file.  Read the
+   rest of it, one RPC at a time, until it is complete or the end of
+   file is reached, and update *LEN.  This happens only with NFSv3.  */
+static error_t
+complete_block (struct iouser *cred, struct node *np, struct data_cache *dc,
+		char *buf, off_t offset, size_t *len)
+{
+  int eof = 0;
+
+  while (*len < dc->block_size && ! eof)
+    {
+      size_t want = dc->block_size - *len, trans_len;
+      void *rpcbuf;
+      error_t err;
+      int *p;
+
+      p = nfs_initialize_rpc (NFSPROC_READ (protocol_version),
+			      cred, 0, &rpcbuf, np, -1);
+      if (! p)
+	return errno;
+
+      p = xdr_encode_fhandle (p, &np->nn->handle);
+      p = xdr_encode_64bit (p, offset + *len);
+      *(p++) = htonl (want);
+
+      err = conduct_rpc (&rpcbuf, &p);
+      if (!err)
+	{
+	  err = nfs_error_trans (ntohl (*p));
+	  p++;
+	  p = process_returned_stat (np, p, !err);
+	}
+      if (!err)
+	{
+	  p++;			/* COUNT */
+	  eof = ntohl (*p);
+	  p++;
+	  trans_len = ntohl (*p);
+	  p++;
+	  if (trans_len > want)
+	    trans_len = want;
+	  memcpy (buf + *len, p, trans_len);
+	  *len += trans_len;
+	  if (trans_len == 0)
+	    eof = 1;
+	}
+      free (rpcbuf);
+      if (err)
+	return err;
+    }
+
+  return 0;
+}
+
+/* Read the N blocks in BLOCKS of NP from the server, in a single
+   batch.  Store them in the cache and copy the parts within
+   [OFFSET, OFFSET + LEN) to DATA, lowering *END to the end of file if
+   a short block shows it.  Return the error of the first block within
+   the requested range that could not be read; failed read-ahead is
+   ignored.  */
+static error_t
+fetch_blocks (struct iouser *cred, struct node *np, struct data_cache *dc,
+	      off_t *blocks, size_t n, char *data, size_t len, off_t offset,
+	      off_t *end)
+{
+  void *rpcbufs[n];
+  int *ps[n];
+  error_t errs[n];
+  error_t err = 0;
+  int bsize = dc->block_size;
+  size_t i, sent;
+
+  for (sent = 0; sent < n; sent++)
+    {
+      int *p = nfs_initialize_rpc (NFSPROC_READ (protocol_version),
+				   cred, 0, &rpcbufs[sent], np, -1);
+      if (! p)
+	break;
+
+      p = xdr_encode_fhandle (p, &np->nn->handle);
+      if (protocol_version == 2)
+	{
+	  *(p++) = htonl (blocks[sent] * bsize);
+	  *(p++) = htonl (bsize);
+	  *(p++) = 0;
+	}
+      else
+	{
+	  p = xdr_encode_64bit (p, blocks[sent] * bsize);
+	  *(p++) = htonl (bsize);
+	}
+      ps[sent] = p;
+    }
+  if (sent == 0)
+    return errno;
+
+  conduct_rpcs (sent, rpcbufs, ps, errs);
+
+  for (i = 0; i < n; i++)
+    {
+      off_t boffset = blocks[i] * bsize;
+      int wanted = boffset < offset + len;
+      struct cached_block *b = &dc->blocks[blocks[i] % DATA_CACHE_BLOCKS];
+      size_t trans_len;
+      int eof = 0;
+      int *p;
+
+      if (i >= sent)
+	{
+	  if (wanted && ! err)
+	    err = ENOMEM;
+	  continue;
+	}
+
+      p = ps[i];
+      if (! errs[i])
+	{
+	  errs[i] = nfs_error_trans (ntohl (*p));
+	  p++;
+	  if (! errs[i] || protocol_version == 3)
+	    p = process_returned_stat (np, p, ! errs[i]);
+	}
+      if (errs[i])
+	{
+	  if (wanted && ! err)
+	    err = errs[i];
+	  free (rpcbufs[i]);
+	  continue;
+	}
+
+      if (protocol_version == 3)
+	{
+	  /* Skip COUNT, which is repeated as the length of the data.  */
+	  p++;
+	  eof = ntohl (*p);
+	  p++;
+	}
+      else
+	/* NFSv2 servers only return short reads at the end of file.  */
+	eof = 1;
+      trans_len = ntohl (*p);
+      p++;
+      if (trans_len > bsize)
+	trans_len = bsize;	/* ??? */
+
+      if (! b->data)
+	b->data = malloc (bsize);
+      if (b->data)
+	{
+	  error_t cerr = 0;
+
+	  b->fetched = 0;
+	  memcpy (b->data, p, trans_len);
+	  if (trans_len < bsize && ! eof)
+	    cerr = complete_block (cred, np, dc, b->data, boffset,
+				   &trans_len);
+	  if (cerr)
+	    {
+	      if (wanted && ! err)
+		err = cerr;
+	    }
+	  else
+	    {
+	      b->offset = boffset;
+	      b->len = trans_len;
+	      b->fetched = mapped_time->seconds;
+	      if (wanted)
+		copy_block (dc, b, data, len, offset, end);
+	    }
+	}
+      else if (wanted)
+	{
+	  /* We cannot cache it, but still return it.  If it is short
+	     without being at the end of file, return what we have.  */
+	  struct cached_block tmp =
+	    { .offset = boffset, .len = trans_len, .data = (char *) p };
+	  copy_block (dc, &tmp, data, len, offset, end);
+	}
+      free (rpcbufs[i]);
+    }
+
+  return err;
+}
+
+/* Implement netfs_attempt_read for NP.  */
+error_t
+data_cache_read (struct iouser *cred, struct node *np,
+		 off_t offset, size_t *len, void *data)
+{
+  struct data_cache *dc;
+  off_t end = offset + *len;
+  off_t first, last, block, eof_block;
+  error_t err;
+
+  if (*len == 0)
+    return 0;
+
+  dc = get_data_cache (np);
+  if (! dc)
+    return ENOMEM;
+
+  /* Revalidate the attributes if they are old, which drops the cache
+     if the file changed.  */
+  err = netfs_validate_stat (np, cred);
+  if (err)
+    return err;
+
+  if (offset == dc->next_offset && read_ahead > 0)
+    {
+      dc->window = dc->window ? dc->window * 2 : 1;
+      if (dc->window > read_ahead)
+	dc->window = read_ahead;
+      if (dc->window > DATA_CACHE_BLOCKS / 2)
+	dc->window = DATA_CACHE_BLOCKS / 2;
+    }
+  else
+    dc->window = 0;
+
+  first = offset / dc->block_size;
+  last = (end - 1) / dc->block_size;
+  eof_block = np->nn_stat.st_size / dc->block_size;
+
+  /* Work on at most DATA_CACHE_BLOCKS blocks at a time, so that they
+     do not evict each other.  */
+  for (block = first; block <= last && block * dc->block_size < end; )
+    {
+      off_t blocks[DATA_CACHE_BLOCKS];
+      off_t stop = block + DATA_CACHE_BLOCKS - 1, b;
+      size_t n = 0;
+
+      if (stop >= last)
+	{
+	  /* The last stretch; add the read-ahead window, but do not
+	     read ahead past the end of file.  */
+	  off_t ahead = last + dc->window;
+	  if (ahead > eof_block)
+	    ahead = eof_block > last ? eof_block : last;
+	  if (ahead < stop)
+	    stop = ahead;
+	}
+
+      for (b = block; b <= stop; b++)
+	{
+	  struct cached_block *cb = find_block (dc, b);
+	  if (cb && b <= last)
+	    copy_block (dc, cb, data, *len, offset, &end);
+	  else if (! cb)
+	    blocks[n++] = b;
+	}
+
+      while (n > 0)
+	{
+	  size_t batch = n > MAX_INFLIGHT ? MAX_INFLIGHT : n;
+	  err = fetch_blocks (cred, np, dc, blocks, batch, data, *len,
+			      offset, &end);
+	  if (err)
+	    return err;
+	  memmove (blocks, blocks + batch, (n - batch) * sizeof *blocks);
+	  n -= batch;
+	}
+
+      block = stop + 1;
+    }
+
+  *len = end > offset ? end - offset : 0;
+  dc->next_offset = offset + *len;
+  return 0;
+}
+
+/* Forget any cached blocks of DC that overlap [OFFSET, OFFSET + LEN).  */
+static void
+invalidate_range (struct data_cache *dc, off_t offset, size_t len)
+{
+  off_t block;
+
+  if (len == 0)
+    return;
+  for (block = offset / dc->block_size;
+       block <= (offset + len - 1) / dc->block_size;
+       block++)
+    {
+      struct cached_block *b = &dc->blocks[block % DATA_CACHE_BLOCKS];
+      if (b->offset == block * dc->block_size)
+	b->fetched = 0;
+    }
+}
+
+/* Remember an unstable write of LEN bytes of DATA at OFFSET to NP,
+   made under write verifier VERF.  */
+static error_t
+record_unstable (struct data_cache *dc, off_t offset, char *data,
+		 size_t len, char *verf)
+{
+  struct unstable_write *w = malloc (sizeof *w + len);
+  if (! w)
+    return ENOMEM;
+
+  w->offset = offset;
+  w->len = len;
+  memcpy (w->data, data, len);
+
+  if (dc->unstable && memcmp (dc->verf, verf, NFS3_WRITEVERFSIZE))
+    dc->verf_changed = 1;
+  memcpy (dc->verf, verf, NFS3_WRITEVERFSIZE);
+
+  w->next = dc->unstable;
+  dc->unstable = w;
+  dc->unstable_bytes += len;
+  return 0;
+}
+
+/* Write LEN bytes of DATA at OFFSET to NP in chunks of at most
+   write_size bytes, sending up to MAX_INFLIGHT of them at once.
+   STABLE is the NFSv3 stable_how to use; unstable writes are recorded
+   for a later commit.  Set *WRITTEN to the number of bytes written
+   contiguously from OFFSET.  */
+static error_t
+write_chunks (struct iouser *cred, struct node *np, struct data_cache *dc,
+	      off_t offset, size_t len, char *data, int stable,
+	      size_t *written)
+{
+  error_t err = 0;
+
+  *written = 0;
+  while (*written < len && ! err)
+    {
+      void *rpcbufs[MAX_INFLIGHT];
+      int *ps[MAX_INFLIGHT];
+      error_t errs[MAX_INFLIGHT];
+      size_t amounts[MAX_INFLIGHT];
+      size_t i, n, pos = *written;
+
+      for (n = 0; n < MAX_INFLIGHT && pos < len; n++)
+	{
+	  size_t thisamt = len - pos;
+	  int *p;
+
+	  if (thisamt > write_size)
+	    thisamt = write_size;
+
+	  p = nfs_initialize_rpc (NFSPROC_WRITE (protocol_version),
+				  cred, thisamt, &rpcbufs[n], np, -1);
+	  if (! p)
+	    break;
+
+	  p = xdr_encode_fhandle (p, &np->nn->handle);
+	  if (protocol_version == 2)
+	    {
+	      *(p++) = 0;
+	      *(p++) = htonl (offset + pos);
+	      *(p++) = 0;
+	    }
+	  else
+	    {
+	      p = xdr_encode_64bit (p, offset + pos);
+	      *(p++) = htonl (thisamt);
+	      *(p++) = htonl (stable);
+	    }
+	  p = xdr_encode_data (p, data + pos, thisamt);
+
+	  ps[n] = p;
+	  amounts[n] = thisamt;
+	  pos += thisamt;
+	}
+      if (n == 0)
+	return errno;
+
+      conduct_rpcs (n, rpcbufs, ps, errs);
+
+      /* Account for the replies in order, stopping at the first one
+	 that failed or came up short.  */
+      for (i = 0; i < n; i++)
+	{
+	  int *p = ps[i];
+	  size_t count = 0;
+
+	  if (! errs[i])
+	    {
+	      errs[i] = nfs_error_trans (ntohl (*p));
+	      p++;
+	      if (dc)
+		dc->own_change = 1;
+	      if (! errs[i] || protocol_version == 3)
+		p = process_wcc_stat (np, p, ! errs[i]);
+	    }
+	  if (! errs[i])
+	    {
+	      if (protocol_version == 3)
+		{
+		  int committed;
+
+		  count = ntohl (*p);
+		  p++;
+		  committed = ntohl (*p);
+		  p++;
+		  if (count > amounts[i])
+		    count = amounts[i];
+		  if (committed == UNSTABLE && dc && ! err)
+		    errs[i] = record_unstable (dc, offset + *written,
+					       data + *written, count,
+					       (char *) p);
+		}
+	      else
+		/* assume it wrote the whole thing */
+		count = amounts[i];
+	    }
+
+	  if (! err)
+	    {
+	      if (errs[i])
+		err = errs[i];
+	      else
+		{
+		  *written += count;
+		  if (count < amounts[i])
+		    /* Retry the rest with the next batch.  */
+		    err = EAGAIN;
+		}
+	    }
+	  free (rpcbufs[i]);
+	}
+
+      if (err == EAGAIN)
+	err = 0;
+    }
+
+  return err;
+}
+
+/* Implement netfs_attempt_write for NP.  */
+error_t
+data_cache_write (struct iouser *cred, struct node *np,
+		  off_t offset, size_t *len, void *data)
+{
+  struct data_cache *dc = get_data_cache (np);
+  int stable = FILE_SYNC;
+  size_t written;
+  error_t err;
+
+  if (protocol_version == 3 && write_behind > 0 && dc)
+    stable = UNSTABLE;
+
+  err = write_chunks (cred, np, dc, offset, *len, data, stable, &written);
+
+  if (dc)
+    invalidate_range (dc, offset, *len);
+
+  if (err == EINTR && written > 0)
+    err = 0;
+  if (err)
+    {
+      *len = 0;
+      return err;
+    }
+  *len = written;
+
+  if (dc && dc->unstable_bytes > write_behind)
+    {
+      err = data_cache_commit (cred, np);
+      if (err)
+	error (0, err, "nfs commit");
+    }
+  return 0;
+}
+
+/* Free the list of unstable writes W.  */
+static void
+free_unstable (struct unstable_write *w)
+{
+  while (w)
+    {
+      struct unstable_write *next = w->next;
+      free (w);
+      w = next;
+    }
+}
+
+/* Make sure that all unstable writes to NP are on stable storage on
+   the server.  */
+error_t
+data_cache_commit (struct iouser *cred, struct node *np)
+{
+  struct data_cache *dc = np->nn->data;
+  struct unstable_write *w, *list;
+  char verf[NFS3_WRITEVERFSIZE];
+  void *rpcbuf;
+  error_t err;
+  int *p;
+
+  if (! dc || ! dc->unstable)
+    return 0;
+
+  p = nfs_initialize_rpc (NFS3PROC_COMMIT, cred, 0, &rpcbuf, np, -1);
+  if (! p)
+    return errno;
+
+  p = xdr_encode_fhandle (p, &np->nn->handle);
+  p = xdr_encode_64bit (p, 0);
+  *(p++) = 0;			/* Up to the end of file.  */
+
+  err = conduct_rpc (&rpcbuf, &p);
+  if (!err)
+    {
+      err = nfs_error_trans (ntohl (*p));
+      p++;
+      p = process_wcc_stat (np, p, !err);
+      if (!err)
+	memcpy (verf, p, NFS3_WRITEVERFSIZE);
+    }
+  free (rpcbuf);
+  if (err)
+    return err;
+
+  list = dc->unstable;
+  dc->unstable = NULL;
+  dc->unstable_bytes = 0;
+
+  if (dc->verf_changed || memcmp (verf, dc->verf, NFS3_WRITEVERFSIZE))
+    {
+      /* The server rebooted since it accepted some of the writes; send
+	 them again, oldest first, this time synchronously.  */
+      struct unstable_write *reversed = NULL;
+
+      while (list)
+	{
+	  w = list;
+	  list = w->next;
+	  w->next = reversed;
+	  reversed = w;
+	}
+      list = reversed;
+
+      for (w = list; w && !err; w = w->next)
+	{
+	  size_t written;
+	  err = write_chunks (cred, np, NULL, w->offset, w->len, w->data,
+			      FILE_SYNC, &written);
+	  if (!err && written < w->len)
+	    err = EIO;
+	}
+    }
+
+  dc->verf_changed = 0;
+  free_unstable (list);
+  return err;
+}
+
+/* Release NP's data cache.  Any writes that could not be committed
+   are lost.  */
+void
+data_cache_free (struct node *np)
+{
+  struct data_cache *dc = np->nn->data;
+  int i;
+
+  if (! dc)
+    return;
+
+  for (i = 0; i < DATA_CACHE_BLOCKS; i++)
+    free (dc->blocks[i].data);
+  free_unstable (dc->unstable);
+  free (dc);
+  np->nn->data = NULL;
+}
@@ -58,6 +58,12 @@ extern char *localhost ();
 /* Default maximum number of bytes to write at once. */
 #define DEFAULT_WRITE_SIZE    8192
 
+/* Default maximum number of blocks to read ahead. */
+#define DEFAULT_READ_AHEAD    8
+
+/* Default maximum number of bytes of uncommitted writes per file. */
+#define DEFAULT_WRITE_BEHIND  1048576
+
 
 /* Number of seconds to timeout cached stat information. */
 int stat_timeout = DEFAULT_STAT_TIMEOUT;
@@ -88,6 +94,12 @@ int read_size = DEFAULT_READ_SIZE;
 
 /* Maximum number of bytes to write at once. */
 int write_size = DEFAULT_WRITE_SIZE;
+
+/* Maximum number of blocks to read ahead of a sequential reader. */
+int read_ahead = DEFAULT_READ_AHEAD;
+
+/* Maximum number of bytes of uncommitted writes per file. */
+int write_behind = DEFAULT_WRITE_BEHIND;
 
 #define OPT_SOFT	's'
 #define OPT_HARD	'h'
@@ -107,6 +119,8 @@ int write_size = DEFAULT_WRITE_SIZE;
 #define OPT_PMAP_PORT	-13
 #define OPT_NCACHE_TO	-14
 #define OPT_NCACHE_NEG_TO -15
+#define OPT_READ_AHEAD	-16
+#define OPT_WRITE_BEHIND -17
 
 /* Return a string corresponding to the printed rep of DEFAULT_what */
 #define ___D(what) #what
@@ -132,6 +146,12 @@ static const struct argp_option common_options[] =
   {"write-size",	    OPT_WSIZE,	   "BYTES", 0,
      "Max packet size for writes (default " _D(WRITE_SIZE)")"},
   {"wsize",0,0,OPTION_ALIAS},
+  {"read-ahead",	    OPT_READ_AHEAD, "BLOCKS", 0,
+     "Max number of read-size blocks to read ahead of sequential readers"
+     " (default " _D(READ_AHEAD) ")"},
+  {"write-behind",	    OPT_WRITE_BEHIND, "BYTES", 0,
+     "Max bytes of uncommitted NFSv3 writes per file; 0 makes all writes"
+     " synchronous (default " _D(WRITE_BEHIND) ")"},
 
   {0,0,0,0,"Timeouts:",3},
   {"stat-timeout",	    OPT_STAT_TO,   "SEC", 0,
@@ -164,8 +184,24 @@ parse_common_opt (int key, char *arg, struct argp_state *state)
       mounted_soft = 0;
       break;
 
-    case OPT_RSIZE: read_size = atoi (arg); break;
-    case OPT_WSIZE: write_size = atoi (arg); break;
+    case OPT_RSIZE:
+    case OPT_WSIZE:
+      {
+	int size = atoi (arg);
+	if (size <= 0)
+	  {
+	    argp_error (state, "%s: BYTES should be a positive integer",
+			key == OPT_RSIZE ? "--read-size" : "--write-size");
+	    return EINVAL;
+	  }
+	if (key == OPT_RSIZE)
+	  read_size = size;
+	else
+	  write_size = size;
+      }
+      break;
+    case OPT_READ_AHEAD: read_ahead = atoi (arg); break;
+    case OPT_WRITE_BEHIND: write_behind = atoi (arg); break;
 
     case OPT_STAT_TO: stat_timeout = atoi (arg); break;
     case OPT_CACHE_TO: cache_timeout = atoi (arg); break;
@@ -243,6 +279,8 @@ netfs_append_args (char **argz, size_t *argz_len)
 
   FOPT ("--read-size=%d", read_size);
   FOPT ("--write-size=%d", write_size);
+  FOPT ("--read-ahead=%d", read_ahead);
+  FOPT ("--write-behind=%d", write_behind);
 
   FOPT ("--stat-timeout=%d", stat_timeout);
   FOPT ("--cache-timeout=%d", cache_timeout);
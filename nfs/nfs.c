@@ -166,7 +166,7 @@ xdr_encode_data (int *p, char *data, size_t len)
 int *
 xdr_encode_64bit (int *p, long long n)
 {
-  *(p++) = htonl (n & 0xffffffff00000000LL >> 32);
+  *(p++) = htonl ((n & 0xffffffff00000000LL) >> 32);
   *(p++) = htonl (n & 0xffffffff);
   return p;
 }
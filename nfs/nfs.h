@@ -71,6 +71,9 @@ struct netnode
 
   struct user_pager_info *fileinfo;
 
+  /* Cached file contents and uncommitted writes; see data-cache.c.  */
+  struct data_cache *data;
+
   /* If this node has been renamed by "deletion" then
      this is the directory and the name in that directory
      which is holding the node */
@@ -117,6 +120,14 @@ extern int read_size;
 /* Maximum amout to write at once */
 extern int write_size;
 
+/* How many blocks of read_size bytes to read ahead of a sequential
+   reader */
+extern int read_ahead;
+
+/* How many bytes of unstable writes to keep before committing them
+   (NFSv3 only) */
+extern int write_behind;
+
 /* Service name for portmapper */
 extern char *pmap_service_name;
 
@@ -164,6 +175,7 @@ extern int protocol_version;
 int hurd_mode_to_nfs_type (mode_t);
 int *xdr_encode_fhandle (int *, struct fhandle *);
 int *xdr_encode_data (int *, char *, size_t);
+int *xdr_encode_64bit (int *, long long);
 int *xdr_encode_string (int *, char *);
 int *xdr_encode_sattr_mode (int *, mode_t);
 int *xdr_encode_sattr_ids (int *, u_int, u_int);
@@ -173,6 +185,7 @@ int *xdr_encode_sattr_stat (int *, struct stat *);
 int *xdr_encode_create_state (int *, mode_t, uid_t);
 int *xdr_decode_fattr (int *, struct stat *);
 int *xdr_decode_string (int *, char *);
+int *xdr_decode_64bit (int *, long long *);
 int *xdr_decode_fhandle (int *, struct node **);
 int *nfs_initialize_rpc (int, struct iouser *, size_t, void **,
 			 struct node *, uid_t);
@@ -185,16 +198,30 @@ extern uint16_t mounted_nfs_port; /* host order */
 
 /* ops.c */
 int *register_fresh_stat (struct node *, int *);
+int *process_returned_stat (struct node *, int *, int);
+int *process_wcc_stat (struct node *, int *, int);
 
 /* rpc.c */
 int *initialize_rpc (int, int, int, size_t, void **, uid_t, gid_t, gid_t);
 error_t conduct_rpc (void **, int **);
+error_t conduct_rpcs (size_t, void **, int **, error_t *);
 void *timeout_service_thread (void *);
 void *rpc_receive_thread (void *);
 
 /* cache.c */
 void lookup_fhandle (struct fhandle *, struct node **);
 int *recache_handle (int *, struct node *);
+error_t commit_all_nodes (void);
+
+/* data-cache.c */
+error_t data_cache_read (struct iouser *, struct node *, off_t, size_t *,
+			 void *);
+error_t data_cache_write (struct iouser *, struct node *, off_t, size_t *,
+			  void *);
+error_t data_cache_commit (struct iouser *, struct node *);
+void data_cache_check (struct node *);
+void data_cache_check_wcc (struct node *, struct timespec *);
+void data_cache_free (struct node *);
 
 /* name-cache.c */
 void enter_lookup_cache (char *, size_t, struct node *, char *);
@@ -74,6 +74,8 @@ register_fresh_stat (struct node *np, int *p)
   np->nn_stat.st_flags = 0;
   np->nn_translated = np->nn_stat.st_mode & S_IFMT;
 
+  data_cache_check (np);
+
   return ret;
 }
 
@@ -122,10 +124,18 @@ process_wcc_stat (struct node *np, int *p, int mod)
       p++;
       if (attrs_exist)
 	{
-	  /* Just skip them for now */
-	  p += 2 * sizeof (int); /* size */
-	  p += 2 * sizeof (int); /* mtime */
-	  p += 2 * sizeof (int); /* atime */
+	  struct timespec mtime;
+
+	  p += 2;		/* size */
+	  mtime.tv_sec = ntohl (*p);
+	  p++;
+	  mtime.tv_nsec = ntohl (*p);
+	  p++;
+	  p += 2;		/* ctime */
+
+	  /* Tell the data cache whether the file was changed behind
+	     our back before this operation.  */
+	  data_cache_check_wcc (np, &mtime);
 	}
 
       /* Now the post_op_attr */
@@ -424,8 +434,9 @@ netfs_attempt_statfs (struct iouser *cred, struct node *np,
 error_t
 netfs_attempt_sync (struct iouser *cred, struct node *np, int wait)
 {
-  /* We are already completely synchronous. */
-  return 0;
+  /* Writes are sent to the server right away; only unstable NFSv3
+     writes can still be pending.  */
+  return data_cache_commit (cred, np);
 }
 
 /* Implement the netfs_attempt_syncfs callback as described in
@@ -433,7 +444,7 @@ netfs_attempt_sync (struct iouser *cred, struct node *np, int wait)
 error_t
 netfs_attempt_syncfs (struct iouser *cred, int wait)
 {
-  return 0;
+  return commit_all_nodes ();
 }
 
 /* Implement the netfs_attempt_read callback as described in
@@ -442,73 +453,7 @@ error_t
 netfs_attempt_read (struct iouser *cred, struct node *np,
 		    off_t offset, size_t *len, void *data)
 {
-  int *p;
-  void *rpcbuf;
-  size_t trans_len;
-  error_t err;
-  size_t amt, thisamt;
-  int eof;
-
-  for (amt = *len; amt;)
-    {
-      thisamt = amt;
-      if (thisamt > read_size)
-	thisamt = read_size;
-
-      p = nfs_initialize_rpc (NFSPROC_READ (protocol_version),
-			      cred, 0, &rpcbuf, np, -1);
-      if (! p)
-        return errno;
-
-      p = xdr_encode_fhandle (p, &np->nn->handle);
-      *(p++) = htonl (offset);
-      *(p++) = htonl (thisamt);
-      if (protocol_version == 2)
-	*(p++) = 0;
-
-      err = conduct_rpc (&rpcbuf, &p);
-      if (!err)
-	{
-	  err = nfs_error_trans (ntohl (*p));
-	  p++;
-
-	  if (!err || protocol_version == 3)
-	    p = process_returned_stat (np, p, !err);
-
-	  if (err)
-	    {
-	      free (rpcbuf);
-	      return err;
-	    }
-
-	  trans_len = ntohl (*p);
-	  p++;
-	  if (trans_len > thisamt)
-	    trans_len = thisamt;	/* ??? */
-
-	  if (protocol_version == 3)
-	    {
-	      eof = ntohl (*p);
-	      p++;
-	    }
-	  else
-	    eof = (trans_len < thisamt);
-
-	  memcpy (data, p, trans_len);
-	  free (rpcbuf);
-
-	  data += trans_len;
-	  offset += trans_len;
-	  amt -= trans_len;
-
-	  if (eof)
-	    {
-	      *len -= amt;
-	      return 0;
-	    }
-	}
-    }
-  return 0;
+  return data_cache_read (cred, np, offset, len, data);
 }
 
 /* Implement the netfs_attempt_write callback as described in
@@ -517,75 +462,7 @@ error_t
 netfs_attempt_write (struct iouser *cred, struct node *np,
 		     off_t offset, size_t *len, void *data)
 {
-  int *p;
-  void *rpcbuf;
-  error_t err;
-  size_t amt, thisamt;
-  size_t count;
-
-  for (amt = *len; amt;)
-    {
-      thisamt = amt;
-      if (thisamt > write_size)
-	thisamt = write_size;
-
-      p = nfs_initialize_rpc (NFSPROC_WRITE (protocol_version),
-			      cred, thisamt, &rpcbuf, np, -1);
-      if (! p)
-        return errno;
-
-      p = xdr_encode_fhandle (p, &np->nn->handle);
-      if (protocol_version == 2)
-	*(p++) = 0;
-      *(p++) = htonl (offset);
-      if (protocol_version == 2)
-	*(p++) = 0;
-      if (protocol_version == 3)
-	*(p++) = htonl (FILE_SYNC);
-      p = xdr_encode_data (p, data, thisamt);
-
-      err = conduct_rpc (&rpcbuf, &p);
-      if (!err)
-	{
-	  err = nfs_error_trans (ntohl (*p));
-	  p++;
-	  if (!err || protocol_version == 3)
-	    p = process_wcc_stat (np, p, !err);
-	  if (!err)
-	    {
-	      if (protocol_version == 3)
-		{
-		  count = ntohl (*p);
-		  p++;
-		  p++;		/* ignore COMMITTED */
-		  /* ignore verf for now */
-		  p += NFS3_WRITEVERFSIZE / sizeof (int);
-		}
-	      else
-		/* assume it wrote the whole thing */
-		count = thisamt;
-
-	      amt -= count;
-	      data += count;
-	      offset += count;
-	    }
-	}
-
-      free (rpcbuf);
-
-      if (err == EINTR && amt != *len)
-	{
-	  *len -= amt;
-	  return 0;
-	}
-
-      if (err)
-	{
-	  *len = 0;
-	  return err;
-	}
-    }
-  return 0;
+  return data_cache_write (cred, np, offset, len, data);
 }
 
 /* See if NAME exists in DIR for CRED.  If so, return EEXIST.  */
@@ -166,97 +166,37 @@ link_rpc (struct rpc_list **list, struct rpc_list *hdr)
   *list = hdr;
 }
 
-/* Send the specified RPC message.  *RPCBUF is the initialized buffer
-   from a previous initialize_rpc call; *PP, the payload, points past
-   the filledin args.  Set *PP to the address of the reply contents
-   themselves.  The user will be expected to free *RPCBUF (which will
-   have changed) when done with the reply contents.  The old value of
-   *RPCBUF will be freed by this routine.  */
-error_t
-conduct_rpc (void **rpcbuf, int **pp)
+/* Send HDR's message, whose payload ends at P.  OUTSTANDING_LOCK
+   must be held.  */
+static error_t
+transmit_rpc (struct rpc_list *hdr, int *p)
 {
-  struct rpc_list *hdr = *rpcbuf;
-  error_t err;
   size_t cc, nc;
-  int timeout = initial_transmit_timeout;
-  time_t lasttrans;
-  int ntransmit = 0;
-  int *p;
-  int xid;
-  int n;
-  int cancel;
-  
-  pthread_mutex_lock (&outstanding_lock);
-
-  link_rpc (&outstanding_rpcs, hdr);
-
-  xid = * (int *) (*rpcbuf + sizeof (struct rpc_list));
 
-  do
-    {
-      /* If we've sent enough, give up.  */
-      if (mounted_soft && ntransmit == soft_retries)
-	{
-	  unlink_rpc (hdr);
-	  pthread_mutex_unlock (&outstanding_lock);
-	  return ETIMEDOUT;
-	}
-
-      /* Issue the RPC.  */
-      lasttrans = mapped_time->seconds;
-      ntransmit++;
-      nc = (void *) *pp - *rpcbuf - sizeof (struct rpc_list);
-      cc = write (main_udp_socket, *rpcbuf + sizeof (struct rpc_list), nc);
-      if (cc == -1)
-	{
-	  unlink_rpc (hdr);
-	  pthread_mutex_unlock (&outstanding_lock);
-	  return errno;
-	}
-      else 
-	assert_backtrace (cc == nc);
-      
-      /* Wait for reply.  */
-      cancel = 0;
-      while (!hdr->reply
-	     && (mapped_time->seconds - lasttrans < timeout)
-	     && !cancel)
-	cancel = pthread_hurd_cond_wait_np (&rpc_wakeup, &outstanding_lock);
-  
-      if (cancel)
-	{
-	  unlink_rpc (hdr);
-	  pthread_mutex_unlock (&outstanding_lock);
-	  return EINTR;
-	}
-
-      /* hdr->reply will have been filled in by rpc_receive_thread,
-         if it has been filled in, then the rpc has been fulfilled,
-         otherwise, retransmit and continue to wait.  */
-      if (!hdr->reply)
-	{
-	  timeout *= 2;
-	  if (timeout > max_transmit_timeout)
-	    timeout = max_transmit_timeout;
-	}
-    }
-  while (!hdr->reply);
+  nc = (void *) p - (void *) hdr - sizeof (struct rpc_list);
+  cc = write (main_udp_socket, (void *) hdr + sizeof (struct rpc_list), nc);
+  if (cc == -1)
+    return errno;
+  assert_backtrace (cc == nc);
+  return 0;
+}
 
-  pthread_mutex_unlock (&outstanding_lock);
+/* Dissect the reply in RPCBUF to the RPC with transaction id XID.
+   If there is no error, set *PP to the rpc return contents.  */
+static error_t
+process_reply (void *rpcbuf, int xid, int **pp)
+{
+  error_t err;
+  int *p;
+  int n;
 
-  /* Switch to the reply buffer.  */
-  *rpcbuf = hdr->reply;
-  free (hdr);
+  p = (int *) rpcbuf;
 
-  /* Process the reply, dissecting errors.  When we're done and if
-     there is no error, set *PP to the rpc return contents.  */ 
-  p = (int *) *rpcbuf;
-  
   /* If the transmition id does not match that in the message,
      something strange happened in rpc_receive_thread.  */
   assert_backtrace (*p == xid);
   p++;
-  
+
   switch (ntohl (*p))
     {
     default:
@@ -347,6 +287,136 @@ conduct_rpc (void **rpcbuf, int **pp)
   return err;
 }
 
+/* Send the specified RPC message.  *RPCBUF is the initialized buffer
+   from a previous initialize_rpc call; *PP, the payload, points past
+   the filledin args.  Set *PP to the address of the reply contents
+   themselves.  The user will be expected to free *RPCBUF (which will
+   have changed) when done with the reply contents.  The old value of
+   *RPCBUF will be freed by this routine.  */
+error_t
+conduct_rpc (void **rpcbuf, int **pp)
+{
+  error_t err;
+
+  conduct_rpcs (1, rpcbuf, pp, &err);
+  return err;
+}
+
+/* Like conduct_rpc, but for the N messages in RPCBUFS and PPS.  All of
+   them are sent before waiting for any reply, so that their round
+   trips overlap.  The result of each RPC is stored in ERRS; the first
+   error is returned.  */
+error_t
+conduct_rpcs (size_t n, void **rpcbufs, int **pps, error_t *errs)
+{
+  struct
+  {
+    int timeout;
+    time_t lasttrans;
+    int ntransmit;
+    int xid;
+    int waiting;
+  } state[n];
+  size_t i, waiting = 0;
+  int cancel = 0;
+
+  pthread_mutex_lock (&outstanding_lock);
+
+  for (i = 0; i < n; i++)
+    {
+      struct rpc_list *hdr = rpcbufs[i];
+
+      link_rpc (&outstanding_rpcs, hdr);
+      state[i].xid = * (int *) (rpcbufs[i] + sizeof (struct rpc_list));
+      state[i].timeout = initial_transmit_timeout;
+      state[i].lasttrans = mapped_time->seconds;
+      state[i].ntransmit = 1;
+      errs[i] = transmit_rpc (hdr, pps[i]);
+      if (errs[i])
+	unlink_rpc (hdr);
+      state[i].waiting = ! errs[i];
+      waiting += state[i].waiting;
+    }
+
+  while (waiting > 0)
+    {
+      for (i = 0; i < n; i++)
+	{
+	  struct rpc_list *hdr = rpcbufs[i];
+
+	  if (! state[i].waiting)
+	    continue;
+
+	  /* hdr->reply will have been filled in by rpc_receive_thread,
+	     if it has been filled in, then the rpc has been fulfilled,
+	     otherwise, retransmit once its timeout has passed.  */
+	  if (hdr->reply)
+	    errs[i] = 0;
+	  else if (mapped_time->seconds - state[i].lasttrans
+		   < state[i].timeout)
+	    continue;
+	  else if (mounted_soft && state[i].ntransmit == soft_retries)
+	    {
+	      /* If we've sent enough, give up.  */
+	      unlink_rpc (hdr);
+	      errs[i] = ETIMEDOUT;
+	    }
+	  else
+	    {
+	      state[i].timeout *= 2;
+	      if (state[i].timeout > max_transmit_timeout)
+		state[i].timeout = max_transmit_timeout;
+	      state[i].lasttrans = mapped_time->seconds;
+	      state[i].ntransmit++;
+	      errs[i] = transmit_rpc (hdr, pps[i]);
+	      if (! errs[i])
+		continue;
+	      unlink_rpc (hdr);
+	    }
+
+	  state[i].waiting = 0;
+	  waiting--;
+	}
+
+      if (waiting == 0)
+	break;
+
+      /* Wait for replies.  */
+      cancel = pthread_hurd_cond_wait_np (&rpc_wakeup, &outstanding_lock);
+      if (cancel)
+	break;
+    }
+
+  if (cancel)
+    for (i = 0; i < n; i++)
+      if (state[i].waiting)
+	{
+	  unlink_rpc (rpcbufs[i]);
+	  state[i].waiting = 0;
+	  errs[i] = EINTR;
+	}
+
+  pthread_mutex_unlock (&outstanding_lock);
+
+  for (i = 0; i < n; i++)
+    {
+      struct rpc_list *hdr = rpcbufs[i];
+
+      if (errs[i] || ! hdr->reply)
+	continue;
+
+      /* Switch to the reply buffer.  */
+      rpcbufs[i] = hdr->reply;
+      free (hdr);
+      errs[i] = process_reply (rpcbufs[i], state[i].xid, &pps[i]);
+    }
+
+  for (i = 0; i < n; i++)
+    if (errs[i])
+      return errs[i];
+  return 0;
+}
+
 /* Dedicated thread to signal those waiting on rpc_wakeup
    once a second.  */
 void *
@@ -19,6 +19,7 @@
    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA. */
 
 
+#include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 #include <sys/mman.h>
@@ -39,70 +40,161 @@
 #include <rpc/auth.h>
 #undef malloc
 
-#define IDHASH_TABLE_SIZE 1024
-#define FHHASH_TABLE_SIZE 1024
-#define REPLYHASH_TABLE_SIZE 1024
+/* Each cache is split into CACHE_STRIPES stripes by the hash of its
+   keys, each with its own lock and hash table, so that requests for
+   different files and users don't contend.  The hash tables grow as
+   needed.  Unreferenced entries are kept on the LRU list of their
+   stripe, oldest first, so expiring them only looks at the entries
+   that actually expire.  */
+#define CACHE_STRIPES 16
 
-
-static struct idspec *idhashtable[IDHASH_TABLE_SIZE];
-pthread_spinlock_t idhashlock = PTHREAD_SPINLOCK_INITIALIZER;
-static int nfreeids;
-static int leastidlastuse;
+struct cache_stripe
+{
+  pthread_mutex_t lock;
+  struct hurd_ihash table;
+  struct lru_link *lru_head, **lru_tail;
+};
+
+#define LRU_ENTRY(link, type) \
+  ((type *) ((char *) (link) - offsetof (type, lru)))
+
+/* Initialize the stripes of a cache whose entries are of type TYPE
+   and compared with HASH and COMPARE.  */
+#define INIT_STRIPES(stripes, type, hash, compare) \
+  do \
+    { \
+      int n_; \
+      for (n_ = 0; n_ < CACHE_STRIPES; n_++) \
+	{ \
+	  pthread_mutex_init (&(stripes)[n_].lock, NULL); \
+	  hurd_ihash_init (&(stripes)[n_].table, offsetof (type, slot)); \
+	  hurd_ihash_set_gki (&(stripes)[n_].table, (hash), (compare)); \
+	  (stripes)[n_].lru_head = NULL; \
+	  (stripes)[n_].lru_tail = &(stripes)[n_].lru_head; \
+	} \
+    } \
+  while (0)
+
+/* Put LINK, whose entry has just become unreferenced, at the end of
+   the LRU list of S.  S must be locked.  */
+static void
+lru_add (struct cache_stripe *s, struct lru_link *link)
+{
+  link->lastuse = mapped_time->seconds;
+  link->next = NULL;
+  link->prevp = s->lru_tail;
+  *s->lru_tail = link;
+  s->lru_tail = &link->next;
+}
+
+/* Take LINK, whose entry is being referenced again, off the LRU list
+   of S.  S must be locked.  */
+static void
+lru_remove (struct cache_stripe *s, struct lru_link *link)
+{
+  *link->prevp = link->next;
+  if (link->next)
+    link->next->prevp = link->prevp;
+  else
+    s->lru_tail = link->prevp;
+}
+
+/* Remove the unreferenced entries of S that have not been used for
+   TIMEOUT seconds, and the oldest ones while S has more than MAX
+   entries, passing each to DISCARD.  S must be locked.  */
+static void
+lru_expire (struct cache_stripe *s, time_t timeout, size_t max,
+	    void (*discard) (struct cache_stripe *, struct lru_link *))
+{
+  while (s->lru_head
+	 && (mapped_time->seconds - s->lru_head->lastuse > timeout
+	     || s->table.nr_items > max))
+    {
+      struct lru_link *link = s->lru_head;
+      lru_remove (s, link);
+      (*discard) (s, link);
+    }
+}
+
+
+static struct cache_stripe idstripes[CACHE_STRIPES];
 
 /* Compare I against the specified set of users/groups.  */
 /* Use of int in decl of UIDS and GIDS is correct here; that's
    the NFS type because they come in in known 32 bit slots.  */
 static int
-idspec_compare (struct idspec *i, int nuids, int ngids,
-		int *uids, int *gids)
+idspec_compare (const void *a, const void *b)
 {
-  if (i->nuids != nuids
-      || i->ngids != ngids)
+  const struct idspec *i = a, *j = b;
+
+  if (i->nuids != j->nuids
+      || i->ngids != j->ngids)
     return 0;
 
   assert_backtrace (sizeof (int) == sizeof (uid_t));
 
-  if (bcmp (i->uids, uids, nuids * sizeof (uid_t))
-      || bcmp (i->gids, gids, ngids * sizeof (gid_t)))
+  if (bcmp (i->uids, j->uids, i->nuids * sizeof (uid_t))
+      || bcmp (i->gids, j->gids, i->ngids * sizeof (gid_t)))
     return 0;
 
   return 1;
 }
 
 /* Compute a hash value for a given user spec.  */
-static int
-idspec_hash (int nuids, int ngids, int *uids, int *gids)
+static hurd_ihash_key_t
+idspec_hash (const void *key)
 {
-  int hash, n;
-
-  hash = nuids + ngids;
-  for (n = 0; n < ngids; n++)
-    hash += gids[n];
-  for (n = 0; n < nuids; n++)
-    hash += uids[n];
-  hash %= IDHASH_TABLE_SIZE;
+  const struct idspec *i = key;
+  hurd_ihash_key_t hash;
+  int n;
+
+  hash = i->nuids + i->ngids;
+  for (n = 0; n < i->ngids; n++)
+    hash = hash * 31 + i->gids[n];
+  for (n = 0; n < i->nuids; n++)
+    hash = hash * 31 + i->uids[n];
   return hash;
 }
 
+static struct cache_stripe *
+idspec_stripe (struct idspec *i)
+{
+  return &idstripes[idspec_hash (i) % CACHE_STRIPES];
+}
+
+static void
+idspec_discard (struct cache_stripe *s, struct lru_link *link)
+{
+  struct idspec *i = LRU_ENTRY (link, struct idspec);
+
+  hurd_ihash_locp_remove (&s->table, i->slot);
+  free (i->uids);
+  free (i->gids);
+  free (i);
+}
+
 /* Lookup a user spec in the hash table and allocate a reference.  */
 static struct idspec *
 idspec_lookup (int nuids, int ngids, int *uids, int *gids)
 {
-  int hash;
-  struct idspec *i;
-
-  hash = idspec_hash (nuids, ngids, uids, gids);
-
-  pthread_spin_lock (&idhashlock);
-  for (i = idhashtable[hash]; i; i = i->next)
-    if (idspec_compare (i, nuids, ngids, uids, gids))
-      {
-	i->references++;
-	if (i->references == 1)
-	  nfreeids--;
-	pthread_spin_unlock (&idhashlock);
-	return i;
-      }
+  struct idspec key, *i;
+  struct cache_stripe *s;
+
+  key.nuids = nuids;
+  key.ngids = ngids;
+  key.uids = (uid_t *) uids;
+  key.gids = (gid_t *) gids;
+  s = idspec_stripe (&key);
+
+  pthread_mutex_lock (&s->lock);
+  i = hurd_ihash_find (&s->table, (hurd_ihash_key_t) &key);
+  if (i)
+    {
+      if (i->references++ == 0)
+	lru_remove (s, &i->lru);
+      pthread_mutex_unlock (&s->lock);
+      return i;
+    }
 
   assert_backtrace (sizeof (uid_t) == sizeof (int));
   i = malloc (sizeof (struct idspec));
@@ -114,13 +206,13 @@ idspec_lookup (int nuids, int ngids, int *uids, int *gids)
   memcpy (i->gids, gids, ngids * sizeof (gid_t));
   i->references = 1;
 
-  i->next = idhashtable[hash];
-  if (idhashtable[hash])
-    idhashtable[hash]->prevp = &i->next;
-  i->prevp = &idhashtable[hash];
-  idhashtable[hash] = i;
+  if (hurd_ihash_add (&s->table, (hurd_ihash_key_t) i, i))
+    {
+      /* Use it uncached; cred_rele will free it.  */
+      i->slot = NULL;
+    }
 
-  pthread_spin_unlock (&idhashlock);
+  pthread_mutex_unlock (&s->lock);
   return i;
 }
 
@@ -187,136 +279,170 @@ process_cred (int *p, struct idspec **credp)
 void
 cred_rele (struct idspec *i)
 {
-  pthread_spin_lock (&idhashlock);
-  i->references--;
-  if (i->references == 0)
+  struct cache_stripe *s = idspec_stripe (i);
+
+  pthread_mutex_lock (&s->lock);
+  if (--i->references == 0)
     {
-      i->lastuse = mapped_time->seconds;
-      if (i->lastuse < leastidlastuse || nfreeids == 0)
-	leastidlastuse = i->lastuse;
-      nfreeids++;
+      if (i->slot)
+	lru_add (s, &i->lru);
+      else
+	{
+	  free (i->uids);
+	  free (i->gids);
+	  free (i);
+	}
     }
-  pthread_spin_unlock (&idhashlock);
+  pthread_mutex_unlock (&s->lock);
 }
 
 void
 cred_ref (struct idspec *i)
 {
-  pthread_spin_lock (&idhashlock);
+  struct cache_stripe *s = idspec_stripe (i);
+
+  pthread_mutex_lock (&s->lock);
   assert_backtrace (i->references);
   i->references++;
-  pthread_spin_unlock (&idhashlock);
+  pthread_mutex_unlock (&s->lock);
 }
 
 void
 scan_creds ()
 {
   int n;
-  int newleast = mapped_time->seconds;
-
-  pthread_spin_lock (&idhashlock);
 
-  if (mapped_time->seconds - leastidlastuse > ID_KEEP_TIMEOUT)
+  for (n = 0; n < CACHE_STRIPES; n++)
     {
-      for (n = 0; n < IDHASH_TABLE_SIZE && nfreeids; n++)
-	{
-	  struct idspec *i = idhashtable[n];
-
-	  while (i && nfreeids)
-	    {
-	      struct idspec *next_i = i->next;
-
-	      if (!i->references
-		  && mapped_time->seconds - i->lastuse > ID_KEEP_TIMEOUT)
-		{
-		  nfreeids--;
-		  *i->prevp = i->next;
-		  if (i->next)
-		    i->next->prevp = i->prevp;
-		  free (i->uids);
-		  free (i->gids);
-		  free (i);
-		}
-	      else if (!i->references && newleast > i->lastuse)
-		newleast = i->lastuse;
-
-	      i = next_i;
-	    }
-	}
-
-      /* If we didn't bail early, then this is valid.  */
-      if (nfreeids)
-	leastidlastuse = newleast;
+      pthread_mutex_lock (&idstripes[n].lock);
+      lru_expire (&idstripes[n], ID_KEEP_TIMEOUT, SIZE_MAX, idspec_discard);
+      pthread_mutex_unlock (&idstripes[n].lock);
     }
-  pthread_spin_unlock (&idhashlock);
 }
 
-
 
-static struct cache_handle *fhhashtable[FHHASH_TABLE_SIZE];
-pthread_mutex_t fhhashlock = PTHREAD_MUTEX_INITIALIZER;
-static int nfreefh;
-static int leastfhlastuse;
 
-static int
-fh_hash (char *fhandle, struct idspec *i)
+static struct cache_stripe fhstripes[CACHE_STRIPES];
+
+static hurd_ihash_key_t
+fh_hash (const void *key)
 {
-  int hash = 0, n;
+  const struct cache_handle *c = key;
+  hurd_ihash_key_t hash = 0;
+  int n;
 
   for (n = 0; n < NFS2_FHSIZE; n++)
-    hash += fhandle[n];
-  hash += (intptr_t) i >> 6;
-  return hash % FHHASH_TABLE_SIZE;
+    hash = hash * 31 + (unsigned char) c->handle.array[n];
+  hash += (intptr_t) c->ids >> 6;
+  return hash;
 }
 
-int *
-lookup_cache_handle (int *p, struct cache_handle **cp, struct idspec *i)
+static int
+fh_compare (const void *a, const void *b)
+{
+  const struct cache_handle *c = a, *d = b;
+
+  return c->ids == d->ids && ! bcmp (c->handle.array, d->handle.array,
+				     NFS2_FHSIZE);
+}
+
+static struct cache_stripe *
+fh_stripe (struct cache_handle *c)
 {
-  int hash;
+  return &fhstripes[fh_hash (c) % CACHE_STRIPES];
+}
+
+static void
+fh_discard (struct cache_stripe *s, struct lru_link *link)
+{
+  struct cache_handle *c = LRU_ENTRY (link, struct cache_handle);
+
+  hurd_ihash_locp_remove (&s->table, c->slot);
+  cred_rele (c->ids);
+  mach_port_deallocate (mach_task_self (), c->port);
+  free (c);
+}
+
+/* Find the cached handle with the same key as KEY and allocate a
+   reference to it.  Return NULL if there is none.  */
+static struct cache_handle *
+fh_find (struct cache_handle *key)
+{
+  struct cache_stripe *s = fh_stripe (key);
   struct cache_handle *c;
-  fsys_t fsys;
-  file_t port;
 
-  hash = fh_hash ((char *)p, i);
-  pthread_mutex_lock (&fhhashlock);
-  for (c = fhhashtable[hash]; c; c = c->next)
-    if (c->ids == i && ! bcmp (c->handle.array, p, NFS2_FHSIZE))
-      {
-	if (c->references == 0)
-	  nfreefh--;
-	c->references++;
-	pthread_mutex_unlock (&fhhashlock);
-	*cp = c;
-	return p + NFS2_FHSIZE / sizeof (int);
-      }
-
-  /* Not found.  */
-
-  /* First four bytes are our internal table of filesystems.  */
-  fsys = lookup_filesystem (*p);
-  if (fsys == MACH_PORT_NULL
-      || fsys_getfile (fsys, i->uids, i->nuids, i->gids, i->ngids,
-		       (char *)(p + 1), NFS2_FHSIZE - sizeof (int), &port))
+  pthread_mutex_lock (&s->lock);
+  c = hurd_ihash_find (&s->table, (hurd_ihash_key_t) key);
+  if (c && c->references++ == 0)
+    lru_remove (s, &c->lru);
+  pthread_mutex_unlock (&s->lock);
+  return c;
+}
+
+/* Enter a handle for the file handle and user in KEY, referring to PORT,
+   in the cache, unless another thread did so first, and return it with a
+   reference allocated.  Consumes PORT.  */
+static struct cache_handle *
+fh_enter (struct cache_handle *key, file_t port)
+{
+  struct cache_stripe *s = fh_stripe (key);
+  struct cache_handle *c;
+
+  pthread_mutex_lock (&s->lock);
+  c = hurd_ihash_find (&s->table, (hurd_ihash_key_t) key);
+  if (c)
     {
-      pthread_mutex_unlock (&fhhashlock);
-      *cp = 0;
-      return p + NFS2_FHSIZE / sizeof (int);
+      if (c->references++ == 0)
+	lru_remove (s, &c->lru);
+      pthread_mutex_unlock (&s->lock);
+      mach_port_deallocate (mach_task_self (), port);
+      return c;
     }
 
   c = malloc (sizeof (struct cache_handle));
-  memcpy (c->handle.array, p, NFS2_FHSIZE);
-  cred_ref (i);
-  c->ids = i;
+  if (! c)
+    {
+      pthread_mutex_unlock (&s->lock);
+      mach_port_deallocate (mach_task_self (), port);
+      return 0;
+    }
+  memcpy (c->handle.array, key->handle.array, NFS2_FHSIZE);
+  cred_ref (key->ids);
+  c->ids = key->ids;
   c->port = port;
   c->references = 1;
+  if (hurd_ihash_add (&s->table, (hurd_ihash_key_t) c, c))
+    c->slot = NULL;		/* Used uncached.  */
+  pthread_mutex_unlock (&s->lock);
+
+  return c;
+}
+
+int *
+lookup_cache_handle (int *p, struct cache_handle **cp, struct idspec *i)
+{
+  struct cache_handle key, *c;
+  fsys_t fsys;
+  file_t port;
+
+  memcpy (key.handle.array, p, NFS2_FHSIZE);
+  key.ids = i;
 
-  c->next = fhhashtable[hash];
-  if (c->next)
-    c->next->prevp = &c->next;
-  c->prevp = &fhhashtable[hash];
-  fhhashtable[hash] = c;
+  c = fh_find (&key);
+  if (! c)
+    {
+      /* Not found.  */
+
+      /* First four bytes are our internal table of filesystems.  */
+      fsys = lookup_filesystem (*p);
+      if (fsys == MACH_PORT_NULL
+	  || fsys_getfile (fsys, i->uids, i->nuids, i->gids, i->ngids,
+			   (char *)(p + 1), NFS2_FHSIZE - sizeof (int), &port))
+	c = 0;
+      else
+	c = fh_enter (&key, port);
+    }
 
-  pthread_mutex_unlock (&fhhashlock);
   *cp = c;
   return p + NFS2_FHSIZE / sizeof (int);
 }
@@ -324,59 +450,38 @@ lookup_cache_handle (int *p, struct cache_handle **cp, struct idspec *i)
 void
 cache_handle_rele (struct cache_handle *c)
 {
-  pthread_mutex_lock (&fhhashlock);
-  c->references--;
-  if (c->references == 0)
+  struct cache_stripe *s = fh_stripe (c);
+
+  pthread_mutex_lock (&s->lock);
+  if (--c->references == 0)
     {
-      c->lastuse = mapped_time->seconds;
-      if (c->lastuse < leastfhlastuse || nfreefh == 0)
-	leastfhlastuse = c->lastuse;
-      nfreefh++;
+      if (c->slot)
+	{
+	  lru_add (s, &c->lru);
+	  lru_expire (s, FH_KEEP_TIMEOUT, FH_CACHE_MAX / CACHE_STRIPES,
+		      fh_discard);
+	}
+      else
+	{
+	  cred_rele (c->ids);
+	  mach_port_deallocate (mach_task_self (), c->port);
+	  free (c);
+	}
     }
-  pthread_mutex_unlock (&fhhashlock);
+  pthread_mutex_unlock (&s->lock);
 }
 
 void
 scan_fhs ()
 {
   int n;
-  int newleast = mapped_time->seconds;
-
-  pthread_mutex_lock (&fhhashlock);
 
-  if (mapped_time->seconds - leastfhlastuse > FH_KEEP_TIMEOUT)
+  for (n = 0; n < CACHE_STRIPES; n++)
     {
-      for (n = 0; n < FHHASH_TABLE_SIZE && nfreefh; n++)
-	{
-	  struct cache_handle *c = fhhashtable[n];
-
-	  while (c && nfreefh)
-	    {
-	      struct cache_handle *next_c = c->next;
-
-	      if (!c->references
-		  && mapped_time->seconds - c->lastuse > FH_KEEP_TIMEOUT)
-		{
-		  nfreefh--;
-		  *c->prevp = c->next;
-		  if (c->next)
-		    c->next->prevp = c->prevp;
-		  cred_rele (c->ids);
-		  mach_port_deallocate (mach_task_self (), c->port);
-		  free (c);
-		}
-	      else if (!c->references && newleast > c->lastuse)
-		newleast = c->lastuse;
-
-	      c = next_c;
-	    }
-	}
-
-      /* If we didn't bail early, then this is valid.  */
-      if (nfreefh)
-	leastfhlastuse = newleast;
+      pthread_mutex_lock (&fhstripes[n].lock);
+      lru_expire (&fhstripes[n], FH_KEEP_TIMEOUT, SIZE_MAX, fh_discard);
+      pthread_mutex_unlock (&fhstripes[n].lock);
     }
-  pthread_mutex_unlock (&fhhashlock);
 }
 
 struct cache_handle *
@@ -384,8 +489,7 @@ create_cached_handle (int fs, struct cache_handle *credc, file_t userport)
 {
   union cache_handle_array fhandle;
   error_t err;
-  struct cache_handle *c;
-  int hash;
+  struct cache_handle key, *c;
   char *bp = fhandle.array + sizeof (int);
   size_t handlelen = NFS2_FHSIZE - sizeof (int);
   mach_port_t newport, ref;
@@ -418,19 +522,12 @@ create_cached_handle (int fs, struct cache_handle *credc, file_t userport)
     }
 
   /* Cache it.  */
-  hash = fh_hash (fhandle.array, credc->ids);
-  pthread_mutex_lock (&fhhashlock);
-  for (c = fhhashtable[hash]; c; c = c->next)
-    if (c->ids == credc->ids &&
-        ! bcmp (fhandle.array, c->handle.array, NFS2_FHSIZE))
-      {
-	/* Return this one.  */
-	if (c->references == 0)
-	  nfreefh--;
-	c->references++;
-	pthread_mutex_unlock (&fhhashlock);
-	return c;
-      }
+  memcpy (key.handle.array, fhandle.array, NFS2_FHSIZE);
+  key.ids = credc->ids;
+  c = fh_find (&key);
+  if (c)
+    /* Return this one.  */
+    return c;
 
   /* Always call fsys_getfile so that we don't depend on the
      particular open modes of the port passed in.  */
@@ -441,36 +538,50 @@ create_cached_handle (int fs, struct cache_handle *credc, file_t userport)
 		      fhandle.array + sizeof (int), NFS2_FHSIZE - sizeof (int),
 		      &newport);
   if (err)
-    {
-      pthread_mutex_unlock (&fhhashlock);
-      return 0;
-    }
+    return 0;
 
   /* Create it anew.  */
-  c = malloc (sizeof (struct cache_handle));
-  memcpy (c->handle.array, fhandle.array, NFS2_FHSIZE);
-  cred_ref (credc->ids);
-  c->ids = credc->ids;
-  c->port = newport;
-  c->references = 1;
+  return fh_enter (&key, newport);
+}
 
-  /* And add it to the hash table.  */
-  c->next = fhhashtable[hash];
-  if (c->next)
-    c->next->prevp = &c->next;
-  c->prevp = &fhhashtable[hash];
-  fhhashtable[hash] = c;
-  pthread_mutex_unlock (&fhhashlock);
 
-  return c;
+
+static struct cache_stripe replystripes[CACHE_STRIPES];
+
+static hurd_ihash_key_t
+reply_hash (const void *key)
+{
+  const struct cached_reply *cr = key;
+
+  return (unsigned int) cr->xid ^ cr->source.sin_addr.s_addr
+    ^ cr->source.sin_port;
+}
+
+static int
+reply_compare (const void *a, const void *b)
+{
+  const struct cached_reply *cr = a, *cs = b;
+
+  return cr->xid == cs->xid
+    && cr->source.sin_addr.s_addr == cs->source.sin_addr.s_addr
+    && cr->source.sin_port == cs->source.sin_port;
+}
+
+static struct cache_stripe *
+reply_stripe (struct cached_reply *cr)
+{
+  return &replystripes[reply_hash (cr) % CACHE_STRIPES];
 }
 
-
+static void
+reply_discard (struct cache_stripe *s, struct lru_link *link)
+{
+  struct cached_reply *cr = LRU_ENTRY (link, struct cached_reply);
 
-static struct cached_reply *replyhashtable [REPLYHASH_TABLE_SIZE];
-static pthread_spinlock_t replycachelock = PTHREAD_SPINLOCK_INITIALIZER;
-static int nfreereplies;
-static int leastreplylastuse;
+  hurd_ihash_locp_remove (&s->table, cr->slot);
+  free (cr->data);
+  free (cr);
+}
 
 /* Check the list of cached replies to see if this is a replay of a
    previous transaction; if so, return the cache record.  Otherwise,
@@ -479,23 +590,23 @@ struct cached_reply *
 check_cached_replies (int xid,
 		      struct sockaddr_in *sender)
 {
-  struct cached_reply *cr;
-  int hash;
-
-  hash = abs(xid % REPLYHASH_TABLE_SIZE);
-
-  pthread_spin_lock (&replycachelock);
-  for (cr = replyhashtable[hash]; cr; cr = cr->next)
-    if (cr->xid == xid
-	&& !bcmp (sender, &cr->source, sizeof (struct sockaddr_in)))
-      {
-	cr->references++;
-	if (cr->references == 1)
-	  nfreereplies--;
-	pthread_spin_unlock (&replycachelock);
-	pthread_mutex_lock (&cr->lock);
-	return cr;
-      }
+  struct cached_reply key, *cr;
+  struct cache_stripe *s;
+
+  key.xid = xid;
+  key.source = *sender;
+  s = reply_stripe (&key);
+
+  pthread_mutex_lock (&s->lock);
+  cr = hurd_ihash_find (&s->table, (hurd_ihash_key_t) &key);
+  if (cr)
+    {
+      if (cr->references++ == 0)
+	lru_remove (s, &cr->lru);
+      pthread_mutex_unlock (&s->lock);
+      pthread_mutex_lock (&cr->lock);
+      return cr;
+    }
 
   cr = malloc (sizeof (struct cached_reply));
   pthread_mutex_init (&cr->lock, NULL);
@@ -504,14 +615,10 @@ check_cached_replies (int xid,
   cr->xid = xid;
   cr->data = 0;
   cr->references = 1;
+  if (hurd_ihash_add (&s->table, (hurd_ihash_key_t) cr, cr))
+    cr->slot = NULL;		/* Used uncached.  */
 
-  cr->next = replyhashtable[hash];
-  if (replyhashtable[hash])
-    replyhashtable[hash]->prevp = &cr->next;
-  cr->prevp = &replyhashtable[hash];
-  replyhashtable[hash] = cr;
-
-  pthread_spin_unlock (&replycachelock);
+  pthread_mutex_unlock (&s->lock);
   return cr;
 }
 
@@ -520,58 +627,46 @@ check_cached_replies (int xid,
 void
 release_cached_reply (struct cached_reply *cr)
 {
+  struct cache_stripe *s = reply_stripe (cr);
+
   pthread_mutex_unlock (&cr->lock);
-  pthread_spin_lock (&replycachelock);
-  cr->references--;
-  if (cr->references == 0)
+  pthread_mutex_lock (&s->lock);
+  if (--cr->references == 0)
     {
-      cr->lastuse = mapped_time->seconds;
-      if (cr->lastuse < leastreplylastuse || nfreereplies == 0)
-	leastreplylastuse = cr->lastuse;
-      nfreereplies++;
+      if (cr->slot)
+	{
+	  lru_add (s, &cr->lru);
+	  lru_expire (s, REPLY_KEEP_TIMEOUT, REPLY_CACHE_MAX / CACHE_STRIPES,
+		      reply_discard);
+	}
+      else
+	{
+	  free (cr->data);
+	  free (cr);
+	}
     }
-  pthread_spin_unlock (&replycachelock);
+  pthread_mutex_unlock (&s->lock);
 }
 
 void
 scan_replies ()
 {
   int n;
-  int newleast = mapped_time->seconds;
 
-  pthread_spin_lock (&replycachelock);
-
-  if (mapped_time->seconds - leastreplylastuse > REPLY_KEEP_TIMEOUT)
+  for (n = 0; n < CACHE_STRIPES; n++)
     {
-      for (n = 0; n < REPLYHASH_TABLE_SIZE && nfreereplies; n++)
-	{
-	  struct cached_reply *cr = replyhashtable[n];
-
-	  while (cr && nfreereplies)
-	    {
-	      struct cached_reply *next_cr = cr->next;
-
-	      if (!cr->references
-		  && mapped_time->seconds - cr->lastuse > REPLY_KEEP_TIMEOUT)
-		{
-		  nfreereplies--;
-		  *cr->prevp = cr->next;
-		  if (cr->next)
-		    cr->next->prevp = cr->prevp;
-		  if (cr->data)
-		    free (cr->data);
-		  free (cr);
-		}
-	      else if (!cr->references && newleast > cr->lastuse)
-		newleast = cr->lastuse;
-
-	      cr = next_cr;
-	    }
-	}
-
-      /* If we didn't bail early, then this is valid.  */
-      if (nfreereplies)
-	leastreplylastuse = newleast;
+      pthread_mutex_lock (&replystripes[n].lock);
+      lru_expire (&replystripes[n], REPLY_KEEP_TIMEOUT, SIZE_MAX,
+		  reply_discard);
+      pthread_mutex_unlock (&replystripes[n].lock);
     }
-  pthread_spin_unlock (&replycachelock);
+}
+
+/* Set up the caches.  */
+void
+init_caches (void)
+{
+  INIT_STRIPES (idstripes, struct idspec, idspec_hash, idspec_compare);
+  INIT_STRIPES (fhstripes, struct cache_handle, fh_hash, fh_compare);
+  INIT_STRIPES (replystripes, struct cached_reply, reply_hash, reply_compare);
 }
@@ -20,6 +20,11 @@
 
 #include <string.h>
 #include <fcntl.h>
+#include <error.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <sys/uio.h>
 
 #include "nfsd.h"
 
@@ -35,17 +40,18 @@
 #include <rpc/rpc_msg.h>
 #undef malloc
 
-void *
-server_loop (void *arg)
+/* Process the RPC request of LEN bytes in BUF, which must be int
+   aligned and is clobbered, from SENDER.  Return the cached reply
+   record for it, locked, with the reply to send to SENDER in its DATA
+   and LEN, or NULL if the request is to be ignored.  */
+static struct cached_reply *
+process_request (char *buf, size_t len, struct sockaddr_in *sender)
 {
-  int fd = (int) arg;
-  char buf[MAXIOSIZE];
   int xid;
-  int *p, *r;
+  int *p, *r, *end;
   char *rbuf;
   struct cached_reply *cr;
   int program;
-  struct sockaddr_in sender;
   int version;
   int procedure;
   struct proctable *table = 0;
@@ -53,172 +59,381 @@ server_loop (void *arg)
   struct idspec *cred;
   struct cache_handle *c, fakec;
   error_t err;
-  socklen_t addrlen;
-  int cc;
 
   memset (&fakec, 0, sizeof (struct cache_handle));
 
-  for (;;)
+  p = (int *) buf;
+  end = (int *) (buf + len);
+  proc = 0;
+  if (len < 2 * sizeof (int))
+    return NULL;
+  xid = *(p++);
+
+  /* Ignore things that aren't proper RPCs.  */
+  if (ntohl (*p) != CALL)
+    return NULL;
+  p++;
+
+  cr = check_cached_replies (xid, sender);
+  if (cr->data)
+    /* This transacation has already completed.  */
+    return cr;
+
+  r = (int *) (rbuf = malloc (MAXIOSIZE));
+
+  if (ntohl (*p) != RPC_MSG_VERSION)
     {
-      p = (int *) buf;
-      proc = 0;
-      addrlen = sizeof (struct sockaddr_in);
-      cc = recvfrom (fd, buf, MAXIOSIZE, 0, &sender, &addrlen);
-      if (cc == -1)
-	continue;		/* Ignore errors.  */
-      xid = *(p++);
+      /* Reject RPC.  */
+      *(r++) = xid;
+      *(r++) = htonl (REPLY);
+      *(r++) = htonl (MSG_DENIED);
+      *(r++) = htonl (RPC_MISMATCH);
+      *(r++) = htonl (RPC_MSG_VERSION);
+      *(r++) = htonl (RPC_MSG_VERSION);
+      goto send_reply;
+    }
+  p++;
 
-      /* Ignore things that aren't proper RPCs.  */
-      if (ntohl (*p) != CALL)
-	continue;
-      p++;
+  program = ntohl (*p);
+  p++;
+  switch (program)
+    {
+    case MOUNTPROG:
+      version = MOUNTVERS;
+      table = &mounttable;
+      break;
 
-      cr = check_cached_replies (xid, &sender);
-      if (cr->data)
-	/* This transacation has already completed.  */
-	goto repost_reply;
+    case NFS_PROGRAM:
+      version = NFS_VERSION;
+      table = &nfs2table;
+      break;
 
-      r = (int *) (rbuf = malloc (MAXIOSIZE));
+    case PMAPPROG:
+      version = PMAPVERS;
+      table = &pmaptable;
+      break;
 
-      if (ntohl (*p) != RPC_MSG_VERSION)
-	{
-	  /* Reject RPC.  */
-	  *(r++) = xid;
-	  *(r++) = htonl (REPLY);
-	  *(r++) = htonl (MSG_DENIED);
-	  *(r++) = htonl (RPC_MISMATCH);
-	  *(r++) = htonl (RPC_MSG_VERSION);
-	  *(r++) = htonl (RPC_MSG_VERSION);
-	  goto send_reply;
-	}
-      p++;
+    default:
+      /* Program unavailable.  */
+      *(r++) = xid;
+      *(r++) = htonl (REPLY);
+      *(r++) = htonl (MSG_ACCEPTED);
+      *(r++) = htonl (AUTH_NULL);
+      *(r++) = htonl (0);
+      *(r++) = htonl (PROG_UNAVAIL);
+      goto send_reply;
+    }
 
-      program = ntohl (*p);
-      p++;
-      switch (program)
-	{
-	case MOUNTPROG:
-	  version = MOUNTVERS;
-	  table = &mounttable;
-	  break;
-
-	case NFS_PROGRAM:
-	  version = NFS_VERSION;
-	  table = &nfs2table;
-	  break;
-
-	case PMAPPROG:
-	  version = PMAPVERS;
-	  table = &pmaptable;
-	  break;
-
-	default:
-	  /* Program unavailable.  */
-	  *(r++) = xid;
-	  *(r++) = htonl (REPLY);
-	  *(r++) = htonl (MSG_ACCEPTED);
-	  *(r++) = htonl (AUTH_NULL);
-	  *(r++) = htonl (0);
-	  *(r++) = htonl (PROG_UNAVAIL);
-	  goto send_reply;
-	}
+  if (ntohl (*p) != version)
+    {
+      /* Program mismatch.  */
+      *(r++) = xid;
+      *(r++) = htonl (REPLY);
+      *(r++) = htonl (MSG_ACCEPTED);
+      *(r++) = htonl (AUTH_NULL);
+      *(r++) = htonl (0);
+      *(r++) = htonl (PROG_MISMATCH);
+      *(r++) = htonl (version);
+      *(r++) = htonl (version);
+      goto send_reply;
+    }
+  p++;
 
-      if (ntohl (*p) != version)
+  procedure = htonl (*p);
+  p++;
+  if (procedure < table->min
+      || procedure > table->max
+      || table->procs[procedure - table->min].func == 0)
+    {
+      /* Procedure unavailable.  */
+      *(r++) = xid;
+      *(r++) = htonl (REPLY);
+      *(r++) = htonl (MSG_ACCEPTED);
+      *(r++) = htonl (AUTH_NULL);
+      *(r++) = htonl (0);
+      *(r++) = htonl (PROC_UNAVAIL);
+      *(r++) = htonl (table->min);
+      *(r++) = htonl (table->max);
+      goto send_reply;
+    }
+  proc = &table->procs[procedure - table->min];
+
+  p = process_cred (p, &cred);
+
+  if (proc->need_handle)
+    p = lookup_cache_handle (p, &c, cred);
+  else
+    {
+      fakec.ids = cred;
+      c = &fakec;
+    }
+
+  if (proc->alloc_reply)
+    {
+      size_t amt;
+      amt = (*proc->alloc_reply) (p, version) + 256;
+      if (amt > MAXIOSIZE)
 	{
-	  /* Program mismatch.  */
-	  *(r++) = xid;
-	  *(r++) = htonl (REPLY);
-	  *(r++) = htonl (MSG_ACCEPTED);
-	  *(r++) = htonl (AUTH_NULL);
-	  *(r++) = htonl (0);
-	  *(r++) = htonl (PROG_MISMATCH);
-	  *(r++) = htonl (version);
-	  *(r++) = htonl (version);
-	  goto send_reply;
+	  free (rbuf);
+	  r = (int *) (rbuf = malloc (amt));
 	}
-      p++;
+    }
 
-      procedure = htonl (*p);
-      p++;
-      if (procedure < table->min
-	  || procedure > table->max
-	  || table->procs[procedure - table->min].func == 0)
+  /* Fill in beginning of reply.  */
+  *(r++) = xid;
+  *(r++) = htonl (REPLY);
+  *(r++) = htonl (MSG_ACCEPTED);
+  *(r++) = htonl (AUTH_NULL);
+  *(r++) = htonl (0);
+  *(r++) = htonl (SUCCESS);
+  if (!proc->process_error)
+    /* The function does its own error processing, and we ignore
+       its return value.  */
+    (void) (*proc->func) (c, p, end, &r, version);
+  else
+    {
+      if (c)
 	{
-	  /* Procedure unavailable.  */
-	  *(r++) = xid;
-	  *(r++) = htonl (REPLY);
-	  *(r++) = htonl (MSG_ACCEPTED);
-	  *(r++) = htonl (AUTH_NULL);
+	  /* Assume success for now and patch it later if necessary.  */
+	  int *errloc = r;
 	  *(r++) = htonl (0);
-	  *(r++) = htonl (PROC_UNAVAIL);
-	  *(r++) = htonl (table->min);
-	  *(r++) = htonl (table->max);
-	  goto send_reply;
+	  /* Call processing function, its output after error code.  */
+	  err = (*proc->func) (c, p, end, &r, version);
+	  if (err)
+	    {
+	      r = errloc;	/* Back up, patch error code, discard rest.  */
+	      *(r++) = htonl (nfs_error_trans (err, version));
+	    }
 	}
-      proc = &table->procs[procedure - table->min];
+      else
+	*(r++) = htonl (nfs_error_trans (ESTALE, version));
+    }
 
-      p = process_cred (p, &cred);
+  cred_rele (cred);
+  if (c && c != &fakec)
+    cache_handle_rele (c);
 
-      if (proc->need_handle)
-	p = lookup_cache_handle (p, &c, cred);
-      else
-	{
-	  fakec.ids = cred;
-	  c = &fakec;
-	}
+ send_reply:
+  cr->data = rbuf;
+  cr->len = (char *)r - rbuf;
+  return cr;
+}
+
+/* A pool of threads serving a UDP socket.  Every thread blocks in
+   recvfrom on the socket; when the last idle one gets a request, it
+   creates another thread first, up to MAX_THREADS, so that a few slow
+   requests (each one may take several RPCs to the filesystem) don't
+   hold up all the others.  */
+struct server_pool
+{
+  int socket;
+  pthread_mutex_t lock;
+  int nthreads, idle, max_threads;
+};
+
+static void *server_loop (void *);
+
+/* Create another thread serving POOL.  POOL must be locked.  */
+static void
+pool_add_thread (struct server_pool *pool)
+{
+  pthread_t thread;
+  int fail;
+
+  fail = pthread_create (&thread, NULL, server_loop, pool);
+  if (fail)
+    {
+      error (0, fail, "Creating server thread");
+      return;
+    }
+  pthread_detach (thread);
+  pool->nthreads++;
+  pool->idle++;
+}
+
+static void *
+server_loop (void *arg)
+{
+  struct server_pool *pool = arg;
+  int buf[MAXIOSIZE / sizeof (int)];
+  struct cached_reply *cr;
+  struct sockaddr_in sender;
+  socklen_t addrlen;
+  int cc;
 
-      if (proc->alloc_reply)
+  for (;;)
+    {
+      addrlen = sizeof (struct sockaddr_in);
+      cc = recvfrom (pool->socket, buf, MAXIOSIZE, 0, &sender, &addrlen);
+      if (cc == -1)
+	continue;		/* Ignore errors.  */
+
+      pthread_mutex_lock (&pool->lock);
+      if (--pool->idle == 0 && pool->nthreads < pool->max_threads)
+	pool_add_thread (pool);
+      pthread_mutex_unlock (&pool->lock);
+
+      cr = process_request ((char *) buf, cc, &sender);
+      if (cr)
 	{
-	  size_t amt;
-	  amt = (*proc->alloc_reply) (p, version) + 256;
-	  if (amt > MAXIOSIZE)
-	    {
-	      free (rbuf);
-	      r = (int *) (rbuf = malloc (amt));
-	    }
+	  sendto (pool->socket, cr->data, cr->len, 0,
+		  (struct sockaddr *) &sender, addrlen);
+	  release_cached_reply (cr);
 	}
 
-      /* Fill in beginning of reply.  */
-      *(r++) = xid;
-      *(r++) = htonl (REPLY);
-      *(r++) = htonl (MSG_ACCEPTED);
-      *(r++) = htonl (AUTH_NULL);
-      *(r++) = htonl (0);
-      *(r++) = htonl (SUCCESS);
-      if (!proc->process_error)
-	/* The function does its own error processing, and we ignore
-	   its return value.  */
-	(void) (*proc->func) (c, p, &r, version);
-      else
+      pthread_mutex_lock (&pool->lock);
+      pool->idle++;
+      pthread_mutex_unlock (&pool->lock);
+    }
+}
+
+/* Serve SOCKET with between MIN_THREADS and MAX_THREADS threads.  */
+void
+create_server_pool (int socket, int min_threads, int max_threads)
+{
+  struct server_pool *pool;
+
+  pool = malloc (sizeof *pool);
+  if (! pool)
+    error (1, errno, "Creating server pool");
+  pool->socket = socket;
+  pthread_mutex_init (&pool->lock, NULL);
+  pool->nthreads = pool->idle = 0;
+  pool->max_threads = max_threads;
+
+  pthread_mutex_lock (&pool->lock);
+  while (pool->nthreads < min_threads)
+    pool_add_thread (pool);
+  pthread_mutex_unlock (&pool->lock);
+  if (pool->nthreads == 0)
+    error (1, 0, "Cannot create any server thread");
+}
+
+
+/* RPC over TCP (RFC 5531, section 11) sends every message as a
+   sequence of fragments, each preceded by a 32-bit word holding its
+   length and, in the top bit, whether it is the last one.  */
+#define LAST_FRAGMENT 0x80000000
+
+/* Read exactly LEN bytes from FD into BUF.  Return zero on success.  */
+static int
+read_fully (int fd, void *buf, size_t len)
+{
+  while (len > 0)
+    {
+      ssize_t cc = read (fd, buf, len);
+      if (cc <= 0)
+	return -1;
+      buf = (char *) buf + cc;
+      len -= cc;
+    }
+  return 0;
+}
+
+/* Serve the TCP connection on ARG, one record after the other.  */
+static void *
+tcp_server_loop (void *arg)
+{
+  int fd = (intptr_t) arg;
+  char *buf;
+  struct sockaddr_in peer;
+  socklen_t addrlen = sizeof peer;
+
+  buf = malloc (MAXIOSIZE);
+  if (! buf || getpeername (fd, (struct sockaddr *) &peer, &addrlen))
+    goto out;
+
+  for (;;)
+    {
+      struct cached_reply *cr;
+      uint32_t marker;
+      size_t len = 0;
+      int overflow = 0;
+
+      /* Collect the fragments of the next record; if it is too large
+	 for us, skip it.  */
+      do
 	{
-	  if (c)
+	  size_t fraglen;
+
+	  if (read_fully (fd, &marker, sizeof marker))
+	    goto out;
+	  marker = ntohl (marker);
+	  fraglen = marker & ~LAST_FRAGMENT;
+
+	  if (overflow || len + fraglen > MAXIOSIZE)
 	    {
-	      /* Assume success for now and patch it later if necessary.  */
-	      int *errloc = r;
-	      *(r++) = htonl (0);
-	      /* Call processing function, its output after error code.  */
-	      err = (*proc->func) (c, p, &r, version);
-	      if (err)
+	      char junk[1024];
+
+	      overflow = 1;
+	      while (fraglen > 0)
 		{
-		  r = errloc;	/* Back up, patch error code, discard rest.  */
-		  *(r++) = htonl (nfs_error_trans (err, version));
+		  size_t n = MIN (fraglen, sizeof junk);
+		  if (read_fully (fd, junk, n))
+		    goto out;
+		  fraglen -= n;
 		}
 	    }
 	  else
-	    *(r++) = htonl (nfs_error_trans (ESTALE, version));
+	    {
+	      if (read_fully (fd, buf + len, fraglen))
+		goto out;
+	      len += fraglen;
+	    }
 	}
+      while (! (marker & LAST_FRAGMENT));
 
-      cred_rele (cred);
-      if (c && c != &fakec)
-	cache_handle_rele (c);
+      if (overflow)
+	continue;
 
-    send_reply:
-      cr->data = rbuf;
-      cr->len = (char *)r - rbuf;
+      cr = process_request (buf, len, &peer);
+      if (cr)
+	{
+	  struct iovec iov[2];
+	  uint32_t reply_marker = htonl (LAST_FRAGMENT | cr->len);
+	  ssize_t cc;
+
+	  iov[0].iov_base = &reply_marker;
+	  iov[0].iov_len = sizeof reply_marker;
+	  iov[1].iov_base = cr->data;
+	  iov[1].iov_len = cr->len;
+	  cc = writev (fd, iov, 2);
+	  release_cached_reply (cr);
+	  if (cc != (ssize_t) (iov[0].iov_len + iov[1].iov_len))
+	    goto out;
+	}
+    }
+
+ out:
+  free (buf);
+  close (fd);
+  return NULL;
+}
+
+/* Accept connections on the TCP socket ARG, serving each with its own
+   thread.  */
+void *
+tcp_listen_loop (void *arg)
+{
+  int socket = (intptr_t) arg;
+
+  for (;;)
+    {
+      pthread_t thread;
+      int fd, fail;
 
-    repost_reply:
-      sendto (fd, cr->data, cr->len, 0,
-	      (struct sockaddr *) &sender, addrlen);
-      release_cached_reply (cr);
+      fd = accept (socket, NULL, NULL);
+      if (fd == -1)
+	continue;		/* Ignore errors.  */
+
+      fail = pthread_create (&thread, NULL, tcp_server_loop,
+			     (void *) (intptr_t) fd);
+      if (fail)
+	{
+	  error (0, fail, "Creating TCP server thread");
+	  close (fd);
+	  continue;
+	}
+      pthread_detach (thread);
     }
 }
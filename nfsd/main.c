@@ -20,26 +20,33 @@
 
 #include "nfsd.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <rpc/pmap_prot.h>
 #include <maptime.h>
 #include <hurd.h>
 #include <pthread.h>
 #include <error.h>
+#include <argp.h>
+#include <stdint.h>
+#include <version.h>
 
 int main_udp_socket, pmap_udp_socket;
+int main_tcp_socket = -1;
 struct sockaddr_in main_address, pmap_address;
 static char index_file[] = LOCALSTATEDIR "/state/misc/nfsd.index";
 char *index_file_name = index_file;
 
-/* Launch a server loop thread */
+const char *argp_program_version = STANDARD_HURD_VERSION (nfsd);
+
+/* Launch a thread running LOOP on SOCKET.  */
 static void
-create_server_thread (int socket)
+create_server_thread (void *(*loop) (void *), int socket)
 {
   pthread_t thread;
   int fail;
 
-  fail = pthread_create (&thread, NULL, server_loop, (void *) socket);
+  fail = pthread_create (&thread, NULL, loop, (void *) (intptr_t) socket);
   if (fail)
     error (1, fail, "Creating main server thread");
 
@@ -48,26 +55,67 @@ create_server_thread (int socket)
     error (1, fail, "Detaching main server thread");
 }
 
+static int nthreads = 4;
+static int max_threads = 64;
+static int use_tcp = 1;
+
+static const struct argp_option options[] =
+{
+  {"threads", 't', "N", 0,
+   "Number of threads serving NFS over UDP to start with (default 4)."},
+  {"max-threads", 'T', "N", 0,
+   "Maximum number of them, created as needed (default 64)."},
+  {"no-tcp", 'U', 0, 0, "Don't serve NFS over TCP."},
+  {0}
+};
+
+static error_t
+parse_opt (int key, char *arg, struct argp_state *state)
+{
+  switch (key)
+    {
+    case 't':
+      nthreads = atoi (arg);
+      break;
+
+    case 'T':
+      max_threads = atoi (arg);
+      break;
+
+    case 'U':
+      use_tcp = 0;
+      break;
+
+    case ARGP_KEY_ARG:
+      /* The old way of giving the number of threads.  */
+      if (state->arg_num > 0)
+	argp_usage (state);
+      nthreads = atoi (arg);
+      break;
+
+    default:
+      return ARGP_ERR_UNKNOWN;
+    }
+  return 0;
+}
+
+static const struct argp argp =
+{ options, parse_opt, "[NUM-THREADS]", "Serve NFS version 2." };
+
 int
 main (int argc, char **argv)
 {
-  int nthreads;
   int fail;
 
-  if (argc > 2)
-    {
-      fprintf (stderr, "%s [num-threads]\n", argv[0]);
-      exit (1);
-    }
-  if (argc == 1)
-    nthreads = 4;
-  else
-    nthreads = atoi (argv[1]);
-  if (!nthreads)
+  argp_parse (&argp, argc, argv, 0, 0, 0);
+  if (nthreads <= 0)
     nthreads = 4;
+  if (max_threads < nthreads)
+    max_threads = nthreads;
 
   authserver = getauth ();
   maptime_map (0, 0, &mapped_time);
+  init_caches ();
 
   main_address.sin_family = AF_INET;
   main_address.sin_port = htons (NFS_PORT);
@@ -88,12 +136,27 @@ main (int argc, char **argv)
   if (fail)
     error (1, errno, "Binding PMAP socket");
 
-  init_filesystems ();
+  if (use_tcp)
+    {
+      int one = 1;
+
+      main_tcp_socket = socket (PF_INET, SOCK_STREAM, 0);
+      if (main_tcp_socket == -1)
+	error (1, errno, "Creating NFS TCP socket");
+      setsockopt (main_tcp_socket, SOL_SOCKET, SO_REUSEADDR,
+		  &one, sizeof one);
+      if (bind (main_tcp_socket, (struct sockaddr *)&main_address,
+		sizeof (struct sockaddr_in))
+	  || listen (main_tcp_socket, 64))
+	error (1, errno, "Binding NFS TCP socket");
+    }
 
-  create_server_thread (pmap_udp_socket);
+  init_filesystems ();
 
-  while (nthreads--)
-    create_server_thread (main_udp_socket);
+  create_server_pool (pmap_udp_socket, 1, 1);
+  create_server_pool (main_udp_socket, nthreads, max_threads);
+  if (main_tcp_socket != -1)
+    create_server_thread (tcp_listen_loop, main_tcp_socket);
 
   for (;;)
     {
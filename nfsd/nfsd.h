@@ -26,19 +26,31 @@
 #include <rpc/types.h>
 #include "../nfs/nfs-spec.h" /* XXX */
 #include <hurd/fs.h>
+#include <hurd/ihash.h>
 
 /* These should be configuration options */
 #define ID_KEEP_TIMEOUT 3600	/* one hour */
 #define FH_KEEP_TIMEOUT 600	/* ten minutes */
 #define REPLY_KEEP_TIMEOUT 120	/* two minutes */
-#define MAXIOSIZE 10240
+#define FH_CACHE_MAX 8192	/* unused file handles kept at most */
+#define REPLY_CACHE_MAX 4096	/* unused replies kept at most */
+#define MAXDATA 32768		/* largest READ or WRITE we serve */
+#define MAXIOSIZE (MAXDATA + 1024)
+
+/* An unreferenced entry of one of the caches in cache.c is on the LRU
+   list of its stripe.  */
+struct lru_link
+{
+  struct lru_link *next, **prevp;
+  time_t lastuse;
+};
 
 struct idspec
 {
-  struct idspec *next, **prevp;
+  hurd_ihash_locp_t slot;
+  struct lru_link lru;
   int nuids, ngids;
   uid_t *uids, *gids;
-  time_t lastuse;
   int references;
 };
 
@@ -49,21 +61,21 @@ union cache_handle_array {
 
 struct cache_handle
 {
-  struct cache_handle *next, **prevp;
+  hurd_ihash_locp_t slot;
+  struct lru_link lru;
   union cache_handle_array handle;
   struct idspec *ids;
   file_t port;
-  time_t lastuse;
   int references;
 };
 
 struct cached_reply
 {
-  struct cached_reply *next, **prevp;
+  hurd_ihash_locp_t slot;
+  struct lru_link lru;
   pthread_mutex_t lock;
   struct sockaddr_in source;
   int xid;
-  time_t lastuse;
   int references;
   size_t len;
   char *data;
@@ -71,7 +83,9 @@ struct cached_reply
 
 struct procedure
 {
-  error_t (*func) (struct cache_handle *, int *, int **, int);
+  /* Process the arguments from P up to END, and encode the results at
+     *REPLY.  */
+  error_t (*func) (struct cache_handle *, int *, int *, int **, int);
   size_t (*alloc_reply) (int *, int);
   int need_handle;
   int process_error;
@@ -91,6 +105,8 @@ volatile struct mapped_time_value *mapped_time;
 /* We don't actually distinguish between these two sockets, but
    we have to listen on two different ports, so that's why they're here. */
 extern int main_udp_socket, pmap_udp_socket;
+/* The socket on which we accept NFS over TCP connections, or -1.  */
+extern int main_tcp_socket;
 extern struct sockaddr_in main_address, pmap_address;
 
 /* Name of the file on disk containing the filesystem index table */
@@ -112,9 +128,11 @@ struct cache_handle *create_cached_handle (int, struct cache_handle *, file_t);
 struct cached_reply *check_cached_replies (int, struct sockaddr_in *);
 void release_cached_reply (struct cached_reply *cr);
 void scan_replies (void);
+void init_caches (void);
 
 /* loop.c */
-void * server_loop (void *);
+void create_server_pool (int socket, int min_threads, int max_threads);
+void * tcp_listen_loop (void *);
 
 /* ops.c */
 extern struct proctable nfs2table, mounttable, pmaptable;
@@ -28,6 +28,7 @@
 #include <dirent.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/param.h>
 
 #include "nfsd.h"
 #include "../nfs/mount.h" /* XXX */
@@ -36,6 +37,7 @@
 static error_t
 op_null (struct cache_handle *c,
 	 int *p,
+	 int *end,
 	 int **reply,
 	 int version)
 {
@@ -45,6 +47,7 @@ op_null (struct cache_handle *c,
 static error_t
 op_getattr (struct cache_handle *c,
 	    int *p,
+	    int *end,
 	    int **reply,
 	    int version)
 {
@@ -140,6 +143,7 @@ complete_setattr (mach_port_t port,
 static error_t
 op_setattr (struct cache_handle *c,
 	    int *p,
+	    int *end,
 	    int **reply,
 	    int version)
 {
@@ -166,6 +170,7 @@ op_setattr (struct cache_handle *c,
 static error_t
 op_lookup (struct cache_handle *c,
 	   int *p,
+	   int *end,
 	   int **reply,
 	   int version)
 {
@@ -206,6 +211,7 @@ op_lookup (struct cache_handle *c,
 static error_t
 op_readlink (struct cache_handle *c,
 	     int *p,
+	     int *end,
 	     int **reply,
 	     int version)
 {
@@ -240,12 +246,13 @@ static size_t
 count_read_buffersize (int *p, int version)
 {
   p++;			/* Skip OFFSET.  */
-  return ntohl (*p);	/* Return COUNT.  */
+  return MIN (ntohl (*p), MAXDATA);	/* Return COUNT.  */
 }
 
 static error_t
 op_read (struct cache_handle *c,
 	 int *p,
+	 int *end,
 	 int **reply,
 	 int version)
 {
@@ -258,7 +265,7 @@ op_read (struct cache_handle *c,
 
   offset = ntohl (*p);
   p++;
-  count = ntohl (*p);
+  count = MIN (ntohl (*p), MAXDATA);
   p++;
 
   err = io_read (c->port, &bp, &buflen, offset, count);
@@ -285,6 +292,7 @@ op_read (struct cache_handle *c,
 static error_t
 op_write (struct cache_handle *c,
 	  int *p,
+	  int *end,
 	  int **reply,
 	  int version)
 {
@@ -301,7 +309,13 @@ op_write (struct cache_handle *c,
   p++;
   count = ntohl (*p);
   p++;
-  bp = (char *) *reply;
+  bp = (char *) p;
+
+  /* COUNT comes from the client; don't write more than it sent.  */
+  if (bp > (char *) end
+      || count > MAXDATA
+      || count > (size_t) ((char *) end - bp))
+    return EINVAL;
 
   while (count)
     {
@@ -327,6 +341,7 @@ op_write (struct cache_handle *c,
 static error_t
 op_create (struct cache_handle *c,
 	   int *p,
+	   int *end,
 	   int **reply,
 	   int version)
 {
@@ -401,6 +416,7 @@ op_create (struct cache_handle *c,
 static error_t
 op_remove (struct cache_handle *c,
 	   int *p,
+	   int *end,
 	   int **reply,
 	   int version)
 {
@@ -418,6 +434,7 @@ op_remove (struct cache_handle *c,
 static error_t
 op_rename (struct cache_handle *fromc,
 	   int *p,
+	   int *end,
 	   int **reply,
 	   int version)
 {
@@ -441,6 +458,7 @@ op_rename (struct cache_handle *fromc,
 static error_t
 op_link (struct cache_handle *filec,
 	 int *p,
+	 int *end,
 	 int **reply,
 	 int version)
 {
@@ -463,6 +481,7 @@ op_link (struct cache_handle *filec,
 static error_t
 op_symlink (struct cache_handle *c,
 	    int *p,
+	    int *end,
 	    int **reply,
 	    int version)
 {
@@ -506,6 +525,7 @@ op_symlink (struct cache_handle *c,
 static error_t
 op_mkdir (struct cache_handle *c,
 	  int *p,
+	  int *end,
 	  int **reply,
 	  int version)
 {
@@ -558,6 +578,7 @@ op_mkdir (struct cache_handle *c,
 static error_t
 op_rmdir (struct cache_handle *c,
 	  int *p,
+	  int *end,
 	  int **reply,
 	  int version)
 {
@@ -574,6 +595,7 @@ op_rmdir (struct cache_handle *c,
 static error_t
 op_readdir (struct cache_handle *c,
 	    int *p,
+	    int *end,
 	    int **reply,
 	    int version)
 {
@@ -645,6 +667,7 @@ count_readdir_buffersize (int *p, int version)
 static error_t
 op_statfs (struct cache_handle *c,
 	   int *p,
+	   int *end,
 	   int **reply,
 	   int version)
 {
@@ -660,6 +683,7 @@ op_statfs (struct cache_handle *c,
 static error_t
 op_mnt (struct cache_handle *c,
 	int *p,
+	int *end,
 	int **reply,
 	int version)
 {
@@ -687,6 +711,7 @@ op_mnt (struct cache_handle *c,
 static error_t
 op_getport (struct cache_handle *c,
 	    int *p,
+	    int *end,
 	    int **reply,
 	    int version)
 {
@@ -699,7 +724,9 @@ op_getport (struct cache_handle *c,
   prot = ntohl (*p);
   p++;
 
-  if (prot != IPPROTO_UDP)
+  if (prot != IPPROTO_UDP
+      && (prot != IPPROTO_TCP || main_tcp_socket == -1
+	  || prog == PMAPPROG))
     *(*reply)++ = htonl (0);
   else if ((prog == MOUNTPROG && vers == MOUNTVERS)
 	   || (prog == NFS_PROGRAM && vers == NFS_VERSION))
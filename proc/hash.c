@@ -30,6 +30,10 @@
 #include "proc.h"
 #include <hurd/ihash.h>
 
+/* The tables are only changed with GLOBAL_LOCK held exclusively, so
+   lookups may run concurrently with the lock held shared.  PGHASH and
+   SIDHASH are also changed under PGRP_LOCK by RPCs holding GLOBAL_LOCK
+   shared; look them up with PGRP_LOCK held in that case.  */
 static struct hurd_ihash pghash
   = HURD_IHASH_INITIALIZER (offsetof (struct pgrp, pg_hashloc));
 static struct hurd_ihash pidhash
@@ -57,7 +61,8 @@ pid_find_allow_zombie (pid_t pid)
   return hurd_ihash_find (&pidhash, pid);
 }
 
-/* Find the process corresponding to a given task. */
+/* Find the process corresponding to a given task.  This may add
+   processes, so GLOBAL_LOCK must be held exclusively.  */
 struct proc *
 task_find (task_t task)
 {
@@ -116,11 +116,11 @@ S_proc_task2proc (struct proc *callerp,
       error_t err;
 
       /* Release global lock while talking to the other proc server.  */
-      pthread_mutex_unlock (&global_lock);
+      global_lock_release ();
 
       err = proc_task2proc (p->p_task_namespace, t, outproc);
 
-      pthread_mutex_lock (&global_lock);
+      global_lock_reacquire ();
 
       if (! err)
 	{
@@ -180,11 +180,11 @@ S_proc_pid2proc (struct proc *callerp,
       error_t err;
 
       /* Release global lock while talking to the other proc server.  */
-      pthread_mutex_unlock (&global_lock);
+      global_lock_release ();
 
       err = proc_task2proc (p->p_task_namespace, p->p_task, outproc);
 
-      pthread_mutex_lock (&global_lock);
+      global_lock_reacquire ();
 
       if (! err)
 	{
@@ -383,6 +383,7 @@ S_proc_getprocargs (struct proc *callerp,
 		  size_t *buflen)
 {
   struct proc *p = pid_find (pid);
+  vm_address_t argv;
 
   /* No need to check CALLERP here; we don't use it. */
 
@@ -396,13 +397,13 @@ S_proc_getprocargs (struct proc *callerp,
       pid_t pid_sub;
 
       /* Release global lock while talking to the other proc server.  */
-      pthread_mutex_unlock (&global_lock);
+      global_lock_release ();
 
       err = proc_task2pid (p->p_task_namespace, p->p_task, &pid_sub);
       if (! err)
 	err = proc_getprocargs (p->p_task_namespace, pid_sub, buf, buflen);
 
-      pthread_mutex_lock (&global_lock);
+      global_lock_reacquire ();
 
       if (! err)
 	return 0;
@@ -410,7 +411,11 @@ S_proc_getprocargs (struct proc *callerp,
       /* Fallback.  */
     }
 
-  return get_string_array (p->p_task, p->p_argv, (vm_address_t *) buf, buflen);
+  pthread_mutex_lock (&p->p_lock);
+  argv = p->p_argv;
+  pthread_mutex_unlock (&p->p_lock);
+
+  return get_string_array (p->p_task, argv, (vm_address_t *) buf, buflen);
 }
 
 /* Implement proc_getprocenv as described in <hurd/process.defs>. */
@@ -421,6 +426,7 @@ S_proc_getprocenv (struct proc *callerp,
 		 size_t *buflen)
 {
   struct proc *p = pid_find (pid);
+  vm_address_t envp;
 
   /* No need to check CALLERP here; we don't use it. */
 
@@ -434,13 +440,13 @@ S_proc_getprocenv (struct proc *callerp,
       pid_t pid_sub;
 
       /* Release global lock while talking to the other proc server.  */
-      pthread_mutex_unlock (&global_lock);
+      global_lock_release ();
 
       err = proc_task2pid (p->p_task_namespace, p->p_task, &pid_sub);
       if (! err)
 	err = proc_getprocenv (p->p_task_namespace, pid_sub, buf, buflen);
 
-      pthread_mutex_lock (&global_lock);
+      global_lock_reacquire ();
 
       if (! err)
 	return 0;
@@ -448,13 +454,139 @@ S_proc_getprocenv (struct proc *callerp,
       /* Fallback.  */
     }
 
-  return get_string_array (p->p_task, p->p_envp, (vm_address_t *)buf, buflen);
+  pthread_mutex_lock (&p->p_lock);
+  envp = p->p_envp;
+  pthread_mutex_unlock (&p->p_lock);
+
+  return get_string_array (p->p_task, envp, (vm_address_t *)buf, buflen);
 }
 
 /* Handy abbreviation for all the various thread details.  */
 #define PI_FETCH_THREAD_DETAILS  \
   (PI_FETCH_THREAD_SCHED | PI_FETCH_THREAD_BASIC | PI_FETCH_THREAD_WAITS)
 
+/* The type of the per-thread part of struct procinfo.  */
+typedef __typeof__ (((struct procinfo *) 0)->threadinfos[0]) threadinfo_data_t;
+
+/* Fill in the parts of PI that proc itself knows about P.  MSGPORT is
+   P's message port, or MACH_PORT_NULL if it has none.  */
+static void
+fill_procinfo (struct proc *p, struct procinfo *pi, mach_port_t msgport)
+{
+  struct proc *tp;
+
+  pthread_mutex_lock (&pgrp_lock);
+  pi->state =
+    ((p->p_stopped ? PI_STOPPED : 0)
+     | (p->p_exec ? PI_EXECED : 0)
+     | (p->p_waiting ? PI_WAITING : 0)
+     | (!p->p_pgrp->pg_orphcnt ? PI_ORPHAN : 0)
+     | (msgport == MACH_PORT_NULL ? PI_NOMSG : 0)
+     | (p->p_pgrp->pg_session->s_sid == p->p_pid ? PI_SESSLD : 0)
+     | (p->p_noowner ? PI_NOTOWNED : 0)
+     | (!p->p_parentset ? PI_NOPARENT : 0)
+     | (p->p_traced ? PI_TRACED : 0)
+     | (p->p_msgportwait ? PI_GETMSG : 0)
+     | (p->p_loginleader ? PI_LOGINLD : 0));
+  pi->owner = p->p_owner;
+  pi->ppid = p->p_parent->p_pid;
+  pi->pgrp = p->p_pgrp->pg_pgid;
+  pi->session = p->p_pgrp->pg_session->s_sid;
+  pthread_mutex_unlock (&pgrp_lock);
+  for (tp = p; !tp->p_loginleader; tp = tp->p_parent)
+    assert_backtrace (tp);
+  pi->logincollection = tp->p_pid;
+  if (p->p_dead || p->p_stopped)
+    {
+      pi->exitstatus = p->p_status;
+      pi->sigcode = p->p_sigcode;
+    }
+  else
+    pi->exitstatus = pi->sigcode = 0;
+}
+
+/* Fill in the task information requested in *FLAGS for TASK in PI.
+   Optional bits of information that cannot be fetched are cleared
+   from *FLAGS.  */
+static error_t
+fill_task_info (task_t task, int *flags, struct procinfo *pi)
+{
+  size_t tkcount;
+  error_t err = 0;
+
+  if (*flags & PI_FETCH_TASKINFO)
+    {
+      tkcount = TASK_BASIC_INFO_COUNT;
+      err = task_info (task, TASK_BASIC_INFO,
+		       (task_info_t) &pi->taskinfo, &tkcount);
+      if (err == MACH_SEND_INVALID_DEST)
+	err = ESRCH;
+#ifdef TASK_SCHED_TIMESHARE_INFO
+      if (!err)
+	{
+	  tkcount = TASK_SCHED_TIMESHARE_INFO_COUNT;
+	  err = task_info (task, TASK_SCHED_TIMESHARE_INFO,
+			   (int *)&pi->timeshare_base_info, &tkcount);
+	  if (err == KERN_INVALID_POLICY)
+	    {
+	      pi->timeshare_base_info.base_priority = -1;
+	      err = 0;
+	    }
+	}
+#endif
+    }
+  if (*flags & PI_FETCH_TASKEVENTS)
+    {
+      tkcount = TASK_EVENTS_INFO_COUNT;
+      err = task_info (task, TASK_EVENTS_INFO,
+		       (task_info_t) &pi->taskevents, &tkcount);
+      if (err)
+	{
+	  /* Something screwy, give up on this bit of info.  */
+	  *flags &= ~PI_FETCH_TASKEVENTS;
+	  err = 0;
+	}
+    }
+
+  return err;
+}
+
+/* Fill in the thread information requested in *FLAGS for THREAD in
+   TI.  Bits of information that cannot be fetched are cleared from
+   *FLAGS.  Return nonzero if THREAD has died.  */
+static int
+fill_thread_info (thread_t thread, int *flags, threadinfo_data_t *ti)
+{
+  size_t thcount;
+  error_t err;
+
+  if (*flags & PI_FETCH_THREAD_BASIC)
+    {
+      thcount = THREAD_BASIC_INFO_COUNT;
+      err = thread_info (thread, THREAD_BASIC_INFO,
+			 (thread_info_t) &ti->pis_bi, &thcount);
+      if (err == MACH_SEND_INVALID_DEST)
+	return 1;
+      if (err)
+	/* Something screwy, give up on this bit of info.  */
+	*flags &= ~PI_FETCH_THREAD_BASIC;
+    }
+
+  if (*flags & PI_FETCH_THREAD_SCHED)
+    {
+      thcount = THREAD_SCHED_INFO_COUNT;
+      err = thread_info (thread, THREAD_SCHED_INFO,
+			 (thread_info_t) &ti->pis_si, &thcount);
+      if (err == MACH_SEND_INVALID_DEST)
+	return 1;
+      if (err)
+	/* Something screwy, give up on this bit of info.  */
+	*flags &= ~PI_FETCH_THREAD_SCHED;
+    }
+
+  return 0;
+}
+
 /* Implement proc_getprocinfo as described in <hurd/process.defs>. */
 kern_return_t
 S_proc_getprocinfo (struct proc *callerp,
@@ -474,8 +606,6 @@ S_proc_getprocinfo (struct proc *callerp,
   int pi_alloced = 0, waits_alloced = 0;
   /* The amount of WAITS we've filled in so far.  */
   mach_msg_type_number_t waits_used = 0;
-  size_t tkcount, thcount;
-  struct proc *tp;
   task_t task;			/* P's task port.  */
   mach_port_t msgport;		/* P's msgport, or MACH_PORT_NULL if none.  */
 
@@ -491,7 +621,7 @@ S_proc_getprocinfo (struct proc *callerp,
       pid_t pid_sub;
 
       /* Release global lock while talking to the other proc server.  */
-      pthread_mutex_unlock (&global_lock);
+      global_lock_release ();
 
       err = proc_task2pid (p->p_task_namespace, p->p_task, &pid_sub);
       if (! err)
@@ -516,12 +646,13 @@ S_proc_getprocinfo (struct proc *callerp,
 	  proc_pid2task (p->p_task_namespace, pi->logincollection,
 			 &t_logincollection);
 
-	  /* Reacquire the global lock for the hash table lookups.  */
-	  pthread_mutex_lock (&global_lock);
+	  /* Reacquire the global lock for the hash table lookups.  We
+	     only hold it shared, so we must not add unknown tasks.  */
+	  global_lock_reacquire ();
 
 	  if (MACH_PORT_VALID (t_ppid))
 	    {
-	      struct proc *q = task_find (t_ppid);
+	      struct proc *q = task_find_nocreate (t_ppid);
 	      pi->ppid = q ? q->p_pid : (pid_t) -1;
 	      mach_port_deallocate (mach_task_self (), t_ppid);
 	    }
@@ -535,19 +666,19 @@ S_proc_getprocinfo (struct proc *callerp,
 	    }
 	  if (MACH_PORT_VALID (t_pgrp))
 	    {
-	      struct proc *q = task_find (t_pgrp);
+	      struct proc *q = task_find_nocreate (t_pgrp);
 	      pi->pgrp = q ? q->p_pid : (pid_t) -1;
 	      mach_port_deallocate (mach_task_self (), t_pgrp);
 	    }
 	  if (MACH_PORT_VALID (t_session))
 	    {
-	      struct proc *q = task_find (t_session);
+	      struct proc *q = task_find_nocreate (t_session);
 	      pi->session = q ? q->p_pid : (pid_t) -1;
 	      mach_port_deallocate (mach_task_self (), t_session);
 	    }
 	  if (MACH_PORT_VALID (t_logincollection))
 	    {
-	      struct proc *q = task_find (t_logincollection);
+	      struct proc *q = task_find_nocreate (t_logincollection);
 	      pi->logincollection = q ? q->p_pid : (pid_t) -1;
 	      mach_port_deallocate (mach_task_self (), t_logincollection);
 	    }
@@ -555,15 +686,16 @@ S_proc_getprocinfo (struct proc *callerp,
 	  return 0;
 	}
 
-      pthread_mutex_lock (&global_lock);
+      global_lock_reacquire ();
       err = 0;
       /* Fallback.  */
     }
 
   task = p->p_task;
 
-  check_msgport_death (p);
-  msgport = p->p_msgport;
+  /* We only hold GLOBAL_LOCK shared, so leave discarding a dead
+     message port to someone holding it exclusively.  */
+  msgport = msgport_is_dead (p) ? MACH_PORT_NULL : p->p_msgport;
 
   if (*flags & PI_FETCH_THREAD_DETAILS)
     *flags |= PI_FETCH_THREADS;
@@ -602,118 +734,24 @@ S_proc_getprocinfo (struct proc *callerp,
   *piarraylen = structsize / sizeof (int);
   pi = (struct procinfo *) *piarray;
 
-  pi->state =
-    ((p->p_stopped ? PI_STOPPED : 0)
-     | (p->p_exec ? PI_EXECED : 0)
-     | (p->p_waiting ? PI_WAITING : 0)
-     | (!p->p_pgrp->pg_orphcnt ? PI_ORPHAN : 0)
-     | (p->p_msgport == MACH_PORT_NULL ? PI_NOMSG : 0)
-     | (p->p_pgrp->pg_session->s_sid == p->p_pid ? PI_SESSLD : 0)
-     | (p->p_noowner ? PI_NOTOWNED : 0)
-     | (!p->p_parentset ? PI_NOPARENT : 0)
-     | (p->p_traced ? PI_TRACED : 0)
-     | (p->p_msgportwait ? PI_GETMSG : 0)
-     | (p->p_loginleader ? PI_LOGINLD : 0));
-  pi->owner = p->p_owner;
-  pi->ppid = p->p_parent->p_pid;
-  pi->pgrp = p->p_pgrp->pg_pgid;
-  pi->session = p->p_pgrp->pg_session->s_sid;
-  for (tp = p; !tp->p_loginleader; tp = tp->p_parent)
-    assert_backtrace (tp);
-  pi->logincollection = tp->p_pid;
-  if (p->p_dead || p->p_stopped)
-    {
-      pi->exitstatus = p->p_status;
-      pi->sigcode = p->p_sigcode;
-    }
-  else
-    pi->exitstatus = pi->sigcode = 0;
-
+  fill_procinfo (p, pi, msgport);
   pi->nthreads = nthreads;
 
   /* Release GLOBAL_LOCK around time consuming bits, and more importatantly,
      potential calls to P's msgport, which can block.  */
-  pthread_mutex_unlock (&global_lock);
+  global_lock_release ();
 
-  if (*flags & PI_FETCH_TASKINFO)
-    {
-      tkcount = TASK_BASIC_INFO_COUNT;
-      err = task_info (task, TASK_BASIC_INFO,
-		       (task_info_t) &pi->taskinfo, &tkcount);
-      if (err == MACH_SEND_INVALID_DEST)
-	err = ESRCH;
-#ifdef TASK_SCHED_TIMESHARE_INFO
-      if (!err)
-	{
-	  tkcount = TASK_SCHED_TIMESHARE_INFO_COUNT;
-	  err = task_info (task, TASK_SCHED_TIMESHARE_INFO,
-			   (int *)&pi->timeshare_base_info, &tkcount);
-	  if (err == KERN_INVALID_POLICY)
-	    {
-	      pi->timeshare_base_info.base_priority = -1;
-	      err = 0;
-	    }
-	}
-#endif
-    }
-  if (*flags & PI_FETCH_TASKEVENTS)
-    {
-      tkcount = TASK_EVENTS_INFO_COUNT;
-      err = task_info (task, TASK_EVENTS_INFO,
-		       (task_info_t) &pi->taskevents, &tkcount);
-      if (err == MACH_SEND_INVALID_DEST)
-	err = ESRCH;
-      if (err)
-	{
-	  /* Something screwy, give up on this bit of info.  */
-	  *flags &= ~PI_FETCH_TASKEVENTS;
-	  err = 0;
-	}
-    }
+  err = fill_task_info (task, flags, pi);
 
   for (i = 0; i < nthreads; i++)
     {
-      if (*flags & PI_FETCH_THREAD_DETAILS)
-	pi->threadinfos[i].died = 0;
-      if (*flags & PI_FETCH_THREAD_BASIC)
+      if (fill_thread_info (thds[i], flags, &pi->threadinfos[i]))
 	{
-	  thcount = THREAD_BASIC_INFO_COUNT;
-	  err = thread_info (thds[i], THREAD_BASIC_INFO,
-			     (thread_info_t) &pi->threadinfos[i].pis_bi,
-			     &thcount);
-	  if (err == MACH_SEND_INVALID_DEST)
-	    {
-	      pi->threadinfos[i].died = 1;
-	      err = 0;
-	      continue;
-	    }
-	  else if (err)
-	    /* Something screwy, give up on this bit of info.  */
-	    {
-	      *flags &= ~PI_FETCH_THREAD_BASIC;
-	      err = 0;
-	    }
-	}
-
-      if (*flags & PI_FETCH_THREAD_SCHED)
-	{
-	  thcount = THREAD_SCHED_INFO_COUNT;
-	  err = thread_info (thds[i], THREAD_SCHED_INFO,
-			     (thread_info_t) &pi->threadinfos[i].pis_si,
-			     &thcount);
-	  if (err == MACH_SEND_INVALID_DEST)
-	    {
-	      pi->threadinfos[i].died = 1;
-	      err = 0;
-	      continue;
-	    }
-	  if (err)
-	    /* Something screwy, give up on this bit of info.  */
-	    {
-	      *flags &= ~PI_FETCH_THREAD_SCHED;
-	      err = 0;
-	    }
+	  pi->threadinfos[i].died = 1;
+	  continue;
 	}
+      if (*flags & PI_FETCH_THREAD_DETAILS)
+	pi->threadinfos[i].died = 0;
 
       /* Note that there are thread wait entries only for those threads
          not marked dead.  */
@@ -784,8 +822,214 @@ S_proc_getprocinfo (struct proc *callerp,
     *waits_len = waits_used;
 
   /* Reacquire GLOBAL_LOCK to make the central locking code happy.  */
-  pthread_mutex_lock (&global_lock);
+  global_lock_reacquire ();
+
+  return err;
+}
+
+/* A process described by proc_getprocinfo_bulk, as recorded while
+   holding GLOBAL_LOCK.  */
+struct bulk_proc
+{
+  pid_t pid;
+  error_t error;
+  task_t task;			/* A send right of our own.  */
+  struct procinfo pi;
+};
+
+/* Append the record for BP to the buffer *BUF of *BUFSIZE bytes, of
+   which *USED are in use, fetching the information from the kernel
+   requested in FLAGS.  */
+static error_t
+append_bulk_record (char **buf, size_t *bufsize, size_t *used,
+		    struct bulk_proc *bp, int flags)
+{
+  struct procinfo_bulk *hdr;
+  struct procinfo *pi;
+  thread_t *thds = 0;
+  size_t nthreads = 0, structsize, recsize, i;
+  error_t err = 0;
+
+  if (! bp->error && (flags & PI_FETCH_THREADS))
+    {
+      err = task_threads (bp->task, &thds, &nthreads);
+      if (err)
+	{
+	  bp->error = err == MACH_SEND_INVALID_DEST ? ESRCH : err;
+	  nthreads = 0;
+	  err = 0;
+	}
+    }
+
+  structsize = sizeof (struct procinfo);
+  if (flags & PI_FETCH_THREAD_DETAILS)
+    structsize += nthreads * sizeof (threadinfo_data_t);
+  structsize = (structsize + 7) & ~7;
+  recsize = sizeof *hdr + structsize;
+
+  if (*used + recsize > *bufsize)
+    {
+      size_t newsize = round_page (*used + recsize);
+      char *new;
+
+      if (newsize < *bufsize * 2)
+	newsize = *bufsize * 2;
+      new = mmap (0, newsize, PROT_READ|PROT_WRITE, MAP_ANON, 0, 0);
+      if (new == MAP_FAILED)
+	{
+	  err = errno;
+	  goto out;
+	}
+      if (*used)
+	memcpy (new, *buf, *used);
+      if (*bufsize)
+	munmap (*buf, *bufsize);
+      *buf = new;
+      *bufsize = newsize;
+    }
+
+  hdr = (struct procinfo_bulk *) (*buf + *used);
+  hdr->pid = bp->pid;
+  hdr->error = bp->error;
+  hdr->flags = 0;
+  hdr->len = 0;
+  *used += sizeof *hdr;
+  if (bp->error)
+    goto out;
+
+  pi = (struct procinfo *) (hdr + 1);
+  memcpy (pi, &bp->pi, sizeof *pi);
+  pi->nthreads = nthreads;
+
+  if (fill_task_info (bp->task, &flags, pi))
+    {
+      /* The task died since we looked at the process table.  */
+      hdr->error = ESRCH;
+      goto out;
+    }
+  for (i = 0; i < nthreads; i++)
+    if (flags & PI_FETCH_THREAD_DETAILS)
+      pi->threadinfos[i].died =
+	fill_thread_info (thds[i], &flags, &pi->threadinfos[i]);
+
+  hdr->flags = flags;
+  hdr->len = structsize / sizeof (int);
+  *used += structsize;
+
+ out:
+  for (i = 0; i < nthreads; i++)
+    mach_port_deallocate (mach_task_self (), thds[i]);
+  if (thds)
+    munmap (thds, nthreads * sizeof (thread_t));
+  return err;
+}
+
+/* Implement proc_getprocinfo_bulk as described in <hurd/process.defs>. */
+kern_return_t
+S_proc_getprocinfo_bulk (struct proc *callerp,
+			 pid_t *pids,
+			 size_t npids,
+			 int *flags,
+			 int **records,
+			 size_t *recordslen)
+{
+  struct bulk_proc *procs;
+  size_t nprocs = 0, i;
+  char *buf = 0;
+  size_t bufsize = 0, used = 0;
+  error_t err = 0;
+
+  void count_proc (struct proc *p, void *arg)
+    {
+      nprocs++;
+    }
+  void record_proc (struct proc *p, void *arg)
+    {
+      struct bulk_proc *bp = &procs[i++];
+
+      bp->pid = p->p_pid;
+      bp->error = 0;
+      bp->task = MACH_PORT_NULL;
+      if (namespace_is_subprocess (p))
+	{
+	  bp->error = EREMOTE;
+	  return;
+	}
+
+      fill_procinfo (p, &bp->pi, msgport_is_dead (p)
+		     ? MACH_PORT_NULL : p->p_msgport);
+      bp->task = p->p_task;
+      if (mach_port_mod_refs (mach_task_self (), bp->task,
+			      MACH_PORT_RIGHT_SEND, 1))
+	{
+	  bp->error = ESRCH;
+	  bp->task = MACH_PORT_NULL;
+	}
+    }
+
+  /* No need to check CALLERP here; we don't use it. */
+
+  /* Thread waits would take an RPC to every process.  */
+  *flags &= ~PI_FETCH_THREAD_WAITS;
+  if (*flags & PI_FETCH_THREAD_DETAILS)
+    *flags |= PI_FETCH_THREADS;
+
+  /* Record what we know about the processes while we hold the lock.  */
+  if (npids == 0)
+    prociterate (count_proc, 0);
+  else
+    nprocs = npids;
+  procs = malloc (nprocs * sizeof *procs);
+  if (! procs && nprocs)
+    return ENOMEM;
+
+  i = 0;
+  if (npids == 0)
+    prociterate (record_proc, 0);
+  else
+    for (; i < npids; )
+      {
+	struct proc *p = pid_find (pids[i]);
+	if (p)
+	  record_proc (p, 0);
+	else
+	  {
+	    procs[i].pid = pids[i];
+	    procs[i].error = ESRCH;
+	    procs[i].task = MACH_PORT_NULL;
+	    i++;
+	  }
+      }
+
+  /* Asking the kernel about the tasks and threads takes a while; don't
+     hold up anyone else meanwhile.  */
+  global_lock_release ();
+
+  for (i = 0; i < nprocs; i++)
+    {
+      if (! err)
+	err = append_bulk_record (&buf, &bufsize, &used, &procs[i], *flags);
+      if (MACH_PORT_VALID (procs[i].task))
+	mach_port_deallocate (mach_task_self (), procs[i].task);
+    }
+  free (procs);
+
+  if (! err && used > *recordslen * sizeof (int))
+    {
+      /* Return BUF itself, less the pages we didn't use.  */
+      if (bufsize > round_page (used))
+	munmap (buf + round_page (used), bufsize - round_page (used));
+      *records = (int *) buf;
+      buf = 0;
+    }
+  else if (! err)
+    memcpy (*records, buf, used);
+  if (buf)
+    munmap (buf, bufsize);
+  if (! err)
+    *recordslen = used / sizeof (int);
 
+  global_lock_reacquire ();
   return err;
 }
 
@@ -820,7 +1064,7 @@ S_proc_getloginid (struct proc *callerp,
       pid_t pid_sub;
 
       /* Release global lock while talking to the other proc server.  */
-      pthread_mutex_unlock (&global_lock);
+      global_lock_release ();
 
       err = proc_task2pid (p->p_task_namespace, p->p_task, &pid_sub);
       if (! err)
@@ -829,7 +1073,7 @@ S_proc_getloginid (struct proc *callerp,
 	/* Acquires global_lock.  */
 	err = namespace_translate_pids (p->p_task_namespace, leader, 1);
       else
-	pthread_mutex_lock (&global_lock);
+	global_lock_reacquire ();
 
       if (! err)
 	return 0;
@@ -870,7 +1114,7 @@ S_proc_getloginpids (struct proc *callerp,
       pid_t pid_sub;
 
       /* Release global lock while talking to the other proc server.  */
-      pthread_mutex_unlock (&global_lock);
+      global_lock_release ();
 
       err = proc_task2pid (l->p_task_namespace, l->p_task, &pid_sub);
       if (! err)
@@ -879,7 +1123,7 @@ S_proc_getloginpids (struct proc *callerp,
 	/* Acquires global_lock.  */
 	err = namespace_translate_pids (l->p_task_namespace, *pids, *npids);
       else
-	pthread_mutex_lock (&global_lock);
+	global_lock_reacquire ();
 
       if (! err)
 	return 0;
@@ -1031,8 +1275,10 @@ S_proc_set_exe (struct proc *p,
   if (! copy)
     return ENOMEM;
 
+  pthread_mutex_lock (&p->p_lock);
   free(p->exe);
   p->exe = copy;
+  pthread_mutex_unlock (&p->p_lock);
   return 0;
 }
 
@@ -1049,10 +1295,12 @@ S_proc_get_exe (struct proc *callerp,
   if (!p)
     return ESRCH;
 
+  pthread_mutex_lock (&p->p_lock);
   if (p->exe)
     snprintf (path, 1024 /* XXX */, "%s", p->exe);
   else
     path[0] = 0;
+  pthread_mutex_unlock (&p->p_lock);
   return 0;
 }
 
@@ -0,0 +1,173 @@
+/* Locking of the proc server's process table
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd; see the file COPYING.  If not, write to
+   the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* Every RPC used to run with GLOBAL_LOCK held, which serialized all of
+   proc.  Now RPCs that only look at the process table (and the ones
+   that only change leaf data of the calling process, see P_LOCK and
+   PGRP_LOCK in proc.h) hold the lock in shared mode and run
+   concurrently; everything else holds it exclusively, which is the old
+   behaviour.  Holding it exclusively means holding GLOBAL_LOCK itself
+   while no thread holds it shared, so exclusive holders may still wait
+   on conditions with GLOBAL_LOCK (see global_lock_wait).
+
+   Shared holders do not keep GLOBAL_LOCK; they are only counted in
+   NSHARED.  Exclusive lockers have priority: new shared lockers wait
+   while one of them is waiting for the shared holders to drain.  */
+
+#include <assert-backtrace.h>
+
+#include "proc.h"
+
+pthread_mutex_t global_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t pgrp_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* These are protected by GLOBAL_LOCK.  */
+static int nshared;		/* Threads holding the lock shared.  */
+static int nexclusive;		/* Threads waiting for NSHARED to drop.  */
+static pthread_cond_t shared_drained = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t exclusive_done = PTHREAD_COND_INITIALIZER;
+
+/* The mode this thread's current RPC holds the lock in.  */
+static __thread int shared_mode;
+
+/* With GLOBAL_LOCK held, wait until no thread holds it shared.  */
+static void
+drain_shared (void)
+{
+  if (nshared == 0)
+    return;
+
+  nexclusive++;
+  while (nshared > 0)
+    pthread_cond_wait (&shared_drained, &global_lock);
+  if (--nexclusive == 0)
+    pthread_cond_broadcast (&exclusive_done);
+}
+
+/* Acquire the process table lock, shared if SHARED is nonzero and
+   exclusively otherwise.  */
+void
+global_lock_acquire (int shared)
+{
+  shared_mode = shared;
+  global_lock_reacquire ();
+}
+
+/* Release the lock taken by global_lock_acquire, e.g. around an RPC
+   that may block.  */
+void
+global_lock_release (void)
+{
+  if (shared_mode)
+    {
+      pthread_mutex_lock (&global_lock);
+      assert_backtrace (nshared > 0);
+      if (--nshared == 0)
+	pthread_cond_broadcast (&shared_drained);
+    }
+  pthread_mutex_unlock (&global_lock);
+}
+
+/* Reacquire the lock in the mode it was last acquired in by this
+   thread.  */
+void
+global_lock_reacquire (void)
+{
+  pthread_mutex_lock (&global_lock);
+  if (shared_mode)
+    {
+      while (nexclusive > 0)
+	pthread_cond_wait (&exclusive_done, &global_lock);
+      nshared++;
+      pthread_mutex_unlock (&global_lock);
+    }
+  else
+    drain_shared ();
+}
+
+/* Wait for COND, which must be signalled with GLOBAL_LOCK held, while
+   holding the lock exclusively.  Return nonzero if the wait was
+   cancelled.  */
+int
+global_lock_wait (pthread_cond_t *cond)
+{
+  int cancel;
+
+  assert_backtrace (! shared_mode);
+  cancel = pthread_hurd_cond_wait_np (cond, &global_lock);
+  drain_shared ();
+  return cancel;
+}
+
+/* RPCs of the process subsystem that may run with the lock held
+   shared, indexed by msgh_id - PROCESS_MSGID_BASE.  They must not
+   change anything but the data guarded by P_LOCK and PGRP_LOCK, and
+   must not call task_find, which may add processes.  */
+#define PROCESS_MSGID_BASE	24000
+static const char shared_rpcs[] =
+{
+  [4] = 1,			/* proc_getprivports */
+  [5] = 1,			/* proc_getallpids, see below */
+  [7] = 1,			/* proc_getexecdata */
+  [9] = 1,			/* proc_uname */
+  [16] = 1,			/* proc_getpids */
+  [17] = 1,			/* proc_set_arg_locations */
+  [18] = 1,			/* proc_get_arg_locations */
+  [29] = 1,			/* proc_pid2task */
+  [32] = 1,			/* proc_proc2task */
+  [33] = 1,			/* proc_pid2proc */
+  [34] = 1,			/* proc_getprocinfo */
+  [35] = 1,			/* proc_getprocargs */
+  [36] = 1,			/* proc_getprocenv */
+  [38] = 1,			/* proc_getloginid */
+  [39] = 1,			/* proc_getloginpids */
+  [41] = 1,			/* proc_getlogin */
+  [42] = 1,			/* proc_setsid */
+  [43] = 1,			/* proc_getsid */
+  [44] = 1,			/* proc_getsessionpgids */
+  [45] = 1,			/* proc_getsessionpids */
+  [46] = 1,			/* proc_getsidport */
+  [47] = 1,			/* proc_setpgrp */
+  [48] = 1,			/* proc_getpgrp */
+  [49] = 1,			/* proc_getpgrppids */
+  [50] = 1,			/* proc_get_tty */
+  [51] = 1,			/* proc_getnports */
+  [54] = 1,			/* proc_is_important */
+  [55] = 1,			/* proc_set_code */
+  [56] = 1,			/* proc_get_code */
+  [58] = 1,			/* proc_set_exe */
+  [59] = 1,			/* proc_get_exe */
+  [60] = 1,			/* proc_set_entry */
+  [61] = 1,			/* proc_get_entry */
+  [62] = 1,			/* proc_getprocinfo_bulk */
+};
+
+/* Return nonzero if the request INP may be served with the lock held
+   shared.  */
+int
+global_lock_shared_rpc (mach_msg_header_t *inp)
+{
+  mach_msg_id_t i = inp->msgh_id - PROCESS_MSGID_BASE;
+
+  /* proc_getallpids calls add_tasks unless the kernel sends us task
+     notifications.  */
+  if (i == 5 && ! task_notifications)
+    return 0;
+  return i >= 0 && i < sizeof shared_rpcs && shared_rpcs[i];
+}
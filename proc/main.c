@@ -42,6 +42,32 @@ const char *argp_program_version = STANDARD_HURD_VERSION (proc);
 #include "proc_exc_S.h"
 #include "task_notify_S.h"
 
+/* Tell whether INP was sent to the process port of a process that
+   has root.  rpcstats_get can enable and reset our statistics, so we
+   only answer it on those ports, instead of flagging our port classes
+   with ports_serve_rpc_stats: the generic port and the ports of
+   unprivileged processes are handed out to everyone.  */
+static int
+rpcstats_allowed (mach_msg_header_t *inp)
+{
+  struct proc *p;
+  int allowed;
+
+  if (MACH_MSGH_BITS_LOCAL (inp->msgh_bits) ==
+      MACH_MSG_TYPE_PROTECTED_PAYLOAD)
+    p = begin_using_proc_payload (inp->msgh_protected_payload);
+  else
+    p = begin_using_proc_port (inp->msgh_local_port);
+  if (! p)
+    return 0;
+
+  global_lock_acquire (1);
+  allowed = check_uid (p, 0);
+  global_lock_release ();
+  end_using_proc (p);
+  return allowed;
+}
+
 int
 message_demuxer (mach_msg_header_t *inp,
 		 mach_msg_header_t *outp)
@@ -53,17 +79,17 @@ message_demuxer (mach_msg_header_t *inp,
       (routine = proc_exc_server_routine (inp)) ||
       (routine = task_notify_server_routine (inp)))
     {
-      pthread_mutex_lock (&global_lock);
+      global_lock_acquire (global_lock_shared_rpc (inp));
       (*routine) (inp, outp);
-      pthread_mutex_unlock (&global_lock);
+      global_lock_release ();
       return TRUE;
     }
   else
-    return FALSE;
+    return rpcstats_allowed (inp) && ports_rpcstats_server (inp, outp);
 }
 
-pthread_mutex_t global_lock = PTHREAD_MUTEX_INITIALIZER;
 int startup_fallback;
+int task_notifications;
 
 error_t
 increase_priority (void)
@@ -236,6 +262,8 @@ main (int argc, char **argv, char **envp)
 					MACH_MSG_TYPE_MAKE_SEND);
   if (err)
     error (0, err, "Registering task notifications failed");
+  else
+    task_notifications = 1;
 
   startup = file_name_lookup (_SERVERS_STARTUP, 0, 0);
   if (MACH_PORT_VALID (startup))
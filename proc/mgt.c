@@ -110,7 +110,7 @@ S_proc_reauthenticate (struct proc *p, mach_port_t rendport)
   naux_gids = sizeof (agbuf) / sizeof (uid_t);
 
   /* Release the global lock while blocking on the auth server and client.  */
-  pthread_mutex_unlock (&global_lock);
+  global_lock_release ();
   do
     err = auth_server_authenticate (authserver,
 				    rendport, MACH_MSG_TYPE_COPY_SEND,
@@ -120,7 +120,7 @@ S_proc_reauthenticate (struct proc *p, mach_port_t rendport)
 				    &gen_gids, &ngen_gids,
 				    &aux_gids, &naux_gids);
   while (err == EINTR);
-  pthread_mutex_lock (&global_lock);
+  global_lock_reacquire ();
 
   if (err)
     return err;
@@ -322,7 +322,9 @@ S_proc_getpids (struct proc *p,
     return EOPNOTSUPP;
   *pid = p->p_pid;
   *ppid = p->p_parent->p_pid;
+  pthread_mutex_lock (&pgrp_lock);
   *orphaned = !p->p_pgrp->pg_orphcnt;
+  pthread_mutex_unlock (&pgrp_lock);
   return 0;
 }
 
@@ -334,8 +336,10 @@ S_proc_set_arg_locations (struct proc *p,
 {
   if (!p)
     return EOPNOTSUPP;
+  pthread_mutex_lock (&p->p_lock);
   p->p_argv = argv;
   p->p_envp = envp;
+  pthread_mutex_unlock (&p->p_lock);
   return 0;
 }
 
@@ -345,8 +349,12 @@ S_proc_get_arg_locations (struct proc *p,
 			  vm_address_t *argv,
 			  vm_address_t *envp)
 {
+  if (!p)
+    return EOPNOTSUPP;
+  pthread_mutex_lock (&p->p_lock);
   *argv = p->p_argv;
   *envp = p->p_envp;
+  pthread_mutex_unlock (&p->p_lock);
   return 0;
 }
 
@@ -356,7 +364,9 @@ S_proc_set_entry (struct proc *p, vm_address_t entry)
 {
   if (!p)
     return EOPNOTSUPP;
+  pthread_mutex_lock (&p->p_lock);
   p->p_entry = entry;
+  pthread_mutex_unlock (&p->p_lock);
   return 0;
 }
 
@@ -364,7 +374,11 @@ S_proc_set_entry (struct proc *p, vm_address_t entry)
 kern_return_t
 S_proc_get_entry (struct proc *p, vm_address_t *entry)
 {
+  if (!p)
+    return EOPNOTSUPP;
+  pthread_mutex_lock (&p->p_lock);
   *entry = p->p_entry;
+  pthread_mutex_unlock (&p->p_lock);
   return 0;
 }
 
@@ -569,7 +583,11 @@ S_proc_getallpids (struct proc *p,
 
   /* No need to check P here; we don't use it. */
 
-  add_tasks (0);
+  /* Without task notifications, look for tasks we don't know about
+     yet.  This adds processes, so global_lock_shared_rpc only lets us
+     run with the lock held shared when we have them.  */
+  if (! task_notifications)
+    add_tasks (0);
 
   nprocs = 0;
   prociterate (count_up, &nprocs);
@@ -612,6 +630,7 @@ allocate_proc (task_t task)
   p->p_msgport = MACH_PORT_NULL;
 
   pthread_cond_init (&p->p_wakeup, NULL);
+  pthread_mutex_init (&p->p_lock, NULL);
 
   return p;
 }
@@ -783,7 +802,7 @@ namespace_translate_pids (mach_port_t namespace, pid_t *pids, size_t pids_len)
   tasks = calloc (pids_len, sizeof *tasks);
   if (tasks == NULL)
     {
-      pthread_mutex_lock (&global_lock);
+      global_lock_reacquire ();
       return ENOMEM;
     }
 
@@ -791,7 +810,7 @@ namespace_translate_pids (mach_port_t namespace, pid_t *pids, size_t pids_len)
     /* We handle errors by checking each returned task.  */
     proc_pid2task (namespace, pids[i], &tasks[i]);
 
-  pthread_mutex_lock (&global_lock);
+  global_lock_reacquire ();
 
   for (i = 0; i < pids_len; i++)
     if (MACH_PORT_VALID (tasks[i]))
@@ -1144,8 +1163,10 @@ S_proc_set_code (struct proc *callerp,
   if (!callerp)
     return EOPNOTSUPP;
 
+  pthread_mutex_lock (&callerp->p_lock);
   callerp->start_code = start_code;
   callerp->end_code = end_code;
+  pthread_mutex_unlock (&callerp->p_lock);
 
   return 0;
 }
@@ -1159,8 +1180,10 @@ S_proc_get_code (struct proc *callerp,
   if (!callerp)
     return EOPNOTSUPP;
 
+  pthread_mutex_lock (&callerp->p_lock);
   *start_code = callerp->start_code;
   *end_code = callerp->end_code;
+  pthread_mutex_unlock (&callerp->p_lock);
 
   return 0;
 }
@@ -110,14 +110,19 @@ S_proc_setsid (struct proc *p)
   if (!p)
     return EOPNOTSUPP;
 
+  pthread_mutex_lock (&pgrp_lock);
   if (p->p_pgrp->pg_pgid == p->p_pid || pgrp_find (p->p_pid))
-    return EPERM;
+    {
+      pthread_mutex_unlock (&pgrp_lock);
+      return EPERM;
+    }
 
   leave_pgrp (p);
 
   sess = new_session (p);
   p->p_pgrp= new_pgrp (p->p_pid, sess);
   join_pgrp (p);
+  pthread_mutex_unlock (&pgrp_lock);
 
   return 0;
 }
@@ -154,7 +159,7 @@ S_proc_getsid (struct proc *callerp,
       pid_t pid_sub;
 
       /* Release global lock while talking to the other proc server.  */
-      pthread_mutex_unlock (&global_lock);
+      global_lock_release ();
 
       err = proc_task2pid (p->p_task_namespace, p->p_task, &pid_sub);
       if (! err)
@@ -163,7 +168,7 @@ S_proc_getsid (struct proc *callerp,
 	/* Acquires global_lock.  */
 	err = namespace_translate_pids (p->p_task_namespace, sid, 1);
       else
-	pthread_mutex_lock (&global_lock);
+	global_lock_reacquire ();
 
       if (! err)
 	return 0;
@@ -171,7 +176,9 @@ S_proc_getsid (struct proc *callerp,
       /* Fallback.  */
     }
 
+  pthread_mutex_lock (&pgrp_lock);
   *sid = p->p_pgrp->pg_session->s_sid;
+  pthread_mutex_unlock (&pgrp_lock);
   return 0;
 }
 
@@ -199,7 +206,7 @@ S_proc_getsessionpids (struct proc *callerp,
       pid_t pid_sub;
 
       /* Release global lock while talking to the other proc server.  */
-      pthread_mutex_unlock (&global_lock);
+      global_lock_release ();
 
       err = proc_task2pid (p->p_task_namespace, p->p_task, &pid_sub);
       if (! err)
@@ -208,7 +215,7 @@ S_proc_getsessionpids (struct proc *callerp,
 	/* Acquires global_lock.  */
 	err = namespace_translate_pids (p->p_task_namespace, *pids, *npidsp);
       else
-	pthread_mutex_lock (&global_lock);
+	global_lock_reacquire ();
 
       if (! err)
 	return 0;
@@ -216,9 +223,13 @@ S_proc_getsessionpids (struct proc *callerp,
       /* Fallback.  */
     }
 
+  pthread_mutex_lock (&pgrp_lock);
   s = session_find (sid);
   if (!s)
-    return ESRCH;
+    {
+      pthread_mutex_unlock (&pgrp_lock);
+      return ESRCH;
+    }
 
   count = 0;
   for (pg = s->s_pgrps; pg; pg = pg->pg_next)
@@ -234,7 +245,10 @@ S_proc_getsessionpids (struct proc *callerp,
       *pids = mmap (0, count * sizeof (pid_t), PROT_READ|PROT_WRITE,
 		    MAP_ANON, 0, 0);
       if (*pids == MAP_FAILED)
-	return errno;
+	{
+	  pthread_mutex_unlock (&pgrp_lock);
+	  return errno;
+	}
 
       pp = *pids;
       for (pg = s->s_pgrps; pg; pg = pg->pg_next)
@@ -242,6 +256,7 @@ S_proc_getsessionpids (struct proc *callerp,
 	  *pp++ = p->p_pid;
       /* Set dealloc XXX */
     }
+  pthread_mutex_unlock (&pgrp_lock);
 
   *npidsp = count;
   return 0;
@@ -271,7 +286,7 @@ S_proc_getsessionpgids (struct proc *callerp,
       pid_t pid_sub;
 
       /* Release global lock while talking to the other proc server.  */
-      pthread_mutex_unlock (&global_lock);
+      global_lock_release ();
 
       err = proc_task2pid (p->p_task_namespace, p->p_task, &pid_sub);
       if (! err)
@@ -280,7 +295,7 @@ S_proc_getsessionpgids (struct proc *callerp,
 	/* Acquires global_lock.  */
 	err = namespace_translate_pids (p->p_task_namespace, *pgids, *npgidsp);
       else
-	pthread_mutex_lock (&global_lock);
+	global_lock_reacquire ();
 
       if (! err)
 	return 0;
@@ -288,9 +303,13 @@ S_proc_getsessionpgids (struct proc *callerp,
       /* Fallback.  */
     }
 
+  pthread_mutex_lock (&pgrp_lock);
   s = session_find (sid);
   if (!s)
-    return ESRCH;
+    {
+      pthread_mutex_unlock (&pgrp_lock);
+      return ESRCH;
+    }
   count = 0;
 
   for (pg = s->s_pgrps; pg; pg = pg->pg_next)
@@ -303,13 +322,17 @@ S_proc_getsessionpgids (struct proc *callerp,
       *pgids = mmap (0, count * sizeof (pid_t), PROT_READ|PROT_WRITE,
 		     MAP_ANON, 0, 0);
       if (*pgids == MAP_FAILED)
-	return errno;
+	{
+	  pthread_mutex_unlock (&pgrp_lock);
+	  return errno;
+	}
 
       pp = *pgids;
       for (pg = s->s_pgrps; pg; pg = pg->pg_next)
 	*pp++ = pg->pg_pgid;
       /* Dealloc ? XXX */
     }
+  pthread_mutex_unlock (&pgrp_lock);
   *npgidsp = count;
   return 0;
 }
@@ -337,7 +360,7 @@ S_proc_getpgrppids (struct proc *callerp,
       pid_t pid_sub;
 
       /* Release global lock while talking to the other proc server.  */
-      pthread_mutex_unlock (&global_lock);
+      global_lock_release ();
 
       err = proc_task2pid (p->p_task_namespace, p->p_task, &pid_sub);
       if (! err)
@@ -346,7 +369,7 @@ S_proc_getpgrppids (struct proc *callerp,
 	/* Acquires global_lock.  */
 	err = namespace_translate_pids (p->p_task_namespace, *pids, *npidsp);
       else
-	pthread_mutex_lock (&global_lock);
+	global_lock_reacquire ();
 
       if (! err)
 	return 0;
@@ -354,13 +377,17 @@ S_proc_getpgrppids (struct proc *callerp,
       /* Fallback.  */
     }
 
+  pthread_mutex_lock (&pgrp_lock);
   if (pgid == 0)
     pg = callerp->p_pgrp;
   else
     {
       pg = pgrp_find (pgid);
       if (!pg)
-	return ESRCH;
+	{
+	  pthread_mutex_unlock (&pgrp_lock);
+	  return ESRCH;
+	}
     }
 
   count = 0;
@@ -374,7 +401,10 @@ S_proc_getpgrppids (struct proc *callerp,
       *pids = mmap (0, count * sizeof (pid_t), PROT_READ|PROT_WRITE,
 		    MAP_ANON, 0, 0);
       if (*pids == MAP_FAILED)
-	return errno;
+	{
+	  pthread_mutex_unlock (&pgrp_lock);
+	  return errno;
+	}
 
       pp = *pids;
       for (p = pg->pg_plist; p; p = p->p_gnext)
@@ -382,6 +412,7 @@ S_proc_getpgrppids (struct proc *callerp,
 	  *pp++ = p->p_pid;
       /* Dealloc ? XXX */
     }
+  pthread_mutex_unlock (&pgrp_lock);
   *npidsp = count;
   return 0;
 }
@@ -396,6 +427,7 @@ S_proc_getsidport (struct proc *p,
   if (!p)
     return EOPNOTSUPP;
 
+  pthread_mutex_lock (&pgrp_lock);
   if (!p->p_pgrp)
     *sessport = MACH_PORT_NULL;
   else
@@ -405,6 +437,7 @@ S_proc_getsidport (struct proc *p,
 				  &p->p_pgrp->pg_session->s_sessionid);
       *sessport = p->p_pgrp->pg_session->s_sessionid;
     }
+  pthread_mutex_unlock (&pgrp_lock);
   *sessport_type = MACH_MSG_TYPE_MAKE_SEND;
   return err;
 }
@@ -431,13 +464,18 @@ S_proc_setpgrp (struct proc *callerp,
 
   if (!pgid)
     pgid = p->p_pid;
+
+  pthread_mutex_lock (&pgrp_lock);
   pg = pgrp_find (pgid);
 
   if (p->p_pgrp->pg_session->s_sid == p->p_pid
       || p->p_pgrp->pg_session != callerp->p_pgrp->pg_session
       || ((pgid != p->p_pid
 	   && (!pg || pg->pg_session != callerp->p_pgrp->pg_session))))
-    return EPERM;
+    {
+      pthread_mutex_unlock (&pgrp_lock);
+      return EPERM;
+    }
 
   if (p->p_pgrp != pg)
     {
@@ -454,6 +492,7 @@ S_proc_setpgrp (struct proc *callerp,
   else
     nowait_msg_proc_newids (p->p_msgport, p->p_task, p->p_parent->p_pid,
 			    pg->pg_pgid, !pg->pg_orphcnt);
+  pthread_mutex_unlock (&pgrp_lock);
 
   return 0;
 }
@@ -471,8 +510,10 @@ S_proc_getpgrp (struct proc *callerp,
   if (!p)
     return ESRCH;
 
+  pthread_mutex_lock (&pgrp_lock);
   if (p->p_pgrp)
     *pgid = p->p_pgrp->pg_pgid;
+  pthread_mutex_unlock (&pgrp_lock);
 
   return 0;
 }
@@ -67,6 +67,10 @@ struct proc
 
   pthread_cond_t p_wakeup;
 
+  /* Protects EXE through P_ENTRY below against RPCs that run with
+     GLOBAL_LOCK held shared.  Not needed when holding it exclusively.  */
+  pthread_mutex_t p_lock;
+
   /* Miscellaneous information */
   char *exe;			/* path to binary executable */
   vm_address_t p_argv, p_envp;
@@ -152,9 +156,18 @@ struct port_class *exc_class;
 mach_port_t generic_port;	/* messages not related to a specific proc */
 struct proc *kernel_proc;
 
+/* The process table lock; see lock.c.  */
 pthread_mutex_t global_lock;
 
+/* Protects the process group and session topology (the pgrp and
+   session hash tables, P_PGRP, P_GNEXT and the contents of struct pgrp
+   and struct session) against RPCs that run with GLOBAL_LOCK held
+   shared.  Not needed when holding GLOBAL_LOCK exclusively.  Lock
+   order is GLOBAL_LOCK, PGRP_LOCK, P_LOCK.  */
+pthread_mutex_t pgrp_lock;
+
 extern int startup_fallback;	/* (ab)use /hurd/startup's message port */
+extern int task_notifications;	/* the kernel tells us about new tasks */
 
 /* Forward declarations */
 void complete_wait (struct proc *, int);
@@ -170,6 +183,7 @@ void abort_getmsgport (struct proc *);
 int zombie_check_pid (pid_t);
 void check_message_dying (struct proc *, struct proc *);
 int check_msgport_death (struct proc *);
+int msgport_is_dead (struct proc *);
 void check_dead_execdata_notify (mach_port_t);
 
 void add_proc_to_hash (struct proc *);
@@ -213,6 +227,12 @@ void complete_exit (struct proc *);
 
 void initialize_version_info (void);
 
+void global_lock_acquire (int);
+void global_lock_release (void);
+void global_lock_reacquire (void);
+int global_lock_wait (pthread_cond_t *);
+int global_lock_shared_rpc (mach_msg_header_t *);
+
 void send_signal (mach_port_t, int, mach_port_t);
 
 
@@ -229,7 +229,7 @@ S_proc_wait (struct proc *p,
     return EWOULDBLOCK;
 
   p->p_waiting = 1;
-  cancel = pthread_hurd_cond_wait_np (&p->p_wakeup, &global_lock);
+  cancel = global_lock_wait (&p->p_wakeup);
   if (p->p_dead)
     return EOPNOTSUPP;
   if (cancel)
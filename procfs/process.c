@@ -17,10 +17,14 @@
    along with this program; if not, write to the Free Software
    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
 
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <hurd/process.h>
+#include <hurd/ihash.h>
 #include <hurd/resource.h>
 #include <mach/vm_param.h>
 #include <ps.h>
@@ -37,8 +41,141 @@
    of information (ie. libps flags) it needs, and what function should
    be used to generate the file's contents.
 
-   The content generators are defined first, followed by glue logic and
-   entry table.  */
+   The proc_stat structures are shared by all the nodes of a process
+   which are read within opt_cache_ttl milliseconds of each other (a
+   "refresh epoch"), so that a program polling several files of many
+   processes costs one set of RPCs to the proc server per process and
+   epoch.
+
+   The snapshot cache is defined first, followed by the content
+   generators, glue logic and entry table.  */
+
+
+/* Snapshot cache */
+
+/* The information about a process shared during a refresh epoch.  */
+struct process_snapshot
+{
+  pid_t pid;
+  unsigned long epoch;
+  int refs;			/* Protected by snapshots_lock.  */
+
+  /* PS may only be used with LOCK held.  */
+  pthread_mutex_t lock;
+  struct proc_stat *ps;
+};
+
+/* The current snapshot of every process, indexed by pid.  The table
+   holds a reference to each.  */
+static struct hurd_ihash snapshots
+  = HURD_IHASH_INITIALIZER (HURD_IHASH_NO_LOCP);
+static pthread_mutex_t snapshots_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned long
+current_epoch (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec * 1000 + ts.tv_nsec / 1000000) / opt_cache_ttl;
+}
+
+/* Drop a reference to SNAP.  Must be called with SNAPSHOTS_LOCK held.  */
+static void
+process_snapshot_unref (struct process_snapshot *snap)
+{
+  if (--snap->refs == 0)
+    {
+      _proc_stat_free (snap->ps);
+      free (snap);
+    }
+}
+
+static void
+process_snapshot_release (struct process_snapshot *snap)
+{
+  pthread_mutex_lock (&snapshots_lock);
+  process_snapshot_unref (snap);
+  pthread_mutex_unlock (&snapshots_lock);
+}
+
+/* Return in *SNAP a new reference to the snapshot of process PID for the
+   current epoch, creating it if needed.  */
+static error_t
+process_snapshot_get (struct ps_context *pc, pid_t pid,
+		      struct process_snapshot **snap)
+{
+  struct process_snapshot *s = NULL, *old;
+  unsigned long epoch = 0;
+  error_t err;
+
+  pthread_mutex_lock (&snapshots_lock);
+  if (opt_cache_ttl > 0)
+    {
+      epoch = current_epoch ();
+      s = hurd_ihash_find (&snapshots, pid);
+      if (s && s->epoch == epoch)
+	{
+	  s->refs++;
+	  pthread_mutex_unlock (&snapshots_lock);
+	  *snap = s;
+	  return 0;
+	}
+    }
+
+  old = s;
+  s = malloc (sizeof *s);
+  if (! s)
+    {
+      pthread_mutex_unlock (&snapshots_lock);
+      return ENOMEM;
+    }
+  err = _proc_stat_create (pid, pc, &s->ps);
+  if (err)
+    {
+      pthread_mutex_unlock (&snapshots_lock);
+      free (s);
+      return err;
+    }
+  s->pid = pid;
+  s->epoch = epoch;
+  s->refs = 1;
+  pthread_mutex_init (&s->lock, NULL);
+
+  if (opt_cache_ttl > 0 && ! hurd_ihash_add (&snapshots, pid, s))
+    {
+      /* The table's reference.  */
+      s->refs++;
+      if (old)
+	process_snapshot_unref (old);
+    }
+  pthread_mutex_unlock (&snapshots_lock);
+
+  *snap = s;
+  return 0;
+}
+
+void
+process_forget_stale (void)
+{
+  unsigned long epoch;
+
+  if (opt_cache_ttl == 0)
+    return;
+
+  pthread_mutex_lock (&snapshots_lock);
+  epoch = current_epoch ();
+  HURD_IHASH_ITERATE (&snapshots, value)
+    {
+      struct process_snapshot *s = value;
+      if (s->epoch != epoch)
+	{
+	  hurd_ihash_remove (&snapshots, s->pid);
+	  process_snapshot_unref (s);
+	}
+    }
+  pthread_mutex_unlock (&snapshots_lock);
+}
 
 
 /* Helper functions */
@@ -92,6 +229,34 @@ static int args_filename_length (const char *name)
   return strchrnul (name, ' ') - name;
 }
 
+/* The size of the buffer procfs provides for the files formatted with
+   process_file_printf.  It is enough for any of them, save for very
+   long command names.  */
+#define PROCESS_FILE_BUFSIZE 1024
+
+/* Format the contents of a file like asprintf, but into *CONTENTS if it
+   is a buffer of PROCESS_FILE_BUFSIZE bytes and they fit.  */
+static ssize_t
+process_file_printf (char **contents, const char *fmt, ...)
+{
+  va_list ap;
+  ssize_t len;
+
+  if (*contents)
+    {
+      va_start (ap, fmt);
+      len = vsnprintf (*contents, PROCESS_FILE_BUFSIZE, fmt, ap);
+      va_end (ap);
+      if (len >= 0 && len < PROCESS_FILE_BUFSIZE)
+	return len;
+    }
+
+  va_start (ap, fmt);
+  len = vasprintf (contents, fmt, ap);
+  va_end (ap);
+  return len;
+}
+
 /* Actual content generators */
 
 static ssize_t
@@ -245,7 +410,7 @@ process_file_gc_stat (struct proc_stat *ps, char **contents)
 
   /* See proc(5) for more information about the contents of each field for the
      Linux procfs.  */
-  return asprintf (contents,
+  return process_file_printf (contents,
       "%d (%.*s) %c "		/* pid, command, state */
       "%d %d %d "		/* ppid, pgid, session */
       "%d %d "			/* controlling tty stuff */
@@ -296,7 +461,7 @@ process_file_gc_statm (struct proc_stat *ps, char **contents)
 {
   task_basic_info_t tbi = proc_stat_task_basic_info (ps);
 
-  return asprintf (contents,
+  return process_file_printf (contents,
       "%lu %lu 0 0 0 0 0\n",
       tbi->virtual_size  / sysconf(_SC_PAGE_SIZE),
       tbi->resident_size / sysconf(_SC_PAGE_SIZE));
@@ -308,7 +473,7 @@ process_file_gc_status (struct proc_stat *ps, char **contents)
   task_basic_info_t tbi = proc_stat_task_basic_info (ps);
   const char *fn = args_filename (proc_stat_args (ps));
 
-  return asprintf (contents,
+  return process_file_printf (contents,
       "Name:\t%.*s\n"
       "State:\t%s\n"
       "Tgid:\t%u\n"
@@ -358,31 +523,64 @@ struct process_file_desc
 
   /* If specified, the file mode to be set with procfs_node_chmod().  */
   mode_t mode;
+
+  /* The contents are formatted with process_file_printf, so procfs
+     should provide a buffer for them.  */
+  int buffered;
 };
 
 struct process_file_node
 {
   const struct process_file_desc *desc;
-  struct proc_stat *ps;
+
+  /* The snapshot of the process directory, which is kept alive by it.  */
+  struct process_snapshot *dir;
+
+  /* The snapshot the current contents point into, if any.  */
+  struct process_snapshot *snap;
 };
 
-/* FIXME: lock the parent! */
 static error_t
 process_file_get_contents (void *hook, char **contents, ssize_t *contents_len)
 {
   struct process_file_node *file = hook;
+  struct process_snapshot *snap;
+  struct proc_stat *ps;
   error_t err;
 
-  /* Fetch the required information.  */
-  err = proc_stat_set_flags (file->ps, file->desc->needs);
+  if (file->snap)
+    {
+      process_snapshot_release (file->snap);
+      file->snap = NULL;
+    }
+
+  /* Use the current snapshot of the process rather than the one of
+     the directory, which may be arbitrarily old if it is kept open.  */
+  err = process_snapshot_get (file->dir->ps->context, file->dir->pid, &snap);
   if (err)
     return EIO;
-  if ((proc_stat_flags (file->ps) & file->desc->needs) != file->desc->needs)
-    return EIO;
+  ps = snap->ps;
+
+  pthread_mutex_lock (&snap->lock);
+
+  /* Fetch the required information.  */
+  err = proc_stat_set_flags (ps, file->desc->needs);
+  if (! err && (proc_stat_flags (ps) & file->desc->needs) != file->desc->needs)
+    err = EIO;
 
   /* Call the actual content generator (see the definitions below).  */
-  *contents_len = file->desc->get_contents (file->ps, contents);
-  return 0;
+  if (! err)
+    *contents_len = file->desc->get_contents (ps, contents);
+
+  pthread_mutex_unlock (&snap->lock);
+
+  if (! err && file->desc->no_cleanup)
+    /* The contents point into PS.  */
+    file->snap = snap;
+  else
+    process_snapshot_release (snap);
+
+  return err ? EIO : 0;
 }
 
 static void
@@ -394,13 +592,29 @@ process_file_cleanup_contents (void *hook, char *contents, ssize_t len)
     free (contents);
 }
 
+static void
+process_file_cleanup (void *hook)
+{
+  struct process_file_node *file = hook;
+
+  if (file->snap)
+    process_snapshot_release (file->snap);
+  free (file);
+}
+
 static struct node *
 process_file_make_node (void *dir_hook, const void *entry_hook)
 {
   static const struct procfs_node_ops ops = {
     .get_contents = process_file_get_contents,
     .cleanup_contents = process_file_cleanup_contents,
-    .cleanup = free,
+    .cleanup = process_file_cleanup,
+  };
+  static const struct procfs_node_ops buffered_ops = {
+    .get_contents = process_file_get_contents,
+    .cleanup_contents = process_file_cleanup_contents,
+    .cleanup = process_file_cleanup,
+    .needed_length = PROCESS_FILE_BUFSIZE,
   };
   struct process_file_node *f;
   struct node *np;
@@ -410,13 +624,14 @@ process_file_make_node (void *dir_hook, const void *entry_hook)
     return NULL;
 
   f->desc = entry_hook;
-  f->ps = dir_hook;
+  f->dir = dir_hook;
+  f->snap = NULL;
 
-  np = procfs_make_node (&ops, f);
+  np = procfs_make_node (f->desc->buffered ? &buffered_ops : &ops, f);
   if (! np)
     return NULL;
 
-  procfs_node_chown (np, proc_stat_owner_uid (f->ps));
+  procfs_node_chown (np, proc_stat_owner_uid (f->dir->ps));
   if (f->desc->mode)
     procfs_node_chmod (np, f->desc->mode);
 
@@ -485,6 +700,7 @@ static struct procfs_dir_entry entries[] = {
     .name = "stat",
     .hook = & (struct process_file_desc) {
       .get_contents = process_file_gc_stat,
+      .buffered = 1,
       .needs = PSTAT_PID | PSTAT_ARGS | PSTAT_STATE | PSTAT_PROC_INFO
 	| PSTAT_TASK | PSTAT_TASK_BASIC | PSTAT_THREAD_BASIC
 	| PSTAT_THREAD_WAIT,
@@ -497,6 +713,7 @@ static struct procfs_dir_entry entries[] = {
     .name = "statm",
     .hook = & (struct process_file_desc) {
       .get_contents = process_file_gc_statm,
+      .buffered = 1,
       .needs = PSTAT_TASK_BASIC,
     },
   },
@@ -504,6 +721,7 @@ static struct procfs_dir_entry entries[] = {
     .name = "status",
     .hook = & (struct process_file_desc) {
       .get_contents = process_file_gc_status,
+      .buffered = 1,
       .needs = PSTAT_PID | PSTAT_ARGS | PSTAT_STATE | PSTAT_PROC_INFO
         | PSTAT_TASK_BASIC | PSTAT_OWNER_UID | PSTAT_NUM_THREADS,
     },
@@ -516,33 +734,37 @@ process_lookup_pid (struct ps_context *pc, pid_t pid, struct node **np)
 {
   static const struct procfs_dir_ops dir_ops = {
     .entries = entries,
-    .cleanup = (void (*)(void *)) _proc_stat_free,
+    .cleanup = (void (*)(void *)) process_snapshot_release,
     .entry_ops = {
       .make_node = process_file_make_node,
     },
   };
-  struct proc_stat *ps;
+  struct process_snapshot *snap;
   int owner;
   error_t err;
 
-  err = _proc_stat_create (pid, pc, &ps);
+  err = process_snapshot_get (pc, pid, &snap);
   if (err == ESRCH)
     return ENOENT;
   if (err)
     return EIO;
 
-  err = proc_stat_set_flags (ps, PSTAT_OWNER_UID);
-  if (err || ! (proc_stat_flags (ps) & PSTAT_OWNER_UID))
+  pthread_mutex_lock (&snap->lock);
+  err = proc_stat_set_flags (snap->ps, PSTAT_OWNER_UID);
+  if (! err && ! (proc_stat_flags (snap->ps) & PSTAT_OWNER_UID))
+    err = EIO;
+  owner = proc_stat_owner_uid (snap->ps);
+  pthread_mutex_unlock (&snap->lock);
+  if (err)
     {
-      _proc_stat_free (ps);
+      process_snapshot_release (snap);
       return EIO;
     }
 
-  *np = procfs_dir_make_node (&dir_ops, ps);
+  *np = procfs_dir_make_node (&dir_ops, snap);
   if (! *np)
     return ENOMEM;
 
-  owner = proc_stat_owner_uid (ps);
   procfs_node_chown (*np, owner >= 0 ? owner : opt_anon_owner);
   return 0;
 }
@@ -25,3 +25,6 @@
 error_t
 process_lookup_pid (struct ps_context *pc, pid_t pid, struct node **np);
 
+/* Forget the cached information about processes that is too old to be
+   used again.  */
+void process_forget_stale (void);
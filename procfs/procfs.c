@@ -35,6 +35,9 @@ struct netnode
   char *contents;
   ssize_t contents_len;
 
+  /* buffer of ops->needed_length bytes for get_contents, if allocated */
+  char *buf;
+
   /* parent directory, if applicable */
   struct node *parent;
 };
@@ -136,11 +139,21 @@ error_t procfs_get_contents (struct node *np, char **data, ssize_t *data_len)
 {
   if (! np->nn->contents && np->nn->ops->get_contents)
     {
-      char *contents;
-      ssize_t contents_len;
+      char *contents = NULL;
+      ssize_t contents_len = -1;
       error_t err;
 
-      contents_len = -1;
+      if (np->nn->ops->needed_length)
+	{
+	  if (! np->nn->buf)
+	    np->nn->buf = malloc (np->nn->ops->needed_length);
+	  if (np->nn->buf)
+	    {
+	      contents = np->nn->buf;
+	      contents_len = np->nn->ops->needed_length;
+	    }
+	}
+
       err = np->nn->ops->get_contents (np->nn->hook, &contents, &contents_len);
       if (err)
 	return err;
@@ -158,7 +171,8 @@ error_t procfs_get_contents (struct node *np, char **data, ssize_t *data_len)
 
 void procfs_refresh (struct node *np)
 {
-  if (np->nn->contents && np->nn->ops->cleanup_contents)
+  if (np->nn->contents && np->nn->contents != np->nn->buf
+      && np->nn->ops->cleanup_contents)
     np->nn->ops->cleanup_contents (np->nn->hook, np->nn->contents, np->nn->contents_len);
 
   np->nn->contents = NULL;
@@ -203,6 +217,7 @@ void procfs_cleanup (struct node *np)
   if (np->nn->parent)
     netfs_nrele (np->nn->parent);
 
+  free (np->nn->buf);
   free (np->nn);
 }
 
@@ -41,6 +41,14 @@ struct procfs_node_ops
   error_t (*get_contents) (void *hook, char **contents, ssize_t *contents_len);
   void (*cleanup_contents) (void *hook, char *contents, ssize_t contents_len);
 
+  /* If nonzero, get_contents is passed in (*CONTENTS, *CONTENTS_LEN) a
+     buffer of this many bytes, which belongs to the node and is reused
+     across refreshes.  It can put the contents there and set
+     *CONTENTS_LEN to their length, or return other storage as usual;
+     cleanup_contents is not called for the buffer.  If the buffer can't
+     be allocated, *CONTENTS is NULL and *CONTENTS_LEN is -1.  */
+  size_t needed_length;
+
   /* Lookup NAME in this directory, and store the result in *np.  The
      returned node should be created by lookup() using procfs_make_node() 
      or a derived function.  Note that the parent will be kept alive as
@@ -25,6 +25,7 @@
 #include <ps.h>
 #include "procfs.h"
 #include "process.h"
+#include "main.h"
 
 #define PID_STR_SIZE (3 * sizeof (pid_t) + 1)
 
@@ -42,6 +43,16 @@ proclist_get_contents (void *hook, char **contents, ssize_t *contents_len)
   if (err)
     return EIO;
 
+  /* Listing the directory is usually followed by a lookup of every
+     process, which needs its owner, and often by reads of their stat
+     files; get that information for all of them at once.  */
+  process_forget_stale ();
+  ps_context_prefetch_procinfo (pc, pids, num_pids,
+				opt_cache_ttl > 0
+				? PSTAT_OWNER_UID | PSTAT_STATE
+				  | PSTAT_TASK_BASIC | PSTAT_NUM_THREADS
+				: PSTAT_OWNER_UID);
+
   *contents = malloc (num_pids * PID_STR_SIZE);
   if (*contents)
     {
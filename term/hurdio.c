@@ -283,8 +283,7 @@ hurdio_writer_loop (void *arg)
       mach_port_mod_refs (mach_task_self (), ioport_copy,
 			  MACH_PORT_RIGHT_SEND, 1);
 
-      while (size--)
-	*bufp++ = dequeue (outputq);
+      dequeue_block (outputq, bufp, size);
 
       /* Submit all the outstanding characters to the I/O port.  */
       pthread_mutex_unlock (&global_lock);
@@ -111,6 +111,72 @@ write_character (int c)
   echo_pstart = output_psize;
 }
 
+/* Words of bytes, for scanning output a word at a time.  */
+#define BYTES(b) ((unsigned long) -1 / 0xff * (b))
+/* Nonzero if a byte of W is below B, which must not exceed 0x80; a
+   byte above one that is may also be flagged.  */
+#define HAS_LESS(w, b) (((w) - BYTES (b)) & ~(w) & BYTES (0x80))
+
+/* Return the length of the run of characters at the start of DATA, LEN
+   bytes long, that output_character passes through unchanged when
+   OLCASE is off, and store in *WIDTH the number of columns they move
+   the cursor.  Those are all but the control characters and DEL.  */
+static size_t
+plain_run (const char *data, size_t len, int *width)
+{
+  size_t i = 0;
+
+  *width = 0;
+  for (; i + sizeof (unsigned long) <= len; i += sizeof (unsigned long))
+    {
+      unsigned long w, high;
+
+      memcpy (&w, data + i, sizeof w);
+      if (HAS_LESS (w, ' ') || HAS_LESS (w ^ BYTES ('\177'), 1))
+	break;
+      /* Bytes with the top bit set don't move the cursor.  */
+      high = w & BYTES (0x80);
+      *width += sizeof w - (high ? __builtin_popcountl (high) : 0);
+    }
+
+  for (; i < len; i++)
+    {
+      unsigned char c = data[i];
+      if (c < ' ' || c == '\177')
+	break;
+      if (c < 0x80)
+	++*width;
+    }
+
+  return i;
+}
+
+/* Place as many characters from the start of DATA, LEN bytes long, on
+   the output queue as can be copied there without output processing,
+   and do what write_character does for them.  Return the number of
+   characters written; zero if DATA[0] must be written with
+   write_character.  */
+size_t
+write_characters (const char *data, size_t len)
+{
+  int width;
+  size_t n;
+
+  if ((termflags & FLUSH_OUTPUT)
+      || ((termstate.c_oflag & OPOST) && (termstate.c_oflag & OLCASE)))
+    return 0;
+
+  n = plain_run (data, len, &width);
+  if (n == 0)
+    return 0;
+
+  enqueue_block (&outputq, data, n);
+  output_psize += width;
+  echo_qsize = 0;
+  echo_pstart = output_psize;
+  return n;
+}
+
 /* Report the width of character C as printed by output_character,
    if output_psize were at LOC. . */
 int
@@ -730,6 +796,85 @@ create_queue (int size, int lowat, int hiwat)
   return q;
 }
 
+/* Add the LEN characters at DATA to *QP, as enqueue would one at a
+   time.  */
+void
+enqueue_block (struct queue **qp, const char *data, size_t len)
+{
+  struct queue *q = *qp;
+  int was_empty = qsize (q) == 0;
+
+  if (len == 0)
+    return;
+
+  while (len > 0)
+    {
+      size_t i, n = q->arraylen - (q->ce - q->array);
+
+      if (n == 0)
+	{
+	  q = *qp = reallocate_queue (q);
+	  continue;
+	}
+      if (n > len)
+	n = len;
+      for (i = 0; i < n; i++)
+	q->ce[i] = data[i];
+      q->ce += n;
+      data += n;
+      len -= n;
+    }
+
+  if (was_empty)
+    {
+      pthread_cond_broadcast (q->wait);
+      pthread_cond_broadcast (&select_alert);
+      if (q == inputq)
+	{
+	  if (pty_select_alert != NULL)
+	    pthread_cond_broadcast (pty_select_alert);
+	  call_asyncs (O_READ);
+	}
+    }
+
+  if (!q->susp && (qsize (q) > q->hiwat))
+    q->susp = 1;
+}
+
+/* Remove the next LEN characters from Q, which must have that many,
+   and store them unquoted in BUF, as dequeue would one at a time.  */
+void
+dequeue_block (struct queue *q, char *buf, size_t len)
+{
+  int beep = 0;
+  size_t i;
+
+  if (len == 0)
+    return;
+
+  assert_backtrace (qsize (q) >= len);
+  for (i = 0; i < len; i++)
+    buf[i] = q->cs[i] & ~QUEUE_QUOTE_MARK;
+  q->cs += len;
+
+  if (q->susp && (qsize (q) < q->lowat))
+    {
+      q->susp = 0;
+      beep = 1;
+    }
+  if (qsize (q) == 0)
+    beep = 1;
+  if (beep)
+    {
+      pthread_cond_broadcast (q->wait);
+      pthread_cond_broadcast (&select_alert);
+      if (q == inputq && pty_select_alert != NULL)
+	pthread_cond_broadcast (pty_select_alert);
+      else if (q == outputq)
+	call_asyncs (O_WRITE);
+    }
+}
+
 /* Make Q able to have more characters added to it. */
 struct queue *
 reallocate_queue (struct queue *q)
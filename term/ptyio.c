@@ -372,8 +372,7 @@ pty_io_read (struct trivfs_protid *cred,
 	  *cp++ = TIOCPKT_DATA;
 	  --size;
 	}
-      while (size--)
-	*cp++ = dequeue (outputq);
+      dequeue_block (outputq, cp, size);
     }
 
   pthread_mutex_unlock (&global_lock);
@@ -417,8 +416,7 @@ pty_io_write (struct trivfs_protid *cred,
 	  return EINTR;
 	}
 
-      for (i = 0; i < datalen; i++)
-	enqueue (&inputq, data[i]);
+      enqueue_block (&inputq, data, datalen);
 
       /* Extra garbage charater */
       enqueue (&inputq, 0);
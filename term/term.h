@@ -207,6 +207,8 @@ extern void enqueue_quote (struct queue **qp, char c);
 extern char unquote_char (quoted_char c);
 extern int char_quoted_p (quoted_char c);
 extern short queue_erase (struct queue *q);
+extern void enqueue_block (struct queue **qp, const char *data, size_t len);
+extern void dequeue_block (struct queue *q, char *buf, size_t len);
 
 #if defined(__USE_EXTERN_INLINES) || defined(TERM_DEFINE_EI)
 /* Return the number of characters in Q. */
@@ -376,6 +378,7 @@ void output_character (int);
 void copy_rawq (void);
 void rescan_inputq (void);
 void write_character (int);
+size_t write_characters (const char *, size_t);
 void init_users (void);
 
 extern char *tty_arg;
@@ -600,8 +600,11 @@ trivfs_S_io_write (struct trivfs_protid *cred,
     }
 
   cancel = 0;
-  for (i = 0; i < datalen; i++)
+  for (i = 0; i < datalen; )
     {
+      int room;
+      size_t n;
+
       while (!qavail (outputq) && !cancel)
 	{
 	  err = (*bottom->start_output) ();
@@ -617,7 +620,19 @@ trivfs_S_io_write (struct trivfs_protid *cred,
       if (cancel)
 	break;
 
-      write_character (data[i]);
+      /* Copy runs of ordinary characters in one go, as far as the high
+	 water mark lets write_character go one at a time.  */
+      room = outputq->hiwat + 1 - qsize (outputq);
+      if (room < 1)
+	room = 1;
+      n = write_characters (data + i,
+			    datalen - i < room ? datalen - i : room);
+      if (n == 0)
+	{
+	  write_character (data[i]);
+	  n = 1;
+	}
+      i += n;
     }
 
   *amt = i;
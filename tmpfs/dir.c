@@ -23,12 +23,85 @@
 
 #include "tmpfs.h"
 #include <stdlib.h>
+#include <string.h>
+
+/* Entries are hashed by name; the key is the NUL-terminated name.  */
+static hurd_ihash_key_t
+name_hash (const void *key)
+{
+  const char *name = key;
+  return hurd_ihash_hash32 (name, strlen (name), 0);
+}
+
+static int
+name_compare (const void *a, const void *b)
+{
+  return strcmp (a, b) == 0;
+}
+
+/* Add DELTA to the number of entries in slot SLOT of DIR.  */
+static void
+live_add (struct tmpfs_dir *dir, size_t slot, int delta)
+{
+  for (slot++; slot <= dir->allocslots; slot += slot & -slot)
+    dir->live[slot - 1] += delta;
+}
+
+/* Return the slot of DIR holding the entry that comes after N others,
+   which must be less than DIR->nentries.  */
+static size_t
+live_find (struct tmpfs_dir *dir, size_t n)
+{
+  size_t pos = 0, step;
+
+  for (step = dir->allocslots; step > 0; step >>= 1)
+    if (dir->live[pos + step - 1] <= n)
+      {
+	pos += step;
+	n -= dir->live[pos - 1];
+      }
+  return pos;
+}
+
+/* Fill in the LIVE tree of DIR, which has ALLOCSLOTS elements, from its
+   first NSLOTS slots.  */
+static void
+live_build (struct tmpfs_dir *dir)
+{
+  size_t i, j;
+
+  for (i = 0; i < dir->allocslots; i++)
+    dir->live[i] = i < dir->nslots && dir->slots[i] != 0;
+  for (i = 1; i <= dir->allocslots; i++)
+    {
+      j = i + (i & -i);
+      if (j <= dir->allocslots)
+	dir->live[j - 1] += dir->live[i - 1];
+    }
+}
+
+/* Free the index of the directory DN, which must be empty.  */
+void
+tmpfs_dir_free (struct disknode *dn)
+{
+  struct tmpfs_dir *dir = dn->u.dir.index;
+
+  if (dir == 0)
+    return;
+  assert_backtrace (dir->nentries == 0);
+  hurd_ihash_destroy (&dir->names);
+  free (dir->slots);
+  free (dir->live);
+  free (dir->holes);
+  free (dir);
+  dn->u.dir.index = 0;
+}
 
 error_t
 diskfs_init_dir (struct node *dp, struct node *pdp, struct protid *cred)
 {
   dp->dn->u.dir.dotdot = pdp->dn;
-  dp->dn->u.dir.entries = 0;
+  dp->dn->u.dir.index = 0;
 
   /* Increase hardlink count for parent directory */
   pdp->dn_stat.st_nlink++;
@@ -42,11 +115,13 @@ error_t
 diskfs_clear_directory (struct node *dp, struct node *pdp,
 			struct protid *cred)
 {
-  if (dp->dn->u.dir.entries != 0)
+  if (! diskfs_dirempty (dp, cred))
     return ENOTEMPTY;
   assert_backtrace (dp->dn_stat.st_size == 0);
   assert_backtrace (dp->dn->u.dir.dotdot == pdp->dn);
 
+  tmpfs_dir_free (dp->dn);
+
   /* Decrease hardlink count for parent directory */
   pdp->dn_stat.st_nlink--;
   /* Take '.' directory into account */
@@ -58,7 +133,7 @@ diskfs_clear_directory (struct node *dp, struct node *pdp,
 int
 diskfs_dirempty (struct node *dp, struct protid *cred)
 {
-  return dp->dn->u.dir.entries == 0;
+  return dp->dn->u.dir.index == 0 || dp->dn->u.dir.index->nentries == 0;
 }
 
 error_t
@@ -66,8 +141,10 @@ diskfs_get_directs (struct node *dp, int entry, int n,
 		    char **data, size_t *datacnt,
 		    vm_size_t bufsiz, int *amt)
 {
+  struct tmpfs_dir *dir = dp->dn->u.dir.index;
   struct tmpfs_dirent *d;
   struct dirent *entp;
+  size_t slot, nslots;
   int i;
 
   if (bufsiz == 0)
@@ -114,23 +191,27 @@ diskfs_get_directs (struct node *dp, int entry, int n,
       entp = (void *) entp + entp->d_reclen;
     }
 
-  /* Skip ahead to the desired entry.  */
-  for (d = dp->dn->u.dir.entries; i < entry && d != 0; d = d->next)
-    ++i;
-
+  /* Entry I is the one in the (I - 2)th occupied slot, so that the
+     entries are numbered without gaps, as our callers expect.  */
   if (i < entry)
-    {
-      assert_backtrace (d == 0);
-      *datacnt = 0;
-      *amt = 0;
-      return 0;
-    }
+    i = entry;
+  nslots = dir ? dir->nslots : 0;
+  if (dir == 0 || i - 2 >= dir->nentries)
+    slot = nslots;
+  else
+    slot = live_find (dir, i - 2);
 
   /* Now fill in the buffer with real entries.  */
-  for (; d != 0; d = d->next, i++)
+  for (; slot < nslots; slot++)
     {
-      size_t rlen = (offsetof (struct dirent, d_name[1]) + d->namelen + 7) & ~7;
-      if (rlen + (char *) entp - *data > bufsiz || (n >= 0 && i > n))
+      size_t rlen;
+
+      d = dir->slots[slot];
+      if (d == 0)
+	continue;
+      rlen = (offsetof (struct dirent, d_name[1]) + d->namelen + 7) & ~7;
+      if (rlen + (char *) entp - *data > bufsiz
+	  || (n >= 0 && i - entry >= n))
 	break;
       entp->d_fileno = (ino_t) (uintptr_t) d->dn;
       entp->d_type = DT_UNKNOWN;
@@ -138,6 +219,7 @@ diskfs_get_directs (struct node *dp, int entry, int n,
       memcpy (entp->d_name, d->name, d->namelen + 1);
       entp->d_reclen = rlen;
       entp = (void *) entp + rlen;
+      i++;
     }
 
   *datacnt = (char *) entp - *data;
@@ -149,7 +231,7 @@ diskfs_get_directs (struct node *dp, int entry, int n,
 
 struct dirstat
 {
-  struct tmpfs_dirent **prevp;
+  struct tmpfs_dirent *entry;	/* The entry found, if any.  */
   int dotdot;
 };
 const size_t diskfs_dirstat_size = sizeof (struct dirstat);
@@ -157,7 +239,7 @@ const size_t diskfs_dirstat_size = sizeof (struct dirstat);
 void
 diskfs_null_dirstat (struct dirstat *ds)
 {
-  ds->prevp = 0;
+  ds->entry = 0;
 }
 
 error_t
@@ -174,7 +256,8 @@ diskfs_lookup_hard (struct node *dp,
 		    struct protid *cred)
 {
   const size_t namelen = strlen (name);
-  struct tmpfs_dirent *d, **prevp;
+  struct tmpfs_dir *dir = dp->dn->u.dir.index;
+  struct tmpfs_dirent *d;
 
   if (type == REMOVE || type == RENAME)
     assert_backtrace (np);
@@ -225,21 +308,17 @@ diskfs_lookup_hard (struct node *dp,
 	}
     }
 
-  for (d = *(prevp = &dp->dn->u.dir.entries); d != 0;
-       d = *(prevp = &d->next))
-    if (d->namelen == namelen && !memcmp (d->name, name, namelen))
-      {
-	if (ds)
-	  ds->prevp = prevp;
-
-	if (np)
-	  return diskfs_cached_lookup ((ino_t) (uintptr_t) d->dn, np);
-	else
-	  return 0;
-      }
-
+  d = dir ? hurd_ihash_find (&dir->names, (hurd_ihash_key_t) name) : 0;
   if (ds)
-    ds->prevp = prevp;
+    ds->entry = d;
+  if (d)
+    {
+      if (np)
+	return diskfs_cached_lookup ((ino_t) (uintptr_t) d->dn, np);
+      else
+	return 0;
+    }
+
   if (np)
     *np = 0;
   return ENOENT;
@@ -254,21 +333,65 @@ diskfs_direnter_hard (struct node *dp, const char *name,
   const size_t namelen = strlen (name);
   const size_t entsize
 	  = (offsetof (struct dirent, d_name[1]) + namelen + 7) & ~7;
+  struct tmpfs_dir *dir = dp->dn->u.dir.index;
   struct tmpfs_dirent *new;
+  size_t cookie;
 
   if (round_page (tmpfs_space_used + entsize) / vm_page_size
       > tmpfs_page_limit)
     return ENOSPC;
 
+  if (dir == 0)
+    {
+      dir = calloc (1, sizeof *dir);
+      if (dir == 0)
+	return ENOSPC;
+      hurd_ihash_init (&dir->names, offsetof (struct tmpfs_dirent, locp));
+      hurd_ihash_set_gki (&dir->names, name_hash, name_compare);
+      dp->dn->u.dir.index = dir;
+    }
+
+  /* Forget the holes that were trimmed off the end, and make sure
+     there is a slot for the new entry.  */
+  while (dir->nholes > 0 && dir->holes[dir->nholes - 1] >= dir->nslots)
+    dir->nholes--;
+  if (dir->nholes == 0 && dir->nslots == dir->allocslots)
+    {
+      size_t n = dir->allocslots ? 2 * dir->allocslots : 16;
+      struct tmpfs_dirent **slots = realloc (dir->slots, n * sizeof *slots);
+      size_t *live;
+      if (slots == 0)
+	return ENOSPC;
+      dir->slots = slots;
+      live = realloc (dir->live, n * sizeof *live);
+      if (live == 0)
+	return ENOSPC;
+      dir->live = live;
+      dir->allocslots = n;
+      live_build (dir);
+    }
+
   new = malloc (offsetof (struct tmpfs_dirent, name) + namelen + 1);
   if (new == 0)
     return ENOSPC;
 
-  new->next = 0;
   new->dn = np->dn;
   new->namelen = namelen;
   memcpy (new->name, name, namelen + 1);
-  *ds->prevp = new;
+  if (hurd_ihash_add (&dir->names, (hurd_ihash_key_t) new->name, new))
+    {
+      free (new);
+      return ENOSPC;
+    }
+
+  if (dir->nholes > 0)
+    cookie = dir->holes[--dir->nholes];
+  else
+    cookie = dir->nslots++;
+  new->cookie = cookie;
+  dir->slots[cookie] = new;
+  live_add (dir, cookie, 1);
+  dir->nentries++;
 
   dp->dn_stat.st_size += entsize;
   adjust_used (entsize);
@@ -286,7 +409,7 @@ diskfs_dirrewrite_hard (struct node *dp, struct node *np,
   if (ds->dotdot)
     dp->dn->u.dir.dotdot = np->dn;
   else
-    (*ds->prevp)->dn = np->dn;
+    ds->entry->dn = np->dn;
 
   return 0;
 }
@@ -294,17 +417,48 @@ diskfs_dirrewrite_hard (struct node *dp, struct node *np,
 error_t
 diskfs_dirremove_hard (struct node *dp, struct dirstat *ds)
 {
-  struct tmpfs_dirent *d = *ds->prevp;
+  struct tmpfs_dir *dir = dp->dn->u.dir.index;
+  struct tmpfs_dirent *d = ds->entry;
   const size_t entsize
 	  = (offsetof (struct dirent, d_name[1]) + d->namelen + 7) & ~7;
 
-  *ds->prevp = d->next;
+  hurd_ihash_locp_remove (&dir->names, d->locp);
+  dir->slots[d->cookie] = 0;
+  live_add (dir, d->cookie, -1);
+  dir->nentries--;
+  if (d->cookie == dir->nslots - 1)
+    {
+      /* Trim the holes at the end.  Those of them in HOLES are
+	 dropped from there when they come up for reuse.  */
+      while (dir->nslots > 0 && dir->slots[dir->nslots - 1] == 0)
+	dir->nslots--;
+      if (dir->nslots == 0)
+	dir->nholes = 0;
+    }
+  else
+    {
+      if (dir->nholes == dir->allocholes)
+	{
+	  size_t n = dir->allocholes ? 2 * dir->allocholes : 16;
+	  size_t *holes = realloc (dir->holes, n * sizeof *holes);
+	  if (holes == 0)
+	    /* Just lose track of the hole.  */
+	    goto removed;
+	  dir->holes = holes;
+	  dir->allocholes = n;
+	}
+      dir->holes[dir->nholes++] = d->cookie;
+    }
+ removed:
 
   if (dp->dirmod_reqs != 0)
     diskfs_notice_dirchange (dp, DIR_CHANGED_UNLINK, d->name);
 
   free (d);
 
+  if (dir->nentries == 0)
+    tmpfs_dir_free (dp->dn);
+
   adjust_used (-entsize);
   dp->dn_stat.st_size -= entsize;
   dp->dn_stat.st_blocks = ((sizeof *dp->dn + dp->dn->translen
@@ -23,24 +23,45 @@
 #include <fcntl.h>
 #include <hurd/hurd_types.h>
 #include <hurd/store.h>
+#include <hurd/pager.h>
 #include "default_pager_U.h"
 #include "libdiskfs/fs_S.h"
 
 unsigned int num_files;
 static unsigned int gen;
 
-/* all_nodes is a list of all nodes.
+/* The in-core nodes are kept in NODE_SHARDS lists, the shard of a node
+   being chosen by the address of its disknode, so that instantiating
+   and releasing nodes in different shards don't contend.
 
-   Access to all_nodes and all_nodes_nr_items is protected by
-   all_nodes_lock.
+   Access to the list and the count of a shard is protected by the
+   lock of the shard.
 
-   Every node in all_nodes carries a light reference.  When we are
-   asked to give up that light reference, we reacquire our lock
+   Every node in a shard carries a light reference.  When we are
+   asked to give up that light reference, we reacquire the shard lock
    momentarily to check whether someone else reacquired a
    reference.  */
-struct node *all_nodes;
-static size_t all_nodes_nr_items;
-pthread_rwlock_t all_nodes_lock = PTHREAD_RWLOCK_INITIALIZER;
+#define NODE_SHARDS	64
+
+struct node_shard
+{
+  pthread_rwlock_t lock;
+  struct node *nodes;
+  size_t nr_items;
+};
+
+static struct node_shard node_shards[NODE_SHARDS] =
+{
+  [0 ... NODE_SHARDS - 1] = { .lock = PTHREAD_RWLOCK_INITIALIZER }
+};
+
+static inline struct node_shard *
+node_shard (const struct disknode *dn)
+{
+  /* Disknodes are allocated with malloc, so the low bits of their
+     addresses carry no information.  */
+  return &node_shards[((uintptr_t) dn >> 4) % NODE_SHARDS];
+}
 
 error_t
 diskfs_alloc_node (struct node *dp, mode_t mode, struct node **npp)
@@ -54,7 +75,6 @@ diskfs_alloc_node (struct node *dp, mode_t mode, struct node **npp)
   if (round_page (get_used () + sizeof *dn) / vm_page_size
       > tmpfs_page_limit)
     {
-      pthread_rwlock_unlock (&all_nodes_lock);
       free (dn);
       return ENOSPC;
     }
@@ -66,9 +86,144 @@ diskfs_alloc_node (struct node *dp, mode_t mode, struct node **npp)
   return diskfs_cached_lookup ((ino_t) (uintptr_t) dn, npp);
 }
 
+/* With --direct-data, io_read and io_write on a regular file copy
+   straight to and from memory of our own instead of through a window
+   on the file's memory object, which costs a round trip to the default
+   pager per window and a memory object per file.  Small files are kept
+   in a malloc'd buffer, larger ones in anonymous memory.  Once the file
+   is mapped (see diskfs_get_filemap), its contents move to a memory
+   object for good.  */
+int tmpfs_direct_data;
+
+/* Return nonzero if the contents of the regular file NP are (to be)
+   kept in its direct data rather than in a memory object.  */
+static int
+direct_data_p (struct node *np)
+{
+  struct disknode *dn = np->dn;
+  return (dn->u.reg.memobj == MACH_PORT_NULL
+	  && (dn->u.reg.data != 0
+	      || (tmpfs_direct_data && np->allocsize == 0)));
+}
+
+/* Release the direct data of NP, which has NP->allocsize bytes.  */
+static void
+free_direct_data (struct node *np)
+{
+  if (np->allocsize <= TMPFS_INLINE_MAX)
+    free (np->dn->u.reg.data);
+  else
+    vm_deallocate (mach_task_self (), (vm_address_t) np->dn->u.reg.data,
+		   np->allocsize);
+  np->dn->u.reg.data = 0;
+}
+
+/* Return the number of bytes to allocate for at least SIZE bytes of
+   direct data.  */
+static off_t
+direct_data_size (off_t size)
+{
+  off_t n;
+
+  if (size > TMPFS_INLINE_MAX)
+    return round_page (size);
+  for (n = 32; n < size; n *= 2)
+    ;
+  return n;
+}
+
+/* Grow the direct data of NP from NP->allocsize to SIZE bytes, as
+   returned by direct_data_size, and zero the new part.  */
+static error_t
+grow_direct_data (struct node *np, off_t size)
+{
+  struct disknode *dn = np->dn;
+  vm_address_t addr;
+
+  if (size <= TMPFS_INLINE_MAX)
+    {
+      char *new = realloc (dn->u.reg.data, size);
+      if (new == 0)
+	return ENOSPC;
+      memset (new + np->allocsize, 0, size - np->allocsize);
+      dn->u.reg.data = new;
+      return 0;
+    }
+
+  if (np->allocsize > TMPFS_INLINE_MAX)
+    {
+      /* Try to extend the anonymous memory in place.  */
+      addr = (vm_address_t) dn->u.reg.data + np->allocsize;
+      if (! vm_allocate (mach_task_self (), &addr, size - np->allocsize, 0))
+	return 0;
+    }
+
+  addr = 0;
+  if (vm_allocate (mach_task_self (), &addr, size, 1))
+    return ENOSPC;
+  if (np->allocsize > TMPFS_INLINE_MAX)
+    {
+      /* The kernel shares the pages until either copy is written.  */
+      if (vm_copy (mach_task_self (), (vm_address_t) dn->u.reg.data,
+		   np->allocsize, addr))
+	{
+	  vm_deallocate (mach_task_self (), addr, size);
+	  return ENOSPC;
+	}
+    }
+  else if (np->allocsize > 0)
+    memcpy ((char *) addr, dn->u.reg.data, np->allocsize);
+  free_direct_data (np);
+  dn->u.reg.data = (char *) addr;
+  return 0;
+}
+
+/* Drop the direct data of NP past SIZE bytes, which is less than
+   NP->allocsize, and return the number of bytes left allocated.  */
+static off_t
+truncate_direct_data (struct node *np, off_t size)
+{
+  char *data = np->dn->u.reg.data;
+  off_t keep;
+
+  if (size == 0)
+    {
+      free_direct_data (np);
+      return 0;
+    }
+
+  keep = np->allocsize <= TMPFS_INLINE_MAX ? np->allocsize : round_page (size);
+  /* Growing the file again must reveal zeros.  */
+  memset (data + size, 0, keep - size);
+  if (keep < np->allocsize)
+    vm_deallocate (mach_task_self (), (vm_address_t) data + keep,
+		   np->allocsize - keep);
+  return keep;
+}
+
+/* Copy LEN bytes from SRC to DST, letting the kernel copy whole pages
+   on write if both are page aligned.  */
+static void
+copy_direct_data (char *dst, const char *src, size_t len)
+{
+  size_t pages = trunc_page (len);
+
+  if (pages > 0 && ((uintptr_t) dst | (uintptr_t) src) % vm_page_size == 0
+      && ! vm_copy (mach_task_self (), (vm_address_t) src, pages,
+		    (vm_address_t) dst))
+    {
+      dst += pages;
+      src += pages;
+      len -= pages;
+    }
+  memcpy (dst, src, len);
+}
+
 void
 diskfs_free_node (struct node *np, mode_t mode)
 {
+  struct node_shard *shard = node_shard (np->dn);
+
   switch (np->dn->type)
     {
     case DT_REG:
@@ -76,21 +231,23 @@ diskfs_free_node (struct node *np, mode_t mode)
 	vm_deallocate (mach_task_self (), np->dn->u.reg.memref, 4096);
 	mach_port_deallocate (mach_task_self (), np->dn->u.reg.memobj);
       }	
+      if (np->dn->u.reg.data != 0)
+	free_direct_data (np);
       break;
     case DT_DIR:
-      assert_backtrace (np->dn->u.dir.entries == 0);
+      tmpfs_dir_free (np->dn);
       break;
     case DT_LNK:
       free (np->dn->u.lnk);
       break;
     }
 
-  pthread_rwlock_wrlock (&all_nodes_lock);
+  pthread_rwlock_wrlock (&shard->lock);
   *np->dn->hprevp = np->dn->hnext;
   if (np->dn->hnext != 0)
     np->dn->hnext->dn->hprevp = np->dn->hprevp;
-  all_nodes_nr_items -= 1;
-  pthread_rwlock_unlock (&all_nodes_lock);
+  shard->nr_items -= 1;
+  pthread_rwlock_unlock (&shard->lock);
 
   free (np->dn);
   np->dn = 0;
@@ -122,8 +279,7 @@ diskfs_node_norefs (struct node *np)
       switch (np->dn->type)
 	{
 	case DT_REG:
-	  assert_backtrace (np->allocsize % vm_page_size == 0);
-	  np->dn->u.reg.allocpages = np->allocsize / vm_page_size;
+	  np->dn->u.reg.allocsize = np->allocsize;
 	  break;
 	case DT_CHR:
 	case DT_BLK:
@@ -145,7 +301,6 @@ recompute_blocks (struct node *np)
   switch (dn->type)
     {
     case DT_REG:
-      np->allocsize = dn->u.reg.allocpages * vm_page_size;
       st->st_blocks += np->allocsize;
       break;
     case DT_LNK:
@@ -168,23 +323,24 @@ error_t
 diskfs_cached_lookup (ino_t inum, struct node **npp)
 {
   struct disknode *dn = (void *) (uintptr_t) inum;
+  struct node_shard *shard = node_shard (dn);
   struct node *np;
 
   assert_backtrace (npp);
 
-  pthread_rwlock_rdlock (&all_nodes_lock);
+  pthread_rwlock_rdlock (&shard->lock);
   if (dn->hprevp != 0)		/* There is already a node.  */
     goto gotit;
   else
     /* Create the new node.  */
     {
       struct stat *st;
-      pthread_rwlock_unlock (&all_nodes_lock);
+      pthread_rwlock_unlock (&shard->lock);
 
       np = diskfs_make_node (dn);
       np->cache_id = (ino_t) (uintptr_t) dn;
 
-      pthread_rwlock_wrlock (&all_nodes_lock);
+      pthread_rwlock_wrlock (&shard->lock);
       if (dn->hprevp != NULL)
         {
           /* We lost a race.  */
@@ -192,14 +348,14 @@ diskfs_cached_lookup (ino_t inum, struct node **npp)
           goto gotit;
         }
 
-      dn->hnext = all_nodes;
+      dn->hnext = shard->nodes;
       if (dn->hnext)
 	dn->hnext->dn->hprevp = &dn->hnext;
-      dn->hprevp = &all_nodes;
-      all_nodes = np;
-      all_nodes_nr_items += 1;
+      dn->hprevp = &shard->nodes;
+      shard->nodes = np;
+      shard->nr_items += 1;
       diskfs_nref_light (np);
-      pthread_rwlock_unlock (&all_nodes_lock);
+      pthread_rwlock_unlock (&shard->lock);
 
       st = &np->dn_stat;
       memset (st, 0, sizeof *st);
@@ -222,7 +378,7 @@ diskfs_cached_lookup (ino_t inum, struct node **npp)
       st->st_flags = dn->flags;
 
       st->st_rdev = 0;
-      np->allocsize = 0;
+      np->allocsize = dn->type == DT_REG ? dn->u.reg.allocsize : 0;
       recompute_blocks (np);
     }
 
@@ -235,55 +391,78 @@ diskfs_cached_lookup (ino_t inum, struct node **npp)
   assert_backtrace (np->dn == dn);
   assert_backtrace (*dn->hprevp == np);
   diskfs_nref (np);
-  pthread_rwlock_unlock (&all_nodes_lock);
+  pthread_rwlock_unlock (&shard->lock);
   pthread_mutex_lock (&np->lock);
   *npp = np;
   return 0;
 }
 
+/* Call FUN on every node, one shard at a time: only the nodes of one
+   shard are held at once, and a shard is locked only while we take
+   references to its nodes, so nodes are instantiated and released in
+   the meantime.  */
 error_t
 diskfs_node_iterate (error_t (*fun) (struct node *))
 {
   error_t err = 0;
-  size_t num_nodes;
-  struct node *node, **node_list, **p;
+  size_t num_nodes, alloc_nodes = 0;
+  struct node *node, **node_list = 0, **p;
+  int i;
 
-  pthread_rwlock_rdlock (&all_nodes_lock);
+  for (i = 0; i < NODE_SHARDS && !err; i++)
+    {
+      struct node_shard *shard = &node_shards[i];
 
-  /* We must copy everything from the hash table into another data structure
-     to avoid running into any problems with the hash-table being modified
-     during processing (normally we delegate access to hash-table with
-     all_nodes_lock, but we can't hold this while locking the
-     individual node locks).  */
+      pthread_rwlock_rdlock (&shard->lock);
 
-  num_nodes = all_nodes_nr_items;
+      /* We must copy the shard into another data structure to avoid
+	 running into any problems with it being modified during
+	 processing (normally we delegate access to the shard with its
+	 lock, but we can't hold this while locking the individual node
+	 locks).  */
 
-  p = node_list = alloca (num_nodes * sizeof (struct node *));
-  for (node = all_nodes; node != 0; node = node->dn->hnext)
-    {
-      *p++ = node;
+      num_nodes = shard->nr_items;
+      if (num_nodes > alloc_nodes)
+	{
+	  pthread_rwlock_unlock (&shard->lock);
+	  free (node_list);
+	  alloc_nodes = 2 * num_nodes;
+	  node_list = malloc (alloc_nodes * sizeof (struct node *));
+	  if (node_list == 0)
+	    return ENOMEM;
+	  /* The shard may have grown while it was unlocked.  */
+	  i--;
+	  continue;
+	}
 
-      /* We acquire a hard reference for node, but without using
-	 diskfs_nref.  We do this so that diskfs_new_hardrefs will not
-	 get called.  */
-      refcounts_ref (&node->refcounts, NULL);
-    }
+      p = node_list;
+      for (node = shard->nodes; node != 0; node = node->dn->hnext)
+	{
+	  *p++ = node;
 
-  pthread_rwlock_unlock (&all_nodes_lock);
+	  /* We acquire a hard reference for node, but without using
+	     diskfs_nref.  We do this so that diskfs_new_hardrefs will not
+	     get called.  */
+	  refcounts_ref (&node->refcounts, NULL);
+	}
 
-  p = node_list;
-  while (num_nodes-- > 0)
-    {
-      node = *p++;
-      if (!err)
+      pthread_rwlock_unlock (&shard->lock);
+
+      p = node_list;
+      while (num_nodes-- > 0)
 	{
-	  pthread_mutex_lock (&node->lock);
-	  err = (*fun) (node);
-	  pthread_mutex_unlock (&node->lock);
+	  node = *p++;
+	  if (!err)
+	    {
+	      pthread_mutex_lock (&node->lock);
+	      err = (*fun) (node);
+	      pthread_mutex_unlock (&node->lock);
+	    }
+	  diskfs_nrele (node);
 	}
-      diskfs_nrele (node);
     }
 
+  free (node_list);
   return err;
 }
 
@@ -295,7 +474,9 @@ diskfs_node_iterate (error_t (*fun) (struct node *))
 void
 diskfs_try_dropping_softrefs (struct node *np)
 {
-  pthread_rwlock_wrlock (&all_nodes_lock);
+  struct node_shard *shard = node_shard (np->dn);
+
+  pthread_rwlock_wrlock (&shard->lock);
   if (np->cache_id != 0)
     {
       /* Check if someone reacquired a reference.  */
@@ -306,16 +487,16 @@ diskfs_try_dropping_softrefs (struct node *np)
 	{
 	  /* A reference was reacquired.  It's fine, we didn't touch
 	     anything yet. */
-	  pthread_rwlock_unlock (&all_nodes_lock);
+	  pthread_rwlock_unlock (&shard->lock);
 	  return;
 	}
 
       /* Just let go of the weak reference.  The node will be removed
-	 from all_nodes in diskfs_free_node.  */
+	 from its shard in diskfs_free_node.  */
       np->cache_id = 0;
       diskfs_nrele_light (np);
     }
-  pthread_rwlock_unlock (&all_nodes_lock);
+  pthread_rwlock_unlock (&shard->lock);
 }
 
 /* The user must define this funcction.  Node NP has some light
@@ -406,6 +587,25 @@ read_symlink_hook (struct node *np, char *target)
 error_t (*diskfs_read_symlink_hook)(struct node *np, char *target)
      = read_symlink_hook;
 
+static error_t
+rdwr_hook (struct node *np, char *data, off_t offset, size_t *amt, int dir)
+{
+  char *contents;
+
+  if (np->dn->type != DT_REG || ! direct_data_p (np))
+    return EINVAL;
+
+  assert_backtrace (offset + *amt <= np->allocsize);
+  contents = np->dn->u.reg.data + offset;
+  if (dir)
+    copy_direct_data (contents, data, *amt);
+  else
+    copy_direct_data (data, contents, *amt);
+  return 0;
+}
+error_t (*diskfs_rdwr_hook)(struct node *np, char *data, off_t offset,
+			    size_t *amt, int dir) = rdwr_hook;
+
 void
 diskfs_write_disknode (struct node *np, int wait)
 {
@@ -446,7 +646,8 @@ diskfs_truncate (struct node *np, off_t size)
 
   assert_backtrace (np->dn->type == DT_REG);
 
-  if (default_pager == MACH_PORT_NULL)
+  int direct = direct_data_p (np);
+  if (! direct && default_pager == MACH_PORT_NULL)
     return EIO;
 
   np->dn_stat.st_size = size;
@@ -454,7 +655,9 @@ diskfs_truncate (struct node *np, off_t size)
   off_t set_size = size;
   size = round_page (size);
 
-  if (np->dn->u.reg.memobj != MACH_PORT_NULL)
+  if (direct)
+    size = truncate_direct_data (np, set_size);
+  else if (np->dn->u.reg.memobj != MACH_PORT_NULL)
     {
       error_t err = default_pager_object_set_size (np->dn->u.reg.memobj, set_size);
       if (err == MIG_BAD_ID)
@@ -471,8 +674,8 @@ diskfs_truncate (struct node *np, off_t size)
   /* Otherwise it never had any real contents.  */
 
   adjust_used (size - np->allocsize);
-  np->dn_stat.st_blocks += (size - np->allocsize) / 512;
   np->allocsize = size;
+  recompute_blocks (np);
 
   return 0;
 }
@@ -490,15 +693,21 @@ diskfs_grow (struct node *np, off_t size, struct protid *cred)
     return 0;
 
   off_t set_size = size;
-  size = round_page (size);
+  int direct = direct_data_p (np);
+  size = direct ? direct_data_size (size) : round_page (size);
   if (round_page (get_used () + size - np->allocsize)
       / vm_page_size > tmpfs_page_limit)
     return ENOSPC;
 
-  if (default_pager == MACH_PORT_NULL)
+  if (direct)
+    {
+      error_t err = grow_direct_data (np, size);
+      if (err)
+	return err;
+    }
+  else if (default_pager == MACH_PORT_NULL)
     return EIO;
-
-  if (np->dn->u.reg.memobj != MACH_PORT_NULL)
+  else if (np->dn->u.reg.memobj != MACH_PORT_NULL)
     {
       /* Increase the limit the memory object will allow to be accessed.  */
       error_t err = default_pager_object_set_size (np->dn->u.reg.memobj, set_size);
@@ -509,8 +718,8 @@ diskfs_grow (struct node *np, off_t size, struct protid *cred)
     }
 
   adjust_used (size - np->allocsize);
-  np->dn_stat.st_blocks += (size - np->allocsize) / 512;
   np->allocsize = size;
+  recompute_blocks (np);
   return 0;
 }
 
@@ -542,7 +751,7 @@ diskfs_get_filemap (struct node *np, vm_prot_t prot)
     {
       error_t err = default_pager_object_create (default_pager,
 						 &np->dn->u.reg.memobj,
-						 np->allocsize);
+						 round_page (np->allocsize));
       if (err)
 	{
 	  errno = err;
@@ -557,6 +766,27 @@ diskfs_get_filemap (struct node *np, vm_prot_t prot)
 	      np->dn->u.reg.memobj, 0, 0, VM_PROT_NONE, VM_PROT_NONE,
 	      VM_INHERIT_NONE);
       assert_perror_backtrace (err);
+
+      if (np->dn->u.reg.data != 0)
+	{
+	  /* From now on the contents live in the memory object.  */
+	  size_t len = np->dn_stat.st_size;
+
+	  err = pager_memcpy (0, np->dn->u.reg.memobj, 0,
+			      np->dn->u.reg.data, &len, VM_PROT_WRITE);
+	  if (err)
+	    {
+	      vm_deallocate (mach_task_self (), np->dn->u.reg.memref, 4096);
+	      mach_port_deallocate (mach_task_self (), np->dn->u.reg.memobj);
+	      np->dn->u.reg.memobj = MACH_PORT_NULL;
+	      errno = err;
+	      return MACH_PORT_NULL;
+	    }
+	  free_direct_data (np);
+	  adjust_used (round_page (np->allocsize) - np->allocsize);
+	  np->allocsize = round_page (np->allocsize);
+	  recompute_blocks (np);
+	}
     }
 
   /* XXX always writable */
@@ -99,11 +99,17 @@ diskfs_reload_global_state ()
 int diskfs_synchronous = 0;
 
 #define OPT_SIZE 600	/* --size */
+#define OPT_DIRECT_DATA 601	/* --direct-data */
+#define OPT_NO_DIRECT_DATA 602	/* --no-direct-data */
 
 static const struct argp_option options[] =
 {
   {"mode", 'm', "MODE", 0, "Permissions (octal) for root directory"},
   {"size", OPT_SIZE, "MAX-BYTES", 0, "Maximum size"},
+  {"direct-data", OPT_DIRECT_DATA, 0, 0,
+   "Keep the contents of files in our own memory until they are mapped"},
+  {"no-direct-data", OPT_NO_DIRECT_DATA, 0, 0,
+   "Keep the contents of new files in default pager objects (default)"},
   {NULL,}
 };
 
@@ -111,6 +117,7 @@ struct option_values
 {
   off_t size;
   mode_t mode;
+  int direct_data;
 };
 
 /* Parse the size string ARG, and set *NEWSIZE with the resulting size.  */
@@ -191,6 +198,7 @@ parse_opt (int key, char *arg, struct argp_state *state)
       state->hook = values;
       values->size = -1;
       values->mode = -1;
+      values->direct_data = -1;
       break;
     case ARGP_KEY_FINI:
       free (values);
@@ -223,6 +231,13 @@ parse_opt (int key, char *arg, struct argp_state *state)
       }
       break;
 
+    case OPT_DIRECT_DATA:
+      values->direct_data = 1;
+      break;
+    case OPT_NO_DIRECT_DATA:
+      values->direct_data = 0;
+      break;
+
     case ARGP_KEY_NO_ARGS:
       if (values->size < 0)
 	{
@@ -258,6 +273,8 @@ parse_opt (int key, char *arg, struct argp_state *state)
       /* All options parse successfully, so implement ours if possible.  */
       tmpfs_page_limit = values->size / vm_page_size;
       tmpfs_root_mode = values->mode;
+      if (values->direct_data != -1)
+	tmpfs_direct_data = values->direct_data;
       break;
 
     default:
@@ -286,6 +303,9 @@ diskfs_append_args (char **argz, size_t *argz_len)
       err = argz_add (argz, argz_len, buf);
     }
 
+  if (!err && tmpfs_direct_data)
+    err = argz_add (argz, argz_len, "--direct-data");
+
   return err;
 }
 
@@ -21,6 +21,7 @@ the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.  */
 #define _tmpfs_h 1
 
 #include <hurd/diskfs.h>
+#include <hurd/ihash.h>
 #include <sys/types.h>
 #include <dirent.h>
 #include <stdint.h>
@@ -48,11 +49,16 @@ struct disknode
     {
       mach_port_t memobj;
       vm_address_t memref;
-      unsigned int allocpages;	/* largest size while memobj was live */
+      off_t allocsize;		/* largest size while memobj was live */
+      /* With --direct-data the contents are kept here until the file
+	 is mapped, instead of in MEMOBJ: in a malloc'd buffer of
+	 ALLOCSIZE bytes while that is at most TMPFS_INLINE_MAX, else in
+	 anonymous memory of our own.  */
+      char *data;
     } reg;
     struct
     {
-      struct tmpfs_dirent *entries;
+      struct tmpfs_dir *index;	/* NULL while the directory is empty */
       struct disknode *dotdot;
     } dir;
     dev_t chr, blk;
@@ -63,13 +69,38 @@ struct disknode
 
 struct tmpfs_dirent
 {
-  struct tmpfs_dirent *next;
+  hurd_ihash_locp_t locp;	/* in tmpfs_dir.names */
+  size_t cookie;		/* index in tmpfs_dir.slots */
   struct disknode *dn;
   uint8_t namelen;
   char name[0];
 };
 
+/* The entries of a directory, hashed by name for lookup, and in an
+   array for readdir.  An entry keeps its index in the array (its
+   cookie) for as long as it exists.  Removing an entry leaves a hole,
+   which is reused by a later entry.  Readdir numbers the entries
+   densely in cookie order, and LIVE, a Fenwick tree counting the
+   entries in the slots, finds the slot of entry N in O(log n).  */
+struct tmpfs_dir
+{
+  struct hurd_ihash names;
+  struct tmpfs_dirent **slots;
+  size_t nslots, allocslots;	/* ALLOCSLOTS is zero or a power of 2 */
+  size_t *live;			/* ALLOCSLOTS long */
+  size_t *holes;		/* indices of the NULL slots, as a stack */
+  size_t nholes, allocholes;
+  size_t nentries;
+};
+
+void tmpfs_dir_free (struct disknode *dn);
+
+/* Files of at most this many bytes keep their direct data in a malloc'd
+   buffer rather than in whole pages.  */
+#define TMPFS_INLINE_MAX 1024
+
 extern off_t tmpfs_page_limit;
+extern int tmpfs_direct_data;
 extern mach_port_t default_pager;
 
 /* These two must be accessed using atomic operations.  */
@@ -28,6 +28,7 @@
 #include <pthread.h>
 #include <hurd/ihash.h>
 #include <hurd/paths.h>
+#include <maptime.h>
 
 #include <version.h>
 
@@ -45,6 +46,17 @@ int netfs_maxsymlinks = 16;	/* arbitrary */
 
 static auth_t fakeroot_auth_port;
 
+/* How long the attributes of the underlying files are cached, in
+   milliseconds.  */
+static int attr_timeout = 1000;
+
+/* Bumped whenever a directory changes, which may change the link
+   count and times of other nodes than those we know about.  The
+   cached attributes of older generations are discarded.  */
+static unsigned long attr_generation;
+
+static volatile struct mapped_time_value *fakeroot_mtime;
+
 struct netnode
 {
   hurd_ihash_locp_t idport_locp;/* easy removal pointer in idport ihash */
@@ -53,6 +65,13 @@ struct netnode
   file_t file;			/* port on real file */
 
   unsigned int faked;
+
+  /* The last result of io_stat on FILE, if ATTR_VALID, fetched at
+     ATTR_TIME during ATTR_GENERATION.  */
+  struct stat attr;
+  struct timeval attr_time;
+  unsigned long attr_generation;
+  int attr_valid;
 };
 
 #define FAKE_UID	(1 << 0)
@@ -61,10 +80,54 @@ struct netnode
 #define FAKE_MODE	(1 << 3)
 #define FAKE_DEFAULT	(1 << 4)
 
-pthread_mutex_t idport_ihash_lock = PTHREAD_MUTEX_INITIALIZER;
-struct hurd_ihash idport_ihash
-= HURD_IHASH_INITIALIZER (sizeof (struct node)
-			  + offsetof (struct netnode, idport_locp));
+/* The nodes by identity port.  The table is split in stripes with a
+   lock each, so that lookups of different files do not contend.  */
+#define IDPORT_STRIPES	64
+
+struct idport_stripe
+{
+  pthread_mutex_t lock;
+  struct hurd_ihash ihash;
+} idport_stripes[IDPORT_STRIPES];
+
+static void
+init_idport_stripes (void)
+{
+  int i;
+
+  for (i = 0; i < IDPORT_STRIPES; i++)
+    {
+      pthread_mutex_init (&idport_stripes[i].lock, NULL);
+      hurd_ihash_init (&idport_stripes[i].ihash,
+		       sizeof (struct node)
+		       + offsetof (struct netnode, idport_locp));
+    }
+}
+
+/* Return the stripe of the table IDPORT goes in.  */
+static inline struct idport_stripe *
+idport_stripe (mach_port_t idport)
+{
+  return &idport_stripes[((unsigned) idport * 2654435761U >> 16)
+			 % IDPORT_STRIPES];
+}
+
+/* The underlying file of NP may have changed; forget its attributes.
+   NP is locked.  */
+static void
+attr_invalidate (struct node *np)
+{
+  netfs_node_netnode (np)->attr_valid = 0;
+}
+
+/* A directory has changed; forget the attributes of all nodes.  Call
+   this after the change, so that attributes fetched while it was in
+   progress are forgotten too.  */
+static void
+attr_invalidate_all (void)
+{
+  __atomic_add_fetch (&attr_generation, 1, __ATOMIC_RELEASE);
+}
 
 
 /* Make a new virtual node.  Always consumes the ports.  If
@@ -75,6 +138,7 @@ new_node (file_t file, mach_port_t idport, int locked, int openmodes,
 {
   error_t err;
   struct netnode *nn;
+  struct idport_stripe *stripe;
 
   assert_backtrace ((openmodes & ~(O_RDWR|O_EXEC)) == 0);
 
@@ -82,10 +146,10 @@ new_node (file_t file, mach_port_t idport, int locked, int openmodes,
   if (*np == 0)
     {
       mach_port_deallocate (mach_task_self (), file);
+      if (locked)
+	pthread_mutex_unlock (&idport_stripe (idport)->lock);
       if (idport != MACH_PORT_NULL)
 	mach_port_deallocate (mach_task_self (), idport);
-      if (locked)
-	pthread_mutex_unlock (&idport_ihash_lock);
       return ENOMEM;
     }
   nn = netfs_node_netnode (*np);
@@ -107,22 +171,24 @@ new_node (file_t file, mach_port_t idport, int locked, int openmodes,
 	}
     }
   nn->faked = FAKE_DEFAULT;
+  nn->attr_valid = 0;
 
   /* The light reference allows us to safely keep the node in the
      hash table.  */
   netfs_nref_light (*np);
+  stripe = idport_stripe (nn->idport);
   if (!locked)
-    pthread_mutex_lock (&idport_ihash_lock);
-  err = hurd_ihash_add (&idport_ihash, nn->idport, *np);
+    pthread_mutex_lock (&stripe->lock);
+  err = hurd_ihash_add (&stripe->ihash, nn->idport, *np);
   if (err)
     goto lose;
 
   pthread_mutex_lock (&(*np)->lock);
-  pthread_mutex_unlock (&idport_ihash_lock);
+  pthread_mutex_unlock (&stripe->lock);
   return 0;
 
  lose:
-  pthread_mutex_unlock (&idport_ihash_lock);
+  pthread_mutex_unlock (&stripe->lock);
   mach_port_deallocate (mach_task_self (), nn->idport);
   mach_port_deallocate (mach_task_self (), file);
   free (*np);
@@ -161,12 +227,14 @@ set_faked_attribute (struct node *np, unsigned int faked)
 void
 netfs_try_dropping_softrefs (struct node *np)
 {
+  struct idport_stripe *stripe = idport_stripe (netfs_node_netnode (np)->idport);
+
   /* We have to drop our light reference by removing the node from the
-     idport_ihash hash table.  */
-  pthread_mutex_lock (&idport_ihash_lock);
+     idport hash table.  */
+  pthread_mutex_lock (&stripe->lock);
 
-  hurd_ihash_locp_remove (&idport_ihash, netfs_node_netnode (np)->idport_locp);
-  pthread_mutex_unlock (&idport_ihash_lock);
+  hurd_ihash_locp_remove (&stripe->ihash, netfs_node_netnode (np)->idport_locp);
+  pthread_mutex_unlock (&stripe->lock);
 
   netfs_nrele_light (np);
 }
@@ -177,7 +245,7 @@ netfs_node_norefs (struct node *np)
 {
   pthread_mutex_unlock (&np->lock);
 
-  /* NP was already removed from idport_ihash through
+  /* NP was already removed from the idport hash table through
      netfs_try_dropping_softrefs.  */
 
   mach_port_deallocate (mach_task_self (), netfs_node_netnode (np)->file);
@@ -296,6 +364,7 @@ netfs_S_dir_lookup (struct protid *diruser,
   mach_port_t file;
   mach_port_t idport, fsidport;
   ino_t fileno;
+  struct idport_stripe *stripe;
 
   if (!diruser)
     return EOPNOTSUPP;
@@ -317,6 +386,10 @@ netfs_S_dir_lookup (struct protid *diruser,
   if (err)
     return err;
 
+  /* We do not know whether a file was created.  */
+  if (flags & O_CREAT)
+    attr_invalidate_all ();
+
   /* See glibc's lookup-retry.c about O_NOFOLLOW.  */
   if (flags & O_NOFOLLOW
       && (*do_retry == FS_RETRY_NORMAL && *retry_name == 0))
@@ -430,10 +503,11 @@ netfs_S_dir_lookup (struct protid *diruser,
 
   mach_port_deallocate (mach_task_self (), fsidport);
 
+  stripe = idport_stripe (idport);
  redo_hash_lookup:
-  pthread_mutex_lock (&idport_ihash_lock);
+  pthread_mutex_lock (&stripe->lock);
   pthread_mutex_lock (&dnp->lock);
-  np = hurd_ihash_find (&idport_ihash, idport);
+  np = hurd_ihash_find (&stripe->ihash, idport);
   if (np != NULL)
     {
       /* We quickly check that NP has hard references. If the node is being
@@ -448,7 +522,7 @@ netfs_S_dir_lookup (struct protid *diruser,
 	  /* If so, unlock the hash table to give the node a chance to actually
 	     be removed and retry.  */
 	  pthread_mutex_unlock (&dnp->lock);
-	  pthread_mutex_unlock (&idport_ihash_lock);
+	  pthread_mutex_unlock (&stripe->lock);
 	  goto redo_hash_lookup;
 	}
 
@@ -469,7 +543,7 @@ netfs_S_dir_lookup (struct protid *diruser,
 
       err = check_openmodes (netfs_node_netnode (np),
 			     (flags & (O_RDWR|O_EXEC)), file);
-      pthread_mutex_unlock (&idport_ihash_lock);
+      pthread_mutex_unlock (&stripe->lock);
     }
   else
     {
@@ -518,6 +592,7 @@ error_t
 netfs_set_translator (struct iouser *cred, struct node *np,
 		      char *argz, size_t argzlen)
 {
+  attr_invalidate (np);
   return file_set_translator (netfs_node_netnode (np)->file,
 			      FS_TRANS_EXCL|FS_TRANS_SET,
 			      FS_TRANS_EXCL|FS_TRANS_SET, 0,
@@ -548,10 +623,31 @@ netfs_attempt_create_file (struct iouser *user, struct node *dir,
 error_t
 netfs_validate_stat (struct node *np, struct iouser *cred)
 {
+  struct netnode *nn = netfs_node_netnode (np);
+  unsigned long generation;
+  struct timeval now;
   struct stat st;
-  error_t err = io_stat (netfs_node_netnode (np)->file, &st);
-  if (err)
-    return err;
+  error_t err;
+
+  /* The attributes of the underlying file are cached for a short time
+     before any faked ones are applied, so that they stay current.  */
+  generation = __atomic_load_n (&attr_generation, __ATOMIC_ACQUIRE);
+  maptime_read (fakeroot_mtime, &now);
+  if (nn->attr_valid && nn->attr_generation == generation
+      && ((now.tv_sec - nn->attr_time.tv_sec) * 1000
+	  + (now.tv_usec - nn->attr_time.tv_usec) / 1000) < attr_timeout)
+    st = nn->attr;
+  else
+    {
+      err = io_stat (nn->file, &st);
+      if (err)
+	return err;
+
+      nn->attr = st;
+      nn->attr_time = now;
+      nn->attr_generation = generation;
+      nn->attr_valid = 1;
+    }
 
   if (netfs_node_netnode (np)->faked & FAKE_UID)
     st.st_uid = np->nn_stat.st_uid;
@@ -631,6 +727,7 @@ netfs_attempt_chmod (struct iouser *cred, struct node *np, mode_t mode)
   /* We don't bother with error checking since the fake mode change should
      always succeed--worst case a later open will get EACCES.  */
   (void) file_chmod (nn->file, real_mode);
+  attr_invalidate (np);
   set_faked_attribute (np, FAKE_MODE);
   np->nn_stat.st_mode = mode;
   return 0;
@@ -645,6 +742,7 @@ netfs_attempt_mksymlink (struct iouser *cred, struct node *np, char *name)
   char trans[sizeof _HURD_SYMLINK + namelen];
   memcpy (trans, _HURD_SYMLINK, sizeof _HURD_SYMLINK);
   memcpy (&trans[sizeof _HURD_SYMLINK], name, namelen);
+  attr_invalidate (np);
   return file_set_translator (netfs_node_netnode (np)->file,
 			      FS_TRANS_EXCL|FS_TRANS_SET,
 			      FS_TRANS_EXCL|FS_TRANS_SET, 0,
@@ -664,12 +762,15 @@ netfs_attempt_mkdev (struct iouser *cred, struct node *np,
     return ENOMEM;
   else
     {
-      error_t err = file_set_translator (netfs_node_netnode (np)->file,
-					 FS_TRANS_EXCL|FS_TRANS_SET,
-					 FS_TRANS_EXCL|FS_TRANS_SET, 0,
-					 trans, translen + 1,
-					 MACH_PORT_NULL,
-					 MACH_MSG_TYPE_COPY_SEND);
+      error_t err;
+
+      attr_invalidate (np);
+      err = file_set_translator (netfs_node_netnode (np)->file,
+				 FS_TRANS_EXCL|FS_TRANS_SET,
+				 FS_TRANS_EXCL|FS_TRANS_SET, 0,
+				 trans, translen + 1,
+				 MACH_PORT_NULL,
+				 MACH_MSG_TYPE_COPY_SEND);
       free (trans);
       return err;
     }
@@ -678,6 +779,7 @@ netfs_attempt_mkdev (struct iouser *cred, struct node *np,
 error_t
 netfs_attempt_chflags (struct iouser *cred, struct node *np, int flags)
 {
+  attr_invalidate (np);
   return file_chflags (netfs_node_netnode (np)->file, flags);
 }
 
@@ -725,12 +827,14 @@ netfs_attempt_utimes (struct iouser *cred, struct node *np,
       err = file_utimes (netfs_node_netnode (np)->file, atim, mtim);
     }
 
+  attr_invalidate (np);
   return err;
 }
 
 error_t
 netfs_attempt_set_size (struct iouser *cred, struct node *np, off_t size)
 {
+  attr_invalidate (np);
   return file_set_size (netfs_node_netnode (np)->file, size);
 }
 
@@ -756,7 +860,10 @@ error_t
 netfs_attempt_mkdir (struct iouser *user, struct node *dir,
 		     char *name, mode_t mode)
 {
-  return dir_mkdir (netfs_node_netnode (dir)->file, name, mode | S_IRWXU);
+  error_t err = dir_mkdir (netfs_node_netnode (dir)->file, name,
+			   mode | S_IRWXU);
+  attr_invalidate_all ();
+  return err;
 }
 
 
@@ -768,7 +875,9 @@ netfs_attempt_mkdir (struct iouser *user, struct node *dir,
 error_t
 netfs_attempt_unlink (struct iouser *user, struct node *dir, char *name)
 {
-  return dir_unlink (netfs_node_netnode (dir)->file, name);
+  error_t err = dir_unlink (netfs_node_netnode (dir)->file, name);
+  attr_invalidate_all ();
+  return err;
 }
 
 error_t
@@ -776,22 +885,29 @@ netfs_attempt_rename (struct iouser *user, struct node *fromdir,
 		      char *fromname, struct node *todir,
 		      char *toname, int excl)
 {
-  return dir_rename (netfs_node_netnode (fromdir)->file, fromname,
-		     netfs_node_netnode (todir)->file, toname, excl);
+  error_t err = dir_rename (netfs_node_netnode (fromdir)->file, fromname,
+			    netfs_node_netnode (todir)->file, toname, excl);
+  attr_invalidate_all ();
+  return err;
 }
 
 error_t
 netfs_attempt_rmdir (struct iouser *user,
 		     struct node *dir, char *name)
 {
-  return dir_rmdir (netfs_node_netnode (dir)->file, name);
+  error_t err = dir_rmdir (netfs_node_netnode (dir)->file, name);
+  attr_invalidate_all ();
+  return err;
 }
 
 error_t
 netfs_attempt_link (struct iouser *user, struct node *dir,
 		    struct node *file, char *name, int excl)
 {
-  return dir_link (netfs_node_netnode (dir)->file, netfs_node_netnode (file)->file, name, excl);
+  error_t err = dir_link (netfs_node_netnode (dir)->file,
+			  netfs_node_netnode (file)->file, name, excl);
+  attr_invalidate_all ();
+  return err;
 }
 
 error_t
@@ -862,6 +978,7 @@ error_t
 netfs_attempt_write (struct iouser *cred, struct node *np,
 		     off_t offset, size_t *len, void *data)
 {
+  attr_invalidate (np);
   return io_write (netfs_node_netnode (np)->file, data, *len, offset, len);
 }
 
@@ -1168,6 +1285,12 @@ netfs_demuxer (mach_msg_header_t *inp,
 			      MACH_MSGH_BITS_REMOTE (inp->msgh_bits));
 	  inp->msgh_local_port = inp->msgh_remote_port;	/* reply port */
 	  inp->msgh_remote_port = netfs_node_netnode (cred->po->np)->file;
+
+	  /* We cannot tell what the message does to the file.  */
+	  pthread_mutex_lock (&cred->po->np->lock);
+	  attr_invalidate (cred->po->np);
+	  pthread_mutex_unlock (&cred->po->np->lock);
+
 	  err = mach_msg (inp, MACH_SEND_MSG, inp->msgh_size, 0,
 			  MACH_PORT_NULL, MACH_MSG_TIMEOUT_NONE,
 			  MACH_PORT_NULL);
@@ -1189,7 +1312,31 @@ main (int argc, char **argv)
   error_t err;
   mach_port_t bootstrap;
 
-  struct argp argp = { .doc = "\
+  const struct argp_option options[] =
+    {
+      {"attr-timeout", 't', "MSECS", 0,
+       "How long to cache the attributes of the underlying files"
+       " (default 1000, 0 to disable)"},
+      {0}
+    };
+  error_t parse_opt (int key, char *arg, struct argp_state *state)
+    {
+      char *end;
+
+      switch (key)
+	{
+	case 't':
+	  attr_timeout = strtol (arg, &end, 10);
+	  if (*arg == '\0' || *end != '\0' || attr_timeout < 0)
+	    argp_error (state, "invalid timeout: %s", arg);
+	  break;
+
+	default:
+	  return ARGP_ERR_UNKNOWN;
+	}
+      return 0;
+    }
+  struct argp argp = { .options = options, .parser = parse_opt, .doc = "\
 A translator for faking privileged access to an underlying filesystem.\v\
 This translator appears to give transparent access to the underlying \
 directory node.  However, all accesses are made using the credentials \
@@ -1198,11 +1345,16 @@ success for chown and chmod operations that only root could actually do, \
 reporting the faked IDs and modes in later stat calls, and allows \
 any user to open nodes regardless of permissions as is done for root." };
 
-  /* Parse our command line arguments (all none of them).  */
+  /* Parse our command line arguments.  */
   argp_parse (&argp, argc, argv, ARGP_IN_ORDER, 0, 0);
 
   fakeroot_auth_port = getauth ();
 
+  err = maptime_map (0, 0, &fakeroot_mtime);
+  if (err)
+    error (4, err, "Cannot map time");
+  init_idport_stripes ();
+
   task_get_bootstrap_port (mach_task_self (), &bootstrap);
   netfs_init ();
 
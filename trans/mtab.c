@@ -53,6 +53,10 @@ static char *target_path = NULL;
 #define MAX_DEPTH	10
 static int max_depth = MAX_DEPTH;
 
+/* How many translators to query at the same time.  */
+#define MAX_JOBS	8
+static int max_jobs = MAX_JOBS;
+
 /* Our control port.  */
 struct trivfs_control *control;
 
@@ -64,7 +68,6 @@ struct mtab
   char *contents;
   size_t contents_len;
   off_t offs;
-  struct hurd_ihash ports_seen;
 };
 
 const char *argp_program_version = STANDARD_HURD_VERSION (mtab);
@@ -73,6 +76,8 @@ static const struct argp_option options[] =
 {
   {"depth", 'd', "DEPTH", 0,
    "Maximum depth to traverse"},
+  {"jobs", 'j', "N", 0,
+   "Number of translators to query at the same time (default 8)"},
   {}
 };
 
@@ -88,6 +93,12 @@ error_t parse_opt (int key, char *arg, struct argp_state *state)
         argp_error (state, "Could not parse depth '%s'.", arg);
       break;
 
+    case 'j':
+      max_jobs = strtoul (arg, &end, 10);
+      if (arg == end || end[0] != 0 || max_jobs < 1)
+        argp_error (state, "Could not parse jobs '%s'.", arg);
+      break;
+
     case ARGP_KEY_ARG:
       target_path = realpath (arg, NULL);
       if (! target_path)
@@ -133,6 +144,18 @@ trivfs_append_args (struct trivfs_control *fsys,
 	return err;
     }
 
+  if (max_jobs != MAX_JOBS)
+    {
+      char *arg;
+      if (asprintf (&arg, "--jobs=%d", max_jobs) < 0)
+        return errno;
+
+      err = argz_add (argz, argz_len, arg);
+      free (arg);
+      if (err)
+	return err;
+    }
+
   err = argz_add (argz, argz_len, target_path);
   return err;
 }
@@ -276,7 +299,6 @@ main (int argc, char *argv[])
       struct mtab mtab =
         {
           .lock = PTHREAD_MUTEX_INITIALIZER,
-          .ports_seen = HURD_IHASH_INITIALIZER (HURD_IHASH_NO_LOCP),
         };
       err = mtab_populate (&mtab, target_path, target_control, max_depth);
       if (err)
@@ -308,38 +330,109 @@ mtab_add_entry (struct mtab *mtab, const char *entry, size_t length)
   return 0;
 }
 
-/* Records CONTROL in ports_seen, returns true if we have already seen
-   this port.  */
-boolean_t
-mtab_mark_as_seen (struct mtab *mtab, mach_port_t control)
+/* A translator found while building the mtab.  */
+struct mtab_translator
 {
+  char *path;
+  mach_port_t control;		/* A send right of ours.  */
+  int depth;			/* How many levels below it to look.  */
+
+  /* What querying it returned.  */
   error_t err;
-  if (hurd_ihash_find (&mtab->ports_seen, (hurd_ihash_key_t) control))
-    return TRUE;
+  error_t generation_err;
+  natural_t generation;
+  char *entry;
+  size_t entry_len;
+  char *children;
+  mach_msg_type_number_t children_len;
+  mach_port_t *controls;
+  mach_msg_type_number_t controls_count;
+
+  /* The translators found below it, in order.  */
+  struct mtab_translator **below;
+  size_t below_count;
+};
 
-  err = mach_port_mod_refs (mach_task_self (), control,
-                            MACH_PORT_RIGHT_SEND, +1);
-  if (err)
-    /* Ewww.  */
-    return TRUE;
+/* A translator in the snapshot, and its generation when it was
+   built.  */
+struct mtab_check
+{
+  mach_port_t control;
+  natural_t generation;
+  int changed;
+};
+
+/* The last mtab built.  It is shared by all opens and only rebuilt
+   when one of the translators in it reports a new generation, that
+   is, when their children or options change.  */
+struct mtab_snapshot
+{
+  char *contents;
+  size_t contents_len;
+  char *path;			/* What it was built for.  */
+  int depth;
+  int reusable;			/* Whether all generations are known.  */
+  struct mtab_check *checks;
+  size_t checks_count;
+};
 
-  hurd_ihash_add (&mtab->ports_seen,
-                  (hurd_ihash_key_t) control, (hurd_ihash_value_t) control);
-  return FALSE;
+static struct mtab_snapshot snapshot;
+static pthread_mutex_t snapshot_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct parallel_job
+{
+  void (*fn) (void *item);
+  char *items;
+  size_t size;
+  size_t count;
+  size_t next;
+};
+
+static void *
+parallel_worker (void *arg)
+{
+  struct parallel_job *job = arg;
+  size_t i;
+
+  while ((i = __atomic_fetch_add (&job->next, 1, __ATOMIC_RELAXED))
+	 < job->count)
+    job->fn (job->items + i * job->size);
+  return NULL;
 }
 
-/* Populates the given MTAB object with the information for PATH.  If
-   INSECURE is given, also follow translators bound to nodes not owned
-   by root or the current user.  */
-/* XXX split up */
-error_t
-mtab_populate (struct mtab *mtab, const char *path, mach_port_t control,
-               int depth)
+/* Call FN on each of the COUNT items of SIZE bytes at ITEMS, with up
+   to MAX_JOBS calls at the same time.  The queries of the translators
+   are independent RPCs, so this hides their latency.  */
+static void
+parallel_map (void (*fn) (void *item), void *items, size_t size,
+	      size_t count)
+{
+  struct parallel_job job = { fn, items, size, count, 0 };
+  pthread_t threads[max_jobs];
+  int nthreads = 0;
+
+  /* This thread does its share too, so there is no need for threads
+     if there is only one item.  */
+  while (nthreads + 1 < max_jobs && nthreads + 1 < count
+	 && pthread_create (&threads[nthreads], NULL,
+			    parallel_worker, &job) == 0)
+    nthreads++;
+
+  parallel_worker (&job);
+
+  while (nthreads > 0)
+    pthread_join (threads[--nthreads], NULL);
+}
+
+/* Make the mtab line for the translator CONTROL bound to PATH in
+   *ENTRY, *ENTRY_LEN bytes long.  */
+static error_t
+mtab_make_entry (mach_port_t control, const char *path,
+		 char **entry, size_t *entry_len)
 {
   error_t err = 0;
 
   /* These resources are freed in the epilogue.	 */
-  file_t node = MACH_PORT_NULL;
   char *argz = NULL;
   size_t argz_len = 0;
   char **argv = NULL;
@@ -347,33 +440,12 @@ mtab_populate (struct mtab *mtab, const char *path, mach_port_t control,
   char *options = NULL;
   size_t options_len = 0;
   char *src = NULL;
-  char *entry = NULL;
-  size_t entry_len = 0;
-  char *children = NULL;
-  size_t children_len = 0;
-  mach_port_t *controls = NULL;
-  size_t controls_count = 0;
-  size_t i;
-
-  if (depth < 0)
-    return 0;
-
-  /* Avoid running in circles.  */
-  if (mtab_mark_as_seen (mtab, control))
-    {
-      err = 0;
-      goto errout;
-    }
+  string_t source;
 
   /* Query its options.	 */
   err = fsys_get_options (control, &argz, &argz_len);
   if (err)
-    {
-      if (err == EOPNOTSUPP)
-	err = 0; /* There's not much we could do then.	*/
-
-      goto errout;
-    }
+    goto errout;
 
   size_t count = argz_count (argz, argz_len);
   argv = malloc ((count + 1) * sizeof (char *));
@@ -412,7 +484,6 @@ mtab_populate (struct mtab *mtab, const char *path, mach_port_t control,
 
   argz_stringify (options, options_len, ',');
 
-  string_t source;
   err = fsys_get_source (control, source);
   if (err)
     goto errout;
@@ -422,86 +493,349 @@ mtab_populate (struct mtab *mtab, const char *path, mach_port_t control,
   if (err)
     goto errout;
 
-  entry_len = asprintf (&entry, "%s %s %s %s 0 0\n", src, path, type,
-			options? options: MNTOPT_DEFAULTS);
-  if (! entry)
+  *entry_len = asprintf (entry, "%s %s %s %s 0 0\n", src, path, type,
+			 options? options: MNTOPT_DEFAULTS);
+  if (! *entry)
+    err = ENOMEM;
+
+ errout:
+  if (argz)
+    vm_deallocate (mach_task_self (), (vm_address_t) argz, argz_len);
+
+  free (argv);
+  free (type);
+  free (options);
+  free (src);
+
+  return err;
+}
+
+/* Query the translator ITEM, a struct mtab_translator **.  */
+static void
+mtab_query (void *item)
+{
+  struct mtab_translator *t = *(struct mtab_translator **) item;
+  error_t err;
+
+  /* Get the generation first, so that any change made while we look
+     at the translator is noticed later on.  */
+  t->generation_err = fsys_get_generation (t->control, &t->generation);
+
+  err = mtab_make_entry (t->control, t->path, &t->entry, &t->entry_len);
+  if (err == EOPNOTSUPP)
     {
-      err = ENOMEM;
-      goto errout;
+      /* There's not much we could do then.  */
+      t->err = 0;
+      return;
     }
 
-  err = mtab_add_entry (mtab, entry, entry_len);
-  if (err)
-    goto errout;
+  if (! err && t->depth > 0)
+    {
+      err = fsys_get_children (t->control, &t->children, &t->children_len,
+			       &t->controls, &t->controls_count);
+      if (err == EOPNOTSUPP)
+	{
+	  err = 0;
+	  t->children_len = 0;
+	  t->controls_count = 0;
+	}
+    }
 
-  /* Recurse.  */
-  err = fsys_get_children (control, &children, &children_len,
-                           &controls, &controls_count);
-  if (err == EOPNOTSUPP)
+  t->err = err;
+}
+
+/* Check whether the translator of ITEM, a struct mtab_check, has
+   changed.  */
+static void
+mtab_check (void *item)
+{
+  struct mtab_check *c = item;
+  natural_t generation;
+
+  c->changed = (fsys_get_generation (c->control, &generation)
+		|| generation != c->generation);
+}
+
+static struct mtab_translator *
+mtab_translator_make (char *path, mach_port_t control, int depth)
+{
+  struct mtab_translator *t = calloc (1, sizeof *t);
+  if (! t)
+    return NULL;
+
+  t->path = path;
+  t->control = control;
+  t->depth = depth;
+  return t;
+}
+
+static void
+mtab_translator_free (struct mtab_translator *t)
+{
+  free (t->path);
+  free (t->entry);
+  if (t->children)
+    vm_deallocate (mach_task_self (), (vm_address_t) t->children,
+		   t->children_len);
+  if (t->controls)
+    {
+      for (size_t i = 0; i < t->controls_count; i++)
+	if (MACH_PORT_VALID (t->controls[i]))
+	  mach_port_deallocate (mach_task_self (), t->controls[i]);
+      vm_deallocate (mach_task_self (), (vm_address_t) t->controls,
+		     t->controls_count * sizeof *t->controls);
+    }
+  free (t->below);
+  free (t);
+}
+
+/* Add the entries of T and of the translators below it to the
+   snapshot S.  */
+static error_t
+mtab_collect (struct mtab_snapshot *s, struct mtab_translator *t, int top)
+{
+  error_t err;
+
+  if (t->err)
     {
-      err = 0;
-      children_len = 0;
+      /* There is really not much we can do about errors below the
+	 top.  */
+      if (top)
+	return t->err;
+      error (0, t->err, "%s", t->path);
+      s->reusable = 0;
     }
 
+  if (t->generation_err)
+    s->reusable = 0;
+
+  if (t->entry)
+    {
+      char *p = realloc (s->contents, s->contents_len + t->entry_len + 1);
+      if (! p)
+	return ENOMEM;
+
+      memcpy (&p[s->contents_len], t->entry, t->entry_len + 1);
+      s->contents = p;
+      s->contents_len += t->entry_len;
+    }
+
+  for (size_t i = 0; i < t->below_count; i++)
+    {
+      err = mtab_collect (s, t->below[i], 0);
+      if (err)
+	return err;
+    }
+
+  return 0;
+}
+
+/* Forget the contents of the snapshot S.  */
+static void
+mtab_snapshot_clear (struct mtab_snapshot *s)
+{
+  free (s->contents);
+  free (s->path);
+  for (size_t i = 0; i < s->checks_count; i++)
+    mach_port_deallocate (mach_task_self (), s->checks[i].control);
+  free (s->checks);
+  memset (s, 0, sizeof *s);
+}
+
+/* Add T to the COUNT translators in *ALL.  */
+static error_t
+mtab_append (struct mtab_translator ***all, size_t *count,
+	     struct mtab_translator *t)
+{
+  struct mtab_translator **p = realloc (*all, (*count + 1) * sizeof *p);
+  if (! p)
+    return ENOMEM;
+
+  p[(*count)++] = t;
+  *all = p;
+  return 0;
+}
+
+/* Build the snapshot S for the translator CONTROL bound to PATH,
+   looking DEPTH levels below it.  The translators of a level are all
+   queried at the same time, and the level below is made of the
+   children found in order, each translator being taken only the
+   first time it is found.  */
+static error_t
+mtab_build (struct mtab_snapshot *s, const char *path, mach_port_t control,
+	    int depth)
+{
+  error_t err;
+  struct hurd_ihash ports_seen
+    = HURD_IHASH_INITIALIZER (HURD_IHASH_NO_LOCP);
+  struct mtab_translator *root;
+  /* All translators found, one level after the other.  */
+  struct mtab_translator **all = NULL;
+  size_t all_count = 0, first, end, i;
+  char *root_path;
+
+  mtab_snapshot_clear (s);
+  s->path = strdup (path);
+  if (! s->path)
+    return ENOMEM;
+  s->depth = depth;
+  s->reusable = 1;
+
+  root_path = strdup (path);
+  root = root_path ? mtab_translator_make (root_path, control, depth) : NULL;
+  if (! root)
+    {
+      free (root_path);
+      return ENOMEM;
+    }
+  err = mach_port_mod_refs (mach_task_self (), control,
+			    MACH_PORT_RIGHT_SEND, +1);
   if (err)
-    goto errout;
+    {
+      mtab_translator_free (root);
+      return err;
+    }
 
-  char *c;
-  if (children_len && controls_count)
-    for (c = children, i = 0; c && i < controls_count;
-         c = argz_next (children, children_len, c), i++)
-      {
-	char *p = NULL;
+  err = mtab_append (&all, &all_count, root);
+  if (err)
+    {
+      mach_port_deallocate (mach_task_self (), control);
+      mtab_translator_free (root);
+      return err;
+    }
+  err = hurd_ihash_add (&ports_seen, (hurd_ihash_key_t) control, root);
 
-        if (! MACH_PORT_VALID (controls[i]))
-          continue;
+  for (first = 0, end = all_count; ! err && first < end;
+       first = end, end = all_count)
+    {
+      parallel_map (mtab_query, &all[first], sizeof *all, end - first);
 
-	asprintf (&p, "%s%s%s",
-		  path,
-		  path[strlen (path) - 1] == '/'? "": "/",
-		  c);
-	if (! p)
-	  {
-	    err = ENOMEM;
-	    goto errout;
-	  }
+      for (i = first; ! err && i < end; i++)
+	{
+	  struct mtab_translator *t = all[i];
+	  size_t j;
+	  char *c;
 
-	err = mtab_populate (mtab, p, controls[i], depth - 1);
-	if (err)
-	  {
-	    /* There is really not much we can do about errors here.  */
-	    error (0, err, "%s", p);
-	    err = 0;
-	  }
+	  if (t->err)
+	    continue;
 
-	free (p);
-        err = mach_port_deallocate (mach_task_self (), controls[i]);
-        assert_perror_backtrace (err);
-        controls[i] = MACH_PORT_NULL;
-      }
+	  for (c = t->children, j = 0; c && j < t->controls_count;
+	       c = argz_next (t->children, t->children_len, c), j++)
+	    {
+	      struct mtab_translator *child;
+	      struct mtab_translator **below;
+	      char *p = NULL;
+
+	      /* Avoid running in circles.  */
+	      if (! MACH_PORT_VALID (t->controls[j])
+		  || hurd_ihash_find (&ports_seen,
+				      (hurd_ihash_key_t) t->controls[j]))
+		continue;
+
+	      below = realloc (t->below,
+			       (t->below_count + 1) * sizeof *t->below);
+	      if (! below)
+		{
+		  err = ENOMEM;
+		  break;
+		}
+	      t->below = below;
+
+	      asprintf (&p, "%s%s%s",
+			t->path,
+			t->path[strlen (t->path) - 1] == '/'? "": "/",
+			c);
+	      child = p ? mtab_translator_make (p, t->controls[j],
+						t->depth - 1) : NULL;
+	      if (! child)
+		{
+		  free (p);
+		  err = ENOMEM;
+		  break;
+		}
+
+	      /* The right now belongs to CHILD.  */
+	      t->controls[j] = MACH_PORT_NULL;
+	      err = mtab_append (&all, &all_count, child);
+	      if (err)
+		{
+		  mach_port_deallocate (mach_task_self (), child->control);
+		  mtab_translator_free (child);
+		  break;
+		}
+	      t->below[t->below_count++] = child;
+
+	      err = hurd_ihash_add (&ports_seen,
+				    (hurd_ihash_key_t) child->control, child);
+	    }
+	}
+    }
+  hurd_ihash_destroy (&ports_seen);
 
- errout:
-  if (node != MACH_PORT_NULL)
-    mach_port_deallocate (mach_task_self (), node);
+  if (! err)
+    err = mtab_collect (s, root, 1);
 
-  if (argz)
-    vm_deallocate (mach_task_self (), (vm_address_t) argz, argz_len);
+  /* Keep the control ports to check the generations against.  */
+  if (! err)
+    {
+      s->checks = malloc (all_count * sizeof *s->checks);
+      if (! s->checks)
+	err = ENOMEM;
+    }
+  for (i = 0; i < all_count; i++)
+    {
+      if (! err)
+	{
+	  s->checks[i].control = all[i]->control;
+	  s->checks[i].generation = all[i]->generation;
+	  s->checks_count++;
+	}
+      else
+	mach_port_deallocate (mach_task_self (), all[i]->control);
+      mtab_translator_free (all[i]);
+    }
+  free (all);
 
-  free (argv);
-  free (type);
-  free (options);
+  if (err)
+    mtab_snapshot_clear (s);
+  return err;
+}
 
-  if (src != source)
-    free (src);
+/* Populates the given MTAB object with the information for PATH,
+   looking DEPTH levels deep below CONTROL.  */
+error_t
+mtab_populate (struct mtab *mtab, const char *path, mach_port_t control,
+               int depth)
+{
+  error_t err = 0;
+  int fresh = 0;
+
+  if (depth < 0)
+    return 0;
+
+  pthread_mutex_lock (&snapshot_lock);
+
+  if (snapshot.reusable && snapshot.depth == depth
+      && strcmp (snapshot.path, path) == 0)
+    {
+      parallel_map (mtab_check, snapshot.checks, sizeof *snapshot.checks,
+		    snapshot.checks_count);
+      fresh = 1;
+      for (size_t i = 0; i < snapshot.checks_count; i++)
+	if (snapshot.checks[i].changed)
+	  {
+	    fresh = 0;
+	    break;
+	  }
+    }
 
-  free (entry);
+  if (! fresh)
+    err = mtab_build (&snapshot, path, control, depth);
 
-  if (children)
-    vm_deallocate (mach_task_self (), (vm_address_t) children, children_len);
-  if (controls)
-    vm_deallocate (mach_task_self (), (vm_address_t) controls,
-                   controls_count * sizeof *controls);
+  if (! err && snapshot.contents_len > 0)
+    err = mtab_add_entry (mtab, snapshot.contents, snapshot.contents_len);
 
+  pthread_mutex_unlock (&snapshot_lock);
   return err;
 }
 
@@ -617,7 +951,6 @@ open_hook (struct trivfs_peropen *peropen)
   mtab->offs = 0;
   mtab->contents = NULL;
   mtab->contents_len = 0;
-  hurd_ihash_init (&mtab->ports_seen, HURD_IHASH_NO_LOCP);
 
   return 0;
 }
@@ -628,9 +961,6 @@ close_hook (struct trivfs_peropen *peropen)
   struct mtab *op = peropen->hook;
   pthread_mutex_destroy (&op->lock);
   free (op->contents);
-  HURD_IHASH_ITERATE (&op->ports_seen, p)
-    mach_port_deallocate (mach_task_self (), (mach_port_t) p);
-  hurd_ihash_destroy (&op->ports_seen);
   free (op);
 }
 
@@ -53,6 +53,10 @@ enum gcry_md_algos hash_algo = GCRY_MD_SHAKE128;
 /* Protected by this lock.  */
 static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/* Incremented whenever entropy is added to the pool, so that the output
+   streams below know to reseed.  */
+static volatile unsigned int pool_generation;
+
 /* A map of the Mach time device.  Used for quick stirring.  */
 volatile struct mapped_time_value *mtime;
 
@@ -88,6 +92,7 @@ pool_add_entropy (const void *buffer, size_t length)
 {
   pthread_mutex_lock (&pool_lock);
   gcry_md_write (pool, buffer, length);
+  pool_generation++;
   pthread_mutex_unlock (&pool_lock);
 }
 
@@ -107,6 +112,130 @@ pool_randomize (void *buffer, size_t length)
   return cerr ? EIO : 0;
 }
 
+
+
+/* Output streams.  Reading from the pool serializes all readers on
+   POOL_LOCK, so reads are served from per-thread ChaCha20 streams
+   instead, which are keyed from the pool and use fast key erasure:
+   every chunk of output is generated with a fresh key, and the first
+   bytes of its keystream become the next key, so that a compromise of
+   the server's state does not reveal past output.  A stream takes a new
+   key from the pool when entropy has been added to it, and at least
+   every STREAM_RESEED_INTERVAL seconds.  */
+
+#define STREAM_KEY_SIZE	32
+#define STREAM_CHUNK	(64 * 1024)
+#define STREAM_RESEED_INTERVAL	60
+
+struct stream
+{
+  gcry_cipher_hd_t cipher;
+  unsigned char key[STREAM_KEY_SIZE];
+  unsigned int generation;	/* POOL_GENERATION when last reseeded.  */
+  time_t reseeded;
+};
+
+static pthread_key_t stream_key;
+
+static void
+stream_destroy (void *arg)
+{
+  struct stream *s = arg;
+
+  gcry_cipher_close (s->cipher);
+  gcry_free (s);
+}
+
+static void
+stream_initialize (void)
+{
+  int err = pthread_key_create (&stream_key, stream_destroy);
+  if (err)
+    error (1, err, "Creating stream key failed");
+}
+
+/* Return the stream of the calling thread, creating it if necessary.  */
+static struct stream *
+stream_get (void)
+{
+  struct stream *s = pthread_getspecific (stream_key);
+
+  if (s)
+    return s;
+
+  /* Allocate it in secure memory, the key must not be swapped out.  */
+  s = gcry_calloc_secure (1, sizeof *s);
+  if (! s)
+    return NULL;
+  if (gcry_cipher_open (&s->cipher, GCRY_CIPHER_CHACHA20,
+			GCRY_CIPHER_MODE_STREAM, GCRY_CIPHER_SECURE))
+    {
+      gcry_free (s);
+      return NULL;
+    }
+  s->generation = pool_generation - 1;	/* Force a reseed.  */
+  pthread_setspecific (stream_key, s);
+  return s;
+}
+
+/* Fill BUFFER with LENGTH bytes of output from the calling thread's
+   stream.  If ZEROED, BUFFER is known to contain only zeros.  */
+static error_t
+stream_randomize (void *buffer, size_t length, int zeroed)
+{
+  static const unsigned char nonce[12];
+  struct stream *s = stream_get ();
+  unsigned char *p = buffer;
+  error_t err;
+
+  if (! s)
+    return pool_randomize (buffer, length);
+
+  if (s->generation != pool_generation
+      || mtime->seconds - s->reseeded >= STREAM_RESEED_INTERVAL)
+    {
+      s->generation = pool_generation;
+      s->reseeded = mtime->seconds;
+      err = pool_randomize (s->key, sizeof s->key);
+      if (err)
+	return err;
+    }
+
+  if (! zeroed)
+    memset (buffer, 0, length);
+
+  while (length > 0)
+    {
+      size_t n = length < STREAM_CHUNK ? length : STREAM_CHUNK;
+      gcry_error_t cerr;
+
+      cerr = gcry_cipher_setkey (s->cipher, s->key, sizeof s->key);
+      if (! cerr)
+	cerr = gcry_cipher_setiv (s->cipher, nonce, sizeof nonce);
+      if (! cerr)
+	{
+	  /* The key is replaced by the start of the keystream before
+	     the rest is handed out.  */
+	  memset (s->key, 0, sizeof s->key);
+	  cerr = gcry_cipher_encrypt (s->cipher, s->key, sizeof s->key,
+				      NULL, 0);
+	}
+      if (! cerr)
+	cerr = gcry_cipher_encrypt (s->cipher, p, n, NULL, 0);
+      if (cerr)
+	{
+	  /* Never hand out a stream we are not sure about again.  */
+	  s->generation = pool_generation - 1;
+	  return EIO;
+	}
+
+      p += n;
+      length -= n;
+    }
+
+  return 0;
+}
+
 
 
 /* Name of file to use as seed.  */
@@ -306,6 +435,9 @@ trivfs_goaway (struct trivfs_control *cntl, int flags)
   exit (0);
 }
 
+/* Reads of at least this many bytes are returned in fresh memory.  */
+#define LARGE_READ_SIZE	(4 * PAGE_SIZE)
+
 /* Read data from an IO object.  If offset is -1, read from the object
    maintained file pointer.  If the object is not seekable, offset is
    ignored.  The amount desired to be read is in AMOUNT.  */
@@ -326,8 +458,10 @@ trivfs_S_io_read (struct trivfs_protid *cred,
 
   if (amount > 0)
     {
-      /* Possibly allocate a new buffer. */
-      if (*data_len < amount)
+      /* Possibly allocate a new buffer.  Large reads always get one:
+	 the fresh pages are known to be zero, so the keystream can go
+	 straight into them, and they are returned out of line.  */
+      if (*data_len < amount || amount >= LARGE_READ_SIZE)
 	{
 	  *data = mmap (0, amount, PROT_READ|PROT_WRITE, MAP_ANON, 0, 0);
 	  if (*data == MAP_FAILED)
@@ -343,7 +477,7 @@ trivfs_S_io_read (struct trivfs_protid *cred,
 	  *data_len = amount;
 	}
 
-      err = pool_randomize (*data, amount);
+      err = stream_randomize (*data, amount, buf != NULL);
       if (err)
         goto errout;
 
@@ -689,6 +823,7 @@ main (int argc, char **argv)
   argp_parse (&random_argp, argc, argv, 0, 0, 0);
 
   pool_initialize ();
+  stream_initialize ();
 
   err = read_random_seed_file ();
   if (err)
@@ -0,0 +1,362 @@
+/* Decode binary traces written by rpctrace --binary
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <hurd.h>
+#include <hurd/ihash.h>
+#include <mach/message.h>
+#include <argp.h>
+#include <error.h>
+#include <fnmatch.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <version.h>
+#include <inttypes.h>
+
+#include "msgids.h"
+#include "rpctrace.h"
+
+const char *argp_program_version = STANDARD_HURD_VERSION (rpcdecode);
+
+static const struct argp_option options[] =
+{
+  {"summary", 'S', 0, 0,
+   "Print per-RPC counts and latency histograms instead of the messages."},
+  {"filter", 'f', "PATTERN", 0,
+   "Only consider RPCs whose name (or number) matches the shell wildcard"
+   " PATTERN."},
+  {0}
+};
+
+static const char args_doc[] = "FILE";
+static const char doc[] = "Decode a binary trace written by rpctrace.";
+
+static int summary;
+static const char *filter;
+
+/* Latency histogram buckets are powers of two of microseconds, so
+   bucket I counts replies that took less than 2^I us.  */
+#define NBUCKETS 32
+
+struct rpc_stats
+{
+  mach_msg_id_t msgid;
+  uint64_t count;		/* Requests seen.  */
+  uint64_t replies;		/* Replies matched to a request.  */
+  uint64_t bytes;		/* Request bytes.  */
+  uint64_t total_ns;
+  uint64_t min_ns;
+  uint64_t max_ns;
+  uint64_t buckets[NBUCKETS];
+};
+
+/* Outstanding requests, keyed by their reply wrapper port.  */
+static struct hurd_ihash pending
+  = HURD_IHASH_INITIALIZER (HURD_IHASH_NO_LOCP);
+
+/* struct rpc_stats, keyed by request msgid.  */
+static struct hurd_ihash stats
+  = HURD_IHASH_INITIALIZER (HURD_IHASH_NO_LOCP);
+
+static const char *
+msgid_name (mach_msg_id_t msgid)
+{
+  const struct msgid_info *info = msgid_info (msgid);
+  return info ? info->name : 0;
+}
+
+/* Return true if records for request id MSGID should be considered.  */
+static int
+selected (mach_msg_id_t msgid)
+{
+  const char *name;
+  char num[16];
+
+  if (filter == NULL)
+    return 1;
+
+  name = msgid_name (msgid);
+  if (name && fnmatch (filter, name, 0) == 0)
+    return 1;
+  snprintf (num, sizeof num, "%d", msgid);
+  return fnmatch (filter, num, 0) == 0;
+}
+
+static struct rpc_stats *
+get_stats (mach_msg_id_t msgid)
+{
+  struct rpc_stats *s = hurd_ihash_find (&stats, msgid);
+  error_t err;
+
+  if (s)
+    return s;
+
+  s = calloc (1, sizeof *s);
+  if (s == NULL)
+    error (1, errno, "calloc");
+  s->msgid = msgid;
+  s->min_ns = UINT64_MAX;
+  err = hurd_ihash_add (&stats, msgid, s);
+  if (err)
+    error (1, err, "hurd_ihash_add");
+  return s;
+}
+
+static void
+account_latency (struct rpc_stats *s, uint64_t ns)
+{
+  uint64_t us = ns / 1000;
+  int b = 0;
+
+  s->replies++;
+  s->total_ns += ns;
+  if (ns < s->min_ns)
+    s->min_ns = ns;
+  if (ns > s->max_ns)
+    s->max_ns = ns;
+
+  while (b < NBUCKETS - 1 && us >= (1ULL << b))
+    b++;
+  s->buckets[b]++;
+}
+
+static void
+print_name (mach_msg_id_t msgid)
+{
+  const char *name = msgid_name (msgid);
+  if (name)
+    printf ("%s", name);
+  else
+    printf ("%d", msgid);
+}
+
+static void
+print_record (const struct rpctrace_record *rec,
+	      const struct rpctrace_record *req)
+{
+  printf ("%" PRIu64 ".%09" PRIu64 " ",
+	  rec->timestamp / 1000000000, rec->timestamp % 1000000000);
+
+  switch (rec->kind)
+    {
+    case RPCTRACE_REPLY:
+      printf ("%u... ", rec->port);
+      if (req)
+	print_name (req->msgid);
+      else
+	printf ("?");
+      printf (" = ");
+      if (rec->retcode == 0)
+	printf ("0");
+      else
+	printf ("%#x (%s)", rec->retcode, strerror (rec->retcode));
+      if (req)
+	printf (" [%" PRIu64 " us]", (rec->timestamp - req->timestamp) / 1000);
+      break;
+
+    default:
+      printf ("%u->", rec->port);
+      print_name (rec->msgid);
+      printf (" (%u bytes%s)", rec->size,
+	      rec->flags & RPCTRACE_F_COMPLEX ? ", complex" : "");
+      if (rec->kind == RPCTRACE_REQUEST)
+	printf (" ...%u", rec->reply_port);
+      else if (rec->kind == RPCTRACE_NOTIFY)
+	printf (" [notification]");
+      break;
+    }
+  putchar ('\n');
+}
+
+static int
+compare_stats (const void *a, const void *b)
+{
+  const struct rpc_stats *sa = *(const struct rpc_stats **) a;
+  const struct rpc_stats *sb = *(const struct rpc_stats **) b;
+
+  /* Most expensive RPCs first.  */
+  if (sa->total_ns != sb->total_ns)
+    return sa->total_ns < sb->total_ns ? 1 : -1;
+  if (sa->count != sb->count)
+    return sa->count < sb->count ? 1 : -1;
+  return sa->msgid - sb->msgid;
+}
+
+static void
+print_summary (void)
+{
+  struct rpc_stats **all;
+  size_t n = 0, i;
+
+  all = malloc (stats.nr_items * sizeof *all);
+  if (all == NULL && stats.nr_items > 0)
+    error (1, errno, "malloc");
+  HURD_IHASH_ITERATE (&stats, value)
+    all[n++] = value;
+  qsort (all, n, sizeof *all, compare_stats);
+
+  for (i = 0; i < n; i++)
+    {
+      struct rpc_stats *s = all[i];
+      int b, last;
+
+      print_name (s->msgid);
+      printf (": %" PRIu64 " calls, %" PRIu64 " bytes", s->count, s->bytes);
+      if (s->replies == 0)
+	{
+	  putchar ('\n');
+	  continue;
+	}
+      printf (", latency us min %" PRIu64 " avg %" PRIu64 " max %" PRIu64
+	      " total %" PRIu64 "\n",
+	      s->min_ns / 1000, s->total_ns / s->replies / 1000,
+	      s->max_ns / 1000, s->total_ns / 1000);
+
+      for (last = NBUCKETS - 1; last > 0 && s->buckets[last] == 0; last--)
+	;
+      for (b = 0; b <= last; b++)
+	printf ("  < %8llu us: %" PRIu64 "\n", 1ULL << b, s->buckets[b]);
+    }
+
+  free (all);
+}
+
+int
+main (int argc, char **argv)
+{
+  const char *file = 0;
+  struct rpctrace_file_header header;
+  struct rpctrace_record rec;
+  FILE *in;
+  error_t err;
+
+  error_t parse_opt (int key, char *arg, struct argp_state *state)
+    {
+      switch (key)
+	{
+	case 'S':
+	  summary = 1;
+	  break;
+
+	case 'f':
+	  filter = arg;
+	  break;
+
+	case ARGP_KEY_ARG:
+	  if (file)
+	    argp_usage (state);
+	  file = arg;
+	  break;
+
+	case ARGP_KEY_NO_ARGS:
+	  argp_usage (state);
+	  return EINVAL;
+
+	default:
+	  return ARGP_ERR_UNKNOWN;
+	}
+      return 0;
+    }
+  const struct argp_child children[] =
+    {
+      { .argp=&msgid_argp, },
+      { 0 }
+    };
+  const struct argp argp = { options, parse_opt, args_doc, doc, children };
+
+  argp_parse (&argp, argc, argv, 0, 0, 0);
+
+  in = strcmp (file, "-") ? fopen (file, "r") : stdin;
+  if (in == NULL)
+    error (1, errno, "%s", file);
+
+  if (fread (&header, sizeof header, 1, in) != 1)
+    error (1, 0, "%s: truncated trace header", file);
+  if (header.magic != RPCTRACE_MAGIC)
+    error (1, 0, "%s: not an rpctrace binary trace", file);
+  if (header.version != RPCTRACE_VERSION
+      || header.record_size != sizeof rec)
+    error (1, 0, "%s: unsupported trace version %u", file, header.version);
+  if (header.lost > 0)
+    error (0, 0, "%s: %" PRIu64 " records were lost while tracing",
+	   file, header.lost);
+
+  while (fread (&rec, sizeof rec, 1, in) == 1)
+    {
+      struct rpctrace_record *req = NULL;
+
+      if (rec.kind == RPCTRACE_REPLY)
+	{
+	  req = hurd_ihash_find (&pending, rec.port);
+	  if (req)
+	    hurd_ihash_remove (&pending, rec.port);
+	  if (! selected (req ? req->msgid : rec.msgid - 100))
+	    {
+	      free (req);
+	      continue;
+	    }
+	  if (summary && req)
+	    account_latency (get_stats (req->msgid),
+			     rec.timestamp - req->timestamp);
+	}
+      else
+	{
+	  if (rec.kind == RPCTRACE_REQUEST)
+	    {
+	      /* A wrapper port is only reused after its reply has been
+		 seen, so a stale entry means that reply was lost.  */
+	      req = hurd_ihash_find (&pending, rec.reply_port);
+	      if (req)
+		{
+		  hurd_ihash_remove (&pending, rec.reply_port);
+		  free (req);
+		}
+	      req = malloc (sizeof *req);
+	      if (req == NULL)
+		error (1, errno, "malloc");
+	      *req = rec;
+	      err = hurd_ihash_add (&pending, rec.reply_port, req);
+	      if (err)
+		error (1, err, "hurd_ihash_add");
+	      req = NULL;
+	    }
+
+	  if (! selected (rec.msgid))
+	    continue;
+	  if (summary)
+	    {
+	      struct rpc_stats *s = get_stats (rec.msgid);
+	      s->count++;
+	      s->bytes += rec.size;
+	    }
+	}
+
+      if (! summary)
+	print_record (&rec, req);
+      free (req);
+    }
+
+  if (ferror (in))
+    error (1, errno, "%s", file);
+
+  if (summary)
+    print_summary ();
+
+  return 0;
+}
@@ -0,0 +1,230 @@
+/* Show per-RPC statistics collected by a Hurd server
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <hurd.h>
+#include <hurd/hurd_types.h>
+#include <mach/message.h>
+#include <argp.h>
+#include <error.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <version.h>
+#include <sys/mman.h>
+
+#include "msgids.h"
+#include "rpcstats_U.h"
+
+const char *argp_program_version = STANDARD_HURD_VERSION (rpcstats);
+
+#define NBUCKETS 24
+
+static const struct argp_option options[] =
+{
+  {"enable", 'e', 0, 0, "Start collecting statistics (discards old ones)."},
+  {"disable", 'd', 0, 0, "Stop collecting statistics."},
+  {"reset", 'r', 0, 0, "Discard collected statistics."},
+  {"proc", 'p', 0, 0, "Query the proc server instead of FILE."},
+  {"histogram", 'H', 0, 0, "Show latency histograms."},
+  {"threads", 't', 0, 0, "Show the thread pool size over time."},
+  {"raw", 'R', 0, 0, "Print the server's report unprocessed."},
+  {0}
+};
+
+static const char args_doc[] = "[FILE]";
+static const char doc[] =
+  "Show the per-RPC statistics collected by the translator for FILE."
+  "\vThe statistics are read through the translator's control port, or"
+  " for --proc through our process port, so only the superuser can use"
+  " this program.  Statistics are only collected after --enable has been"
+  " given.";
+
+struct rpc
+{
+  mach_msg_id_t msgid;
+  unsigned long long count, total, max, wait;
+  unsigned long long buckets[NBUCKETS];
+};
+
+static int
+compare_rpcs (const void *a, const void *b)
+{
+  const struct rpc *ra = a, *rb = b;
+  if (ra->total != rb->total)
+    return ra->total < rb->total ? 1 : -1;
+  return ra->msgid - rb->msgid;
+}
+
+static void
+print_name (mach_msg_id_t msgid)
+{
+  const struct msgid_info *info = msgid_info (msgid);
+  if (info)
+    printf ("%-28s", info->name);
+  else
+    printf ("%-28d", msgid);
+}
+
+int
+main (int argc, char **argv)
+{
+  error_t err;
+  const char *file = 0;
+  int flags = 0, use_proc = 0, histogram = 0, threads = 0, raw = 0;
+  mach_port_t node, server;
+  char *data = 0, *line, *next;
+  mach_msg_type_number_t len = 0;
+  struct rpc *rpcs = 0;
+  size_t nrpcs = 0, i;
+
+  error_t parse_opt (int key, char *arg, struct argp_state *state)
+    {
+      switch (key)
+	{
+	case 'e': flags |= RPCSTATS_ENABLE; break;
+	case 'd': flags |= RPCSTATS_DISABLE; break;
+	case 'r': flags |= RPCSTATS_RESET; break;
+	case 'p': use_proc = 1; break;
+	case 'H': histogram = 1; break;
+	case 't': threads = 1; break;
+	case 'R': raw = 1; break;
+
+	case ARGP_KEY_ARG:
+	  if (file)
+	    argp_usage (state);
+	  file = arg;
+	  break;
+
+	case ARGP_KEY_END:
+	  if (!file == !use_proc)
+	    argp_error (state, "Specify exactly one of FILE and --proc");
+	  break;
+
+	default:
+	  return ARGP_ERR_UNKNOWN;
+	}
+      return 0;
+    }
+  const struct argp_child children[] =
+    {
+      { .argp=&msgid_argp, },
+      { 0 }
+    };
+  const struct argp argp = { options, parse_opt, args_doc, doc, children };
+
+  argp_parse (&argp, argc, argv, 0, 0, 0);
+
+  if (use_proc)
+    server = getproc ();
+  else
+    {
+      node = file_name_lookup (file, 0, 0);
+      if (node == MACH_PORT_NULL)
+	error (1, errno, "%s", file);
+      err = file_getcontrol (node, &server);
+      if (err)
+	error (1, err, "%s: Cannot get control port", file);
+      mach_port_deallocate (mach_task_self (), node);
+    }
+
+  err = rpcstats_get (server, flags, &data, &len);
+  if (err)
+    error (1, err, "%s", use_proc ? "proc" : file);
+
+  if (raw)
+    {
+      fwrite (data, 1, len, stdout);
+      return 0;
+    }
+
+  for (line = data; line < data + len; line = next)
+    {
+      char *end = memchr (line, '\n', data + len - line);
+      unsigned long long a;
+      unsigned int n, m;
+
+      if (end == NULL)
+	break;
+      *end = '\0';
+      next = end + 1;
+
+      if (sscanf (line, "enabled %u", &n) == 1 && !n)
+	printf ("Statistics are disabled.\n");
+      else if (sscanf (line, "elapsed %llu", &a) == 1)
+	printf ("Collected over %llu ms.\n", a / 1000000);
+      else if (sscanf (line, "threads %u %u", &n, &m) == 2)
+	printf ("Threads: %u now, %u at most.\n", n, m);
+      else if (sscanf (line, "overflow %llu", &a) == 1 && a)
+	printf ("%llu RPCs not accounted for (table full).\n", a);
+      else if (sscanf (line, "sample %llu %u", &a, &n) == 2)
+	{
+	  if (threads)
+	    printf ("  %10llu ms: %u threads\n", a / 1000000, n);
+	}
+      else if (strncmp (line, "rpc ", 4) == 0)
+	{
+	  struct rpc *r;
+	  char *p;
+	  int k;
+
+	  rpcs = realloc (rpcs, (nrpcs + 1) * sizeof *rpcs);
+	  if (rpcs == NULL)
+	    error (1, errno, "realloc");
+	  r = &rpcs[nrpcs++];
+	  memset (r, 0, sizeof *r);
+	  p = line + 4;
+	  r->msgid = strtol (p, &p, 10);
+	  r->count = strtoull (p, &p, 10);
+	  r->total = strtoull (p, &p, 10);
+	  r->max = strtoull (p, &p, 10);
+	  r->wait = strtoull (p, &p, 10);
+	  for (k = 0; k < NBUCKETS; k++)
+	    r->buckets[k] = strtoull (p, &p, 10);
+	}
+    }
+
+  qsort (rpcs, nrpcs, sizeof *rpcs, compare_rpcs);
+
+  if (nrpcs > 0)
+    printf ("%-28s %10s %12s %10s %10s %12s\n", "RPC", "CALLS",
+	    "TOTAL(us)", "AVG(us)", "MAX(us)", "WAIT(us)");
+  for (i = 0; i < nrpcs; i++)
+    {
+      struct rpc *r = &rpcs[i];
+      int k, last;
+
+      print_name (r->msgid);
+      printf (" %10llu %12llu %10llu %10llu %12llu\n", r->count,
+	      r->total / 1000, r->total / r->count / 1000, r->max / 1000,
+	      r->wait / 1000);
+
+      if (! histogram)
+	continue;
+      for (last = NBUCKETS - 1; last > 0 && r->buckets[last] == 0; last--)
+	;
+      for (k = 0; k <= last; k++)
+	printf ("    %s %8llu us: %llu\n", k == NBUCKETS - 1 ? ">=" : " <",
+		k == NBUCKETS - 1 ? 1ULL << (k - 1) : 1ULL << k,
+		r->buckets[k]);
+    }
+
+  munmap (data, len);
+  return 0;
+}
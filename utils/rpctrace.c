@@ -38,13 +38,23 @@
 #include <stddef.h>
 #include <argz.h>
 #include <envz.h>
+#include <pthread.h>
+#include <time.h>
 
 #include "msgids.h"
+#include "rpctrace.h"
 
 const char *argp_program_version = STANDARD_HURD_VERSION (rpctrace);
 
 static unsigned strsize = 80;
 
+/* If non-null, write binary trace records to this file instead of
+   formatting messages to OSTREAM.  */
+static const char *binary_file;
+
+/* Number of records in the binary trace ring buffer.  */
+static size_t ring_records = 64 * 1024;
+
 static const struct argp_option options[] =
 {
   {"output", 'o', "FILE", 0, "Send trace output to FILE instead of stderr."},
@@ -52,6 +62,11 @@ static const struct argp_option options[] =
   {0, 'E', "var[=value]", 0,
    "Set/change (var=value) or remove (var) an environment variable among the "
    "ones inherited by the executed process."},
+  {"binary", 'B', "FILE", 0,
+   "Write compact binary trace records to FILE instead of printing messages;"
+   " use rpcdecode to render them."},
+  {"ring-size", 'R', "RECORDS", 0,
+   "Number of records buffered in memory in binary mode (default 65536)."},
   {0}
 };
 
@@ -259,6 +274,190 @@ static void print_data (mach_msg_type_name_t type,
 			mach_msg_type_number_t eltsize);
 
 
+/*** Binary trace output ***/
+
+/* In binary mode the tracing thread only appends fixed-size records to
+   RING.  A separate writer thread drains the ring to BINARY_FD, so the
+   traced task never waits for formatting or for the output file.  The
+   ring has a single producer and a single consumer; RING_HEAD and
+   RING_TAIL only ever increase and are reduced modulo RING_RECORDS
+   when indexing.  If the writer falls behind, records are dropped and
+   counted rather than stalling the traced program.  */
+static struct rpctrace_record *ring;
+static size_t ring_head;		/* Next slot to fill.  */
+static size_t ring_tail;		/* Next slot to write out.  */
+static uint64_t ring_lost;
+static int binary_fd = -1;
+static int ring_done;
+static pthread_t ring_thread;
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ring_wakeup = PTHREAD_COND_INITIALIZER;
+
+static void
+write_fully (const void *buf, size_t len)
+{
+  while (len > 0)
+    {
+      ssize_t n = write (binary_fd, buf, len);
+      if (n < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  error (2, errno, "%s", binary_file);
+	}
+      buf += n;
+      len -= n;
+    }
+}
+
+/* Write out all records between RING_TAIL and the current head.  */
+static void
+ring_drain (void)
+{
+  size_t head = __atomic_load_n (&ring_head, __ATOMIC_ACQUIRE);
+  size_t tail = ring_tail;
+
+  while (tail != head)
+    {
+      size_t start = tail % ring_records;
+      size_t count = head - tail;
+
+      /* Don't run past the end of the ring.  */
+      if (count > ring_records - start)
+	count = ring_records - start;
+      write_fully (&ring[start], count * sizeof *ring);
+      tail += count;
+      __atomic_store_n (&ring_tail, tail, __ATOMIC_RELEASE);
+    }
+}
+
+static void *
+ring_writer (void *arg)
+{
+  pthread_mutex_lock (&ring_lock);
+  while (! ring_done)
+    {
+      struct timespec timeout;
+
+      /* The producer only signals when the ring gets half full; make
+	 sure a slow trickle of messages still reaches the file.  */
+      clock_gettime (CLOCK_REALTIME, &timeout);
+      timeout.tv_nsec += 100 * 1000 * 1000;
+      if (timeout.tv_nsec >= 1000 * 1000 * 1000)
+	{
+	  timeout.tv_sec += 1;
+	  timeout.tv_nsec -= 1000 * 1000 * 1000;
+	}
+      pthread_cond_timedwait (&ring_wakeup, &ring_lock, &timeout);
+
+      pthread_mutex_unlock (&ring_lock);
+      ring_drain ();
+      pthread_mutex_lock (&ring_lock);
+    }
+  pthread_mutex_unlock (&ring_lock);
+
+  ring_drain ();
+  return 0;
+}
+
+static void
+ring_open (void)
+{
+  struct rpctrace_file_header header = {
+    .magic = RPCTRACE_MAGIC,
+    .version = RPCTRACE_VERSION,
+    .record_size = sizeof (struct rpctrace_record),
+  };
+  error_t err;
+
+  binary_fd = open (binary_file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (binary_fd < 0)
+    error (1, errno, "%s", binary_file);
+
+  ring = calloc (ring_records, sizeof *ring);
+  if (ring == NULL)
+    error (1, errno, "cannot allocate %zu trace records", ring_records);
+
+  write_fully (&header, sizeof header);
+
+  err = pthread_create (&ring_thread, NULL, ring_writer, NULL);
+  if (err)
+    error (1, err, "pthread_create");
+}
+
+/* Flush all buffered records and record the number of lost ones in
+   the file header.  Later calls to ring_record do nothing.  */
+static void
+ring_close (void)
+{
+  pthread_mutex_lock (&ring_lock);
+  ring_done = 1;
+  pthread_cond_signal (&ring_wakeup);
+  pthread_mutex_unlock (&ring_lock);
+  pthread_join (ring_thread, NULL);
+
+  if (pwrite (binary_fd, &ring_lost, sizeof ring_lost,
+	      offsetof (struct rpctrace_file_header, lost))
+      != sizeof ring_lost)
+    error (0, errno, "%s", binary_file);
+  if (ring_lost > 0)
+    error (0, 0, "%" PRIu64 " trace records lost; try a larger --ring-size",
+	   ring_lost);
+  close (binary_fd);
+  free (ring);
+}
+
+/* Append a record for message INP, which arrived on wrapper port PORT.
+   This is called on the tracing hot path.  The tracing threads are
+   still running when main calls ring_close, so RING_LOCK is held to
+   make sure that the ring is not freed under us; records that come in
+   after ring_close are dropped.  */
+static void
+ring_record (mach_msg_header_t *inp, mach_port_t port,
+	     mach_port_t reply_port, enum rpctrace_kind kind,
+	     kern_return_t retcode)
+{
+  struct rpctrace_record *rec;
+  struct timespec ts;
+  size_t tail;
+
+  pthread_mutex_lock (&ring_lock);
+  if (ring_done)
+    {
+      pthread_mutex_unlock (&ring_lock);
+      return;
+    }
+
+  tail = __atomic_load_n (&ring_tail, __ATOMIC_ACQUIRE);
+  if (ring_head - tail >= ring_records)
+    {
+      ring_lost++;
+      pthread_mutex_unlock (&ring_lock);
+      return;
+    }
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  rec = &ring[ring_head % ring_records];
+  rec->timestamp = (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+  rec->msgid = inp->msgh_id;
+  rec->size = inp->msgh_size;
+  rec->port = port;
+  rec->reply_port = reply_port;
+  rec->retcode = retcode;
+  rec->kind = kind;
+  rec->flags = (inp->msgh_bits & MACH_MSGH_BITS_COMPLEX)
+	       ? RPCTRACE_F_COMPLEX : 0;
+
+  __atomic_store_n (&ring_head, ring_head + 1, __ATOMIC_RELEASE);
+
+  /* Wake the writer early when the ring starts to fill up.  */
+  if (ring_head - tail == ring_records / 2)
+    pthread_cond_signal (&ring_wakeup);
+  pthread_mutex_unlock (&ring_lock);
+}
+
+
 /*** Mechanics of tracing messages and interposing on ports ***/
 
 /* Create a new info for the receive right.
@@ -798,9 +997,11 @@ rewrite_right (mach_port_t *right, mach_msg_type_name_t *type,
   return 0;
 }
 
+/* Interpose on the port rights in the message body starting at
+   MSG_BUF_PTR.  If PRINT is true, also print the message data.  */
 static void
 print_contents (mach_msg_header_t *inp,
-		void *msg_buf_ptr, struct req_info *req)
+		void *msg_buf_ptr, struct req_info *req, int print)
 {
   error_t err;
 
@@ -844,7 +1045,7 @@ print_contents (mach_msg_header_t *inp,
 
       if (first)
 	first = 0;
-      else
+      else if (print)
 	putc (' ', ostream);
 
       /* Note that MACH_MSG_TYPE_PORT_NAME does not indicate a port right.
@@ -872,6 +1073,12 @@ print_contents (mach_msg_header_t *inp,
 
 	      str = rewrite_right (&portnames[i], &newtypes[i], req);
 
+	      if (i > 0 && newtypes[i] != newtypes[0])
+		poly = 1;
+
+	      if (! print)
+		continue;
+
 	      putc ((i == 0 && nelt > 1) ? '{' : ' ', ostream);
 
 	      if (portnames[i] == MACH_PORT_NULL)
@@ -885,10 +1092,8 @@ print_contents (mach_msg_header_t *inp,
 		  else
 		    fprintf (ostream, "%3u", (unsigned int) portnames[i]);
 		}
-	      if (i > 0 && newtypes[i] != newtypes[0])
-		poly = 1;
 	    }
-	  if (nelt > 1)
+	  if (print && nelt > 1)
 	    putc ('}', ostream);
 
 	  if (poly)
@@ -947,7 +1152,7 @@ print_contents (mach_msg_header_t *inp,
 		type->msgt_name = newtypes[0];
 	    }
 	}
-      else
+      else if (print)
 	print_data (name, data, nelt, eltsize);
     }
 }
@@ -1286,11 +1491,20 @@ trace_and_forward (mach_msg_header_t *inp, mach_msg_header_t *outp)
 	  req->is_req = FALSE;
 	  /* This sure looks like an RPC reply message.  */
 	  mig_reply_header_t *rh = (void *) inp;
-	  print_reply_header ((struct send_once_info *) info, rh, req);
-	  putc (' ', ostream);
-	  fflush (ostream);
-	  print_contents (&rh->Head, rh + 1, req);
-	  putc ('\n', ostream);
+	  if (binary_file)
+	    {
+	      ring_record (inp, info->pi.port_right, MACH_PORT_NULL,
+			   RPCTRACE_REPLY, rh->RetCode);
+	      print_contents (&rh->Head, rh + 1, req, 0);
+	    }
+	  else
+	    {
+	      print_reply_header ((struct send_once_info *) info, rh, req);
+	      putc (' ', ostream);
+	      fflush (ostream);
+	      print_contents (&rh->Head, rh + 1, req, 1);
+	      putc ('\n', ostream);
+	    }
 
 	  if (inp->msgh_id == 2161)/* the reply message for thread_create */
 	    wrap_new_thread (inp, req);
@@ -1305,10 +1519,18 @@ trace_and_forward (mach_msg_header_t *inp, mach_msg_header_t *outp)
 	  task_t to = 0;
 	  struct req_info *req = NULL;
 
+	  int notification = inp->msgh_id <= 72 && inp->msgh_id >= 64;
+
 	  /* Print something about the message header.  */
-	  print_request_header ((struct sender_info *) info, inp);
+	  if (binary_file)
+	    ring_record (inp, info->pi.port_right, inp->msgh_local_port,
+			 notification ? RPCTRACE_NOTIFY
+			 : inp->msgh_local_port == MACH_PORT_NULL
+			 ? RPCTRACE_SIMPLE : RPCTRACE_REQUEST, 0);
+	  else
+	    print_request_header ((struct sender_info *) info, inp);
 	  /* It's a notification message. */
-	  if (inp->msgh_id <= 72 && inp->msgh_id >= 64)
+	  if (notification)
 	    {
 	      assert_backtrace (info->type == MACH_MSG_TYPE_MOVE_SEND_ONCE);
 	      /* mach_notify_port_destroyed message has a port,
@@ -1328,19 +1550,21 @@ trace_and_forward (mach_msg_header_t *inp, mach_msg_header_t *outp)
 
 	  /* If it's the notification message, req is NULL.
 	   * TODO again, it's difficult to handle mach_notify_port_destroyed */
-	  print_contents (inp, inp + 1, req);
+	  print_contents (inp, inp + 1, req, binary_file == NULL);
 	  if (inp->msgh_local_port == MACH_PORT_NULL) /* simpleroutine */
 	    {
 	      /* If it's a simpleroutine,
 	       * we don't need the request information any more. */
 	      req = remove_request (inp->msgh_id, reply_port);
 	      free (req);
-	      fprintf (ostream, ");\n");
+	      if (! binary_file)
+		fprintf (ostream, ");\n");
 	    }
-	  else
+	  else if (! binary_file)
 	    /* Leave a partial line that will be finished later.  */
 	    fprintf (ostream, ")");
-	  fflush (ostream);
+	  if (! binary_file)
+	    fflush (ostream);
 
 	  /* If it's the first request from the traced task,
 	   * wrap the all threads in the task. */
@@ -1703,6 +1927,16 @@ main (int argc, char **argv, char **envp)
 	  strsize = atoi (arg);
 	  break;
 
+	case 'B':
+	  binary_file = arg;
+	  break;
+
+	case 'R':
+	  ring_records = strtoul (arg, NULL, 0);
+	  if (ring_records == 0)
+	    argp_error (state, "invalid ring size: %s", arg);
+	  break;
+
 	case 'E':
 	  if (envz == NULL)
 	    {
@@ -1769,6 +2003,9 @@ main (int argc, char **argv, char **envp)
     ostream = stderr;
   setlinebuf (ostream);
 
+  if (binary_file)
+    ring_open ();
+
   traced_bucket = ports_create_bucket ();
   traced_class = ports_create_class (&traced_clean, NULL);
   other_class = ports_create_class (0, 0);
@@ -1817,6 +2054,9 @@ main (int argc, char **argv, char **envp)
     else
       fprintf (ostream, "Child %d %s\n", pid, strsignal (WTERMSIG (status)));
   }
+
+  if (binary_file)
+    ring_close ();
   
   ports_destroy_right (notify_pi);
   free (envz);
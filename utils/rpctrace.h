@@ -0,0 +1,70 @@
+/* Binary trace format shared by rpctrace and rpcdecode.
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef _HURD_RPCTRACE_H_
+#define _HURD_RPCTRACE_H_
+
+#include <stdint.h>
+
+/* A binary trace file starts with this header, followed by a
+   sequence of struct rpctrace_record.  Everything is stored in the
+   byte order of the tracing host; the decoder refuses files whose
+   magic does not match.  */
+#define RPCTRACE_MAGIC		0x52504354	/* "RPCT" */
+#define RPCTRACE_VERSION	1
+
+struct rpctrace_file_header
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t record_size;		/* sizeof (struct rpctrace_record) */
+  uint32_t pad;
+  uint64_t lost;		/* Records dropped because the ring was full.
+				   Filled in when the trace is closed.  */
+};
+
+/* Kinds of traced messages.  */
+enum rpctrace_kind
+  {
+    RPCTRACE_REQUEST = 1,	/* A routine; a reply is expected.  */
+    RPCTRACE_SIMPLE,		/* A simpleroutine; no reply.  */
+    RPCTRACE_NOTIFY,		/* A Mach notification.  */
+    RPCTRACE_REPLY,		/* The reply to an earlier request.  */
+  };
+
+/* One traced message.  This is written on the tracing hot path, so it
+   only holds values that can be obtained without any extra RPC or
+   formatting work.  Port names are the names of rpctrace's wrapper
+   ports; a request's REPLY_PORT equals the PORT of its reply record.  */
+struct rpctrace_record
+{
+  uint64_t timestamp;		/* CLOCK_MONOTONIC, in nanoseconds.  */
+  int32_t msgid;		/* msgh_id of the message.  */
+  uint32_t size;		/* msgh_size of the message.  */
+  uint32_t port;		/* Wrapper port the message arrived on.  */
+  uint32_t reply_port;		/* Wrapper reply port, or 0.  */
+  int32_t retcode;		/* RetCode of a reply, otherwise 0.  */
+  uint16_t kind;		/* enum rpctrace_kind */
+  uint16_t flags;		/* RPCTRACE_F_* */
+};
+
+/* The message carried port rights or out-of-line data.  */
+#define RPCTRACE_F_COMPLEX	0x0001
+
+#endif	/* _HURD_RPCTRACE_H_ */